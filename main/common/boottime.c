@@ -0,0 +1,222 @@
+/**************************************************************************
+ *
+ * Copyright (c) 2013 Alcatel-Lucent
+ *
+ * Alcatel Lucent licenses this file to You under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file except in
+ * compliance with the License.  A copy of the License is contained the
+ * file LICENSE at the top level of this repository.
+ * You may also obtain a copy of the License at:
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ **************************************************************************
+ *
+ * boottime.c:
+ *
+ *  Boot timeline.  The startup code calls bootmark() at the end of each
+ *  major phase (init1, flash, TFS, monrc, ethernet, etc...); each call
+ *  records the name and the time since the timeline was reset (just
+ *  after init1(), when the hardware timer is usable) in a fixed table.
+ *  Scripts add marks with "boottime -m name" and applications with
+ *  mon_bootmark().  The "boottime" command displays the table, and can
+ *  store it in a TFS file or shell variables so that it can be collected
+ *  from a number of targets.
+ *
+ *  The times are derived from target_timer() ticks, accumulated at each
+ *  mark; so if more than one full wrap of the 32-bit timer elapses
+ *  between two consecutive marks, the interval is undercounted.
+ *
+ * Original author:     Ed Sutter (ed.sutter@alcatel-lucent.com)
+ *
+ */
+#include "config.h"
+#include "stddefs.h"
+#include "genlib.h"
+#include "cli.h"
+#include "timer.h"
+#include "tfs.h"
+#include "tfsprivate.h"
+
+#if INCLUDE_BOOTTIME
+
+#ifndef BOOTMARK_MAX
+#define BOOTMARK_MAX        32
+#endif
+
+#define BOOTMARK_NAMESIZE   16
+
+struct bootmark {
+    char    name[BOOTMARK_NAMESIZE];
+    ulong   usec;               /* Microseconds since the reset */
+};
+
+static struct bootmark BootMarks[BOOTMARK_MAX];
+static int BootMarkTot;         /* Number of marks in BootMarks[] */
+static int BootMarkDropped;     /* Marks lost because the table was full */
+static ulong BootTickLast;      /* target_timer() at the last mark */
+static unsigned long long BootTicks;
+
+/* bootmarkreset():
+ * Clear the timeline; the next mark is time zero.
+ */
+void
+bootmarkreset(void)
+{
+    BootMarkTot = BootMarkDropped = 0;
+    BootTicks = 0;
+    BootTickLast = target_timer();
+}
+
+/* bootmark():
+ * Record the named checkpoint.  Return 0 if recorded, else -1 (the
+ * table is full).
+ */
+int
+bootmark(char *name)
+{
+    ulong   now;
+    struct  bootmark *bmp;
+
+    now = target_timer();
+    BootTicks += (now - BootTickLast);
+    BootTickLast = now;
+
+    if(BootMarkTot >= BOOTMARK_MAX) {
+        BootMarkDropped++;
+        return(-1);
+    }
+    bmp = &BootMarks[BootMarkTot++];
+    strncpy(bmp->name,name,BOOTMARK_NAMESIZE-1);
+    bmp->name[BOOTMARK_NAMESIZE-1] = 0;
+    bmp->usec = (ulong)((BootTicks * 1000) / TIMER_TICKS_PER_MSEC);
+    return(0);
+}
+
+#if INCLUDE_TFS
+/* bootstore():
+ * Write the timeline to a TFS file; one "name usec" line per mark.
+ */
+static int
+bootstore(char *fname)
+{
+    int     i, err, size;
+    char    buf[BOOTMARK_MAX * (BOOTMARK_NAMESIZE + 12)];
+
+    size = 0;
+    for(i=0; i<BootMarkTot; i++) {
+        size += sprintf(buf+size,"%s %ld\n",BootMarks[i].name,
+                        BootMarks[i].usec);
+    }
+    tfsunlink(fname);
+    err = tfsadd(fname,"boottime",0,(unsigned char *)buf,size);
+    if(err != TFS_OKAY) {
+        printf("%s: %s\n",fname,(char *)tfsctrl(TFS_ERRMSG,err,0));
+        return(-1);
+    }
+    return(0);
+}
+#endif
+
+char *BoottimeHelp[] = {
+    "Boot timeline",
+    "-[cf:m:sv]",
+#if INCLUDE_VERBOSEHELP
+    "Options:",
+    " -c         clear the timeline (next mark is time zero)",
+    " -f{fname}  store the timeline in a TFS file",
+    " -m{name}   add a mark",
+    " -s         store the timeline in shell variables",
+    " -v         display the timeline (default if no other option)",
+    "",
+    "Notes:",
+    " * With -s, BT_{mark} is set to each mark's time in msec and",
+    "   BOOTTIME to the time of the last mark.",
+#endif
+    0,
+};
+
+int
+BoottimeCmd(int argc,char *argv[])
+{
+    int     i, opt, show, shvars;
+    char    *fname, varname[BOOTMARK_NAMESIZE+4];
+    ulong   usec, last;
+
+    fname = (char *)0;
+    show = -1;
+    shvars = 0;
+    while((opt=getopt(argc,argv,"cf:m:sv")) != -1) {
+        switch(opt) {
+        case 'c':
+            bootmarkreset();
+            break;
+        case 'f':
+            fname = optarg;
+            break;
+        case 'm':
+            if(bootmark(optarg) < 0) {
+                printf("Boot timeline full\n");
+            }
+            break;
+        case 's':
+            shvars = 1;
+            break;
+        case 'v':
+            show = 1;
+            break;
+        default:
+            return(CMD_PARAM_ERROR);
+        }
+        if(show < 0) {
+            show = 0;
+        }
+    }
+    if(argc != optind) {
+        return(CMD_PARAM_ERROR);
+    }
+
+    if(show) {
+        printf("   Mark                 msec       delta\n");
+        last = 0;
+        for(i=0; i<BootMarkTot; i++) {
+            usec = BootMarks[i].usec;
+            printf("%2d %-16s %5ld.%03ld %5ld.%03ld\n",i,BootMarks[i].name,
+                   usec/1000,usec%1000,(usec-last)/1000,(usec-last)%1000);
+            last = usec;
+        }
+        if(BootMarkDropped) {
+            printf("(%d marks dropped)\n",BootMarkDropped);
+        }
+    }
+
+    if(shvars) {
+        for(i=0; i<BootMarkTot; i++) {
+            sprintf(varname,"BT_%s",BootMarks[i].name);
+            shell_sprintf(varname,"%ld",BootMarks[i].usec/1000);
+        }
+        if(BootMarkTot) {
+            shell_sprintf("BOOTTIME","%ld",
+                          BootMarks[BootMarkTot-1].usec/1000);
+        }
+    }
+
+    if(fname) {
+#if INCLUDE_TFS
+        if(bootstore(fname) < 0) {
+            return(CMD_FAILURE);
+        }
+#else
+        printf("TFS not available\n");
+        return(CMD_FAILURE);
+#endif
+    }
+    return(CMD_SUCCESS);
+}
+#endif
@@ -39,19 +39,15 @@
 #include "genlib.h"
 #include "stddefs.h"
 #include "cli.h"
+#include "timer.h"
+#include "structdef.h"
+#include <stdarg.h>
 
 #if INCLUDE_CAST
 
 static  ulong memAddr;
 static  int castDepth;
-
-#define OPEN_BRACE  '{'
-#define CLOSE_BRACE '}'
-
-#define STRUCT_SEARCH   1
-#define STRUCT_DISPLAY  2
-#define STRUCT_ALLDONE  3
-#define STRUCT_ERROR    4
+static  char castQuiet;
 
 #define STRUCT_SHOWPAD  (1<<0)
 #define STRUCT_SHOWADD  (1<<1)
@@ -60,6 +56,10 @@ static  int castDepth;
 
 #define STRUCTFILE "structfile"
 
+#ifndef CASTBENCH_CASTS
+#define CASTBENCH_CASTS 1000
+#endif
+
 struct mbrinfo {
     char *type;
     char *format;
@@ -78,6 +78,26 @@ struct mbrinfo mbrinfotbl[] = {
     { 0,0,0 }
 };
 
+/* cast_printf():
+ *  All of cast's output goes through here so that it can be turned
+ *  off (castQuiet) when timing with the -B option.
+ */
+static int
+cast_printf(char *fmt, ...)
+{
+    int tot;
+    va_list argp;
+
+    if(castQuiet) {
+        return(0);
+    }
+
+    va_start(argp,fmt);
+    tot = vsnprintf(0,0,fmt,argp);
+    va_end(argp);
+    return(tot);
+}
+
 /* castIndent():
  *  Used to insert initial whitespace based on the depth of the
  *  structure nesting.
@@ -88,7 +108,7 @@ castIndent(void)
     int i;
 
     for(i=0; i<castDepth; i++) {
-        printf("  ");
+        cast_printf("  ");
     }
 }
 
@@ -109,243 +129,179 @@ strAddr(long flags, char *buf)
 }
 
 /* showStruct():
- *  The workhorse of cast.  This function parses the structfile looking for
- *  the structure type; then it attempts to display the memory block that
- *  begins at memAddr as if it was the structure.  Note that there is no
- *  pre-processing done to verify valid syntax of the structure definition.
+ *  The workhorse of cast.  This function displays the memory block that
+ *  begins at memAddr as if it was the structure 'ssp' from the parsed
+ *  structure definition file; nested structures are displayed with a
+ *  recursive call.  On return memAddr is just past the structure (or at
+ *  the next link, if linkname is set).
  */
 int
-showStruct(int tfd,long flags,char *structtype,char *structname,char *linkname)
+showStruct(struct sdimage *sdp,long flags,struct sdstruct *ssp,
+           char *structname,char *linkname)
 {
+    struct sdmember *mp;
     struct mbrinfo *mptr;
-    ulong curpos, nextlink;
-    int i, state, snl, retval, tblsize;
-    char line[96], addrstr[16], format[64];
-    char *cp, *eol, *type, *eotype, *name, *bracket, *eoname, tmp;
+    ulong base, nextlink;
+    int i, j, len, retval;
+    char addrstr[16], format[64], subname[64], *cp, *bracket;
 
-    type = (char *)0;
     retval = nextlink = 0;
-    curpos = tfsctrl(TFS_TELL,tfd,0);
-    tfsseek(tfd,0,TFS_BEGIN);
     castIndent();
     if(structname) {
-        printf("struct %s %s:\n",structtype,structname);
+        cast_printf("struct %s %s:\n",ssp->name,structname);
     } else {
-        printf("struct %s @0x%lx:\n",structtype,memAddr);
+        cast_printf("struct %s @0x%lx:\n",ssp->name,memAddr);
     }
-    castDepth++;
-
-    state = STRUCT_SEARCH;
-    snl = strlen(structtype);
 
-    while(1) {
-        if(tfsgetline(tfd,line,sizeof(line)-1) == 0) {
-            printf("Structure definition '%s' not found\n",structtype);
-            break;
-        }
-        if((line[0] == '\r') || (line[0] == '\n')) { /* empty line? */
-            continue;
-        }
+    if(sdefsize(sdp,ssp) < 0) {
+        return(-1);
+    }
+    castDepth++;
 
-        eol = strpbrk(line,";#\r\n");
-        if(eol) {
-            *eol = 0;
-        }
+    base = memAddr;
+    mp = ssp->mbrs;
+    for(j=0; j<ssp->nmbrs; j++, mp++) {
+        memAddr = base + mp->offset;
 
-        if(state == STRUCT_SEARCH) {
-            if(!strncmp(line,"struct",6)) {
-                cp = line+6;
-                while(isspace(*cp)) {
-                    cp++;
-                }
-                if(!strncmp(cp,structtype,snl)) {
-                    cp += snl;
-                    while(isspace(*cp)) {
-                        cp++;
-                    }
-                    if(*cp == OPEN_BRACE) {
-                        state = STRUCT_DISPLAY;
-                    } else {
-                        retval = -1;
-                        break;
-                    }
+        switch(mp->kind) {
+        case SDM_BASIC:
+            if(mp->ptr) {
+                castIndent();
+                cast_printf("%s%-8s %s: ",strAddr(flags,addrstr),
+                            mp->type,mp->name);
+                if(!strcmp(mp->type,"char.c")) {
+                    cast_printf("\"%s\"\n",*(char **)memAddr);
+                } else {
+                    cast_printf("0x%lx\n",*(ulong *)memAddr);
                 }
-            }
-        } else if(state == STRUCT_DISPLAY) {
-            type = line;
-            while(isspace(*type)) {
-                type++;
-            }
-
-            if(*type == CLOSE_BRACE) {
-                state = STRUCT_ALLDONE;
                 break;
             }
-
-            eotype = type;
-            while(!isspace(*eotype)) {
-                eotype++;
+            for(mptr = mbrinfotbl; mptr->type; mptr++) {
+                if(!strcmp(mp->type,mptr->type)) {
+                    break;
+                }
             }
-            *eotype = 0;
-            name = eotype+1;
-            while(isspace(*name)) {
-                name++;
+            if(!mptr->type) {
+                cast_printf("invalid member type: %s\n",mp->type);
+                retval = -1;
+                goto done;
             }
-            bracket = strchr(name,'[');
-            if(bracket) {
-                tblsize = atoi(bracket+1);
+            castIndent();
+            if(strchr(mp->name,'[')) {
+                if(!strcmp(mp->type,"char.c")) {
+                    cast_printf("%s%-8s %s: ",
+                                strAddr(flags,addrstr),mptr->type,mp->name);
+                    cp = (char *)memAddr;
+                    for(i=0; i<mp->count && isprint(*cp); i++) {
+                        cast_printf("%c",*cp++);
+                    }
+                    cast_printf("\n");
+                } else
+                    cast_printf("%s%-8s %s\n",
+                                strAddr(flags,addrstr),mptr->type,mp->name);
             } else {
-                tblsize = 1;
-            }
-
-            if(*name == '*') {
-                castIndent();
-                printf("%s%-8s %s: ",strAddr(flags,addrstr),type,name);
-                if(!strcmp(type,"char.c")) {
-                    printf("\"%s\"\n",*(char **)memAddr);
-                } else {
-                    printf("0x%lx\n",*(ulong *)memAddr);
+                sprintf(format,"%s%-8s %%s: %s\n",
+                        strAddr(flags,addrstr),mptr->type,mptr->format);
+                switch(mptr->size) {
+                case 1:
+                    cast_printf(format,mp->name,*(uchar *)memAddr);
+                    break;
+                case 2:
+                    cast_printf(format,mp->name,*(ushort *)memAddr);
+                    break;
+                case 4:
+                    cast_printf(format,mp->name,*(ulong *)memAddr);
+                    break;
                 }
-                memAddr += 4;
-                continue;
             }
-            mptr = mbrinfotbl;
-            while(mptr->type) {
-                if(!strcmp(type,mptr->type)) {
-                    castIndent();
-                    eoname = name;
-                    while(!isspace(*eoname)) {
-                        eoname++;
-                    }
-                    tmp = *eoname;
-                    *eoname = 0;
-
-                    if(bracket) {
-                        if(!strcmp(type,"char.c")) {
-                            printf("%s%-8s %s: ",
-                                   strAddr(flags,addrstr),mptr->type,name);
-                            cp = (char *)memAddr;
-                            for(i=0; i<tblsize && isprint(*cp); i++) {
-                                printf("%c",*cp++);
-                            }
-                            printf("\n");
-                        } else
-                            printf("%s%-8s %s\n",
-                                   strAddr(flags,addrstr),mptr->type,name);
-                        memAddr += mptr->size * tblsize;
-                    } else {
-                        sprintf(format,"%s%-8s %%s: %s\n",
-                                strAddr(flags,addrstr),mptr->type,mptr->format);
-                        switch(mptr->size) {
-                        case 1:
-                            printf(format,name,*(uchar *)memAddr);
-                            break;
-                        case 2:
-                            printf(format,name,*(ushort *)memAddr);
-                            break;
-                        case 4:
-                            printf(format,name,*(ulong *)memAddr);
-                            break;
-                        }
-                        memAddr += mptr->size;
+            break;
+        case SDM_STRUCT:
+            if(mp->ptr) {
+                castIndent();
+                cast_printf("%sstruct %s %s: 0x%08lx\n",strAddr(flags,addrstr),
+                            mp->type,mp->name,*(ulong *)memAddr);
+                if(linkname) {
+                    if(!strcmp(linkname,mp->name+1)) {
+                        nextlink = *(ulong *)memAddr;
                     }
-                    *eoname = tmp;
-                    break;
                 }
-                mptr++;
+                break;
             }
-            if(!(mptr->type)) {
-                int padsize;
-                char *subtype, *subname, *eossn;
-
-                if(!strcmp(type,"struct")) {
-                    subtype = eotype+1;
-                    while(isspace(*subtype)) {
-                        subtype++;
-                    }
-                    subname = subtype;
-                    while(!isspace(*subname)) {
-                        subname++;
-                    }
-                    *subname = 0;
-
-                    subname++;
-                    while(isspace(*subname)) {
-                        subname++;
-                    }
-                    eossn = subname;
-                    while(!isspace(*eossn)) {
-                        eossn++;
-                    }
-                    *eossn = 0;
-                    if(*subname == '*') {
-                        castIndent();
-                        printf("%s%s %s %s: 0x%08lx\n",strAddr(flags,addrstr),
-                               type,subtype,subname,*(ulong *)memAddr);
-                        if(linkname) {
-                            if(!strcmp(linkname,subname+1)) {
-                                nextlink = *(ulong *)memAddr;
-                            }
-                        }
-                        memAddr += 4;
-                    } else {
-                        for(i=0; i<tblsize; i++) {
-                            if(bracket) {
-                                sprintf(bracket+1,"%d]",i);
-                            }
-                            if(showStruct(tfd,flags,subtype,subname,0) < 0) {
-                                state = STRUCT_ALLDONE;
-                                goto done;
-                            }
-                        }
-                    }
-                } else if(!strncmp(type,"pad[",4)) {
-                    padsize = atoi(type+4);
-                    if(flags & STRUCT_SHOWPAD) {
-                        castIndent();
-                        printf("%spad[%d]\n",strAddr(flags,addrstr),padsize);
-                    }
-                    memAddr += padsize;
-                } else  {
+            bracket = strchr(mp->name,'[');
+            for(i=0; i<mp->count; i++) {
+                len = bracket ? bracket - mp->name : strlen(mp->name);
+                if(len > (int)sizeof(subname) - 16) {
+                    len = sizeof(subname) - 16;
+                }
+                memcpy(subname,mp->name,len);
+                if(bracket) {
+                    sprintf(subname+len,"[%d]",i);
+                } else {
+                    subname[len] = 0;
+                }
+                memAddr = base + mp->offset + i*(mp->size/mp->count);
+                if(showStruct(sdp,flags,&sdp->structs[mp->sidx],
+                              subname,0) < 0) {
                     retval = -1;
-                    break;
+                    goto done;
                 }
             }
-        } else {
-            state = STRUCT_ERROR;
+            break;
+        case SDM_PAD:
+            if(flags & STRUCT_SHOWPAD) {
+                castIndent();
+                cast_printf("%spad[%d]\n",strAddr(flags,addrstr),mp->count);
+            }
             break;
         }
     }
 done:
-
-    switch(state) {
-    case STRUCT_SEARCH:
-        printf("struct %s not found\n",structtype);
-        retval = -1;
-        break;
-    case STRUCT_DISPLAY:
-        printf("invalid member type: %s\n",type);
-        retval = -1;
-        break;
-    case STRUCT_ERROR:
-        printf("unknown error\n");
-        retval = -1;
-        break;
-    }
-    tfsseek(tfd,curpos,TFS_BEGIN);
     if(linkname) {
         memAddr = nextlink;
+    } else {
+        memAddr = base + ssp->size;
     }
     castDepth--;
     return(retval);
 }
 
+/* castBench():
+ *  Time 'casts' quiet casts of the structure (see -B), to check the cost
+ *  of walking a deeply nested structure.  The result is printed and
+ *  placed in the CASTBENCH shell variable.
+ */
+static void
+castBench(struct sdimage *sdp,struct sdstruct *ssp,long flags,int casts)
+{
+    int i, msec;
+    ulong addr;
+    struct elapsed_tmr tmr;
+
+    addr = memAddr;
+    castQuiet = 1;
+    startElapsedTimer(&tmr,0x7fffffff);
+    for(i=0; i<casts; i++) {
+        memAddr = addr;
+        castDepth = 0;
+        if(showStruct(sdp,flags,ssp,0,0) < 0) {
+            break;
+        }
+    }
+    msec = msecSinceStart(&tmr);
+    castQuiet = 0;
+
+    printf("%d casts of struct %s (%d bytes): %d msec\n",
+           i,ssp->name,ssp->size,msec);
+    shell_sprintf("CASTBENCH","%d",msec);
+}
+
 char *CastHelp[] = {
     "Cast a structure definition across data in memory.",
-    "-[al:n:pt:] {struct type} {address}",
+    "-[aB:l:n:pt:] {struct type} {address}",
 #if INCLUDE_VERBOSEHELP
     "Options:",
     " -a   show addresses",
+    " -B{casts} time quiet casts (0 = default count), set CASTBENCH",
     " -l{linkname}",
     " -n{structname}",
     " -p   show padding",
@@ -358,18 +314,27 @@ int
 Cast(int argc,char *argv[])
 {
     long    flags;
-    int     opt, tfd, index;
+    int     opt, index, bench;
     char    *structtype, *structfile, *tablename, *linkname, *name;
+    struct  sdimage *sdp;
+    struct  sdstruct *ssp;
 
     flags = 0;
+    bench = -1;
     name = (char *)0;
     linkname = (char *)0;
     tablename = (char *)0;
-    while((opt=getopt(argc,argv,"apl:n:t:")) != -1) {
+    while((opt=getopt(argc,argv,"aB:pl:n:t:")) != -1) {
         switch(opt) {
         case 'a':
             flags |= STRUCT_SHOWADD;
             break;
+        case 'B':
+            bench = atoi(optarg);
+            if(bench <= 0) {
+                bench = CASTBENCH_CASTS;
+            }
+            break;
         case 'l':
             linkname = optarg;
             break;
@@ -399,16 +364,25 @@ Cast(int argc,char *argv[])
         structfile = STRUCTFILE;
     }
 
-    tfd = tfsopen(structfile,TFS_RDONLY,0);
-    if(tfd < 0) {
+    sdp = sdefload(structfile,0);
+    if(!sdp) {
         printf("Structure definition file '%s' not found\n",structfile);
         return(CMD_FAILURE);
     }
+    if((ssp = sdeffind(sdp,structtype)) == 0) {
+        printf("struct %s not found\n",structtype);
+        return(CMD_FAILURE);
+    }
+
+    if(bench > 0) {
+        castBench(sdp,ssp,flags,bench);
+        return(CMD_SUCCESS);
+    }
 
     index = 0;
     do {
         castDepth = 0;
-        showStruct(tfd,flags,structtype,name,linkname);
+        showStruct(sdp,flags,ssp,name,linkname);
         index++;
         if(linkname) {
             printf("Link #%d = 0x%lx\n",index,memAddr);
@@ -424,7 +398,6 @@ Cast(int argc,char *argv[])
         }
     } while(tablename || linkname);
 
-    tfsclose(tfd,0);
     return(CMD_SUCCESS);
 }
 #endif
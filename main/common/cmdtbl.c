@@ -40,6 +40,7 @@
 #define INCLUDE_CM 1
 #define INCLUDE_SM 1
 #define INCLUDE_MT 1
+#define INCLUDE_MB 1
 #endif
 
 extern  int Arp(int, char **);
@@ -75,6 +76,7 @@ extern  int If(int, char **);
 extern  int Igmp(int, char **);
 extern  int Item(int, char **);
 extern  int Jffs2Cmd(int, char **);
+extern  int MemBench(int, char **);
 extern  int Mt(int, char **);
 extern  int MtraceCmd(int, char **);
 extern  int Pm(int, char **);
@@ -91,6 +93,7 @@ extern  int SpifCmd(int, char **);
 extern  int Strace(int, char **);
 extern  int StructCmd(int, char **);
 extern  int SyslogCmd(int, char **);
+extern  int BoottimeCmd(int, char **);
 extern  int Tfs(int, char **);
 extern  int Tftp(int, char **);
 extern  int TsiCmd(int, char **);
@@ -133,6 +136,7 @@ extern  char *IfHelp[];
 extern  char *IgmpHelp[];
 extern  char *ItemHelp[];
 extern  char *Jffs2Help[];
+extern  char *MemBenchHelp[];
 extern  char *MtHelp[];
 extern  char *MtraceHelp[];
 extern  char *PmHelp[];
@@ -149,6 +153,7 @@ extern  char *SpifHelp[];
 extern  char *StraceHelp[];
 extern  char *StructHelp[];
 extern  char *SyslogHelp[];
+extern  char *BoottimeHelp[];
 extern  char *TfsHelp[];
 extern  char *TftpHelp[];
 extern  char *TsiHelp[];
@@ -168,6 +173,9 @@ struct monCommand cmdlist[] = {
 #if INCLUDE_BMEM
     { "bmem",       BmemCmd,    BmemHelp,       0 },
 #endif
+#if INCLUDE_BOOTTIME
+    { "boottime",   BoottimeCmd,BoottimeHelp,   0 },
+#endif
 #if INCLUDE_BOARDINFO
     { "brdinfo",    BinfoCmd,   BinfoHelp,      0 },
 #endif
@@ -266,6 +274,10 @@ struct monCommand cmdlist[] = {
     { "jffs2",      Jffs2Cmd,   Jffs2Help,      0 },
 #endif
 
+#if INCLUDE_MB
+    { "membench",   MemBench,   MemBenchHelp,   0 },
+#endif
+
 #if INCLUDE_MT
     { "mt",         Mt,         MtHelp,         0 },
 #endif
@@ -360,6 +372,14 @@ struct monCommand cmdlist[] = {
     { 0,0,0,0 },
 };
 
+/* cmdIndex[]:
+ *  Hash index into cmdlist[] built by _docommand() (see cmdindex() in
+ *  docmd.c) on first use.  Sized at twice the number of commands so
+ *  that probe sequences stay short.
+ */
+short cmdIndex[2*(sizeof(cmdlist)/sizeof(struct monCommand))];
+int cmdIndexSize = sizeof(cmdIndex)/sizeof(short);
+
 #if INCLUDE_USRLVL
 
 /* cmdUlvl[]:
@@ -897,6 +897,7 @@ processBOOTP(struct ether_header *ehdr,ushort size)
         }
     }
 
+    bootmark("bootp");
     DhcpBootpDone(1,(struct dhcphdr *)bhdr,
                   size - ((int)((int)&bhdr->vsa - (int)ehdr)));
 
@@ -1065,6 +1066,7 @@ processDHCP(struct ether_header *ehdr,ushort size)
         /* Check for vendor specific stuff... */
         DhcpVendorSpecific(dhdr);
 
+        bootmark("dhcp");
         DhcpBootpDone(0,dhdr,
                       size - ((int)((int)&dhdr->magic_cookie - (int)ehdr)));
 
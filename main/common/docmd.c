@@ -30,6 +30,7 @@
  */
 #include "config.h"
 #include "genlib.h"
+#include "stddefs.h"
 #include "tfs.h"
 #include "tfsprivate.h"
 #include "ether.h"
@@ -46,6 +47,109 @@ char    *appcmdUlvl;
 
 extern  struct monCommand cmdlist[];
 extern  char cmdUlvl[];
+extern  short cmdIndex[];
+extern  int cmdIndexSize;
+
+/* Command name index:
+ *  Each command list (the monitor's cmdlist[] and the application's
+ *  list installed by addcommand()) can have an open-addressed hash
+ *  table of indices into the list, so that _docommand() finds a command
+ *  with one hash and (usually) one strcmp instead of a linear scan.
+ *  Table entries are the list index + 1 (zero is an empty slot).  If a
+ *  list has no index (no memory for it), it is just searched linearly.
+ */
+struct cmdindex {
+    struct  monCommand *list;   /* List that tbl indexes (0 = none) */
+    short   *tbl;
+    int     size;
+};
+
+static struct cmdindex monCmdIndex, appCmdIndex;
+
+struct cmdkey {
+    struct  monCommand *list;
+    short   *tbl;
+    char    *name;
+};
+
+/* cmdslot():
+ *  The hashprobe() callback for a command index.
+ */
+static int
+cmdslot(int idx, void *arg)
+{
+    struct cmdkey *key = (struct cmdkey *)arg;
+    int i;
+
+    if((i = key->tbl[idx]) == 0) {
+        return(HASH_EMPTY);
+    }
+    if(strcmp(key->list[i-1].name,key->name) == 0) {
+        return(HASH_MATCH);
+    }
+    return(HASH_OTHER);
+}
+
+/* cmdindex():
+ *  Build the index of 'list' in the 'size' entries of 'tbl'.  If a
+ *  name appears more than once, the first one wins (same as the linear
+ *  search).
+ */
+static void
+cmdindex(struct cmdindex *cip, struct monCommand *list, short *tbl, int size)
+{
+    int i, idx, tot;
+    struct cmdkey key;
+
+    cip->list = (struct monCommand *)0;
+    for(tot=0; list[tot].name; tot++);
+    if((tbl == 0) || (tot >= size)) {
+        return;
+    }
+
+    memset((char *)tbl,0,size * sizeof(short));
+    key.list = list;
+    key.tbl = tbl;
+    for(i=0; i<tot; i++) {
+        key.name = list[i].name;
+        if((hashprobe(strhash(key.name,-1),size,cmdslot,&key,&idx) == -1) &&
+                (idx != -1)) {
+            tbl[idx] = i + 1;
+        }
+    }
+    cip->tbl = tbl;
+    cip->size = size;
+    cip->list = list;
+}
+
+/* cmdfind():
+ *  Return a pointer to the entry in 'list' whose name is 'name'; else 0.
+ */
+static struct monCommand *
+cmdfind(struct cmdindex *cip, struct monCommand *list, char *name)
+{
+    int idx;
+    struct cmdkey key;
+    struct monCommand *cmdptr;
+
+    if(cip->list == list) {
+        key.list = list;
+        key.tbl = cip->tbl;
+        key.name = name;
+        idx = hashprobe(strhash(name,-1),cip->size,cmdslot,&key,0);
+        if(idx == -1) {
+            return((struct monCommand *)0);
+        }
+        return(&list[cip->tbl[idx]-1]);
+    }
+
+    for(cmdptr = list; cmdptr->name; cmdptr++) {
+        if(strcmp(name,cmdptr->name) == 0) {
+            return(cmdptr);
+        }
+    }
+    return((struct monCommand *)0);
+}
 
 void
 showusage(struct monCommand *cmdptr)
@@ -64,6 +168,11 @@ paramerr(struct monCommand *cmdptr)
     showusage(cmdptr);
 }
 
+/* addcommand():
+ *  Install the application's command list.  The list is indexed
+ *  here, so if the application modifies its list it must call this
+ *  again to have the changes picked up.
+ */
 int
 addcommand(struct monCommand *cmdlist, char *cmdlvl)
 {
@@ -71,6 +180,23 @@ addcommand(struct monCommand *cmdlist, char *cmdlvl)
 #if INCLUDE_USRLVL
     appcmdUlvl = cmdlvl;
 #endif
+
+#if INCLUDE_MALLOC
+    {
+        int tot;
+
+        if(appCmdIndex.tbl) {
+            free((char *)appCmdIndex.tbl);
+            appCmdIndex.tbl = (short *)0;
+        }
+        appCmdIndex.list = (struct monCommand *)0;
+        if(cmdlist) {
+            for(tot=0; cmdlist[tot].name; tot++);
+            appCmdIndex.tbl = (short *)malloc((tot*2+1) * sizeof(short));
+            cmdindex(&appCmdIndex,cmdlist,appCmdIndex.tbl,tot*2+1);
+        }
+    }
+#endif
     return(0);
 }
 
@@ -638,6 +764,61 @@ getPathEntry(char *path, char *entry, int entrysize)
     return(path);
 }
 
+/* PathMissCache[]:
+ * Names that findPath() recently failed to find.  Looking up a
+ * non-existent command costs a tfsstat() for each PATH entry, so the
+ * misses are remembered until TFS is modified (tracked by tfsFmodCount)
+ * or PATH changes.
+ */
+#if INCLUDE_TFS
+#ifndef PATHMISS_CACHESIZE
+#define PATHMISS_CACHESIZE  8
+#endif
+
+static char PathMissCache[PATHMISS_CACHESIZE][TFSNAMESIZE+1];
+static int  PathMissNext;
+static long PathMissFmod;
+static ulong PathMissPath;
+
+static int
+pathmiss(char *name, char *path)
+{
+    int i;
+    ulong phash;
+
+    phash = path ? strhash(path,-1) : 0;
+    if((PathMissFmod != tfsFmodCount) || (PathMissPath != phash)) {
+        for(i=0; i<PATHMISS_CACHESIZE; i++) {
+            PathMissCache[i][0] = 0;
+        }
+        PathMissFmod = tfsFmodCount;
+        PathMissPath = phash;
+        return(0);
+    }
+    for(i=0; i<PATHMISS_CACHESIZE; i++) {
+        if(strcmp(PathMissCache[i],name) == 0) {
+            return(1);
+        }
+    }
+    return(0);
+}
+
+static void
+pathmissadd(char *name)
+{
+    if(strlen(name) > TFSNAMESIZE) {
+        return;
+    }
+    strcpy(PathMissCache[PathMissNext],name);
+    if(++PathMissNext == PATHMISS_CACHESIZE) {
+        PathMissNext = 0;
+    }
+}
+#else
+#define pathmiss(name,path) 0
+#define pathmissadd(name)
+#endif
+
 /* findPath():
  * If PATH is set, then step through each colon-delimited entry looking
  * for a valid executable.
@@ -650,11 +831,16 @@ findPath(char *name,char *fpath,int pathsize)
     char *path;
     char entry[TFSNAMESIZE+1];
 
+    path = getenv("PATH");
+    if((*name == 0) || pathmiss(name,path)) {
+        return(0);
+    }
+
     if((tfp = tfsstat(name))) {
         strcpy(fpath,name);
     }
 
-    if((path = getenv("PATH"))) {
+    if(path) {
         if((*path == ':') && tfp) {
             return(1);
         }
@@ -675,6 +861,7 @@ findPath(char *name,char *fpath,int pathsize)
     if(tfp) {
         return(1);
     }
+    pathmissadd(name);
     return(0);
 }
 #else
@@ -811,16 +998,19 @@ _docommand(char *cmdline,int verbose)
          * we want to eliminate the leading underscore of argv[0] (if
          * there is one).
          */
-        if((cmdptrbase == cmdlist) && (argv[0][0] == '_')) {
-            strcpy(argv[0],&argv[0][1]);
-        }
-
-        for(cmdptr = cmdptrbase; cmdptr->name; cmdptr++) {
-            if(strcmp(argv[0],cmdptr->name) == 0) {
-                break;
+        if(cmdptrbase == cmdlist) {
+            if(argv[0][0] == '_') {
+                strcpy(argv[0],&argv[0][1]);
+            }
+            if(monCmdIndex.list == 0) {
+                cmdindex(&monCmdIndex,cmdlist,cmdIndex,cmdIndexSize);
             }
+            cmdptr = cmdfind(&monCmdIndex,cmdlist,argv[0]);
+        } else {
+            cmdptr = cmdfind(&appCmdIndex,cmdptrbase,argv[0]);
         }
-        if(cmdptr->name) {
+
+        if(cmdptr) {
 #if INCLUDE_USRLVL
             /* If command exists, but we are not at the required user
              * level, then just pretend there was no command match...
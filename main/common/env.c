@@ -52,16 +52,37 @@ extern void TARGET_ENV_SETUP(void);
 int shell_print(void);
 int envToExec(char *);
 void clearenv(void);
+static void shell_bench(int);
 
-/* Structure used for the shell variables: */
+/* Shell variables are kept in an open-addressed (linear probing) hash
+ * table of pointers to s_shell entries.  Each entry is one allocation
+ * holding the header, the variable name and the space for its value;
+ * so a lookup is a hash, usually one strcmp and no list walking, and
+ * setting a variable is at most one allocation.
+ */
 struct s_shell {
-    char    *val;       /* Value stored in shell variable */
-    char    *name;      /* Name of shell variable */
-    int     vsize;      /* Size of storage allocated for value */
-    struct  s_shell *next;
+    ulong   hash;       /* Hash of the name (avoids most strcmp calls) */
+    int     vsize;      /* Size of storage available for value */
+    char    *val;       /* Value stored in shell variable (follows name) */
+    char    name[1];    /* Name of shell variable */
 };
 
-struct s_shell *shell_vars;
+/* SHELLVAR_TBLSIZE:
+ * Initial number of slots in the table (must be a power of 2).  The
+ * table is doubled whenever it gets more than 3/4 full.
+ */
+#ifndef SHELLVAR_TBLSIZE
+#define SHELLVAR_TBLSIZE    64
+#endif
+
+/* Slots of deleted variables are marked with SHELLVAR_DELETED so that
+ * the probe sequence of other variables isn't broken.
+ */
+#define SHELLVAR_DELETED    ((struct s_shell *)1)
+#define SHELLVAR_INUSE(sp)  ((sp) > SHELLVAR_DELETED)
+
+static struct s_shell **shell_tbl;
+static int shell_tblsize, shell_varcnt, shell_delcnt;
 
 /* If no malloc, then use locally defined env_alloc() and env_free()...
  */
@@ -72,46 +93,84 @@ struct s_shell *shell_vars;
 
 #else
 
-#define ENV_ALLOC_TOT   48
-#define ENV_ALLOC_SIZE  (sizeof(struct s_shell)+8)
+/* ENV_ARENA_SIZE:
+ * Without malloc, shell variables come out of a small static arena.
+ * Each block in the arena starts with a long that holds the size of
+ * the block (including that long), with the low bit set if the block
+ * is in use.  Allocation is first-fit from the freed blocks, then from
+ * the top of the arena.  Freeing a block merges adjacent free blocks
+ * and pulls the top of the arena back when possible.
+ */
+#ifndef ENV_ARENA_SIZE
+#define ENV_ARENA_SIZE  2048
+#endif
 
-struct env_space {
-    int inuse;
-    char space[ENV_ALLOC_SIZE];
-} envSpace[ENV_ALLOC_TOT];
+#define ENV_BLKSIZE(bp)     (*(long *)(bp) & ~1L)
+#define ENV_BLKINUSE(bp)    (*(long *)(bp) & 1L)
+#define ENV_BLKMIN          (int)(4*sizeof(long))
 
+static long envArena[ENV_ARENA_SIZE/sizeof(long)];
+static char *envArenaTop;
 
 char *
 env_alloc(int size)
 {
-    int  i;
+    char    *bp, *base;
+    long    need, bsize;
 
-    if(size > ENV_ALLOC_SIZE) {
-        return(0);
+    base = (char *)envArena;
+    if(envArenaTop == 0) {
+        envArenaTop = base;
     }
-
-    for(i=0; i<ENV_ALLOC_TOT; i++) {
-        if(envSpace[i].inuse == 0) {
-            envSpace[i].inuse = 1;
-            memset(envSpace[i].space,0,ENV_ALLOC_SIZE);
-            return(envSpace[i].space);
+    need = (size + sizeof(long) + sizeof(long) - 1) & ~(sizeof(long) - 1);
+
+    for(bp = base; bp < envArenaTop; bp += ENV_BLKSIZE(bp)) {
+        bsize = ENV_BLKSIZE(bp);
+        if(!ENV_BLKINUSE(bp) && (bsize >= need)) {
+            if(bsize - need >= ENV_BLKMIN) {
+                *(long *)(bp + need) = bsize - need;
+                bsize = need;
+            }
+            break;
         }
     }
-    return(0);
+    if(bp == envArenaTop) {
+        if(envArenaTop + need > base + sizeof(envArena)) {
+            return(0);
+        }
+        envArenaTop += need;
+        bsize = need;
+    }
+    *(long *)bp = bsize | 1;
+    memset(bp+sizeof(long),0,bsize-sizeof(long));
+    return(bp+sizeof(long));
 }
 
 void
 env_free(char *space)
 {
-    int i;
+    char    *bp, *nxt;
+
+    bp = space - sizeof(long);
+    if((bp < (char *)envArena) || (bp >= envArenaTop)) {
+        return;
+    }
+    *(long *)bp &= ~1L;
 
-    for(i=0; i<ENV_ALLOC_TOT; i++) {
-        if(envSpace[i].space == space) {
-            envSpace[i].inuse = 0;
+    for(bp = (char *)envArena; bp < envArenaTop; bp += ENV_BLKSIZE(bp)) {
+        if(ENV_BLKINUSE(bp)) {
+            continue;
+        }
+        nxt = bp + ENV_BLKSIZE(bp);
+        while((nxt < envArenaTop) && !ENV_BLKINUSE(nxt)) {
+            nxt += ENV_BLKSIZE(nxt);
+        }
+        if(nxt == envArenaTop) {
+            envArenaTop = bp;
             break;
         }
+        *(long *)bp = nxt - bp;
     }
-    return;
 }
 #endif
 
@@ -130,12 +189,13 @@ env_free(char *space)
 char *SetHelp[] = {
     "Shell variable operations",
 #if INCLUDE_EE
-    "-[ab:cdef:iox] [varname[=expression]] [value]",
+    "-[aB:b:cdef:iox] [varname[=expression]] [value]",
 #else
-    "-[ab:cdef:iox] [varname] [value]",
+    "-[aB:b:cdef:iox] [varname] [value]",
 #endif
 #if INCLUDE_VERBOSEHELP
     " -a        AND var with value",
+    " -B{n}     benchmark script var overhead with 'n' vars defined",
     " -b        set console baudrate",
     " -c        clear the environment",
     " -d        decrease var by value (or 1)",
@@ -165,12 +225,15 @@ Set(int argc,char *argv[])
     setop = SET_NOOP;
     envp = (char *)0;
     decimal = 1;
-    while((opt=getopt(argc,argv,"ab:cdef:iox")) != -1) {
+    while((opt=getopt(argc,argv,"aB:b:cdef:iox")) != -1) {
         switch(opt) {
         case 'a':       /* logical and */
             setop = SET_AND;
             decimal = 0;
             break;
+        case 'B':
+            shell_bench(atoi(optarg));
+            return(CMD_SUCCESS);
         case 'b':
             ChangeConsoleBaudrate(atoi(optarg));
             return(CMD_SUCCESS);
@@ -203,7 +266,7 @@ Set(int argc,char *argv[])
         }
     }
 
-    if(!shell_vars) {
+    if(!shell_tbl) {
         printf("No memory allocated for environment.\n");
         return(CMD_FAILURE);
     }
@@ -293,139 +356,199 @@ Set(int argc,char *argv[])
 }
 
 /* Shell variable support routines...
- *  The basic scheme is to malloc in the space needed for the variable
- *  name and the value of that variable.  For each variable that
- *  exists there is one s_shell structure that is in the linked list.
- *  As shell variables are removed, their corresonding s_shell structure
- *  is NOT removed, but the data pointed to within the structure is
- *  freed.  This keeps the linked list implementation extremely simple
- *  but maintains the versatility gained by using malloc for the
- *  variables instead of some limted set of static arrays.
+ *  Each variable is one s_shell entry (header, name and value in a
+ *  single allocation) hashed into shell_tbl[].  The value space is
+ *  rounded up a bit so that the common case of re-setting a variable
+ *  to a value of similar size (CMDSTAT, loop counters, etc...) is just
+ *  a strcpy.  If the new value doesn't fit, the entry is replaced.
  */
 
+struct shell_key {
+    char    *name;
+    ulong   hash;
+};
 
-/* shell_alloc():
- *  First scan through the entire list to see if the requested
- *  shell variable name already exists in the list; if it does,
- *  then just use the same s_shell entry but change the value.
- *  Also, if the new value fits in the same space as the older value,
- *  then just use the same memory space (don't do the free/malloc).
- *  If it doesn't, then scan through the list again.  If there
- *  is one that has no variable assigned to it (name = 0), then
- *  use it for the new allocation.  If all s_shell structures do
- *  have valid entries, then malloc a new s_shell structure and then
- *  place the new shell variable data in that structure.
+/* shell_slot():
+ * The hashprobe() callback for shell_tbl[].
  */
+static int
+shell_slot(int idx, void *arg)
+{
+    struct  shell_key *key = (struct shell_key *)arg;
+    struct  s_shell *sp;
 
+    sp = shell_tbl[idx];
+    if(sp == (struct s_shell *)0) {
+        return(HASH_EMPTY);
+    }
+    if(sp == SHELLVAR_DELETED) {
+        return(HASH_DELETED);
+    }
+    if((sp->hash == key->hash) && (strcmp(sp->name,key->name) == 0)) {
+        return(HASH_MATCH);
+    }
+    return(HASH_OTHER);
+}
+
+/* shell_find():
+ * Return the index of the table slot that holds the variable 'name',
+ * or -1 if not found.  If 'freeslot' is non-null, it is loaded with
+ * the index of the first slot that a new variable of this name could
+ * be placed in.
+ */
+static int
+shell_find(char *name, ulong hash, int *freeslot)
+{
+    struct  shell_key key;
+
+    key.name = name;
+    key.hash = hash;
+    return(hashprobe(hash,shell_tblsize,shell_slot,&key,freeslot));
+}
+
+/* shell_tblinit():
+ * Allocate a table of 'size' slots and re-hash any existing variables
+ * into it (this also drops all SHELLVAR_DELETED markers).
+ */
+static int
+shell_tblinit(int size)
+{
+    int     i, idx, oldsize;
+    struct  s_shell **newtbl, **oldtbl, *sp;
+
+    newtbl = (struct s_shell **)env_alloc(size * sizeof(struct s_shell *));
+    if(!newtbl) {
+        return(-1);
+    }
+    memset((char *)newtbl,0,size * sizeof(struct s_shell *));
+
+    oldtbl = shell_tbl;
+    oldsize = shell_tblsize;
+    shell_tbl = newtbl;
+    shell_tblsize = size;
+    shell_delcnt = 0;
+
+    for(i=0; i<oldsize; i++) {
+        sp = oldtbl[i];
+        if(SHELLVAR_INUSE(sp)) {
+            shell_find(sp->name,sp->hash,&idx);
+            newtbl[idx] = sp;
+        }
+    }
+    if(oldtbl) {
+        env_free((char *)oldtbl);
+    }
+    return(0);
+}
+
+/* shell_alloc():
+ *  If the variable already exists and the new value fits in the space
+ *  of the old one, just copy it in.  Otherwise build a new entry and
+ *  either replace the old one or drop it into a free slot (growing
+ *  the table first if it is getting too full to probe efficiently).
+ */
 static int
 shell_alloc(char *name,char *value)
 {
-    int namelen, valuelen;
-    struct s_shell *sp;
+    ulong   hash;
+    int     idx, freeslot, namelen, valuelen, vsize;
+    struct  s_shell *sp;
 
-    sp = shell_vars;
-    namelen = strlen(name);
+    hash = strhash(name,-1);
     valuelen = strlen(value);
-    while(1) {
-        if(sp->name == (char *)0) {
-            if(sp->next != (struct s_shell *)0) {
-                sp = sp->next;
-                continue;
-            } else {
-                break;
-            }
-        }
-        if(strcmp(sp->name,name) == 0) {
-            if(sp->vsize < valuelen+1) {        /* If new value is smaller  */
-                env_free(sp->val);              /* than the old value, then */
-                sp->val = env_alloc(valuelen+1);/* don't re-allocate any    */
-                if(!sp->val) {                  /* memory, just copy into   */
-                    return(-1);    /* the space used by the	*/
-                }
-                sp->vsize = valuelen+1;         /* previous value.          */
-            }
+    idx = shell_find(name,hash,&freeslot);
+    if(idx >= 0) {
+        sp = shell_tbl[idx];
+        if(valuelen < sp->vsize) {
             strcpy(sp->val,value);
             return(0);
         }
-        if(sp->next == (struct s_shell *)0) {
-            break;
+    } else if((shell_varcnt + shell_delcnt + 1) * 4 > shell_tblsize * 3) {
+        /* Double the table if it is really filling up; if it's just
+         * cluttered with deleted slots, re-hashing at the same size
+         * is enough.
+         */
+        if(shell_tblinit((shell_varcnt + 1) * 2 > shell_tblsize ?
+                         shell_tblsize * 2 : shell_tblsize) < 0) {
+            return(-1);
         }
-        sp = sp->next;
+        shell_find(name,hash,&freeslot);
     }
-    sp = shell_vars;
-    while(1) {
-        if(sp->name == (char *)0) {
-            sp->name = env_alloc(namelen+1);
-            if(!sp->name) {
-                return(-1);
-            }
-            strcpy(sp->name,name);
-            sp->val = env_alloc(valuelen+1);
-            if(!sp->val) {
-                return(-1);
-            }
-            sp->vsize = valuelen+1;
-            strcpy(sp->val,value);
-            return(0);
-        }
-        if(sp->next != (struct s_shell *)0) {
-            sp = sp->next;
-        } else {
-            sp->next = (struct s_shell *)env_alloc(sizeof(struct s_shell));
-            if(!sp->next) {
-                return(-1);
-            }
-            sp = sp->next;
-            sp->name = env_alloc(namelen+1);
-            if(!sp->name) {
-                return(-1);
-            }
-            strcpy(sp->name,name);
-            sp->val = env_alloc(valuelen+1);
-            if(!sp->val) {
-                return(-1);
-            }
-            sp->vsize = valuelen+1;
-            strcpy(sp->val,value);
-            sp->next = (struct s_shell *)0;
-            return(0);
+
+    namelen = strlen(name);
+    vsize = (valuelen + 8) & ~7;
+    sp = (struct s_shell *)env_alloc(sizeof(struct s_shell) + namelen + vsize);
+    if(!sp) {
+        return(-1);
+    }
+    sp->hash = hash;
+    sp->vsize = vsize;
+    strcpy(sp->name,name);
+    sp->val = sp->name + namelen + 1;
+    strcpy(sp->val,value);
+
+    if(idx >= 0) {
+        env_free((char *)shell_tbl[idx]);
+        shell_tbl[idx] = sp;
+    } else {
+        if(shell_tbl[freeslot] == SHELLVAR_DELETED) {
+            shell_delcnt--;
         }
+        shell_tbl[freeslot] = sp;
+        shell_varcnt++;
     }
+    return(0);
 }
 
 /* shell_dealloc():
- *  Remove the requested shell variable from the list.  Return 0 if
+ *  Remove the requested shell variable from the table.  Return 0 if
  *  the variable was removed successfully, otherwise return -1.
  */
 static int
 shell_dealloc(char *name)
 {
-    struct  s_shell *sp;
+    int idx;
 
-    sp = shell_vars;
-    while(1) {
-        if(sp->name == (char *)0) {
-            if(sp->next == (struct s_shell *)0) {
-                return(-1);
-            } else {
-                sp = sp->next;
-                continue;
-            }
-        }
-        if(strcmp(name,sp->name) == 0) {
-            env_free(sp->name);
-            env_free(sp->val);
-            sp->name = (char *)0;
-            sp->val = (char *)0;
-            return(0);
-        }
+    idx = shell_find(name,strhash(name,-1),0);
+    if(idx < 0) {
+        return(-1);
+    }
+    env_free((char *)shell_tbl[idx]);
+    shell_tbl[idx] = SHELLVAR_DELETED;
+    shell_varcnt--;
+    shell_delcnt++;
+    return(0);
+}
 
-        if(sp->next == (struct s_shell *)0) {
-            return(-1);
-        } else {
-            sp = sp->next;
+/* shell_sorted():
+ * Return an allocated array of the current entries sorted by name,
+ * so that listings (and scripts built from the environment) don't come
+ * out in hash order.  The caller must env_free() the array.
+ */
+static struct s_shell **
+shell_sorted(void)
+{
+    int     i, j, tot;
+    struct  s_shell **list, *sp;
+
+    list = (struct s_shell **)env_alloc((shell_varcnt+1) *
+                                        sizeof(struct s_shell *));
+    if(!list) {
+        return(0);
+    }
+    for(tot=0, i=0; i<shell_tblsize; i++) {
+        sp = shell_tbl[i];
+        if(!SHELLVAR_INUSE(sp)) {
+            continue;
         }
+        for(j=tot; (j > 0) && (strcmp(list[j-1]->name,sp->name) > 0); j--) {
+            list[j] = list[j-1];
+        }
+        list[j] = sp;
+        tot++;
     }
+    list[tot] = (struct s_shell *)0;
+    return(list);
 }
 
 /* ConsoleBaudEnvSet():
@@ -451,16 +574,15 @@ ShellVarInit()
     char    buf[16];
 
 #if !INCLUDE_MALLOC
-    memset((char *)&envSpace,0,sizeof(envSpace));
+    envArenaTop = (char *)envArena;
 #endif
 
-    shell_vars = (struct s_shell *)env_alloc(sizeof(struct s_shell));
-    if(!shell_vars) {
+    shell_tbl = (struct s_shell **)0;
+    shell_tblsize = shell_varcnt = shell_delcnt = 0;
+    if(shell_tblinit(SHELLVAR_TBLSIZE) < 0) {
         printf("No memory for environment initialization\n");
         return(-1);
     }
-    shell_vars->next = (struct s_shell *)0;
-    shell_vars->name = (char *)0;
     setenv("PROMPT",PROMPT);
     sprintf(buf,"0x%lx",APPLICATION_RAMSTART);
     setenv("APPRAMBASE",buf);
@@ -494,16 +616,16 @@ ShellVarInit()
 char *
 getenv(char *name)
 {
-    register struct s_shell *sp;
+    int idx;
 
-    for(sp = shell_vars; sp != (struct s_shell *)0; sp = sp->next) {
-        if(sp->name != (char *)0) {
-            if(strcmp(sp->name,name) == 0) {
-                return(sp->val);
-            }
-        }
+    if(!shell_tbl) {
+        return((char *)0);
+    }
+    idx = shell_find(name,strhash(name,-1),0);
+    if(idx < 0) {
+        return((char *)0);
     }
-    return((char *)0);
+    return(shell_tbl[idx]->val);
 }
 
 /* getenvp:
@@ -519,15 +641,16 @@ getenv(char *name)
 char *
 getenvp(void)
 {
-    int size;
+    int i, size;
     char *envp, *cp;
     register struct s_shell *sp;
 
     size = 0;
 
     /* Get total size of the current environment vars */
-    for(sp = shell_vars; sp != (struct s_shell *)0; sp = sp->next) {
-        if(sp->name != (char *)0) {
+    for(i=0; i<shell_tblsize; i++) {
+        sp = shell_tbl[i];
+        if(SHELLVAR_INUSE(sp)) {
             size += (strlen(sp->name) + strlen(sp->val) + 2);
         }
     }
@@ -541,8 +664,9 @@ getenvp(void)
     }
 
     cp = envp;
-    for(sp = shell_vars; sp != (struct s_shell *)0; sp = sp->next) {
-        if(sp->name != (char *)0) {
+    for(i=0; i<shell_tblsize; i++) {
+        sp = shell_tbl[i];
+        if(SHELLVAR_INUSE(sp)) {
             cp += sprintf(cp,"%s=%s\n",sp->name,sp->val);
         }
     }
@@ -556,16 +680,17 @@ getenvp(void)
 void
 clearenv(void)
 {
+    int     i;
     struct  s_shell *sp;
 
-    for(sp = shell_vars; sp != (struct s_shell *)0; sp = sp->next) {
-        if(sp->name != (char *)0) {
-            env_free(sp->name);
-            env_free(sp->val);
-            sp->name = (char *)0;
-            sp->val = (char *)0;
+    for(i=0; i<shell_tblsize; i++) {
+        sp = shell_tbl[i];
+        if(SHELLVAR_INUSE(sp)) {
+            env_free((char *)sp);
         }
+        shell_tbl[i] = (struct s_shell *)0;
     }
+    shell_varcnt = shell_delcnt = 0;
 }
 
 /* setenv:
@@ -574,7 +699,7 @@ clearenv(void)
 int
 setenv(char *name,char *value)
 {
-    if(!shell_vars) {
+    if(!shell_tbl) {
         return(-1);
     }
     if((value == (char *)0) || (*value == 0)) {
@@ -590,9 +715,9 @@ setenv(char *name,char *value)
 int
 shell_print(void)
 {
-    int maxlen, len;
+    int i, maxlen, len;
     char format[8];
-    register struct s_shell *sp;
+    struct s_shell **list, *sp;
 
     /* Before printing the list, pass through the list to determine the
      * largest variable name.  This is used to create a format string
@@ -602,38 +727,83 @@ shell_print(void)
      * for all variables.
      */
     maxlen = 0;
-    sp = shell_vars;
-    while(1) {
-        if(sp->name) {
+    for(i=0; i<shell_tblsize; i++) {
+        sp = shell_tbl[i];
+        if(SHELLVAR_INUSE(sp)) {
             len = strlen(sp->name);
             if(len > maxlen) {
                 maxlen = len;
             }
         }
-        if(sp->next != (struct s_shell *)0) {
-            sp = sp->next;
-        } else {
-            break;
-        }
     }
     sprintf(format,"%%%ds = ",maxlen+1);
 
     /* Now that we know the size of the largest variable, we can
-     * print the list cleanly...
+     * print the list cleanly (sorted if there's space to do that)...
      */
-    sp = shell_vars;
-    while(1) {
-        if(sp->name != (char *)0) {
+    list = shell_sorted();
+    for(i=0; i<shell_tblsize; i++) {
+        sp = list ? list[i] : shell_tbl[i];
+        if(list && !sp) {
+            break;
+        }
+        if(SHELLVAR_INUSE(sp)) {
             printf(format, sp->name);
             puts(sp->val);      /* sp->val may overflow printf, so use puts */
         }
-        if(sp->next != (struct s_shell *)0) {
-            sp = sp->next;
-        } else {
+    }
+    if(list) {
+        env_free((char *)list);
+    }
+    return(0);
+}
+
+/* shell_bench():
+ * Time the shell variable work done by the script runner for every
+ * line of a script (getenv() of SCRIPTVERBOSE and SCRIPT_IGNORE_ERROR,
+ * expansion of a $VAR reference and setenv() of CMDSTAT) with 'nvars'
+ * extra variables defined.  The elapsed time for SHELLBENCH_LINES
+ * lines is printed and placed in the SETBENCH shell variable.
+ */
+#ifndef SHELLBENCH_LINES
+#define SHELLBENCH_LINES    10000
+#endif
+
+static void
+shell_bench(int nvars)
+{
+    struct  elapsed_tmr tmr;
+    char    name[16], buf[CMDLINESIZE];
+    int     i, size, defined;
+    ulong   msec;
+
+    for(defined=0; defined<nvars; defined++) {
+        sprintf(name,"_SVB%d",defined);
+        if(setenv(name,name) < 0) {
+            printf("Out of space after %d vars\n",defined);
             break;
         }
     }
-    return(0);
+
+    startElapsedTimer(&tmr,0x7fffffff);
+    for(i=0; i<SHELLBENCH_LINES; i++) {
+        getenv("SCRIPTVERBOSE");
+        getenv("SCRIPT_IGNORE_ERROR");
+        if(defined) {
+            sprintf(name,"_SVB%d",i % defined);
+            shellsym_chk('$',name,&size,buf,sizeof(buf));
+        }
+        setenv("CMDSTAT",(i & 1) ? "PASS" : "FAIL");
+    }
+    msec = msecSinceStart(&tmr);
+
+    for(i=0; i<defined; i++) {
+        sprintf(name,"_SVB%d",i);
+        setenv(name,0);
+    }
+    printf("%d script lines, %d vars: %d msec\n",
+           SHELLBENCH_LINES,defined,msec);
+    shell_sprintf("SETBENCH","%d",msec);
 }
 
 /* shell_sprintf():
@@ -678,7 +848,7 @@ validEnvToExecVar(char *varname)
         "MONITORBUILT", "PLATFORM",     "PROMPT",
         "TFS_DEVTOT",   "FLASH_DEVTOT", "PROMPT",
         "VERSION_MAJ",  "VERSION_MIN",  "VERSION_TGT",
-        "MONCMD_SRCIP", "MONCMD_SRCPORT",
+        "MONCMD_SRCIP", "MONCMD_SRCPORT", "SCRIPTMSEC",
 #if INCLUDE_HWTMR
         "TARGETTIMER",  "TICKSPERMSEC",
 #endif
@@ -720,17 +890,25 @@ validEnvToExecVar(char *varname)
 int
 envToExec(char *filename)
 {
-    int     err, vartot, size, rc;
+    int     err, vartot, size, rc, i;
     char    *buf, *bp, *cp;
-    register struct s_shell *sp;
+    struct  s_shell **list, *sp;
 
-    sp = shell_vars;
     vartot = size = rc = 0;
 
+    /* Build the script in name order, so that the same environment
+     * always produces the same file...
+     */
+    list = shell_sorted();
+    if(!list) {
+        printf("Out of memory\n");
+        return(-1);
+    }
+
     /* First go through the list to see how much space we need
      * to allocate...
      */
-    while(1) {
+    for(i=0; (sp = list[i]); i++) {
         if(validEnvToExecVar(sp->name)) {
             size += strlen(sp->name) + 6;
             cp = sp->val;
@@ -744,13 +922,9 @@ envToExec(char *filename)
             size += 3;
             vartot++;
         }
-        if(sp->next != (struct s_shell *)0) {
-            sp = sp->next;
-        } else {
-            break;
-        }
     }
     if(size == 0) {
+        env_free((char *)list);
         return(0);
     }
 
@@ -759,9 +933,13 @@ envToExec(char *filename)
      * to create the file...
      */
     vartot = 0;
-    sp = shell_vars;
     buf = bp = (char *)env_alloc(size);
-    while(1) {
+    if(!buf) {
+        env_free((char *)list);
+        printf("Out of memory\n");
+        return(-1);
+    }
+    for(i=0; (sp = list[i]); i++) {
         /* Note: if this code changes, then the code above that is used to
          * allocate the buffer size may also need to change...
          */
@@ -779,11 +957,6 @@ envToExec(char *filename)
             *bp = 0;
             vartot++;
         }
-        if(sp->next != (struct s_shell *)0) {
-            sp = sp->next;
-        } else {
-            break;
-        }
     }
     if(vartot > 0) {
         err = tfsadd(filename,"envsetup","e",(unsigned char *)buf,strlen(buf));
@@ -793,6 +966,7 @@ envToExec(char *filename)
         }
     }
     env_free(buf);
+    env_free((char *)list);
     return(rc);
 }
 #endif
@@ -41,6 +41,29 @@
 #define INCLUDE_ETHERVERBOSE INCLUDE_ETHERNET
 #endif
 
+/* MONCMD_QUEUESIZE:
+ * Number of incoming moncmd requests that can be held waiting for
+ * execution (one slot is always left empty, so the usable depth is
+ * one less than this).
+ * MONCMD_REQSIZE:
+ * Maximum size of one moncmd request (which may contain several
+ * newline-separated commands).
+ * MONCMD_REPLYSIZE:
+ * Maximum payload of a moncmd response packet.  The default keeps a
+ * response packet (with tag) within a standard 1500 byte MTU.
+ */
+#ifndef MONCMD_QUEUESIZE
+#define MONCMD_QUEUESIZE    4
+#endif
+
+#ifndef MONCMD_REQSIZE
+#define MONCMD_REQSIZE      512
+#endif
+
+#ifndef MONCMD_REPLYSIZE
+#define MONCMD_REPLYSIZE    1400
+#endif
+
 #ifndef INCLUDE_RARPIPASSIGN
 #define INCLUDE_RARPIPASSIGN INCLUDE_ETHERNET
 #endif
@@ -676,6 +699,8 @@ extern  void disablePromiscuousReception(void);
 extern  int enselftest(int), polletherdev(void), EtherdevStartup(int);
 extern  void DisableEtherdev(void);
 extern  void tftpStateCheck(void), dhcpStateCheck(void);
+extern  void syslogPoll(void);
+extern  int syslogEnqueue(int, char *);
 extern  int DhcpIPCheck(char *);
 extern  void dhcpDisable(void);
 extern  void tftpInit(void);
@@ -29,6 +29,7 @@
 #include "endian.h"
 #include "stddefs.h"
 #include "genlib.h"
+#include "ctype.h"
 
 #if INCLUDE_ETHERNET
 #include "cpuio.h"
@@ -40,11 +41,10 @@
 void ShowEthernetStats(void);
 
 #if INCLUDE_MONCMD
+extern  int MonCmdTotal, MonCmdDropped;
 void    executeMONCMD(void);
 void    processMONCMD(struct ether_header *,ushort);
 int     SendIPMonChar(uchar,int);
-char    IPMonCmdLine[CMDLINESIZE];
-int     IPMonCmdVerbose;
 int     IPMonCmdActive;         /* Set if MONCMD is in progress. */
 #endif
 
@@ -58,6 +58,12 @@ int     IPMonCmdActive;         /* Set if MONCMD is in progress. */
 #define ShowDhcpStats()
 #endif
 
+#if INCLUDE_SYSLOG
+#define syslogPoll()        syslogPoll()
+#else
+#define syslogPoll()
+#endif
+
 #if INCLUDE_TFTP
 #define tftpStateCheck()    tftpStateCheck()
 #define tftpInit()          tftpInit()
@@ -85,7 +91,6 @@ int EtherRFRAMECnt;         /* Number of packets received. */
 int EtherPollNesting;       /* Incremented when pollethernet() is called. */
 int MaxEtherPollNesting;    /* High-warter mark of EtherPollNesting. */
 ushort  UniqueIpId;
-ulong IPMonCmdHdrBuf[(sizeof(struct ether_header) + sizeof(struct ip) + sizeof(struct Udphdr) + 128)/(sizeof(ulong))];
 struct  ether_header *IPMonCmdHdr;
 
 /* AppPktPtr & AppPktLen:
@@ -336,6 +341,10 @@ ShowEthernetStats(void)
     printf("IP hdr cksum errors:     %d\n",EtherIPERRCnt);
     printf("UDP pkt cksum errors:    %d\n",EtherUDPERRCnt);
     printf("Max pollethernet nest:   %d\n",MaxEtherPollNesting);
+#if INCLUDE_MONCMD
+    printf("MONCMD commands:         %d\n",MonCmdTotal);
+    printf("MONCMD requests dropped: %d\n",MonCmdDropped);
+#endif
 }
 
 /* DisableEthernet():
@@ -499,13 +508,12 @@ pollethernet(void)
 
     pcnt = polletherdev();
 #if INCLUDE_MONCMD
-    if(IPMonCmdLine[0] != 0) {
-        executeMONCMD();
-    }
+    executeMONCMD();
 #endif
 
     dhcpStateCheck();
     tftpStateCheck();
+    syslogPoll();
 
     EtherPollNesting--;
     return(pcnt);
@@ -952,93 +960,210 @@ skipIPAddrFilter:
  * 2. executeMONCMD():
  *    After the ethernet packet has been properly dequeued, then
  *    process the remote command appropriately.
+ *
+ * Batching & pipelining:
+ * A single datagram may carry several newline-separated commands; they
+ * are executed in order and their output is returned as one response.
+ * Incoming requests are held in a small queue (MONCMD_QUEUESIZE) so that
+ * a client can have several requests in flight without waiting for each
+ * response.  If the queue is full the request is dropped (and counted);
+ * the client is expected to retransmit.
+ *
+ * To make pipelining usable, a request can be tagged by prefixing it
+ * with "%TAG:" where TAG is a decimal number chosen by the client...
+ *
+ *      %17:tfs ls\necho $IPADD
+ *
+ * The response to a tagged request is coalesced into packets of up to
+ * MONCMD_REPLYSIZE bytes (rather than one packet per line) and each
+ * response packet starts with "%TAG:SEQ:" (SEQ counting from zero).
+ * The last packet of the response uses "%TAG:SEQ." and, as with an
+ * untagged request, its payload is terminated by a NULL.  This gives
+ * the client what it needs to match responses to requests, put the
+ * packets back in order and detect loss.  Untagged requests keep the
+ * original one-packet-per-line response so that existing moncmd and
+ * netcat clients are unaffected.
  */
+struct moncmdreq {
+    struct  ether_header hdr;
+    struct  ip ihdr;
+    struct  Udphdr uhdr;
+    short   verbose;
+    short   tagged;
+    int     tag;
+    char    cmd[MONCMD_REQSIZE];
+};
+
+static struct moncmdreq MonCmdQueue[MONCMD_QUEUESIZE];
+static int  MonCmdQin, MonCmdQout, MonCmdBusy;
+static int  MonCmdTagged, MonCmdSeq;
+static int  MonCmdTag;
+int     MonCmdTotal, MonCmdDropped;
 
 void
 processMONCMD(struct ether_header *ehdr,ushort size)
 {
-    int     verbose = 0, doitnow = 0;
+    int     verbose = 0, doitnow = 0, nxt, len;
     struct  ip *ihdr;
     struct  Udphdr *uhdr;
+    struct  moncmdreq *req;
     char    *moncmd;
     uchar   *src;
 
-    if(size > sizeof(IPMonCmdHdrBuf)) {
-        return;
-    }
-
     ihdr = (struct ip *)(ehdr + 1);
     uhdr = (struct Udphdr *)(ihdr + 1);
     moncmd = (char *)(uhdr + 1);
-    memcpy((char *)IPMonCmdHdrBuf,(char *)ehdr,size);
-    IPMonCmdHdr = (struct ether_header *)&IPMonCmdHdrBuf;
     src = (uchar *)&ihdr->ip_src;
 
-    /* Keep track of who sent the most recent moncmd request:
+    len = ecs(uhdr->uh_ulen) - sizeof(struct Udphdr);
+    if((len <= 0) || (len > size - ((char *)moncmd - (char *)ehdr))) {
+        return;
+    }
+
+    /* The payload is usually (but not necessarily) NULL terminated,
+     * so trim any trailing NULLs and use the UDP length to determine
+     * where the request ends...
      */
-    shell_sprintf(MONCMD_SRCIP_VARNAME,"%d.%d.%d.%d",
-                  src[0],src[1],src[2],src[3]);
-    shell_sprintf(MONCMD_SRCPORT_VARNAME,"%d",ecs(uhdr->uh_sport));
+    while((len > 0) && (moncmd[len-1] == 0)) {
+        len--;
+    }
 
-    if(!MFLAGS_NOMONCMDPRN()) {
-        printf("MONCMD (from %s): ",getenv(MONCMD_SRCIP_VARNAME));
-        puts(moncmd);
-        verbose = 1;
+    if(len >= MONCMD_REQSIZE) {
+        printf("MONCMD (from %d.%d.%d.%d): too long\n",
+               src[0],src[1],src[2],src[3]);
+        return;
     }
 
-    if(strlen(moncmd) >= (sizeof(IPMonCmdLine) - 2)) {
-        printf("MONCMD (from %s): too long\n",getenv(MONCMD_SRCIP_VARNAME));
+    nxt = MonCmdQin + 1;
+    if(nxt == MONCMD_QUEUESIZE) {
+        nxt = 0;
+    }
+    if(nxt == MonCmdQout) {
+        MonCmdDropped++;
         return;
     }
 
+    if(!MFLAGS_NOMONCMDPRN()) {
+        verbose = 1;
+    }
+
     /* A leading '.' tells the moncmd server to execute the command now,
      * not after the pollethernet queue has been emptied...
      */
     if(*moncmd == '.') {
         moncmd++;
+        len--;
         doitnow = 1;
     }
 
-    strcpy(IPMonCmdLine+1,moncmd);
-    IPMonCmdLine[0] = '+';
-    IPMonCmdVerbose = verbose;
+    req = &MonCmdQueue[MonCmdQin];
+    memcpy((char *)&req->hdr,(char *)ehdr,sizeof(struct ether_header));
+    memcpy((char *)&req->ihdr,(char *)ihdr,sizeof(struct ip));
+    memcpy((char *)&req->uhdr,(char *)uhdr,sizeof(struct Udphdr));
+    req->verbose = verbose;
+    req->tagged = 0;
+    req->tag = 0;
+
+    if((*moncmd == '%') && isdigit(moncmd[1])) {
+        char *colon;
+
+        req->tag = (int)strtol(moncmd+1,&colon,10);
+        if(*colon == ':') {
+            colon++;
+            len -= (colon - moncmd);
+            moncmd = colon;
+            req->tagged = 1;
+        }
+    }
+    memcpy(req->cmd,moncmd,len);
+    req->cmd[len] = 0;
+
+    MonCmdQin = nxt;
 
     if(doitnow) {
         executeMONCMD();
     }
 }
 
+/* executeMONCMD():
+ * Pull the next request off the queue and run each of the newline
+ * separated commands within it.  The MonCmdBusy flag keeps this from
+ * being re-entered by the pollethernet() calls that are made while
+ * the commands themselves are running; any requests that arrive in
+ * the meantime wait in the queue.
+ */
 void
 executeMONCMD(void)
 {
     char    *ncnl;          /* netcat newline */
-    char    *moncmd;
+    char    *moncmd, *eol;
+    struct  moncmdreq *req;
 
-    /* Clear the initial '+' character so that this function is
-     * never executed multiple times because of calls to
-     * polletherdev() during the MONCMD transaction.
+    if(MonCmdBusy || (MonCmdQin == MonCmdQout)) {
+        return;
+    }
+    MonCmdBusy = 1;
+
+    req = &MonCmdQueue[MonCmdQout];
+    IPMonCmdHdr = &req->hdr;
+
+    /* Keep track of who sent the most recent moncmd request:
      */
-    IPMonCmdLine[0] = 0;
+    {
+        uchar *src = (uchar *)&req->ihdr.ip_src;
+
+        shell_sprintf(MONCMD_SRCIP_VARNAME,"%d.%d.%d.%d",
+                      src[0],src[1],src[2],src[3]);
+    }
+    shell_sprintf(MONCMD_SRCPORT_VARNAME,"%d",ecs(req->uhdr.uh_sport));
+
+    if(req->verbose) {
+        printf("MONCMD (from %s): ",getenv(MONCMD_SRCIP_VARNAME));
+        puts(req->cmd);
+    }
 
     /* If the first character of the incoming command is an '@', then
      * the response is not sent back to the client...
      */
-    moncmd = IPMonCmdLine + 1;
+    moncmd = req->cmd;
     if(*moncmd == '@') {
         IPMonCmdActive = 0;
         moncmd++;
     } else {
         IPMonCmdActive = 1;
     }
+    MonCmdTagged = req->tagged;
+    MonCmdTag = req->tag;
+    MonCmdSeq = 0;
 
     /* Added to support netcat...
+     * A trailing newline indicates that this came from netcat, so
+     * the prompt is sent back as part of the response.
      */
-    ncnl = strchr(moncmd,0x0a);
-    if(ncnl) {
-        *ncnl = 0;
+    ncnl = strrchr(moncmd,0x0a);
+    if(ncnl && (ncnl[1] != 0)) {
+        ncnl = 0;
     }
 
-    docommand(moncmd,IPMonCmdVerbose);
+    /* Run each line of the request as a separate command...
+     */
+    while(*moncmd) {
+        eol = strchr(moncmd,0x0a);
+        if(eol) {
+            *eol = 0;
+            if((eol > moncmd) && (eol[-1] == '\r')) {
+                eol[-1] = 0;
+            }
+        }
+        if(*moncmd) {
+            docommand(moncmd,req->verbose);
+            MonCmdTotal++;
+        }
+        if(!eol) {
+            break;
+        }
+        moncmd = eol + 1;
+    }
 
     if(ncnl) {
         writeprompt();
@@ -1054,15 +1179,26 @@ executeMONCMD(void)
         writeprompt();
     }
 
-    IPMonCmdLine[0] = 0;
+    if(++MonCmdQout == MONCMD_QUEUESIZE) {
+        MonCmdQout = 0;
+    }
+    MonCmdBusy = 0;
 }
 
+/* SendIPMonChar():
+ * Accumulate the response to a moncmd request and send it back to the
+ * client.  For an untagged request a packet is sent at the end of each
+ * line; for a tagged request the response is coalesced into packets of
+ * up to MONCMD_REPLYSIZE bytes, each prefixed with the tag and sequence
+ * number (see processMONCMD() above).
+ */
 int
 SendIPMonChar(uchar c, int done)
 {
     static  int idx;
-    static  char linebuf[128];
-    int len, hdrlen;
+    static  char linebuf[MONCMD_REPLYSIZE];
+    int len, hdrlen, taglen;
+    char tagbuf[24];
     struct ether_header *te;
     struct ip *ti, *ri;
     struct Udphdr *tu, *ru;
@@ -1079,7 +1215,8 @@ SendIPMonChar(uchar c, int done)
 
     linebuf[idx++] = c;
 
-    if((idx < sizeof(linebuf)) && (!done) && (c != '\n')) {
+    if((idx < sizeof(linebuf)) && (!done) &&
+            (MonCmdTagged || (c != '\n'))) {
         return(0);
     }
 
@@ -1089,8 +1226,15 @@ SendIPMonChar(uchar c, int done)
      */
     IPMonCmdActive = 0;
 
+    if(MonCmdTagged) {
+        taglen = snprintf(tagbuf,sizeof(tagbuf),"%c%d:%d%c",'%',
+                          MonCmdTag,MonCmdSeq++,done ? '.' : ':');
+    } else {
+        taglen = 0;
+    }
+
     hdrlen = sizeof(struct ip) + sizeof(struct Udphdr);
-    len = idx + hdrlen ;
+    len = taglen + idx + hdrlen ;
 
     te = EtherCopy(IPMonCmdHdr);
 
@@ -1112,13 +1256,14 @@ SendIPMonChar(uchar c, int done)
     ru = (struct Udphdr *)(ri + 1);
     tu->uh_sport = ru->uh_dport;
     tu->uh_dport = ru->uh_sport;
-    tu->uh_ulen = ecs((ushort)(sizeof(struct Udphdr) + idx));
-    memcpy((char *)(tu+1),linebuf,idx);
+    tu->uh_ulen = ecs((ushort)(sizeof(struct Udphdr) + taglen + idx));
+    memcpy((char *)(tu+1),tagbuf,taglen);
+    memcpy((char *)(tu+1)+taglen,linebuf,idx);
 
     ipChksum(ti);       /* Compute checksum of ip hdr */
     udpChksum(ti);      /* Compute UDP checksum */
 
-    sendBuffer(MONRESPSIZE);
+    sendBuffer(MONRESPSIZE + taglen);
     idx = 0;
     IPMonCmdActive = 1;
     return(1);
@@ -37,6 +37,9 @@
 #include "tfs.h"
 #include "tfsprivate.h"
 #include "cli.h"
+#include "timer.h"
+#include "ether.h"
+#include "warmstart.h"
 
 extern struct flashdesc FlashNamId[];
 
@@ -55,6 +58,35 @@ int     sectortoaddr(int,int *,uchar **);
  */
 int FlashProtectWindow;
 
+/* FlashEraseActive:
+ *  Set while an asynchronous erase is in progress.  The monitor polls
+ *  ethernet while the erase is suspended, so this keeps anything that
+ *  runs from there (i.e. a TFTP transfer into TFS) from starting another
+ *  write or erase on top of it.
+ */
+int FlashEraseActive;
+
+/* FlashEraseNoPoll:
+ *  Set by the App* entry points for the duration of an erase requested
+ *  by the application.  The application owns the network interface and
+ *  calls in with FLASH_INTSOFF() held, so the erase paths must not poll
+ *  ethernet on its behalf; only the monitor's own (CLI, TFS) erases do.
+ */
+static int FlashEraseNoPoll;
+
+#ifdef FLASHRAM_BASE
+/* FLASHRAM_ERASE_MSEC:
+ *  Simulated erase time for the ram "flash" bank (see FlashRamEraseCtl()).
+ *  Zero (the default) erases immediately.  Can be changed at runtime
+ *  with "flash etime".
+ */
+#ifndef FLASHRAM_ERASE_MSEC
+#define FLASHRAM_ERASE_MSEC 0
+#endif
+
+static int FlashRamEraseMsec = FLASHRAM_ERASE_MSEC;
+#endif
+
 /* FlashBank[]:
  *  This table contains all of the information that is needed to keep the
  *  flash code somewhat generic across multiple flash devices.
@@ -298,40 +330,108 @@ flashtype(struct flashinfo *fdev)
     return(fdev->fltype(fdev));
 }
 
-/* flasherase():
- *  Use the device-specific function pointer to call the routine
- *  relocated to RAM space.
- *  Note that flasherase() is called with a sector number.  The sector
- *  number is relative to the entire system, not just the particular device.
- *  This means that if there is more than one flash device in the system that
- *  the actual sector number (relative to the device) may not be the same
- *  value.  This adjustment is made here so that the underlying code that is
- *  pumped into ram for execution does not have to be aware of this.
- * Return...
- *  1 if successful
- * -1 if failure
- *  0 if sector is protected or locked
+/* flasheraseasync():
+ *  Erase the sector through the driver's flerasectl() interface instead
+ *  of the blocking flerase().  While the device is busy, every
+ *  FLASH_ERASE_SVC_MSEC the erase is suspended (so the flash can be read
+ *  again), ethernet is polled so that ICMP, TFTP, etc... keep going, and
+ *  then the erase is resumed.  Erases requested by the application
+ *  (FlashEraseNoPoll set) just wait for the device.
+ *  Return 0 if successful, else -1 (same as flerase()).
  */
-int
-flasherase(int snum)
+static int
+flasheraseasync(struct flashinfo *fdev,int dev_snum)
+{
+    int rc;
+    struct elapsed_tmr tmr;
+
+    if(fdev->flerasectl(fdev,dev_snum,FLASH_ERASE_START) < 0) {
+        return(-1);
+    }
+    FlashEraseActive = 1;
+    startElapsedTimer(&tmr,FLASH_ERASE_SVC_MSEC);
+    while((rc = fdev->flerasectl(fdev,dev_snum,FLASH_ERASE_POLL)) == 0) {
+        WATCHDOG_MACRO;
+        if(!FlashEraseNoPoll && msecElapsed(&tmr)) {
+            if(fdev->flerasectl(fdev,dev_snum,FLASH_ERASE_SUSPEND) == 0) {
+                pollethernet();
+                if(fdev->flerasectl(fdev,dev_snum,FLASH_ERASE_RESUME) < 0) {
+                    rc = -1;
+                    break;
+                }
+            }
+            startElapsedTimer(&tmr,FLASH_ERASE_SVC_MSEC);
+        }
+    }
+    FlashEraseActive = 0;
+    return(rc < 0 ? -1 : 0);
+}
+
+/* flashasyncok():
+ *  The asynchronous erase runs the monitor's own code while the device
+ *  is busy, so it can only be used if the driver supports it and the
+ *  monitor isn't running out of the same bank.
+ */
+static int
+flashasyncok(struct flashinfo *fdev)
+{
+    uchar *pc;
+
+    pc = (uchar *)flasheraseasync;
+    if((fdev->flerasectl == 0) || ((pc >= fdev->base) && (pc <= fdev->end))) {
+        return(0);
+    }
+    return(1);
+}
+
+/* flasheraseneeded():
+ *  Checks made before a device erase.  Return 1 if the sector needs
+ *  to be erased, 0 if it already is, and -1 if it is protected or locked.
+ */
+static int
+flasheraseneeded(struct flashinfo *fdev,int snum)
+{
+    struct sectorinfo *sinfo;
+
+    sinfo = &fdev->sectors[snum - fdev->sectors[0].snum];
+    if(flasherased(sinfo->begin,sinfo->end)) {
+        return(0);
+    }
+    if((!FlashProtectWindow) && (sinfo->protected)) {
+        printf("Sector %d protected\n",snum);
+        return(-1);
+    }
+    if(flashlocked(snum,1)) {
+        return(-1);
+    }
+    return(1);
+}
+
+/* flasherase1():
+ *  The body of flasherase() (without the FlashEraseActive check, so
+ *  that the erase scheduler can use it).
+ */
+static int
+flasherase1(int snum)
 {
     uchar *tmp;
     ulong *base, *end;
     int size, rc, dev_snum;
     struct flashinfo *fdev;
-    struct sectorinfo *sinfo;
-
-    if(FlashTrace) {
-        printf("flasherase(%d)\n",snum);
-    }
 
     if(!(fdev = snumtofdev(snum))) {
         return(-1);
     }
+    dev_snum = snum - fdev->sectors[0].snum;
 
     /* If the device type is RAM, the erase is a bit different...
      */
     if(fdev->id == FLASHRAM) {
+#ifdef FLASHRAM_BASE
+        if(FlashRamEraseMsec && flashasyncok(fdev)) {
+            return(flasheraseasync(fdev,dev_snum) == 0 ? 1 : -1);
+        }
+#endif
         // Use 'tmp' here to eliminate a 3.4 toolset warning.
         sectortoaddr(snum,&size,&tmp);
         base = (ulong *)tmp;
@@ -346,23 +446,20 @@ flasherase(int snum)
         return(1);
     }
 
-    /* If the sector is soft-protected or locked, return negative
+    /* If the sector is soft-protected or locked, return zero
      * and print failure.  If the sector is already erased, then
      * there is no need to issue the device-specific erase algorithm.
      */
-    dev_snum = snum - fdev->sectors[0].snum;
-    sinfo = &fdev->sectors[dev_snum];
-    if(!flasherased(sinfo->begin,sinfo->end)) {
-        if((!FlashProtectWindow) && (sinfo->protected)) {
-            printf("Sector %d protected\n",snum);
-            return(0);
-        }
-
-        if(flashlocked(snum,1)) {
-            return(0);
+    rc = flasheraseneeded(fdev,snum);
+    if(rc < 0) {
+        return(0);
+    }
+    if(rc > 0) {
+        if(flashasyncok(fdev)) {
+            rc = flasheraseasync(fdev,dev_snum);
+        } else {
+            rc = fdev->flerase(fdev,dev_snum);
         }
-
-        rc = fdev->flerase(fdev,dev_snum);
         if(rc < 0) {
             return(rc);
         }
@@ -371,6 +468,193 @@ flasherase(int snum)
 }
 
 
+/* flasherase():
+ *  Use the device-specific function pointer to call the routine
+ *  relocated to RAM space.
+ *  Note that flasherase() is called with a sector number.  The sector
+ *  number is relative to the entire system, not just the particular device.
+ *  This means that if there is more than one flash device in the system that
+ *  the actual sector number (relative to the device) may not be the same
+ *  value.  This adjustment is made here so that the underlying code that is
+ *  pumped into ram for execution does not have to be aware of this.
+ * Return...
+ *  1 if successful
+ * -1 if failure
+ *  0 if sector is protected or locked
+ */
+int
+flasherase(int snum)
+{
+    if(FlashTrace) {
+        printf("flasherase(%d)\n",snum);
+    }
+
+    if(FlashEraseActive) {
+        printf("flasherase(%d) failed: erase in progress\n",snum);
+        return(-1);
+    }
+    return(flasherase1(snum));
+}
+
+/* flasheraseschedok():
+ *  Return 1 if erases on this bank can be left running while the
+ *  scheduler services the other banks.
+ */
+static int
+flasheraseschedok(struct flashinfo *fdev)
+{
+#ifdef FLASHRAM_BASE
+    if((fdev->id == FLASHRAM) && (FlashRamEraseMsec == 0)) {
+        return(0);
+    }
+#endif
+    return(flashasyncok(fdev));
+}
+
+/* flasheraseset():
+ *  Erase the sectors first..last (limited to those within 'range' if
+ *  range is non-null, using the inRange() syntax) with the erases on
+ *  different banks overlapped.  Each bank works through its own sectors
+ *  in order; on a bank that supports flerasectl() (see flashasyncok())
+ *  the next erase is started as soon as the previous one completes, and
+ *  every FLASH_ERASE_SVC_MSEC all busy banks are suspended together so
+ *  that ethernet can be polled (not for the App* entry points, see
+ *  FlashEraseNoPoll).  Sectors on the other banks are erased
+ *  one at a time with the blocking flasherase1(), in turn with the rest.
+ *  Once a sector fails, no new erases are started, but the ones already
+ *  running are allowed to complete.
+ *  If fesp is non-null, it is loaded with the number of sectors erased
+ *  (including those that already were), their size and the elapsed time.
+ * Return...
+ *  1 if successful
+ * -1 if failure
+ *  0 if a sector is protected or locked
+ */
+int
+flasheraseset(char *range,int first,int last,struct flashestat *fesp)
+{
+    int     b, rc, ret, busy, snum, dev_snum;
+    int     next[FLASHBANKS], inflight[FLASHBANKS];
+    struct  flashinfo *fdev;
+    struct  flashestat fes;
+    struct  elapsed_tmr tmr, svc;
+
+    if(FlashTrace) {
+        printf("flasheraseset(%s,%d,%d)\n",range ? range : "",first,last);
+    }
+
+    if(FlashEraseActive) {
+        printf("flasheraseset() failed: erase in progress\n");
+        return(-1);
+    }
+
+    for(b=0; b<FLASHBANKS; b++) {
+        next[b] = 0;
+        inflight[b] = -1;
+    }
+    fes.erased = 0;
+    fes.bytes = 0;
+    ret = 1;
+    FlashEraseActive = 1;
+    startElapsedTimer(&tmr,0x7fffffff);
+    startElapsedTimer(&svc,FLASH_ERASE_SVC_MSEC);
+
+    do {
+        busy = 0;
+        for(b=0; b<FLASHBANKS; b++) {
+            fdev = &FlashBank[b];
+
+            /* Check on the erase running in this bank (if any)...
+             */
+            if(inflight[b] >= 0) {
+                rc = fdev->flerasectl(fdev,inflight[b],FLASH_ERASE_POLL);
+                if(rc == 0) {
+                    busy++;
+                    continue;
+                }
+                if(rc < 0) {
+                    ret = -1;
+                } else {
+                    fes.erased++;
+                    fes.bytes += fdev->sectors[inflight[b]].size;
+                }
+                inflight[b] = -1;
+            }
+
+            /* ...then start the next selected sector.
+             */
+            while((ret == 1) && (next[b] < fdev->sectorcnt)) {
+                dev_snum = next[b]++;
+                snum = fdev->sectors[dev_snum].snum;
+                if((snum < first) || (snum > last) ||
+                   (range && !inRange(range,snum))) {
+                    continue;
+                }
+                if(!flasheraseschedok(fdev)) {
+                    rc = flasherase1(snum);
+                    if(rc != 1) {
+                        ret = rc;
+                        break;
+                    }
+                    fes.erased++;
+                    fes.bytes += fdev->sectors[dev_snum].size;
+                    busy++;
+                    break;
+                }
+                rc = 1;
+                if(fdev->id != FLASHRAM) {
+                    rc = flasheraseneeded(fdev,snum);
+                }
+                if(rc < 0) {
+                    ret = 0;
+                    break;
+                }
+                if(rc == 0) {
+                    fes.erased++;
+                    fes.bytes += fdev->sectors[dev_snum].size;
+                    continue;
+                }
+                if(fdev->flerasectl(fdev,dev_snum,FLASH_ERASE_START) < 0) {
+                    ret = -1;
+                    break;
+                }
+                inflight[b] = dev_snum;
+                busy++;
+                break;
+            }
+        }
+
+        if(busy && !FlashEraseNoPoll && msecElapsed(&svc)) {
+            for(b=0; b<FLASHBANKS; b++) {
+                if(inflight[b] >= 0) {
+                    fdev = &FlashBank[b];
+                    fdev->flerasectl(fdev,inflight[b],FLASH_ERASE_SUSPEND);
+                }
+            }
+            pollethernet();
+            for(b=0; b<FLASHBANKS; b++) {
+                if(inflight[b] >= 0) {
+                    fdev = &FlashBank[b];
+                    if(fdev->flerasectl(fdev,inflight[b],
+                                        FLASH_ERASE_RESUME) < 0) {
+                        inflight[b] = -1;
+                        ret = -1;
+                    }
+                }
+            }
+            startElapsedTimer(&svc,FLASH_ERASE_SVC_MSEC);
+        }
+        fes.msec = msecSinceStart(&tmr);
+        WATCHDOG_MACRO;
+    } while(busy);
+
+    FlashEraseActive = 0;
+    if(fesp) {
+        *fesp = fes;
+    }
+    return(ret);
+}
+
 /* flashwrite():
  *  Use the device-specific function pointer to call the routine
  *  relocated to RAM space.
@@ -387,6 +671,11 @@ flashwrite(struct flashinfo *fdev,uchar *dest,uchar *src,long bytecnt)
         printf("flashwrite(0x%lx,0x%lx,%ld)\n",(long)dest,(long)src,bytecnt);
     }
 
+    if(FlashEraseActive) {
+        printf("flashwrite() failed: erase in progress\n");
+        return(-1);
+    }
+
     if(fdev->id == FLASHRAM) {
         uchar *sp, *dp, *end;
         sp = src;
@@ -454,6 +743,12 @@ flashwrite(struct flashinfo *fdev,uchar *dest,uchar *src,long bytecnt)
         }
     }
 
+    /* If the flash already holds the data, there's nothing to program.
+     */
+    if(memcmp((char *)dest,(char *)src,(int)bytecnt) == 0) {
+        return(0);
+    }
+
     /* Now make sure that there is no attempt to transition a bit
      * in the affected range from 0 to 1...  A flash write can only
      * bring bits low (erase brings them  high).
@@ -484,20 +779,29 @@ flashwrite(struct flashinfo *fdev,uchar *dest,uchar *src,long bytecnt)
 }
 
 /* flashewrite():
- *  Use the device-specific function pointer to call the routine
- *  relocated to RAM space.
+ *  Write the range and restart (this is how a new monitor image is
+ *  installed, by "flash ewrite", xmodem -B and the TFS alternate device
+ *  table).  If the monitor isn't running out of the bank (see
+ *  flashasyncok()), this is done with the delta write, flashdwrite(),
+ *  so that only the sectors that change are erased or programmed (and
+ *  the rest of a partly covered sector is kept), then the target is
+ *  reset as the driver would do it.  Otherwise it is left to the
+ *  device-specific routine relocated to RAM space, because flashdwrite()
+ *  runs from (and compares with) the flash that it would be erasing.
  */
 int
 flashewrite(uchar *dest,uchar *src,long bytecnt)
 {
     int i;
+    uchar *pc;
     struct flashinfo *fdev;
+    struct flashdstat fds;
 
     if(FlashTrace) {
         printf("flashwrite(0x%lx,0x%lx,%ld)\n",(long)dest,(long)src,bytecnt);
     }
 
-    if((fdev = addrtobank(dest)) == 0) {
+    if(((fdev = addrtobank(dest)) == 0) || FlashEraseActive) {
         return(-1);
     }
 
@@ -519,7 +823,120 @@ flashewrite(uchar *dest,uchar *src,long bytecnt)
             }
         }
     }
-    return(fdev->flewrite(fdev,dest,src,bytecnt));
+
+    pc = (uchar *)flashdwrite;
+    if((pc >= fdev->base) && (pc <= fdev->end)) {
+        return(fdev->flewrite(fdev,dest,src,bytecnt));
+    }
+    if(flashdwrite(dest,src,bytecnt,&fds) < 0) {
+        return(-1);
+    }
+    printf("Sectors: %d skipped, %d programmed, %d erased\n",
+           fds.skipped,fds.programmed,fds.erased);
+#ifdef RESETMACRO
+    RESETMACRO();
+#else
+    target_reset();
+#endif
+    return(0);  /* won't get here */
+}
+
+/* flashdwrite():
+ *  Delta write: bring the flash range at dest to the content at src,
+ *  touching only the sectors that differ.  Each sector in the range is
+ *  compared with the new data and is...
+ *   - skipped if it already matches;
+ *   - programmed in place if the change only brings bits low (1->0);
+ *   - otherwise erased and programmed.  If the range only covers part
+ *     of the sector, the rest of the sector is saved in a ram buffer
+ *     (this needs INCLUDE_MALLOC) and programmed back after the erase.
+ *  This works the same way on a ram "flash" bank (FLASHRAM_BASE), so
+ *  it can be tried out there.  If fdsp is non-null, the sector counts
+ *  are returned in it.
+ *  Return 0 if successful, else negative.
+ */
+int
+flashdwrite(uchar *dest,uchar *src,long bytecnt,struct flashdstat *fdsp)
+{
+    int     snum, size, rc;
+    long    off, tmpcnt, i;
+    uchar   *base, *wdest, *wsrc, *sbuf;
+    struct  flashinfo *fdev;
+    struct  flashdstat fds;
+
+    if(FlashTrace) {
+        printf("flashdwrite(0x%lx,0x%lx,%ld)\n",(long)dest,(long)src,bytecnt);
+    }
+
+    rc = 0;
+    fds.skipped = fds.programmed = fds.erased = 0;
+    while(bytecnt > 0) {
+        if((addrtosector(dest,&snum,&size,&base) < 0) ||
+                ((fdev = snumtofdev(snum)) == 0)) {
+            rc = -1;
+            break;
+        }
+        off = dest - base;
+        tmpcnt = size - off;
+        if(tmpcnt > bytecnt) {
+            tmpcnt = bytecnt;
+        }
+
+        if(memcmp((char *)dest,(char *)src,(int)tmpcnt) == 0) {
+            fds.skipped++;
+        } else {
+            for(i=0; i<tmpcnt; i++) {
+                if((dest[i] & src[i]) != src[i]) {
+                    break;
+                }
+            }
+            if(i == tmpcnt) {
+                rc = flashwrite(fdev,dest,src,tmpcnt);
+                fds.programmed++;
+            } else {
+                sbuf = (uchar *)0;
+                wdest = dest;
+                wsrc = src;
+                if(tmpcnt != size) {
+#if INCLUDE_MALLOC
+                    sbuf = (uchar *)malloc(size);
+#endif
+                    if(!sbuf) {
+                        printf("flashdwrite() failed: no buffer for "
+                               "partial sector %d\n",snum);
+                        rc = -1;
+                        break;
+                    }
+                    memcpy((char *)sbuf,(char *)base,size);
+                    memcpy((char *)sbuf+off,(char *)src,(int)tmpcnt);
+                    wdest = base;
+                    wsrc = sbuf;
+                }
+                if(flasherase(snum) != 1) {
+                    rc = -1;
+                } else {
+                    rc = flashwrite(fdev,wdest,wsrc,sbuf ? size : tmpcnt);
+                }
+#if INCLUDE_MALLOC
+                if(sbuf) {
+                    free(sbuf);
+                }
+#endif
+                fds.erased++;
+            }
+        }
+        if(rc < 0) {
+            printf("flashdwrite() failed at sector %d\n",snum);
+            break;
+        }
+        dest += tmpcnt;
+        src += tmpcnt;
+        bytecnt -= tmpcnt;
+    }
+    if(fdsp) {
+        *fdsp = fds;
+    }
+    return(rc);
 }
 
 /* flashlock():
@@ -951,26 +1368,35 @@ int
 AppFlashEraseAll()
 {
     FLASH_INTSDECL;
-    int     ret, snum, lastsnum;
+    int     ret;
 
-    ret = 0;
     FLASH_INTSOFF();
 
-    /* Loop through all sectors of all banks...
+    /* All sectors of all banks...
      */
-    lastsnum = lastflashsector();
-    for(snum=0; snum<=lastsnum; snum++) {
-        WATCHDOG_MACRO;
-        ret = flasherase(snum);
-        if(ret <= 0) {
-            break;
-        }
-    }
+    FlashEraseNoPoll = 1;
+    ret = flasheraseset(0,0,lastflashsector(),0);
+    FlashEraseNoPoll = 0;
 
     FLASH_INTSRESTORE();
     return(ret);
 }
 
+/* Erase sectors first through last (overlapped across banks). */
+int
+AppFlashEraseSet(int first, int last)
+{
+    int     ret;
+    FLASH_INTSDECL;
+
+    FLASH_INTSOFF();
+    FlashEraseNoPoll = 1;
+    ret = flasheraseset(0,first,last,0);
+    FlashEraseNoPoll = 0;
+    FLASH_INTSRESTORE();
+    return(ret);
+}
+
 /* Erase the flash sector specified. */
 int
 AppFlashErase(int snum) /* erase specified sector */
@@ -979,7 +1405,9 @@ AppFlashErase(int snum) /* erase specified sector */
     FLASH_INTSDECL;
 
     FLASH_INTSOFF();
+    FlashEraseNoPoll = 1;
     ret = flasherase(snum);
+    FlashEraseNoPoll = 0;
     FLASH_INTSRESTORE();
     return(ret);
 }
@@ -1012,6 +1440,52 @@ sectorProtect(char *range, int protect)
 
 struct sectorinfo sinfoRAM[FLASHRAM_SECTORCOUNT];
 
+/* Per bank, so that several ram banks can be erasing at once:
+ */
+static struct elapsed_tmr FlashRamEraseTmr[FLASHBANKS];
+static ulong FlashRamEraseLeft[FLASHBANKS];
+
+/* FlashRamEraseCtl():
+ * Simulated asynchronous erase for the ram "flash" bank, so that the
+ * flerasectl() path can be exercised without real flash: the erase takes
+ * FlashRamEraseMsec, the time spent suspended doesn't count, and the
+ * sector is only set to 0xff when the poll sees the time is up.
+ */
+static int
+FlashRamEraseCtl(struct flashinfo *fdev,int snum,int op)
+{
+    int bank;
+    ulong *base, *end;
+
+    bank = fdev - FlashBank;
+    switch(op) {
+    case FLASH_ERASE_START:
+        startElapsedTimer(&FlashRamEraseTmr[bank],FlashRamEraseMsec);
+        return(0);
+    case FLASH_ERASE_POLL:
+        if(!msecElapsed(&FlashRamEraseTmr[bank])) {
+            return(0);
+        }
+        base = (ulong *)fdev->sectors[snum].begin;
+        end = base + (fdev->sectors[snum].size/sizeof(long));
+        while(base < end) {
+            *base = 0xffffffff;
+            if(*base != 0xffffffff) {
+                return(-1);
+            }
+            base++;
+        }
+        return(1);
+    case FLASH_ERASE_SUSPEND:
+        FlashRamEraseLeft[bank] = msecRemaining(&FlashRamEraseTmr[bank]);
+        return(0);
+    case FLASH_ERASE_RESUME:
+        startElapsedTimer(&FlashRamEraseTmr[bank],FlashRamEraseLeft[bank]);
+        return(0);
+    }
+    return(-1);
+}
+
 /* FlashRamInit():
  * This monitor supports TFS space allocated across multiple flash devices
  * that may not be in contiguous memory space.  To allow RAM to be seen
@@ -1055,6 +1529,7 @@ FlashRamInit(int snum, int scnt, struct flashinfo *fbnk,
     fbnk->flwrite = FlashOpNotSupported;    /* Flashwrite() function. */
     fbnk->flewrite = FlashOpNotSupported;   /* Flashewrite() function. */
     fbnk->fllock = FlashOpNotSupported;     /* Flashlock() function. */
+    fbnk->flerasectl = FlashRamEraseCtl;    /* Simulated async erase. */
     fbnk->sectors = sinfo;                  /* Ptr to sector size table. */
     begin = fbnk->base;
     for(i=0; i<fbnk->sectorcnt; i++,snum++) {
@@ -1093,6 +1568,10 @@ char *FlashHelp[] = {
     "  trace {lvl}",
     "  write {dest} {src} {byte_cnt}",
     "  ewrite {dest} {src} {byte_cnt}",
+    "  dwrite {dest} {src} {byte_cnt}",
+#ifdef FLASHRAM_BASE
+    "  etime [msec]  (simulated erase time for ram bank)",
+#endif
     "",
     "  rnge = range of affected sectors",
     "   Range syntax examples: <1> <1-5> <1,3,7> <all>",
@@ -1159,6 +1638,35 @@ FlashCmd(int argc,char *argv[])
         } else {
             ret = CMD_PARAM_ERROR;
         }
+    }
+#ifdef FLASHRAM_BASE
+    else if(!strcmp(argv[1],"etime")) {
+        if(argc == 3) {
+            FlashRamEraseMsec = atoi(argv[2]);
+        } else if(argc == 2) {
+            printf("Ram bank erase time: %d msec\n",FlashRamEraseMsec);
+        } else {
+            ret = CMD_PARAM_ERROR;
+        }
+    }
+#endif
+    else if(!strcmp(argv[1],"dwrite")) {
+        struct flashdstat fds;
+
+        if(argc == 5) {
+            dest = strtoul(argv[2],(char **)0,0);
+            src = strtoul(argv[3],(char **)0,0);
+            bytecnt = (long)strtoul(argv[4],(char **)0,0);
+            rslt = flashdwrite((uchar *)dest,(uchar *)src,bytecnt,&fds);
+            printf("Sectors: %d skipped, %d programmed, %d erased\n",
+                   fds.skipped,fds.programmed,fds.erased);
+            if(rslt < 0) {
+                printf("dwrite failed (%ld)\n",rslt);
+                ret = CMD_FAILURE;
+            }
+        } else {
+            ret = CMD_PARAM_ERROR;
+        }
     } else if(!strcmp(argv[1],"write")) {
         if(argc == 5) {
             dest = strtoul(argv[2],(char **)0,0);
@@ -1211,9 +1719,16 @@ FlashCmd(int argc,char *argv[])
         if(argc != 3) {
             ret = CMD_PARAM_ERROR;
         } else {
-            uchar *base;
-            int rc, snum, size, stot = 0;
-
+            int rc, first, last;
+            char *range;
+            struct flashestat fes;
+
+            /* An address range is converted to the span of sectors
+             * that it touches; otherwise it's a sector range...
+             */
+            range = 0;
+            first = 0;
+            last = lastflashsector();
             if(strncmp(argv[2],"0x",2) == 0) {
                 ulong begin, end;
                 char *dash = strchr(argv[2],'-');
@@ -1222,41 +1737,26 @@ FlashCmd(int argc,char *argv[])
                 if(dash) {
                     end = strtoul(dash+1,0,0);
                 }
-
-                while(begin <= end) {
-                    if(addrtosector((uchar *)begin,&snum,&size,&base) < 0) {
-                        break;
-                    }
-                    begin = (ulong)base;
-                    rc = flasherase(snum);
-                    if(rc != 1) {
-                        printf("Erase failed (%d)\n",rc);
-                        ret = CMD_FAILURE;
-                        break;
-                    }
-                    stot++;
-                    begin += size;
+                if((addrtosector((uchar *)begin,&first,0,0) < 0) ||
+                   (addrtosector((uchar *)end,&last,0,0) < 0)) {
+                    first = 0;
+                    last = -1;
                 }
             } else {
-                int last;
-
-                last = lastflashsector();
-                for(snum=0; snum<=last; snum++) {
-                    int rc;
-
-                    if((argv[2] == 0) || inRange(argv[2],snum)) {
-                        ticktock();
-                        rc = flasherase(snum);
-                        if(rc != 1) {
-                            printf("Erase failed (%d)\n",rc);
-                            ret = CMD_FAILURE;
-                            break;
-                        }
-                        stot++;
-                    }
-                }
+                range = argv[2];
+            }
+
+            rc = flasheraseset(range,first,last,&fes);
+            if(rc != 1) {
+                printf("Erase failed (%d)\n",rc);
+                ret = CMD_FAILURE;
             }
-            printf("%d sectors erased\n",stot);
+            printf("%d sectors erased",fes.erased);
+            if(fes.msec) {
+                printf(" (%ld KB/sec)",
+                       (long)(((fes.bytes / 1024) * 1000) / fes.msec));
+            }
+            printf("\n");
         }
     } else if((!strcmp(argv[1],"lock")) || (!strcmp(argv[1],"unlock")) ||
               (!strcmp(argv[1],"lockdwn"))) {
@@ -1324,11 +1824,18 @@ FlashCmd(int argc,char *argv[])
  * provided by the application.
  * The finfo parameter is actually a flashinfo pointer; set void here
  * to eliminate confusion when used with monlib.h and the application .
+ *
+ * Only the members up to (not including) flerasectl are copied, since
+ * an application may have been built with the flashinfo structure from
+ * before it was added.  An override also clears flerasectl, so that the
+ * bank's erases go through the application's flerase() rather than the
+ * driver's asynchronous erase.
  */
 int
 FlashOpOverride(void *finfo, int get, int bank)
 {
     char *src, *dst;
+    int size;
     struct flashinfo *fdev;
 
     if((!finfo) || (bank >= FLASHBANKS)) {
@@ -1336,6 +1843,7 @@ FlashOpOverride(void *finfo, int get, int bank)
     }
 
     fdev = &FlashBank[bank];
+    size = (int)((char *)&fdev->flerasectl - (char *)fdev);
 
     if(get) {
         src = (char *)fdev;
@@ -1344,7 +1852,10 @@ FlashOpOverride(void *finfo, int get, int bank)
         src = (char *)finfo;
         dst = (char *)fdev;
     }
-    memcpy(dst,src,sizeof(struct flashinfo));
+    memcpy(dst,src,size);
+    if(!get) {
+        fdev->flerasectl = 0;
+    }
     return(0);
 }
 
@@ -41,6 +41,25 @@
 #define FLASH_LOCKQRY       4
 #define FLASH_LOCKABLE      5       /* query driver for lock support */
 
+/* Operations for the (optional) asynchronous erase interface,
+ * flerasectl().  FLASH_ERASE_POLL returns 1 when the erase is done,
+ * 0 while it is still busy and -1 if it failed; the others return 0
+ * if successful, else -1.  While suspended, the rest of the device
+ * can be read.
+ */
+#define FLASH_ERASE_START   1
+#define FLASH_ERASE_POLL    2
+#define FLASH_ERASE_SUSPEND 3
+#define FLASH_ERASE_RESUME  4
+
+/* FLASH_ERASE_SVC_MSEC:
+ * While an asynchronous erase is in progress, this is how often it is
+ * suspended to let the monitor poll ethernet.
+ */
+#ifndef FLASH_ERASE_SVC_MSEC
+#define FLASH_ERASE_SVC_MSEC    20
+#endif
+
 /* Device ID used for ram that is "pretending" to be a flash bank. */
 #define FLASHRAM    0x9999
 
@@ -76,6 +95,31 @@ struct  flashinfo {
                     unsigned char *,long);
     int (*fllock)(struct flashinfo *,int,int);
     struct sectorinfo *sectors;
+    /* Optional (null if not supported).  Applications built before
+     * this member was added have a shorter flashinfo, so it must stay
+     * last: FlashOpOverride() only copies the members before it.
+     */
+    int (*flerasectl)(struct flashinfo *,int,int);
+};
+
+/* Result of a delta write (see flashdwrite()): the number of sectors
+ * in the range that were left alone, programmed without an erase, and
+ * erased then programmed.
+ */
+struct  flashdstat {
+    int     skipped;
+    int     programmed;
+    int     erased;
+};
+
+/* flashestat:
+ * Returned by flasheraseset(); the number of sectors erased, their total
+ * size and the time it took, so that the throughput can be reported.
+ */
+struct  flashestat {
+    int     erased;
+    long    bytes;
+    unsigned long msec;
 };
 
 extern int      FlashTrace;
@@ -92,6 +136,8 @@ extern int flashtype(struct flashinfo *);
 extern int flasherase(int snum);
 extern int flashwrite(struct flashinfo *,unsigned char *,unsigned char *,long);
 extern int flashewrite(unsigned char *,unsigned char *,long);
+extern int flashdwrite(unsigned char *,unsigned char *,long,struct flashdstat *);
+extern int flasheraseset(char *,int,int,struct flashestat *);
 extern int flasherased(unsigned char *,unsigned char *);
 extern int flashlock(int, int);
 extern int flashlocked(int, int);
@@ -104,6 +150,7 @@ extern void LowerFlashProtectWindow(void);
 extern int AppFlashWrite(unsigned char *,unsigned char *,long);
 extern int AppFlashEraseAll(void);
 extern int AppFlashErase(int);
+extern int AppFlashEraseSet(int,int);
 extern int srange(char *,int *,int *);
 extern int sectorProtect(char *,int);
 extern int FlashOpNotSupported(void);
@@ -111,6 +158,7 @@ extern int FlashLockNotSupported(struct flashinfo *,int,int);
 extern int lastlargesector(int,unsigned char *,int,int *,int *,unsigned char **);
 extern int lastflashsector(void);
 extern int FlashRamInit(int, int, struct flashinfo *,struct sectorinfo *,int *);
+extern int FlashEraseActive;
 extern int InFlashSpace(unsigned char *begin, int size);
 extern int FlashOpOverride(void *flashinfo,int get,int bank);
 
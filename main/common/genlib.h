@@ -98,6 +98,8 @@ extern int getfullline(char *buf,int max,int ledit,int timeout,\
                        char *prefill, int echo);
 extern int stkchk(char *);
 extern int inRange(char *,int);
+extern unsigned long strhash(char *,int);
+extern int hashprobe(unsigned long,int,int (*)(int,void *),void *,int *);
 extern int More(void);
 extern int validPassword(char *,int);
 extern int newPasswordFile(void);
@@ -121,6 +123,18 @@ extern int cacheInit(void);
 extern int pioget(char,int);
 extern int extendHeap(char *,int);
 extern int decompress(char *,int,char *);
+extern void *unZipOpen(char *,int);
+extern int unZipRead(void *,char *,int);
+extern int unZipMember(void *,char **,unsigned long *);
+extern void unZipClose(void *);
+extern int zfGunzip(char *,int,char *,int);
+extern int zfUncompress(char *,int,char *,int);
+extern int isLz4(char *,int);
+extern int unLz4(char *,int,char *,int);
+extern void *unLz4Open(char *,int);
+extern int unLz4Read(void *,char *,int);
+extern void unLz4Close(void *);
+extern int unLz4Block(char *,int,char *,int);
 extern int RedirectionCheck(char *);
 extern int docommand(char *, int);
 extern int SymFileFd(int);
@@ -232,6 +246,13 @@ extern int (*moncomptr)(int,void *, void *, void *);
 
 #define STACK_PREINIT_VAL   0x63636363
 
+/* What a hashprobe() callback finds in a table slot:
+ */
+#define HASH_EMPTY      0       /* Never used; the key isn't in the table */
+#define HASH_MATCH      1       /* Holds the key */
+#define HASH_OTHER      2       /* Holds some other key */
+#define HASH_DELETED    3       /* Was used; the probe continues past it */
+
 /* If the watchdog macro is defined, then we also define the
  * WATCHDOG_ENABLED macro so that code can use #ifdef WATCHDOG_ENABLED
  * or simply insert WATCHDOG_MACRO inline...
@@ -0,0 +1,68 @@
+/**************************************************************************
+ *
+ * Copyright (c) 2013 Alcatel-Lucent
+ *
+ * Alcatel Lucent licenses this file to You under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file except in
+ * compliance with the License.  A copy of the License is contained the
+ * file LICENSE at the top level of this repository.
+ * You may also obtain a copy of the License at:
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ **************************************************************************
+ *
+ * heapprof.h
+ *
+ * Layout of the binary heap profile snapshot written to TFS by
+ * "heap -S{filename}".  The snapshot is a heapprof_hdr followed by
+ * 'nsites' heapprof_site records.  All values are stored in the
+ * target's native byte order; the 'magic' field lets a host tool
+ * detect the byte order before diffing two snapshots.
+ *
+ */
+#ifndef _HEAPPROF_H_
+#define _HEAPPROF_H_
+
+#define HEAPPROF_MAGIC      0x48505246      /* "HPRF" */
+#define HEAPPROF_VERSION    1
+#define HEAPPROF_HISTSIZE   16
+#define HEAPPROF_FNAMESIZE  32
+
+struct heapprof_hdr {
+    unsigned long   magic;
+    unsigned long   version;
+    unsigned long   allocsize;      /* ALLOCSIZE of the monitor build */
+    unsigned long   mcalls;         /* Calls to malloc */
+    unsigned long   fcalls;         /* Calls to free */
+    unsigned long   highwater;      /* Heap high-water level (bytes) */
+    unsigned long   alloctot;       /* Bytes currently allocated */
+    unsigned long   freetot;        /* Bytes free on the heap */
+    unsigned long   largestfree;    /* Largest free block */
+    unsigned long   memleft;        /* Bytes not yet given to the heap */
+    unsigned long   hist[HEAPPROF_HISTSIZE];
+                                    /* hist[i] counts requests of
+                                     * 2^(i+3)+1 .. 2^(i+4) bytes
+                                     * (hist[0] is 1..16 bytes, the
+                                     * last bucket is everything larger)
+                                     */
+    unsigned long   nsites;
+};
+
+struct heapprof_site {
+    char            fname[HEAPPROF_FNAMESIZE];
+    unsigned long   fline;
+    unsigned long   allocs;         /* Allocations made at this site */
+    unsigned long   frees;          /* ...and subsequently freed */
+    unsigned long   livebytes;      /* Bytes currently allocated */
+    unsigned long   peakbytes;      /* High-water level of livebytes */
+    unsigned long   totbytes;       /* Total bytes ever allocated */
+};
+
+#endif
@@ -47,24 +47,79 @@
 #include "tfsprivate.h"
 #include "ether.h"
 #include "cli.h"
+#include "timer.h"
 #include <ctype.h>
 
 #if INCLUDE_TFSSCRIPT
 
+/* Script images:
+ * Before a script is run it is compiled into a scriptimage; a RAM copy
+ * of the file with each line NULL terminated (CRs stripped), a table
+ * of those lines and a hashed index of the "# tag" lines.  So stepping
+ * through a script doesn't go back through tfsgetline() for each line
+ * and goto/gosub is a hash lookup instead of a scan of the file.
+ * The most recently used images are kept in ScriptCache[], keyed by
+ * file name and TFS header CRC (any change to the file changes the
+ * header, so a stale image is never used).  Images of files that have
+ * since been changed or removed are freed by tfsscriptflush() the next
+ * time a script is loaded after TFS has been modified (tfsFmodCount),
+ * and "tfs sflush" frees them all.
+ */
+#ifndef SCRIPTCACHE_SIZE
+#define SCRIPTCACHE_SIZE    4
+#endif
+
+#define SLINE_EMPTY     0x01    /* Nothing on the line */
+#define SLINE_NOERR     0x02    /* Line starts with '-' (ignore error) */
+#define SLINE_COMMENT   0x04    /* Comment (or tag) line */
+
+struct scriptline {
+    char    *text;
+    int     flags;
+};
+
+struct scriptimage {
+    char    name[TFSNAMESIZE+1];
+    ulong   hdrcrc;
+    int     users;              /* Number of active runs of this image */
+    int     cached;             /* Non-zero if in ScriptCache[] */
+    ulong   lastuse;
+    int     nlines;
+    struct  scriptline *lines;
+    int     tagtblsize;         /* Power of 2 */
+    int     *tagtbl;            /* Index of tag line, or -1 */
+};
+
+static struct scriptimage *ScriptCache[SCRIPTCACHE_SIZE];
+static ulong ScriptCacheTick;
+static long ScriptCacheFmod;
+
 /* Subroutine variables:
  * The definition of MAXGOSUBDEPTH (15) determines the maximum number
  * of subroutines that can be nested within any one script invocation.
- * ReturnToTellTbl[]
- *  Used by script runner to keep track of the location in the file that
+ * ReturnToLineTbl[]
+ *  Used by script runner to keep track of the line in the script that
  *  the subroutine is supposed to return to.
  * ReturnToDepth
  *  The current subroutine nesting depth of the script runner.
  */
 #define MAXGOSUBDEPTH   15
 static int  ReturnToDepth;
-static long ReturnToTellTbl[MAXGOSUBDEPTH+1];
+static int  ReturnToLineTbl[MAXGOSUBDEPTH+1];
 static int  CurrentScriptfdTbl[TFS_MAXOPEN+1];
 
+/* ScriptLineTbl[]:
+ * Index of the next line to be executed by each level of running
+ * script.
+ */
+static int  ScriptLineTbl[TFS_MAXOPEN+1];
+
+/* ScriptTmr:
+ * Started when a top level script starts; the elapsed time is put in
+ * the SCRIPTMSEC shell variable when it completes.
+ */
+static struct elapsed_tmr ScriptTmr;
+
 /* ScriptIsRunning:
  * Non-zero if a script is active, else zero.
  */
@@ -561,14 +616,14 @@ gototag(char *tag)
         if(ScriptGotoTag) {
             free(ScriptGotoTag);
         }
-        ScriptGotoTag = malloc(strlen(tag)+8);
-        sprintf(ScriptGotoTag,"# %s",tag);
+        ScriptGotoTag = malloc(strlen(tag)+1);
+        strcpy(ScriptGotoTag,tag);
     }
 }
 
 /* gosubtag():
  *  Similar in basic use to gototag(), except that we keep a copy of the
- *  current position in the active script file so that it can be returned
+ *  current position in the active script so that it can be returned
  *  to later.
  */
 void
@@ -579,7 +634,7 @@ gosubtag(char *tag)
             printf("Max return-to depth reached\n");
             return;
         }
-        ReturnToTellTbl[ReturnToDepth++] = tfstell(currentScriptfd());
+        ReturnToLineTbl[ReturnToDepth++] = ScriptLineTbl[ScriptIsRunning];
         gototag(tag);
     }
 }
@@ -587,27 +642,321 @@ gosubtag(char *tag)
 void
 gosubret(char *ignored)
 {
-    int offset, err;
-
     if(InAScript()) {
-        err = 0;
-
         if(ReturnToDepth <= 0) {
             printf("Nothing to return to\n");
-            err = 1;
+            printf("Possible gosub/return imbalance.\n");
         } else {
             ReturnToDepth--;
-            offset = tfsseek(currentScriptfd(),
-                             ReturnToTellTbl[ReturnToDepth],TFS_BEGIN);
-            if(offset <= 0) {
-                err = 1;
-                printf("return error: %s\n",tfserrmsg(offset));
+            ScriptLineTbl[ScriptIsRunning] = ReturnToLineTbl[ReturnToDepth];
+        }
+    }
+}
+
+/* scripttaglen():
+ * If the line is a tag line ("# tagname" followed by whitespace, ':'
+ * or end of line), return the length of the tag name; else zero.
+ */
+static int
+scripttaglen(char *line)
+{
+    int len;
+
+    if((line[0] != '#') || (line[1] != ' ')) {
+        return(0);
+    }
+    for(len=0; line[len+2] && !isspace(line[len+2]) &&
+            (line[len+2] != ':'); len++);
+    return(len);
+}
+
+struct scripttagkey {
+    struct  scriptimage *sip;
+    char    *tag;
+    int     len;
+};
+
+/* scripttagslot():
+ * The hashprobe() callback for a script's tag table.
+ */
+static int
+scripttagslot(int idx, void *arg)
+{
+    struct  scripttagkey *key = (struct scripttagkey *)arg;
+    int     line;
+
+    if((line = key->sip->tagtbl[idx]) == -1) {
+        return(HASH_EMPTY);
+    }
+    if((scripttaglen(key->sip->lines[line].text) == key->len) &&
+            !strncmp(key->sip->lines[line].text+2,key->tag,key->len)) {
+        return(HASH_MATCH);
+    }
+    return(HASH_OTHER);
+}
+
+/* scriptgetline():
+ * Pull the next line out of the raw file data using the same rules as
+ * tfsgetline() (CRs are dropped; data ends at NULL, Ctrl-Z or a
+ * non-ASCII byte; lines are limited to CMDLINESIZE).  If 'to' is
+ * non-null the line (without the newline) is copied there.  Return
+ * a pointer to the start of the next line, or null at end of data.
+ */
+static uchar *
+scriptgetline(uchar *from, uchar *end, char *to, int *lenp)
+{
+    int len, tot;
+
+    if((from >= end) || (*from == 0) || (*from == 0x1a) || (*from > 0x7f)) {
+        return(0);
+    }
+    for(len=tot=0; (from < end) && (tot < CMDLINESIZE-1); from++) {
+        if((*from == 0x1a) || (*from > 0x7f) || (*from == 0)) {
+            break;
+        }
+        tot++;
+        if(*from == 0x0d) {
+            continue;
+        }
+        if(*from == 0x0a) {
+            from++;
+            break;
+        }
+        if(to) {
+            to[len] = *from;
+        }
+        len++;
+    }
+    if(to) {
+        to[len] = 0;
+    }
+    *lenp = len;
+    return(from);
+}
+
+/* scriptcompile():
+ * Build a scriptimage from the raw script data at 'base'.  Everything
+ * (the image header, line table, tag index and text) is in a single
+ * allocation.
+ */
+static struct scriptimage *
+scriptcompile(uchar *base, int size)
+{
+    char    lcpy[CMDLINESIZE], *text;
+    uchar   *cp, *end;
+    int     i, len, tlen, nlines, ntags, tsize, idx, tot;
+    struct  scriptimage *sip;
+    struct  scriptline *slp;
+    struct  scripttagkey key;
+
+    /* First pass: count lines, tags and text space... */
+    end = base + size;
+    nlines = ntags = tsize = 0;
+    for(cp = base; (cp = scriptgetline(cp,end,lcpy,&len)); nlines++) {
+        tsize += len + 1;
+        if(scripttaglen(lcpy)) {
+            ntags++;
+        }
+    }
+    for(tot = 8; tot < ntags*2; tot <<= 1);
+
+    sip = (struct scriptimage *)malloc(sizeof(struct scriptimage) +
+                                       nlines * sizeof(struct scriptline) +
+                                       tot * sizeof(int) + tsize);
+    if(!sip) {
+        return(0);
+    }
+    memset((char *)sip,0,sizeof(struct scriptimage));
+    sip->nlines = nlines;
+    sip->lines = (struct scriptline *)(sip+1);
+    sip->tagtblsize = tot;
+    sip->tagtbl = (int *)(sip->lines + nlines);
+    text = (char *)(sip->tagtbl + tot);
+    for(i=0; i<tot; i++) {
+        sip->tagtbl[i] = -1;
+    }
+
+    /* Second pass: copy the text in and build the tables... */
+    key.sip = sip;
+    slp = sip->lines;
+    for(i=0, cp = base; (cp = scriptgetline(cp,end,text,&len)); i++, slp++) {
+        slp->text = text;
+        slp->flags = 0;
+        if(len == 0) {
+            slp->flags |= SLINE_EMPTY;
+        }
+        if(*text == '-') {
+            slp->flags |= SLINE_NOERR;
+            text++;
+        }
+        while(isspace(*text)) {
+            text++;
+        }
+        if(*text == '#') {
+            slp->flags |= SLINE_COMMENT;
+        }
+
+        /* If a tag appears more than once, the first one wins (same
+         * as the old top-down search)...
+         */
+        tlen = scripttaglen(slp->text);
+        if(tlen) {
+            key.tag = slp->text+2;
+            key.len = tlen;
+            if((hashprobe(strhash(key.tag,tlen),tot,scripttagslot,&key,
+                    &idx) == -1) && (idx != -1)) {
+                sip->tagtbl[idx] = i;
             }
         }
-        if(err) {
-            printf("Possible gosub/return imbalance.\n");
+        text = slp->text + len + 1;
+    }
+    return(sip);
+}
+
+/* scriptfindtag():
+ * Return the index of the line containing "# tag", or -1.
+ */
+static int
+scriptfindtag(struct scriptimage *sip, char *tag)
+{
+    int     idx;
+    struct  scripttagkey key;
+
+    key.sip = sip;
+    key.tag = tag;
+    key.len = strlen(tag);
+    idx = hashprobe(strhash(tag,key.len),sip->tagtblsize,scripttagslot,
+                    &key,0);
+    if(idx == -1) {
+        return(-1);
+    }
+    return(sip->tagtbl[idx]);
+}
+
+/* tfsscriptflush():
+ * Take images out of the script cache; all of them if 'all' is set,
+ * else only those whose file has been changed or removed since it was
+ * compiled.  An image that is running is freed by scriptrelease() when
+ * its last run finishes.  Return the number of images taken out.
+ */
+int
+tfsscriptflush(int all)
+{
+    int     i, tot;
+    TFILE   *tfp;
+    struct  scriptimage *sip;
+
+    tot = 0;
+    for(i=0; i<SCRIPTCACHE_SIZE; i++) {
+        sip = ScriptCache[i];
+        if(!sip) {
+            continue;
+        }
+        if(!all) {
+            tfp = tfsstat(sip->name);
+            if(tfp && (tfp->hdrcrc == sip->hdrcrc)) {
+                continue;
+            }
+        }
+        ScriptCache[i] = (struct scriptimage *)0;
+        sip->cached = 0;
+        if(sip->users == 0) {
+            free((char *)sip);
+        }
+        tot++;
+    }
+    ScriptCacheFmod = tfsFmodCount;
+    return(tot);
+}
+
+/* scriptload():
+ * Return the image of the script opened as 'tfd', either from the
+ * cache or by compiling it (and then caching it if there's a cache slot
+ * that isn't in use).  In-place-modifiable files can change without
+ * their header changing, so they are never cached.
+ */
+static struct scriptimage *
+scriptload(int tfd)
+{
+    int     i, victim;
+    struct  tfsdat *tdat;
+    struct  scriptimage *sip;
+
+    if(ScriptCacheFmod != tfsFmodCount) {
+        tfsscriptflush(0);
+    }
+
+    tdat = &tfsSlots[tfd];
+    for(i=0; i<SCRIPTCACHE_SIZE; i++) {
+        if(tdat->hdr.flags & TFS_IPMOD) {
+            break;
+        }
+        sip = ScriptCache[i];
+        if(sip && (sip->hdrcrc == tdat->hdr.hdrcrc) &&
+                (strcmp(sip->name,tdat->hdr.name) == 0)) {
+            sip->users++;
+            sip->lastuse = ++ScriptCacheTick;
+            return(sip);
+        }
+    }
+
+#if INCLUDE_TFSCPRS
+    if(tdat->blktbl) {
+        char    *image;
+
+        if(tfscprsimage(tfd,&image) != TFS_OKAY) {
+            return(0);
+        }
+        sip = scriptcompile((uchar *)image,tdat->hdr.filsize);
+        free(image);
+    } else {
+        sip = scriptcompile(tdat->base,tdat->hdr.filsize);
+    }
+#else
+    sip = scriptcompile(tdat->base,tdat->hdr.filsize);
+#endif
+    if(!sip) {
+        return(0);
+    }
+    strcpy(sip->name,tdat->hdr.name);
+    sip->hdrcrc = tdat->hdr.hdrcrc;
+    sip->users = 1;
+    sip->lastuse = ++ScriptCacheTick;
+
+    /* Take an empty slot, else the least recently used image that
+     * isn't currently running...
+     */
+    victim = -1;
+    for(i=0; i<SCRIPTCACHE_SIZE; i++) {
+        if(tdat->hdr.flags & TFS_IPMOD) {
+            break;
+        }
+        if(ScriptCache[i] == 0) {
+            victim = i;
+            break;
+        }
+        if((ScriptCache[i]->users == 0) && ((victim == -1) ||
+                (ScriptCache[i]->lastuse < ScriptCache[victim]->lastuse))) {
+            victim = i;
         }
     }
+    if(victim != -1) {
+        if(ScriptCache[victim]) {
+            free((char *)ScriptCache[victim]);
+        }
+        ScriptCache[victim] = sip;
+        sip->cached = 1;
+    }
+    return(sip);
+}
+
+static void
+scriptrelease(struct scriptimage *sip)
+{
+    sip->users--;
+    if((sip->users == 0) && (!sip->cached)) {
+        free((char *)sip);
+    }
 }
 
 /* tfsscript():
@@ -626,46 +975,49 @@ gosubret(char *ignored)
  *  the executable returns through the same point into which it was started
  *  (the entrypoint).  If the executable uses mon_appexit() to terminate,
  *  then the calling script will not regain control.
+ *
+ *  The script is run from its compiled image (see scriptcompile()), so
+ *  once loaded the file itself is only kept open for tfsscriptname().
  */
 
 int
 tfsscript(TFILE *fp,int verbose)
 {
     char    lcpy[CMDLINESIZE], *sv;
-    int     tfd, lnsize, lno, verbosity, ignoreerror, cmdstat;
+    int     tfd, lno, depth, verbosity, ignoreerror, cmdstat;
+    struct  scriptimage *sip;
+    struct  scriptline *slp;
 
     tfd = tfsopen(fp->name,TFS_RDONLY,0);
     if(tfd < 0) {
         return(tfd);
     }
 
-    lno = 0;
+    sip = scriptload(tfd);
+    if(!sip) {
+        tfsclose(tfd,0);
+        return(TFSERR_MEMFAIL);
+    }
 
     /* If ScriptIsRunning is zero, then we know that this is the top-level
      * script, so we can initialize state here...
      */
     if(ScriptIsRunning == 0) {
         ReturnToDepth = 0;
+        startElapsedTimer(&ScriptTmr,0x7fffffff);
     }
 
-    CurrentScriptfdTbl[++ScriptIsRunning] = tfd;
+    depth = ++ScriptIsRunning;
+    CurrentScriptfdTbl[depth] = tfd;
+    ScriptLineTbl[depth] = 0;
 
-    while(1) {
-        lno++;
-        lnsize = tfsgetline(tfd,lcpy,CMDLINESIZE);
-        if(lnsize == 0) {   /* end of file? */
-            break;
-        }
-        if(lnsize < 0) {
-            printf("tfsscript(): %s\n",tfserrmsg(lnsize));
-            break;
-        }
-        if((lcpy[0] == '\r') || (lcpy[0] == '\n')) { /* empty line? */
+    while(ScriptLineTbl[depth] < sip->nlines) {
+        slp = &sip->lines[ScriptLineTbl[depth]++];
+        lno = ScriptLineTbl[depth];
+        if(slp->flags & SLINE_EMPTY) {
             continue;
         }
 
-        lcpy[lnsize-1] = 0;         /* Remove the newline */
-
         /* Just in case the goto tag was set outside a script, */
         /* clear it now. */
         if(ScriptGotoTag) {
@@ -691,17 +1043,27 @@ tfsscript(TFILE *fp,int verbose)
             verbosity = verbose;
         }
 
-        if((lcpy[0] == '-') || (getenv("SCRIPT_IGNORE_ERROR"))) {
+        if((slp->flags & SLINE_NOERR) || (getenv("SCRIPT_IGNORE_ERROR"))) {
             ignoreerror = 1;
         } else {
             ignoreerror = 0;
         }
 
         if(verbosity) {
-            printf("[%02d]: %s\n",lno,lcpy);
+            printf("[%02d]: %s\n",lno,slp->text);
         }
 
-        cmdstat = tfsDocommand(lcpy[0] == '-' ? lcpy+1 : lcpy, 0);
+        /* The monitor's own command interpreter does nothing with a
+         * comment line, so don't bother passing those in.  Otherwise
+         * pass a copy of the line, because the interpreter is allowed
+         * to modify it.
+         */
+        if((slp->flags & SLINE_COMMENT) && (tfsDocommand == docommand)) {
+            cmdstat = CMD_SUCCESS;
+        } else {
+            strcpy(lcpy,(slp->flags & SLINE_NOERR) ? slp->text+1 : slp->text);
+            cmdstat = tfsDocommand(lcpy, 0);
+        }
 
         if(cmdstat != CMD_SUCCESS) {
             setenv("CMDSTAT","FAIL");
@@ -726,45 +1088,39 @@ tfsscript(TFILE *fp,int verbose)
             break;
         }
 
-        /* If ScriptGotoTag is set, then attempt to reposition the line
-         * pointer to the line that contains the tag.
+        /* If ScriptGotoTag is set, then continue with the line that
+         * follows the tag.
          */
         if(ScriptGotoTag) {
-            int     tlen;
-
-            tlen = strlen(ScriptGotoTag);
-            lno = 0;
-            tfsseek(tfd,0,TFS_BEGIN);
-            while(1) {
-                lnsize = tfsgetline(tfd,lcpy,CMDLINESIZE);
-                if(lnsize == 0) {
-                    printf("Tag '%s' not found\n",ScriptGotoTag+2);
-                    free(ScriptGotoTag);
-                    ScriptGotoTag = (char *)0;
-                    tfsclose(tfd,0);
-                    return(TFS_OKAY);
-                }
-                lno++;
-                if(!strncmp(lcpy,ScriptGotoTag,tlen) &&
-                        (isspace(lcpy[tlen]) || (lcpy[tlen] == ':'))) {
-                    free(ScriptGotoTag);
-                    ScriptGotoTag = (char *)0;
-                    break;
-                }
+            int     tagline;
+
+            tagline = scriptfindtag(sip,ScriptGotoTag);
+            if(tagline < 0) {
+                printf("Tag '%s' not found\n",ScriptGotoTag);
+                free(ScriptGotoTag);
+                ScriptGotoTag = (char *)0;
+                break;
             }
+            free(ScriptGotoTag);
+            ScriptGotoTag = (char *)0;
+            ScriptLineTbl[depth] = tagline + 1;
         }
         /* After each line, poll ethernet interface. */
         pollethernet();
     }
     tfsclose(tfd,0);
+    scriptrelease(sip);
     if(ScriptExitFlag & REMOVE_SCRIPT) {
         tfsunlink(fp->name);
     }
     if(ScriptIsRunning > 0) {
         ScriptIsRunning--;
-        if((ScriptIsRunning == 0) && (ReturnToDepth != 0)) {
-            printf("Error: script is done, but return-to-depth != 0\n");
-            printf("(possible gosub/return imbalance)\n");
+        if(ScriptIsRunning == 0) {
+            if(ReturnToDepth != 0) {
+                printf("Error: script is done, but return-to-depth != 0\n");
+                printf("(possible gosub/return imbalance)\n");
+            }
+            shell_sprintf("SCRIPTMSEC","%d",msecSinceStart(&ScriptTmr));
         }
     } else  {
         printf("Script run-depth error\n");
@@ -817,6 +1173,12 @@ tfsscript(TFILE *fp,int verbose)
     return(TFSERR_NOTAVAILABLE);
 }
 
+int
+tfsscriptflush(int all)
+{
+    return(0);
+}
+
 char *
 tfsscriptname(void)
 {
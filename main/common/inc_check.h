@@ -51,6 +51,13 @@
  *      is a bit larger and needs more RAM for malloc() but it does a MUCH
  *      better job of compression.  I've seen as high as 75% of the file size
  *      compressed.  It is illegal to set both of these macros.
+ *  INCLUDE_UNLZ4:
+ *      (optional) LZ4 decompression (zlib/unlz4.c).  This can be set with
+ *      or without INCLUDE_UNZIP.  An LZ4 image is typically a third to a
+ *      half larger than the same image gzip'ed, but decompresses several
+ *      times faster, so it suits images where boot time matters.
+ *      decompress() and the TFS loader tell the two formats apart by
+ *      their magic numbers.
  *  INCLUDE_ETHERNET:
  *      This pulls in the basic ethernet drivers with ARP, and some of the
  *      lowest level ethernet interface code.
@@ -77,6 +84,13 @@
  *      (otherwise a simpler, less robust mechanism is used).
  *      TFSSYMTBL pulls in the symbol-table functionality and TFSSCRIPT
  *      pulls in the CLI commands that are normally associated with scripts.
+ *  INCLUDE_TFSCPRS:
+ *      (optional) Support for compressed TFS files (the 'c' flag); files
+ *      that are LZ4 compressed in independent blocks and decompressed a
+ *      block at a time as they are read through the API (see TFS_CPRS in
+ *      tfs.h).  Requires TFSAPI and UNLZ4.  TFSCPRS_CACHE (default 4) is
+ *      the number of decompressed blocks kept and TFSCPRS_BLKMAX (default
+ *      16K) is the largest block size supported.
  *  INCLUDE_XMODEM:
  *      Pull in Xmodem.
  *  INCLUDE_LINEEDIT:
@@ -134,6 +148,10 @@
  *      target_timer() which returns a 32-bit value representing a
  *      a hardware-resident clock whose rate is defined by the value
  *      specified by TIMER_TICKS_PER_MSEC.
+ *  INCLUDE_BOOTTIME:
+ *      If set, then the startup code records a timeline of the boot
+ *      phases, displayed by the "boottime" command.  This requires
+ *      INCLUDE_HWTMR.
  *  INCLUDE_VERBOSEHELP:
  *      If set, then full help text is built in; else only the usage
  *      and abstract is included.
@@ -173,6 +191,10 @@
 #error "INCLUDE_HWTMR must be defined in config.h."
 #endif
 
+#ifndef INCLUDE_BOOTTIME
+#error "INCLUDE_BOOTTIME must be defined in config.h."
+#endif
+
 #ifndef INCLUDE_VERBOSEHELP
 #error "INCLUDE_VERBOSEHELP must be defined in config.h."
 #endif
@@ -316,6 +338,15 @@
 #endif
 #endif
 
+/***********************************************************************
+ * The boot timeline is measured with the hardware timer.
+ */
+#if INCLUDE_BOOTTIME
+#if !INCLUDE_HWTMR
+#error "Can't set INCLUDE_BOOTTIME without INCLUDE_HWTMR."
+#endif
+#endif
+
 /***********************************************************************
  * Certain pieces of the monitor cannot be enabled without basic TFS:
  */
@@ -348,8 +379,15 @@
 #endif
 #if INCLUDE_TFSSYMTBL
 #error  "Can't include TFSSYMTBL without TFSAPI"
+#endif
+#if INCLUDE_TFSCPRS
+#error  "Can't include TFSCPRS without TFSAPI"
+#endif
+
 #endif
 
+#if INCLUDE_TFSCPRS && !INCLUDE_UNLZ4
+#error  "Can't include TFSCPRS without UNLZ4"
 #endif
 
 /***********************************************************************
@@ -34,6 +34,7 @@
 #include "stddefs.h"
 #include "assert.h"
 #include "genlib.h"
+#include "mpool.h"
 #include "cli.h"
 #include "tfs.h"
 #include "tfsprivate.h"
@@ -192,6 +193,9 @@ struct jffs2_cleanregion_node {
     jint32 physaddr;
 };
 
+static struct mpool CleanRegionPool =
+    MPOOL_INIT("jffs2 region", sizeof(struct jffs2_cleanregion_node), 32);
+
 struct jffs2_umoninfo {
     jint8   quiet;
     jint32  direntsize;
@@ -408,7 +412,9 @@ showCleanregion(int nodenum, struct jffs2_cleanregion_node *c)
 static int
 jzlibcpy(char *src, char *dest, ulong srclen, ulong destlen)
 {
-#if INCLUDE_JFFS2ZLIB
+#if USE_FAST_INFLATE
+    return(zfUncompress(src,(int)srclen,dest,(int)destlen));
+#elif INCLUDE_JFFS2ZLIB
     z_stream strm;
     int ret;
 
@@ -502,14 +508,14 @@ allocCleanRegion(jint32 base, jint32 size)
 {
     struct jffs2_cleanregion_node *c;
 
-    c = (struct jffs2_cleanregion_node *)malloc(sizeof(*c));
+    c = (struct jffs2_cleanregion_node *)mpoolAlloc(&CleanRegionPool);
     if(c) {
         memset((void *)c, 0, sizeof(*c));
         c->nodetype = JFFS2_NODETYPE_CLEANREGION;
         c->physaddr = base;
         c->totlen = size;
     } else {
-        printf("%s: malloc() failed\n", __func__);
+        printf("%s: mpoolAlloc() failed\n", __func__);
     }
     return (struct jffs2_unknown_node *)c;
 }
@@ -664,6 +670,13 @@ struct jffs2_unknown_node_list {
     struct jffs2_unknown_node *u;
 };
 
+/* ListNodePool:
+ * One list node is allocated for every node found by the scan, so
+ * they come from a pool rather than the heap.
+ */
+static struct mpool ListNodePool =
+    MPOOL_INIT("jffs2 list", sizeof(struct jffs2_unknown_node_list), 256);
+
 static int
 is_empty_list(struct jffs2_unknown_node_list *l)
 {
@@ -679,7 +692,7 @@ allocListNode(ulong nodenum, struct jffs2_unknown_node *u)
 {
     struct jffs2_unknown_node_list *cu;
 
-    cu = (struct jffs2_unknown_node_list *)malloc(sizeof(*cu));
+    cu = (struct jffs2_unknown_node_list *)mpoolAlloc(&ListNodePool);
     if(cu) {
         cu->next = NULL;
         cu->prev = NULL;
@@ -687,7 +700,7 @@ allocListNode(ulong nodenum, struct jffs2_unknown_node *u)
         cu->nodenum = nodenum;
     } else {
         /* TODO: report/handle allocation failure */
-        printf("allocListNode: malloc() failed\n");
+        printf("allocListNode: mpoolAlloc() failed\n");
     }
     return cu;
 }
@@ -709,9 +722,9 @@ delListNode(struct jffs2_unknown_node_list *u)
 {
     removeNodeFromList(u);
     if(u->u != NULL && is_cleanregion(u->u)) {
-        free(u->u);
+        mpoolFree(&CleanRegionPool, u->u);
     }
-    free(u);
+    mpoolFree(&ListNodePool, u);
     return 0;
 }
 
@@ -732,19 +745,21 @@ initNodeList(struct jffs2_unknown_node_list **a)
     return *a;
 }
 
+/* discardNodeList():
+ * This is only used to throw away the scanned node list, and that is
+ * the only list that exists when it is called (fragment lists built by
+ * readInode() are torn down before it returns).  So rather than walk
+ * the list, every list node and clean region goes back to its pool in
+ * one step.
+ */
 static struct jffs2_unknown_node_list *
 discardNodeList(struct jffs2_unknown_node_list *list)
 {
     if(list == NULL) {
         return NULL;
     }
-    while(list->prev != NULL) {
-        list = list->prev;
-    }
-    while(list->next != NULL) {
-        delListNode(list->next);
-    }
-    delListNode(list);
+    mpoolReset(&ListNodePool);
+    mpoolReset(&CleanRegionPool);
     return NULL;
 }
 
@@ -1564,7 +1579,7 @@ readInode(struct jffs2_unknown_node_list *list,
     return len;
 
 fail_alloc_initial_node:
-    free(fr);
+    mpoolFree(&CleanRegionPool, fr);
     printf("%s: allocListNode() returned NULL (aborted)\n",
            __func__);
     return 0;
@@ -50,6 +50,16 @@
  * on all allocation structures, so it is fairly good at detecting illegal
  * use of the allocated memory.
  *
+ * If speed does matter, set MALLOC_TLSF in config.h.  This keeps the
+ * same mhdr based block layout (so heapdump, the extended heap and
+ * MALLOC_DEBUG all still work), but free blocks are also kept on
+ * segregated free lists indexed by a two-level bitmap (in the style
+ * of TLSF, "Two-Level Segregated Fit").  Finding a block for malloc()
+ * and returning one with free() are then constant time operations.
+ * In that mode, the full heapcheck() on every call is only done if
+ * enabled with "heap -d"; otherwise only the tags of the block being
+ * freed are checked.
+ *
  * Original author:     Ed Sutter (ed.sutter@alcatel-lucent.com)
  *
  */
@@ -58,6 +68,15 @@
 #include "genlib.h"
 #include "stddefs.h"
 #include "cli.h"
+#include "timer.h"
+#include "mpool.h"
+#include "heapprof.h"
+#include "tfs.h"
+#include "tfsprivate.h"
+
+#ifndef MALLOC_TLSF
+#define MALLOC_TLSF         0
+#endif
 
 #define FNAMESIZE           32
 
@@ -71,6 +90,9 @@ extern  int extendHeap(char *,int);
 extern  void unExtendHeap(void);
 extern  char *getExtHeapBase(void);
 
+static  void mpoolShow(void);
+static  void mpoolClear(void);
+
 
 /* mhdr:
    The control structure used by the memory allocator.
@@ -95,6 +117,7 @@ struct  mhdr {
 #ifdef MALLOC_DEBUG
     char    fname[FNAMESIZE];
     int     fline;
+    int     fsite;          /* Index into msites[] (or -1). */
 #endif
 };
 
@@ -127,6 +150,274 @@ static char mtrace;
  */
 static struct mhdr  *heapbase;
 
+/* sizehist:
+ * Histogram of requested allocation sizes (see heapprof.h for the
+ * bucket boundaries).
+ */
+static ulong sizehist[HEAPPROF_HISTSIZE];
+
+#ifdef MALLOC_DEBUG
+/* msites:
+ * Per-callsite allocation profile.  A call site is identified by the
+ * __FILE__ pointer and __LINE__ passed in by the MALLOC_DEBUG wrappers;
+ * the table is hashed on both with linear probing.  Each allocated
+ * mhdr records the index of its site, so free() can charge the block
+ * back to the site it came from.  Allocations that don't fit in the
+ * table are only counted in msitesfull.
+ */
+#ifndef MALLOC_SITES
+#define MALLOC_SITES        64
+#endif
+
+struct msite {
+    char    *fname;
+    int     fline;
+    ulong   allocs, frees;
+    ulong   livebytes, peakbytes, totbytes;
+};
+
+static struct msite msites[MALLOC_SITES];
+static int msitesfull;
+
+static int
+sitelookup(char *fname, int fline)
+{
+    int i, idx;
+
+    idx = ((ulong)fname + (ulong)fline * 31) % MALLOC_SITES;
+    for(i=0; i<MALLOC_SITES; i++) {
+        if(msites[idx].fname == 0) {
+            msites[idx].fname = fname;
+            msites[idx].fline = fline;
+            return(idx);
+        }
+        if((msites[idx].fname == fname) && (msites[idx].fline == fline)) {
+            return(idx);
+        }
+        if(++idx == MALLOC_SITES) {
+            idx = 0;
+        }
+    }
+    msitesfull++;
+    return(-1);
+}
+
+/* setsite():
+ * Record the caller's file/line in a newly allocated block and charge
+ * the block to that call site.
+ */
+static void
+setsite(struct mhdr *mptr, char *fname, int fline)
+{
+    struct msite *sp;
+    int size;
+
+    strncpy(mptr->fname,fname,FNAMESIZE-1);
+    mptr->fname[FNAMESIZE-1] = 0;
+    mptr->fline = fline;
+    mptr->fsite = sitelookup(fname,fline);
+    if(mptr->fsite < 0) {
+        return;
+    }
+
+    size = abs(mptr->size);
+    sp = &msites[mptr->fsite];
+    sp->allocs++;
+    sp->totbytes += size;
+    sp->livebytes += size;
+    if(sp->livebytes > sp->peakbytes) {
+        sp->peakbytes = sp->livebytes;
+    }
+}
+
+/* siterelease():
+ * Remove 'size' bytes from the live total of site 'idx'.
+ */
+static void
+siterelease(int idx, int size)
+{
+    if((idx < 0) || (idx >= MALLOC_SITES) || (msites[idx].fname == 0)) {
+        return;
+    }
+    msites[idx].frees++;
+    msites[idx].livebytes -= size;
+}
+#define SITERELEASE(mptr)   siterelease((mptr)->fsite,abs((mptr)->size))
+#define SITECLEAR(mptr)     ((mptr)->fsite = -1)
+#else
+#define SITERELEASE(mptr)
+#define SITECLEAR(mptr)
+#endif
+
+static void
+sizehist_add(int size)
+{
+    int i;
+
+    for(i=0; (i < HEAPPROF_HISTSIZE-1) && (size > (16 << i)); i++);
+    sizehist[i]++;
+}
+
+#if MALLOC_TLSF
+/* Segregated free lists:
+ * Free block sizes are mapped to a first-level index (the power of two
+ * range the size falls in) and a second-level index (which of the
+ * TLSF_SLCNT equal slices of that range).  Sizes below TLSF_SMALL are
+ * all in first-level 0, one list per 4-byte size.  A bit is set in
+ * flbitmap/slbitmap for each non-empty list, so the smallest suitable
+ * non-empty list is found with a couple of bit scans.
+ *
+ * The free list links are kept in the (otherwise unused) data space of
+ * each free block, which is why a block is never smaller than
+ * MINBLKSIZE.  Blocks are also still linked through mhdr next/prev in
+ * the order they were carved from GetMemory() space, which is what
+ * free() uses to find contiguous neighbors to coalesce with; heaptail
+ * is the last block on that list.
+ */
+#define TLSF_SLBITS         3
+#define TLSF_SLCNT          (1 << TLSF_SLBITS)
+#define TLSF_FLSHIFT        (TLSF_SLBITS + 2)
+#define TLSF_FLCNT          (33 - TLSF_FLSHIFT)
+#define TLSF_SMALL          (1 << TLSF_FLSHIFT)
+#define MINBLKSIZE          (2 * sizeof(struct mhdr *))
+
+#define FNEXT(m)            (((struct mhdr **)((m)+1))[0])
+#define FPREV(m)            (((struct mhdr **)((m)+1))[1])
+
+static ulong flbitmap;
+static ulong slbitmap[TLSF_FLCNT];
+static struct mhdr *freelist[TLSF_FLCNT][TLSF_SLCNT];
+static struct mhdr *heaptail;
+
+/* mcheck:
+ * If set (by heap -d), then the full heapcheck() is run on each call
+ * to malloc, realloc and free.
+ */
+static char mcheck;
+
+static int
+tlsf_msb(ulong val)
+{
+    return(31 - __builtin_clz(val));
+}
+
+static void
+tlsf_mapping(int size, int *fl, int *sl)
+{
+    int msb;
+
+    if(size < TLSF_SMALL) {
+        *fl = 0;
+        *sl = size >> 2;
+    } else {
+        msb = tlsf_msb(size);
+        *fl = msb - TLSF_FLSHIFT + 1;
+        *sl = (size >> (msb - TLSF_SLBITS)) - TLSF_SLCNT;
+    }
+}
+
+static void
+tlsf_insert(struct mhdr *mptr)
+{
+    int fl, sl;
+    struct mhdr *head;
+
+    tlsf_mapping(mptr->size,&fl,&sl);
+    head = freelist[fl][sl];
+    FNEXT(mptr) = head;
+    FPREV(mptr) = (struct mhdr *)0;
+    if(head) {
+        FPREV(head) = mptr;
+    }
+    freelist[fl][sl] = mptr;
+    flbitmap |= (1 << fl);
+    slbitmap[fl] |= (1 << sl);
+}
+
+static void
+tlsf_remove(struct mhdr *mptr)
+{
+    int fl, sl;
+
+    tlsf_mapping(mptr->size,&fl,&sl);
+    if(FNEXT(mptr)) {
+        FPREV(FNEXT(mptr)) = FPREV(mptr);
+    }
+    if(FPREV(mptr)) {
+        FNEXT(FPREV(mptr)) = FNEXT(mptr);
+    } else {
+        freelist[fl][sl] = FNEXT(mptr);
+        if(!freelist[fl][sl]) {
+            slbitmap[fl] &= ~(1 << sl);
+            if(!slbitmap[fl]) {
+                flbitmap &= ~(1 << fl);
+            }
+        }
+    }
+}
+
+/* tlsf_findfree():
+ * Return a free block that is at least 'size' bytes (or NULL).
+ * The size is first rounded up to the start of the next list so
+ * that any block on the list that is found is large enough.
+ */
+static struct mhdr *
+tlsf_findfree(int size)
+{
+    int fl, sl;
+    ulong map;
+
+    if(size >= TLSF_SMALL) {
+        size += (1 << (tlsf_msb(size) - TLSF_SLBITS)) - 1;
+    }
+    tlsf_mapping(size,&fl,&sl);
+    if(fl >= TLSF_FLCNT) {
+        return((struct mhdr *)0);
+    }
+
+    map = slbitmap[fl] & (~0UL << sl);
+    if(!map) {
+        map = flbitmap & (~0UL << (fl+1));
+        if(!map) {
+            return((struct mhdr *)0);
+        }
+        fl = __builtin_ctz(map);
+        map = slbitmap[fl];
+    }
+    sl = __builtin_ctz(map);
+    return(freelist[fl][sl]);
+}
+
+/* tlsf_split():
+ * If the block is large enough to hold 'size' bytes plus another
+ * block, then split off the remainder and put it on a free list.
+ */
+static void
+tlsf_split(struct mhdr *mptr, int size)
+{
+    struct mhdr *mptr1;
+
+    if(mptr->size < (int)(size + MHDRSIZE + MINBLKSIZE)) {
+        return;
+    }
+
+    mptr1 = (struct mhdr *)((char *)(mptr+1) + size);
+    mptr1->pretag  = PRETAG;
+    mptr1->posttag = POSTTAG;
+    mptr1->next = mptr->next;
+    mptr->next = mptr1;
+    if(mptr1->next) {
+        mptr1->next->prev = mptr1;
+    } else {
+        heaptail = mptr1;
+    }
+    mptr1->prev = mptr;
+    mptr1->size = (mptr->size - size) - MHDRSIZE;
+    mptr->size = size;
+    tlsf_insert(mptr1);
+}
+#endif
+
 static void
 heapinit(void)
 {
@@ -141,6 +432,13 @@ heapinit(void)
     }
     heapbase->next = (struct mhdr *)0;
     heapbase->prev = (struct mhdr *)0;
+#if MALLOC_TLSF
+    memset((char *)freelist,0,sizeof(freelist));
+    memset((char *)slbitmap,0,sizeof(slbitmap));
+    flbitmap = 0;
+    heaptail = heapbase;
+    tlsf_insert(heapbase);
+#endif
 }
 
 /* heapcheck():
@@ -190,6 +488,90 @@ heapcheck(struct mhdr *mp,char *msg)
     return(0);
 }
 
+#if MALLOC_TLSF
+static char *
+_malloc(int size)
+{
+    struct mhdr *mptr;
+
+    if(mtrace) {
+        printf("malloc(%d) = ",size);
+    }
+
+    if(size <= 0) {
+        if(mtrace) {
+            printf("0\n");
+        }
+        return(0);
+    }
+
+    if(!heapbase) {
+        heapinit();
+    }
+
+    if(mcheck && (heapcheck(0,0) < 0)) {
+        if(mtrace) {
+            printf("00\n");
+        }
+        return((char *)0);
+    }
+
+    /* Keep track of number of calls to malloc for debug. */
+    mcalls++;
+    sizehist_add(size);
+
+    /* Make size divisible by 4 and big enough to hold the free list
+     * links once the block is freed:
+     */
+    if(size & 3) {
+        size += 4;
+        size &= 0xfffffffc;
+    }
+    if(size < (int)MINBLKSIZE) {
+        size = MINBLKSIZE;
+    }
+
+    mptr = tlsf_findfree(size);
+    if(mptr) {
+        tlsf_remove(mptr);
+    } else {
+        int getsize;
+
+        getsize = size + MHDRSIZE;
+        mptr = (struct mhdr *)GetMemory(getsize);
+        if(!mptr) {
+            mfails++;
+            if(!mquiet) {
+                printf("\007MALLOC ERROR: no more memory\n");
+            }
+            if(mtrace) {
+                printf("000\n");
+            }
+            return((char *)0);
+        }
+        mptr->pretag = PRETAG;
+        mptr->posttag = POSTTAG;
+        mptr->size = getsize - MHDRSIZE;
+        mptr->next = (struct mhdr *)0;
+        mptr->prev = heaptail;
+        heaptail->next = mptr;
+        heaptail = mptr;
+    }
+
+    tlsf_split(mptr,size);
+    mtot += mptr->size;
+    if((mtot - ftot) > highwater) {
+        highwater = (mtot - ftot);
+    }
+    mptr->size = -mptr->size;
+    SITECLEAR(mptr);
+
+    if(mtrace) {
+        printf("0x%lx\n",(long)(mptr+1));
+    }
+    return((char *)(mptr+1));
+}
+#else
 static char *
 _malloc(int size)
 {
@@ -216,6 +598,7 @@ _malloc(int size)
 
     /* Keep track of number of calls to malloc for debug. */
     mcalls++;
+    sizehist_add(size);
 
     /* Make size divisible by 4: */
     if(size & 3) {
@@ -258,6 +641,7 @@ _malloc(int size)
                     highwater = (mtot - ftot);
                 }
             }
+            SITECLEAR(mptr);
             if(mtrace) {
                 printf("0x%lx\n",(long)(mptr+1));
             }
@@ -291,6 +675,7 @@ _malloc(int size)
         }
     }
 }
+#endif
 
 #ifdef MALLOC_DEBUG
 #undef malloc
@@ -305,10 +690,7 @@ malloc(int size, char *fname, int fline)
     if(cp) {
         mptr = (struct mhdr *)cp;
         mptr--;
-        strncpy(mptr->fname,fname,FNAMESIZE-1);
-        mptr->fline = fline;
-        mptr->fname[FNAMESIZE-1] = 0;
-        mptr->fline = fline;
+        setsite(mptr,fname,fline);
     }
     return(cp);
 }
@@ -321,6 +703,91 @@ malloc(int size)
 }
 #endif
 
+#if MALLOC_TLSF
+/* blockcheck():
+ * The per-call check used when the full heapcheck() is not enabled;
+ * just verify that the incoming pointer looks like an allocated block.
+ */
+static int
+blockcheck(struct mhdr *mptr, char *msg)
+{
+    if(mcheck) {
+        return(heapcheck(mptr,msg));
+    }
+    if((mptr->pretag != PRETAG) || (mptr->posttag != POSTTAG) ||
+            (mptr->size >= 0)) {
+        if(!mquiet) {
+            printf("\007MALLOC ERROR: 0x%lx invalid or free block",
+                   (ulong)(mptr+1));
+            if(msg) {
+                printf(" (%s)",msg);
+            }
+            printf("\n");
+        }
+        return(-1);
+    }
+    return(0);
+}
+
+void
+free(void *vp)
+{
+    char    *cp  = vp;
+    struct  mhdr    *mptr, *nxt, *prv;
+
+    if(mtrace) {
+        printf("free(0x%lx)\n",(long)cp);
+    }
+
+    /* Keep track of number of calls to free for debug. */
+    fcalls++;
+
+    /* As with the standard free(), a null pointer is a no-op.
+     */
+    if(!cp) {
+        return;
+    }
+
+    mptr = (struct mhdr *)cp - 1;
+    if(blockcheck(mptr,0) < 0) {
+        return;
+    }
+    SITERELEASE(mptr);
+
+    mptr->size = -mptr->size;
+    ftot += mptr->size;
+
+    /* Coalesce with the next and/or previous block if they are free
+     * and contiguous, taking them off their free lists first...
+     */
+    nxt = mptr->next;
+    if(nxt && (nxt->size > 0) &&
+            (nxt == (struct mhdr *)((char *)mptr + mptr->size + MHDRSIZE))) {
+        tlsf_remove(nxt);
+        mptr->size += nxt->size + MHDRSIZE;
+        mptr->next = nxt->next;
+        if(mptr->next) {
+            mptr->next->prev = mptr;
+        } else {
+            heaptail = mptr;
+        }
+    }
+    prv = mptr->prev;
+    if(prv && (prv->size > 0) &&
+            (mptr == (struct mhdr *)((char *)prv + prv->size + MHDRSIZE))) {
+        tlsf_remove(prv);
+        prv->size += mptr->size + MHDRSIZE;
+        prv->next = mptr->next;
+        if(prv->next) {
+            prv->next->prev = prv;
+        } else {
+            heaptail = prv;
+        }
+        mptr = prv;
+    }
+    tlsf_insert(mptr);
+}
+#else
 void
 free(void *vp)
 {
@@ -342,6 +809,7 @@ free(void *vp)
     if(heapcheck(mptr,0) < 0) {
         return;
     }
+    SITERELEASE(mptr);
 
     /* The first thing to do to free the block is to make the size
      * positive.
@@ -379,6 +847,7 @@ free(void *vp)
         }
     }
 }
+#endif
 
 /* calloc():
  *  Allocate space for an array of nelem elements of size elsize.
@@ -414,10 +883,7 @@ calloc(int nelem, int elsize, char *fname, int fline)
     if(cp) {
         mptr = (struct mhdr *)cp;
         mptr--;
-        strncpy(mptr->fname,fname,FNAMESIZE-1);
-        mptr->fline = fline;
-        mptr->fname[FNAMESIZE-1] = 0;
-        mptr->fline = fline;
+        setsite(mptr,fname,fline);
     }
     return(cp);
 }
@@ -436,8 +902,12 @@ static char *
 _realloc(char *cp,int newsize)
 {
     char            *new;
-    int             asize, delta;
-    struct  mhdr    *mptr, tmphdr;
+    int             asize;
+    struct  mhdr    *mptr;
+#if !MALLOC_TLSF
+    int             delta;
+    struct  mhdr    tmphdr;
+#endif
 
     rcalls++;
 
@@ -461,9 +931,15 @@ _realloc(char *cp,int newsize)
     /* Start by checking sanity of heap and make sure that the incoming
      * pointer corresponds to a valid entry in the heap.
      */
+#if MALLOC_TLSF
+    if(blockcheck(mptr,0) < 0) {
+        return((char *)0);
+    }
+#else
     if(heapcheck(mptr,0) < 0) {
         return((char *)0);
     }
+#endif
 
     /* Recall that mptr->size is negative since the block is not free, so
      * use the absolute value of mptr->size...
@@ -486,6 +962,33 @@ _realloc(char *cp,int newsize)
         return(cp);
     }
 
+#if MALLOC_TLSF
+    /* With the segregated free lists, the next block can only be
+     * absorbed if it is free and contiguous; it comes off its free
+     * list and whatever is left over is split off again...
+     */
+    if((mptr->next) && (mptr->next->size > 0) &&
+            (mptr->next == (struct mhdr *)((char *)mptr + asize + MHDRSIZE)) &&
+            ((asize + mptr->next->size + MHDRSIZE) >= newsize)) {
+        struct mhdr *nxt = mptr->next;
+
+        tlsf_remove(nxt);
+        mptr->size = asize + nxt->size + MHDRSIZE;
+        mptr->next = nxt->next;
+        if(mptr->next) {
+            mptr->next->prev = mptr;
+        } else {
+            heaptail = mptr;
+        }
+        tlsf_split(mptr,newsize);
+        mtot += (mptr->size - asize);
+        if((mtot - ftot) > highwater) {
+            highwater = (mtot - ftot);
+        }
+        mptr->size = -mptr->size;
+        return(cp);
+    }
+#else
     /* Now we do the actual reallocation...
      * If there is a fragment after this one (next != NULL) AND it is
      * available (size > 0) AND the combined size of the next fragment
@@ -521,6 +1024,7 @@ _realloc(char *cp,int newsize)
         }
         return(cp);
     }
+#endif
 
     /* If the next fragment is not large enough, then malloc new space,
      * copy the existing data to that block, free the old space and return
@@ -543,15 +1047,27 @@ realloc(char *buf, int newsize, char *fname, int fline)
 {
     char *cp;
     struct  mhdr    *mptr;
+    int oldsite, oldsize;
 
+    /* If the block is resized in place, then it is charged to the
+     * site of this realloc call from here on; if it moves, the old
+     * block is released by the free() done within _realloc()...
+     */
+    oldsite = -1;
+    oldsize = 0;
+    if(buf) {
+        mptr = (struct mhdr *)buf - 1;
+        oldsite = mptr->fsite;
+        oldsize = abs(mptr->size);
+    }
     cp = _realloc(buf, newsize);
     if(cp) {
+        if(cp == buf) {
+            siterelease(oldsite,oldsize);
+        }
         mptr = (struct mhdr *)cp;
         mptr--;
-        strncpy(mptr->fname,fname,FNAMESIZE-1);
-        mptr->fline = fline;
-        mptr->fname[FNAMESIZE-1] = 0;
-        mptr->fline = fline;
+        setsite(mptr,fname,fline);
     }
     return(cp);
 }
@@ -611,6 +1127,10 @@ heapdump(int verbose)
     if(verbose) {
         putchar('\n');
     }
+#if MALLOC_TLSF
+    printf("  Segregated-fit allocator (heap check %s)\n",
+           mcheck ? "on every call" : "off");
+#endif
     printf("  Malloc/realloc/free calls:  %d/%d/%d\n",mcalls,rcalls,fcalls);
     printf("  Malloc/free totals: %d/%d\n",mtot,ftot);
     printf("  High-water level:   %d\n",highwater);
@@ -619,6 +1139,7 @@ heapdump(int verbose)
     printf("  Bytes currently allocated:   %d\n",alloctot);
     printf("  Bytes free on current heap:  %d\n",freetot);
     printf("  Bytes left in allocation pool:  %d\n",GetMemoryLeft());
+    mpoolShow();
 }
 
 /* releaseExtendedHeap():
@@ -647,7 +1168,13 @@ releaseExtendedHeap(int verbose)
     mptr = heapbase;
     for(i=0; mptr; i++) {
         if(mptr->next == extbase) {
+#if MALLOC_TLSF
+            if((extbase->next == (struct mhdr *)0) && (extbase->size > 0)) {
+                tlsf_remove(extbase);
+                heaptail = mptr;
+#else
             if(mptr->next->next == (struct mhdr *)0) {
+#endif
                 mptr->next = (struct mhdr *)0;
                 unExtendHeap();
                 if(verbose) {
@@ -670,16 +1197,375 @@ releaseExtendedHeap(int verbose)
     return(0);
 }
 
+/* mpoolAlloc() & friends:
+ * Fixed-size object pools for code that allocates large numbers of
+ * identical small objects (JFFS2 scan list nodes, shell variable
+ * entries, etc...).  Objects are carved out of chunks of 'objcnt'
+ * objects that are obtained from malloc(), so there is no per-object
+ * mhdr overhead and allocation doesn't touch the heap at all except
+ * when a new chunk is needed.  Freed objects go on a singly linked
+ * free list (linked through the first word of the object).
+ *
+ * mpoolReset() returns every object in the pool at once in constant
+ * time; the chunks are kept and re-carved from the beginning, so a
+ * pool that is repeatedly filled and reset (a JFFS2 re-scan) only
+ * goes to the heap the first time.
+ *
+ * Each chunk starts with a pointer to the next chunk, followed by the
+ * objects themselves.
+ */
+static struct mpool *mpoollist;
+
+int
+mpoolCreate(struct mpool *mp, char *name, int objsize, int objcnt)
+{
+    if((objsize <= 0) || (objcnt <= 0)) {
+        return(-1);
+    }
+    memset((char *)mp,0,sizeof(struct mpool));
+    mp->name = name;
+    mp->objsize = (objsize + sizeof(char *) - 1) & ~(sizeof(char *) - 1);
+    mp->objcnt = objcnt;
+    return(0);
+}
+
+char *
+mpoolAlloc(struct mpool *mp)
+{
+    char *obj, *nxt;
+
+    if(mp->freelist) {
+        obj = mp->freelist;
+        mp->freelist = *(char **)obj;
+    } else {
+        if((!mp->curchunk) || (mp->bump == mp->objcnt)) {
+            /* Move on to the next chunk (retained from before the last
+             * reset) or get a new one from the heap...
+             */
+            nxt = mp->curchunk ? *(char **)mp->curchunk : mp->chunklist;
+            if(!nxt) {
+                nxt = _malloc(sizeof(char *) + (mp->objsize * mp->objcnt));
+                if(!nxt) {
+                    return((char *)0);
+                }
+                *(char **)nxt = (char *)0;
+                if(mp->curchunk) {
+                    *(char **)mp->curchunk = nxt;
+                } else {
+                    mp->chunklist = nxt;
+                }
+                if(mp->chunks++ == 0) {
+                    mp->next = mpoollist;
+                    mpoollist = mp;
+                }
+            }
+            mp->curchunk = nxt;
+            mp->bump = 0;
+        }
+        obj = mp->curchunk + sizeof(char *) + (mp->bump++ * mp->objsize);
+    }
+    if(++mp->inuse > mp->hwm) {
+        mp->hwm = mp->inuse;
+    }
+    return(obj);
+}
+
+void
+mpoolFree(struct mpool *mp, void *obj)
+{
+    if(!obj) {
+        return;
+    }
+    *(char **)obj = mp->freelist;
+    mp->freelist = obj;
+    mp->inuse--;
+}
+
+void
+mpoolReset(struct mpool *mp)
+{
+    mp->freelist = (char *)0;
+    mp->curchunk = (char *)0;
+    mp->bump = 0;
+    mp->inuse = 0;
+}
+
+static void
+mpoolShow(void)
+{
+    struct mpool *mp;
+
+    if(!mpoollist) {
+        return;
+    }
+    printf("  Object pools:      objsize  capacity  inuse  hi-water\n");
+    for(mp = mpoollist; mp; mp = mp->next) {
+        printf("    %-16s %7d %9d %6d %9d\n",mp->name,mp->objsize,
+               mp->chunks * mp->objcnt,mp->inuse,mp->hwm);
+    }
+}
+
+static void
+mpoolClear(void)
+{
+    struct mpool *mp;
+
+    for(mp = mpoollist; mp; mp = mp->next) {
+        mp->hwm = mp->inuse;
+    }
+}
+
+/* heapbench():
+ * Run an allocation pattern like that of a JFFS2 partition scan: one
+ * small node descriptor is allocated per scanned node and kept on a
+ * list, with a short-lived larger buffer (name/data decompression)
+ * every few nodes; then the whole list is discarded.  Report the time it
+ * took so that allocator changes can be compared on real hardware.
+ *
+ * This is a synthetic approximation, not a recorded trace: the node
+ * sizes and the one-in-BENCH_TMPEVERY buffer are rough figures for a
+ * scan that takes its list nodes from the heap (jffs2.c now takes them
+ * from mpools, so its scan only goes to the heap for a new chunk).  It
+ * is meant for comparing allocators with each other, not for
+ * predicting how long a scan of a real partition will take.
+ */
+#define BENCH_NODESIZE      32
+#define BENCH_TMPSIZE       512
+#define BENCH_TMPEVERY      8
+
+static void
+heapbench(int nodes, int passes)
+{
+    int i, pass, ncnt;
+    ulong msec;
+    char **list, **node, *tmp;
+    struct elapsed_tmr tmr;
+
+    ncnt = 0;
+    startElapsedTimer(&tmr,0x7fffffff);
+    for(pass=0; pass<passes; pass++) {
+        list = (char **)0;
+        for(i=0; i<nodes; i++) {
+            node = (char **)_malloc(BENCH_NODESIZE + (i & 3) * 4);
+            if(!node) {
+                break;
+            }
+            *node = (char *)list;
+            list = node;
+            ncnt++;
+            if((i % BENCH_TMPEVERY) == 0) {
+                tmp = _malloc(BENCH_TMPSIZE);
+                if(tmp) {
+                    free(tmp);
+                }
+            }
+        }
+        while(list) {
+            node = (char **)*list;
+            free((char *)list);
+            list = node;
+        }
+    }
+    msec = msecSinceStart(&tmr);
+
+    printf("  %d passes, %d nodes: %d msec",passes,ncnt,msec);
+    if(msec) {
+        printf(" (%d allocs/sec)",
+               (int)(((ulong)ncnt * (BENCH_TMPEVERY+1) / BENCH_TMPEVERY)
+                     * 1000 / msec));
+    }
+    putchar('\n');
+    shell_sprintf("HEAPBENCH","%d",msec);
+}
+
+/* heapfrag():
+ * Walk the heap and return the total number of free bytes; the size
+ * of the largest free block is returned in *largest and the number of
+ * bytes currently allocated in *alloctot.
+ */
+static int
+heapfrag(int *largest, int *alloctot)
+{
+    int freetot;
+    struct mhdr *mptr;
+
+    freetot = *largest = *alloctot = 0;
+    for(mptr = heapbase; mptr; mptr = mptr->next) {
+        if(mptr->size > 0) {
+            freetot += mptr->size;
+            if(mptr->size > *largest) {
+                *largest = mptr->size;
+            }
+        } else {
+            *alloctot -= mptr->size;
+        }
+    }
+    return(freetot);
+}
+
+/* heapprofile():
+ * Display the allocation size histogram, the current fragmentation
+ * of the heap and (if built with MALLOC_DEBUG) the per-callsite
+ * allocation profile.
+ * Fragmentation is reported as the percentage of free heap space that
+ * is NOT in the largest free block; i.e. 0% means all free space is
+ * in one piece.
+ */
+static void
+heapprofile(void)
+{
+    int i, freetot, largest, alloctot;
+
+    if(heapbase == 0) {
+        heapinit();
+    }
+    printf("Request size histogram:\n");
+    for(i=0; i<HEAPPROF_HISTSIZE; i++) {
+        if(sizehist[i] == 0) {
+            continue;
+        }
+        if(i == 0) {
+            printf("  %7d - %7d: %d\n",1,16,sizehist[i]);
+        } else if(i == HEAPPROF_HISTSIZE-1) {
+            printf("  %7d +        : %d\n",(8 << i)+1,sizehist[i]);
+        } else {
+            printf("  %7d - %7d: %d\n",(8 << i)+1,16 << i,sizehist[i]);
+        }
+    }
+
+    freetot = heapfrag(&largest,&alloctot);
+    printf("Free: %d bytes, largest block: %d bytes, fragmentation: %d%c\n",
+           freetot,largest,freetot ? ((freetot-largest)*100)/freetot : 0,'%');
+
+#ifdef MALLOC_DEBUG
+    printf("Allocation sites:\n");
+    printf("  %-24s %5s %7s %7s %8s %8s %9s\n","file","line",
+           "allocs","frees","live","peak","total");
+    for(i=0; i<MALLOC_SITES; i++) {
+        struct msite *sp = &msites[i];
+
+        if(sp->fname == 0) {
+            continue;
+        }
+        printf("  %-24s %5d %7d %7d %8d %8d %9d\n",sp->fname,sp->fline,
+               sp->allocs,sp->frees,sp->livebytes,sp->peakbytes,
+               sp->totbytes);
+    }
+    if(msitesfull) {
+        printf("  (%d allocations not tracked, site table full)\n",
+               msitesfull);
+    }
+#else
+    printf("(rebuild with MALLOC_DEBUG for per-callsite profile)\n");
+#endif
+}
+
+#if INCLUDE_TFS
+/* heapsnapshot():
+ * Write the current heap profile to a TFS file using the binary
+ * format described in heapprof.h.  Two snapshots taken at different
+ * times (e.g. before and after a suspected leak) can be pulled off
+ * the target and compared with the host tool heapdiff (refer to
+ * ports/linux_host/heapdiff.c).
+ */
+static int
+heapsnapshot(char *fname)
+{
+    char *buf;
+    int i, size, err, nsites, largest, alloctot;
+    struct heapprof_hdr *hp;
+#ifdef MALLOC_DEBUG
+    struct heapprof_site *sp;
+#endif
+
+    if(heapbase == 0) {
+        heapinit();
+    }
+
+    nsites = 0;
+#ifdef MALLOC_DEBUG
+    for(i=0; i<MALLOC_SITES; i++) {
+        if(msites[i].fname) {
+            nsites++;
+        }
+    }
+#endif
+    size = sizeof(struct heapprof_hdr) + nsites * sizeof(struct heapprof_site);
+    buf = _malloc(size);
+    if(!buf) {
+        printf("Can't allocate %d bytes for snapshot\n",size);
+        return(-1);
+    }
+    memset(buf,0,size);
+
+    hp = (struct heapprof_hdr *)buf;
+    hp->magic = HEAPPROF_MAGIC;
+    hp->version = HEAPPROF_VERSION;
+    hp->allocsize = ALLOCSIZE;
+    hp->mcalls = mcalls;
+    hp->fcalls = fcalls;
+    hp->highwater = highwater;
+    hp->freetot = heapfrag(&largest,&alloctot);
+    hp->largestfree = largest;
+    hp->memleft = GetMemoryLeft();
+    for(i=0; i<HEAPPROF_HISTSIZE; i++) {
+        hp->hist[i] = sizehist[i];
+    }
+    hp->nsites = nsites;
+
+    /* Bytes currently allocated shouldn't include the snapshot buffer
+     * itself...
+     */
+    hp->alloctot = alloctot - abs(((struct mhdr *)buf - 1)->size);
+
+#ifdef MALLOC_DEBUG
+    sp = (struct heapprof_site *)(hp+1);
+    for(i=0; i<MALLOC_SITES; i++) {
+        if(msites[i].fname == 0) {
+            continue;
+        }
+        strncpy(sp->fname,msites[i].fname,HEAPPROF_FNAMESIZE-1);
+        sp->fline = msites[i].fline;
+        sp->allocs = msites[i].allocs;
+        sp->frees = msites[i].frees;
+        sp->livebytes = msites[i].livebytes;
+        sp->peakbytes = msites[i].peakbytes;
+        sp->totbytes = msites[i].totbytes;
+        sp++;
+    }
+#endif
+
+    err = tfsadd(fname,"heapprof",0,(unsigned char *)buf,size);
+    free(buf);
+    if(err != TFS_OKAY) {
+        printf("%s: %s\n",fname,(char *)tfsctrl(TFS_ERRMSG,err,0));
+        return(-1);
+    }
+    return(0);
+}
+#endif
 
 char *HeapHelp[] = {
     "Display heap statistics.",
-    "-[cf:m:qtvX:x]",
+#if MALLOC_TLSF
+    "-[B:cdf:m:pqS:tvX:x]",
+#else
+    "-[B:cf:m:pqS:tvX:x]",
+#endif
 #if INCLUDE_VERBOSEHELP
     "Options:",
-    " -c        clear high-water level and malloc/free totals",
+    " -B{n[,p]} benchmark: synthetic JFFS2 scan load, n nodes, p passes",
+    " -c        clear high-water levels and malloc/free totals",
+#if MALLOC_TLSF
+    " -d        toggle full heap check on every malloc/free",
+#endif
     " -f{ptr}   free block @ 'ptr'",
     " -m{size}  malloc 'size' bytes",
+    " -p        profile: size histogram, fragmentation & call sites",
     " -q        quiet runtime (don't print MALLOC ERROR msgs)",
+#if INCLUDE_TFS
+    " -S{file}  write binary heap profile snapshot to TFS 'file'",
+#endif
     " -v        verbose (more detail)",
     " -t        toggle runtime malloc/free trace",
     " -X{base,size}",
@@ -698,13 +1584,37 @@ Heap(int argc,char *argv[])
     showheap = 1;
     establish_extended_heap = (char *)0;
     release_extended_heap = verbose = 0;
-    while((opt=getopt(argc,argv,"cf:m:qtvX:x")) != -1) {
+#if MALLOC_TLSF
+    while((opt=getopt(argc,argv,"B:cdf:m:pqS:tvX:x")) != -1) {
+#else
+    while((opt=getopt(argc,argv,"B:cf:m:pqS:tvX:x")) != -1) {
+#endif
         switch(opt) {
+        case 'B':
+            {
+                char *comma;
+                int nodes, passes;
+
+                nodes = (int)strtoul(optarg,&comma,0);
+                passes = (*comma == ',') ? (int)strtoul(comma+1,0,0) : 1;
+                heapbench(nodes,passes);
+            }
+            showheap = 0;
+            break;
         case 'c':
             mcalls = fcalls = 0;
             mtot = ftot = highwater = 0;
+            memset((char *)sizehist,0,sizeof(sizehist));
+            mpoolClear();
             showheap = 0;
             break;
+#if MALLOC_TLSF
+        case 'd':
+            mcheck = ~mcheck;
+            printf("Heap check on every call: %sabled\n",
+                   mcheck ? "en" : "dis");
+            return(CMD_SUCCESS);
+#endif
         case 'f':
             free((char *)strtoul(optarg,0,0));
             showheap = 0;
@@ -717,10 +1627,25 @@ Heap(int argc,char *argv[])
             }
             showheap = 0;
             break;
+        case 'p':
+            heapprofile();
+            showheap = 0;
+            break;
         case 'q':
             showheap = 0;
             mquiet = 1;
             break;
+        case 'S':
+#if INCLUDE_TFS
+            if(heapsnapshot(optarg) < 0) {
+                return(CMD_FAILURE);
+            }
+            showheap = 0;
+            break;
+#else
+            printf("TFS not built in\n");
+            return(CMD_FAILURE);
+#endif
         case 't':
             mtrace = ~mtrace;
             printf("Runtime trace: %sabled\n",
@@ -31,6 +31,8 @@
 #include "stddefs.h"
 #include <ctype.h>
 #include "cli.h"
+#include "timer.h"
+#include "cache.h"
 
 /* With INCLUDE_MEMCMDS defined in config.h, all uMon commands in this
  * file are automatically pulled into the build.  If there is a need to
@@ -45,6 +47,7 @@
 #define INCLUDE_CM 1
 #define INCLUDE_SM 1
 #define INCLUDE_MT 1
+#define INCLUDE_MB 1
 #endif
 
 #if INCLUDE_PM
@@ -985,21 +988,423 @@ Cm(int argc,char *argv[])
  *  would not be executing) and the ram used for stack and bss must
  *  already be somewhat useable.
  */
+
+/* Memory test engine (-a):
+ * Faster tests with more coverage for large parts (manufacturing test),
+ * selected by name:
+ *  march:  March C- with all-zeros/all-ones data.
+ *  movinv: Moving inversions; fill with a pattern, then an ascending
+ *          pass checks it and writes its inverse, then a descending pass
+ *          checks the inverse and writes it back.  Repeated for each of
+ *          the patterns in mtPatterns[].
+ *  aia:    Address-in-address (and -t complemented) as above, plus -s.
+ *  random: Pseudo-random data from the -r seed; written, verified, then
+ *          repeated with the complement.
+ *  all:    All of the above.
+ * The engine transfers MT_BURST words per access (so the compiler can
+ * use multi-word loads/stores) where the order of the accesses doesn't
+ * matter: fills and read-only passes.  Elements that read and write
+ * (march and movinv) go a word at a time in the element's direction,
+ * refer to mtElement().  Between elements the D-cache is flushed over
+ * the range so that, with the data cache on, the next element reads back
+ * from memory; the flush (an external call) also keeps the compiler from
+ * carrying data across elements.  With -u the same tests run a second
+ * time through the given alias, which should be an uncached view of the
+ * same memory.
+ * Each test reports its error count and MB/sec tested (the MTRATE shell
+ * variable is loaded with the last rate).
+ */
+#define MT_BURST    8
+
+#define MT_MARCH    (1 << 0)
+#define MT_MOVINV   (1 << 1)
+#define MT_AIA      (1 << 2)
+#define MT_RANDOM   (1 << 3)
+
+struct mtctx {
+    ulong   *start;
+    ulong   *end;
+    ulong   chunks;         /* Number of MT_BURST word chunks */
+    ulong   togglemask;
+    int     errcnt;
+    int     verbose;
+    int     quitonerr;
+    int     aborted;
+};
+
+static ulong mtPatterns[] = {
+    0x00000000, 0x55555555, 0x33333333, 0x0f0f0f0f, 0x00ff00ff, 0x0000ffff
+};
+
+/* mtPoll():
+ * Called for each chunk; every 256K check for abort (and ticktock if
+ * verbose).  Return non-zero if the test is to stop.
+ */
+static int
+mtPoll(struct mtctx *mcp, ulong *p)
+{
+    if(((ulong)p & 0x3ffff) == 0) {
+        if(gotachar()) {
+            mcp->aborted = 1;
+        } else if(mcp->verbose) {
+            ticktock();
+        }
+    }
+    return(mcp->aborted);
+}
+
+/* mtCheck():
+ * Compare a burst that was read back with what was expected.
+ */
+static void
+mtCheck(struct mtctx *mcp, ulong *p, ulong *got, ulong *exp)
+{
+    int i;
+
+    for(i=0; i<MT_BURST; i++) {
+        if(got[i] != exp[i]) {
+            mcp->errcnt++;
+            if(mcp->verbose > 1)
+                printf("MtErr @ x%lx: read x%lx expected x%lx\n",
+                       (ulong)(p+i),got[i],exp[i]);
+            if(mcp->quitonerr) {
+                mcp->aborted = 1;
+            }
+        }
+    }
+}
+
+static void
+mtFlush(struct mtctx *mcp)
+{
+    flushDcache((char *)mcp->start,(char *)mcp->end - (char *)mcp->start);
+}
+
+/* mtChunk():
+ * Address of the c'th chunk, counting up from the bottom or down from
+ * the top of the range.
+ */
+static ulong *
+mtChunk(struct mtctx *mcp, ulong c, int up)
+{
+    if(up) {
+        return(mcp->start + (c * MT_BURST));
+    }
+    return(mcp->end - ((c + 1) * MT_BURST));
+}
+
+/* mtFill():
+ * Write the whole range with 'val'.
+ */
+static void
+mtFill(struct mtctx *mcp, ulong val)
+{
+    ulong c, *p;
+
+    for(c=0; c<mcp->chunks; c++) {
+        p = mtChunk(mcp,c,1);
+        if(mtPoll(mcp,p)) {
+            return;
+        }
+        p[0] = val;
+        p[1] = val;
+        p[2] = val;
+        p[3] = val;
+        p[4] = val;
+        p[5] = val;
+        p[6] = val;
+        p[7] = val;
+    }
+    mtFlush(mcp);
+}
+
+/* mtElement():
+ * One march element: in the given direction, read each location,
+ * verify it is 'rd' and then, if 'write' is set, write 'wr'.
+ * A read-only element reads a burst at a time.  When there is a write,
+ * each word is read and then written before the next word is touched
+ * (through a volatile pointer, so the compiler can't batch the reads);
+ * March C- depends on that order to catch coupling faults between
+ * neighbouring words.
+ */
+static void
+mtElement(struct mtctx *mcp, int up, ulong rd, ulong wr, int write)
+{
+    int     i;
+    ulong   c, *p, got[MT_BURST], exp[MT_BURST];
+    vulong  *vp;
+
+    for(i=0; i<MT_BURST; i++) {
+        exp[i] = rd;
+    }
+    for(c=0; c<mcp->chunks; c++) {
+        p = mtChunk(mcp,c,up);
+        if(mtPoll(mcp,p)) {
+            return;
+        }
+        if(write) {
+            vp = (vulong *)p;
+            if(up) {
+                for(i=0; i<MT_BURST; i++) {
+                    got[i] = vp[i];
+                    vp[i] = wr;
+                }
+            } else {
+                for(i=MT_BURST-1; i>=0; i--) {
+                    got[i] = vp[i];
+                    vp[i] = wr;
+                }
+            }
+        } else {
+            got[0] = p[0];
+            got[1] = p[1];
+            got[2] = p[2];
+            got[3] = p[3];
+            got[4] = p[4];
+            got[5] = p[5];
+            got[6] = p[6];
+            got[7] = p[7];
+        }
+        if((got[0] != rd) || (got[1] != rd) || (got[2] != rd) ||
+                (got[3] != rd) || (got[4] != rd) || (got[5] != rd) ||
+                (got[6] != rd) || (got[7] != rd)) {
+            mtCheck(mcp,p,got,exp);
+        }
+    }
+    mtFlush(mcp);
+}
+
+static void
+mtMarch(struct mtctx *mcp)
+{
+    mtFill(mcp,0);
+    mtElement(mcp,1,0,~0,1);
+    mtElement(mcp,1,~0,0,1);
+    mtElement(mcp,0,0,~0,1);
+    mtElement(mcp,0,~0,0,1);
+    mtElement(mcp,1,0,0,0);
+}
+
+static void
+mtMovInv(struct mtctx *mcp)
+{
+    int     i;
+    ulong   pat;
+
+    for(i=0; i<sizeof(mtPatterns)/sizeof(mtPatterns[0]); i++) {
+        pat = mtPatterns[i];
+        mtFill(mcp,pat);
+        mtElement(mcp,1,pat,~pat,1);
+        mtElement(mcp,0,~pat,pat,1);
+        if(mcp->aborted) {
+            break;
+        }
+    }
+}
+
+/* mtAddrVal():
+ * Data for address-in-address: the address, or its complement
+ * on -t boundaries.
+ */
+static ulong
+mtAddrVal(struct mtctx *mcp, ulong *p)
+{
+    if((ulong)p & mcp->togglemask) {
+        return(~(ulong)p);
+    }
+    return((ulong)p);
+}
+
+static void
+mtAia(struct mtctx *mcp, ulong rwsleep)
+{
+    int     i;
+    ulong   c, *p, got[MT_BURST], exp[MT_BURST];
+
+    for(c=0; c<mcp->chunks; c++) {
+        p = mtChunk(mcp,c,1);
+        if(mtPoll(mcp,p)) {
+            return;
+        }
+        for(i=0; i<MT_BURST; i++) {
+            exp[i] = mtAddrVal(mcp,p+i);
+        }
+        p[0] = exp[0];
+        p[1] = exp[1];
+        p[2] = exp[2];
+        p[3] = exp[3];
+        p[4] = exp[4];
+        p[5] = exp[5];
+        p[6] = exp[6];
+        p[7] = exp[7];
+    }
+    mtFlush(mcp);
+
+    for(i=0; i<rwsleep; i++) {
+        monDelay(1000);
+        if(mtPoll(mcp,0)) {
+            return;
+        }
+    }
+
+    for(c=0; c<mcp->chunks; c++) {
+        p = mtChunk(mcp,c,1);
+        if(mtPoll(mcp,p)) {
+            return;
+        }
+        got[0] = p[0];
+        got[1] = p[1];
+        got[2] = p[2];
+        got[3] = p[3];
+        got[4] = p[4];
+        got[5] = p[5];
+        got[6] = p[6];
+        got[7] = p[7];
+        for(i=0; i<MT_BURST; i++) {
+            exp[i] = mtAddrVal(mcp,p+i);
+        }
+        mtCheck(mcp,p,got,exp);
+    }
+}
+
+/* mtRandom():
+ * Fill with a pseudo-random sequence (LCG) from the seed, then
+ * regenerate the sequence to verify; 'inv' complements the data.
+ */
+static void
+mtRandom(struct mtctx *mcp, ulong seed, int inv)
+{
+    int     i;
+    ulong   c, x, *p, got[MT_BURST], exp[MT_BURST];
+
+    x = seed;
+    for(c=0; c<mcp->chunks; c++) {
+        p = mtChunk(mcp,c,1);
+        if(mtPoll(mcp,p)) {
+            return;
+        }
+        for(i=0; i<MT_BURST; i++) {
+            x = x * 1664525 + 1013904223;
+            exp[i] = inv ? ~x : x;
+        }
+        p[0] = exp[0];
+        p[1] = exp[1];
+        p[2] = exp[2];
+        p[3] = exp[3];
+        p[4] = exp[4];
+        p[5] = exp[5];
+        p[6] = exp[6];
+        p[7] = exp[7];
+    }
+    mtFlush(mcp);
+
+    x = seed;
+    for(c=0; c<mcp->chunks; c++) {
+        p = mtChunk(mcp,c,1);
+        if(mtPoll(mcp,p)) {
+            return;
+        }
+        got[0] = p[0];
+        got[1] = p[1];
+        got[2] = p[2];
+        got[3] = p[3];
+        got[4] = p[4];
+        got[5] = p[5];
+        got[6] = p[6];
+        got[7] = p[7];
+        for(i=0; i<MT_BURST; i++) {
+            x = x * 1664525 + 1013904223;
+            exp[i] = inv ? ~x : x;
+        }
+        mtCheck(mcp,p,got,exp);
+    }
+}
+
+/* mtEngine():
+ * Run each of the selected tests over the range and report errors
+ * and rate.  Return the number of errors.
+ */
+static int
+mtEngine(struct mtctx *mcp, int tests, ulong seed, ulong rwsleep, char *what)
+{
+    int     test, errs;
+    char    *name;
+    ulong   msec, mbps;
+    struct  elapsed_tmr tmr;
+
+    errs = 0;
+    for(test=MT_MARCH; test<=MT_RANDOM; test <<= 1) {
+        if(!(tests & test) || mcp->aborted) {
+            continue;
+        }
+        mcp->errcnt = 0;
+        startElapsedTimer(&tmr,0x7fffffff);
+        switch(test) {
+        case MT_MARCH:
+            name = "March C-";
+            mtMarch(mcp);
+            break;
+        case MT_MOVINV:
+            name = "Moving inversions";
+            mtMovInv(mcp);
+            break;
+        case MT_AIA:
+            name = "Address-in-address";
+            mtAia(mcp,rwsleep);
+            break;
+        case MT_RANDOM:
+            name = "Random";
+            mtRandom(mcp,seed,0);
+            if(!mcp->aborted) {
+                mtRandom(mcp,seed,1);
+            }
+            break;
+        default:
+            continue;
+        }
+        msec = msecSinceStart(&tmr);
+        printf("%-18s",name);
+        if(what) {
+            printf(" (%s)",what);
+        }
+        printf(": %d errors",mcp->errcnt);
+        if(test == MT_RANDOM) {
+            printf(", seed 0x%lx",seed);
+        }
+#if INCLUDE_HWTMR
+        if(msec && !mcp->aborted) {
+            mbps = (ulong)(((unsigned long long)
+                            ((char *)mcp->end - (char *)mcp->start) * 1000) /
+                           ((unsigned long long)msec << 20));
+            printf(", %ld MB/sec",mbps);
+            shell_sprintf("MTRATE","%ld",mbps);
+        }
+#endif
+        printf("%s\n",mcp->aborted ? " (aborted)" : "");
+        errs += mcp->errcnt;
+    }
+    return(errs);
+}
+
 char *MtHelp[] = {
     "Memory test",
-    "-[CcqSs:t:v] {addr} {len}",
+    "-[a:CcqSs:r:t:u:v] {addr} {len}",
 #if INCLUDE_VERBOSEHELP
     "Options:",
+    " -a{alg} test engine: march, movinv, aia, random or all",
     " -c    continuous",
     " -C    crc32 calculation",
     " -q    quit on error",
+    " -r##  seed for random test",
     " -S    determine size of on-board memory (see note below)",
     " -s##  sleep ## seconds between adr-in-addr write and readback",
     " -t##  toggle data on '##'-bit boundary (##: 32 or 64)",
+    " -u{adr} with -a, repeat tests through this (uncached) alias",
     " -v    cumulative verbosity...",
     "       -v=<ticker>, -vv=<ticker + msg-per-error>",
     "",
-    "Memory test is walking ones followed by address-in-address",
+    "Memory test (without -a) is walking ones followed by",
+    "address-in-address",
     "",
     "Note1: For normal memory test, hit any key to abort test with errors",
     "Note2: With -S option, {addr} is the base of physical memory and",
@@ -1013,11 +1418,14 @@ int
 Mt(int argc,char *argv[])
 {
     int     errcnt, len, testaborted, opt, runcrc;
-    int     quitonerr, verbose, continuous, testtot, sizemem;
-    ulong   arg1, arg2, *start, rwsleep, togglemask;
+    int     quitonerr, verbose, continuous, testtot, sizemem, tests;
+    ulong   arg1, arg2, *start, rwsleep, togglemask, seed, alias;
     ulong   *end, walker, readback, shouldbe;
     volatile ulong *addr;
 
+    tests = 0;
+    seed = 1;
+    alias = 0;
     runcrc = 0;
     sizemem = 0;
     continuous = 0;
@@ -1025,8 +1433,23 @@ Mt(int argc,char *argv[])
     verbose = 0;
     rwsleep = 0;
     togglemask = 0;
-    while((opt=getopt(argc,argv,"cCqSs:t:v")) != -1) {
+    while((opt=getopt(argc,argv,"a:cCqr:Ss:t:u:v")) != -1) {
         switch(opt) {
+        case 'a':
+            if(!strcmp(optarg,"march")) {
+                tests |= MT_MARCH;
+            } else if(!strcmp(optarg,"movinv")) {
+                tests |= MT_MOVINV;
+            } else if(!strcmp(optarg,"aia")) {
+                tests |= MT_AIA;
+            } else if(!strcmp(optarg,"random")) {
+                tests |= MT_RANDOM;
+            } else if(!strcmp(optarg,"all")) {
+                tests |= (MT_MARCH | MT_MOVINV | MT_AIA | MT_RANDOM);
+            } else {
+                return(CMD_PARAM_ERROR);
+            }
+            break;
         case 'c':
             continuous = 1;
             break;
@@ -1036,6 +1459,9 @@ Mt(int argc,char *argv[])
         case 'q':
             quitonerr = 1;
             break;
+        case 'r':
+            seed = strtoul(optarg,0,0);
+            break;
         case 'S':
             sizemem = 1;
             break;
@@ -1054,6 +1480,9 @@ Mt(int argc,char *argv[])
                 return(CMD_PARAM_ERROR);
             }
             break;
+        case 'u':
+            alias = strtoul(optarg,0,0);
+            break;
         case 'v':
             verbose++;      /* Cumulative verbosity */
             break;
@@ -1148,6 +1577,45 @@ Mt(int argc,char *argv[])
         return(CMD_SUCCESS);
     }
 
+    /* If -a option, then run the test engine instead...
+     */
+    if(tests) {
+        struct mtctx mc;
+
+        arg1 &= ~(sizeof(ulong)-1);
+        arg2 &= ~((MT_BURST * sizeof(ulong))-1);
+        alias &= ~(sizeof(ulong)-1);
+        if(arg2 == 0) {
+            return(CMD_PARAM_ERROR);
+        }
+        printf("Testing 0x%lx .. 0x%lx\n",arg1,arg1+arg2);
+
+        memset((char *)&mc,0,sizeof(mc));
+        mc.chunks = arg2 / (MT_BURST * sizeof(ulong));
+        mc.togglemask = togglemask;
+        mc.verbose = verbose;
+        mc.quitonerr = quitonerr;
+        errcnt = testtot = 0;
+        do {
+            mc.start = (ulong *)arg1;
+            mc.end = (ulong *)(arg1 + arg2);
+            errcnt += mtEngine(&mc,tests,seed,rwsleep,alias ? "cached" : 0);
+            if(alias) {
+                mc.start = (ulong *)alias;
+                mc.end = (ulong *)(alias + arg2);
+                errcnt += mtEngine(&mc,tests,seed,rwsleep,"uncached");
+            }
+            testtot++;
+        } while(continuous && !mc.aborted);
+
+        printf("Found %d errors", errcnt);
+        if(continuous && mc.aborted) {
+            printf(" after %d test loops",testtot);
+        }
+        printf(".\n");
+        return(errcnt ? CMD_FAILURE : CMD_SUCCESS);
+    }
+
     arg1 &= ~0x3;   /* Word align */
     arg2 &= ~0x3;
 
@@ -1297,3 +1765,300 @@ Mt(int argc,char *argv[])
     }
 }
 #endif
+
+#if INCLUDE_MB
+
+/* MemBench():
+ *  Memory bandwidth and latency benchmark.
+ *  Bandwidth is measured for sequential read, write and copy (first
+ *  half of the block to the second half) at each access width; latency
+ *  by chasing a chain of pointers, one per MEMBENCH_LINE bytes, linked
+ *  in a pseudo-random order so that each load depends on the previous
+ *  one and can't be prefetched.  The chain is built over block sizes
+ *  doubling from MEMBENCH_MINLAT up to the block length, so the steps
+ *  in the result show the cache levels and DRAM.
+ *  Each test repeats for at least MEMBENCH_MSEC (-t) and the D-cache
+ *  is flushed over the block before each one.  The cache hooks in
+ *  cache.c have no way to mark a region uncached, so for a cached vs
+ *  uncached comparison the -u option names a second block (an uncached
+ *  alias of the same memory, or a region the MMU setup leaves uncached)
+ *  that gets the same tests.
+ *
+ *  The results are put in shell variables:
+ *      MBW_{R|W|C}{8|16|32|64}  bandwidth in MB/sec,
+ *      MBL_{size}               latency in nsec per load,
+ *  with a "U" suffix for the -u block.
+ */
+#ifndef MEMBENCH_MSEC
+#define MEMBENCH_MSEC   200
+#endif
+
+#ifndef MEMBENCH_LINE
+#define MEMBENCH_LINE   64
+#endif
+
+#ifndef MEMBENCH_MINLAT
+#define MEMBENCH_MINLAT 0x1000
+#endif
+
+#define MB_READ     0
+#define MB_WRITE    1
+#define MB_COPY     2
+
+static volatile ulong mbSink;
+
+char *MemBenchHelp[] = {
+    "Memory bandwidth/latency benchmark",
+    "-[blt:u:] {addr} {len}",
+#if INCLUDE_VERBOSEHELP
+    "Options:",
+    " -b      bandwidth only",
+    " -l      latency only",
+    " -t##    msec per test (default 200)",
+    " -u{adr} also run on this (uncached) block",
+    "",
+    "Note: {len} is rounded down to a power of 2 (minimum 4K);",
+    "      results are stored in MBW_XXX and MBL_XXX shell variables.",
+#endif
+    0,
+};
+
+/* mbPass():
+ * One pass of the bandwidth test over the block; return the number
+ * of bytes moved.
+ */
+static ulong
+mbPass(int op, int width, uchar *buf, ulong len)
+{
+    ulong   i, n, sum;
+
+    if(op == MB_COPY) {
+        len >>= 1;
+    }
+    n = len / width;
+    sum = 0;
+    switch(width) {
+    case 1: {
+        volatile uchar *src = buf, *dst = buf + len;
+
+        for(i=0; i<n; i++) {
+            if(op == MB_READ) {
+                sum += src[i];
+            } else if(op == MB_WRITE) {
+                src[i] = (uchar)i;
+            } else {
+                dst[i] = src[i];
+            }
+        }
+        break;
+    }
+    case 2: {
+        volatile ushort *src = (ushort *)buf, *dst = (ushort *)(buf + len);
+
+        for(i=0; i<n; i++) {
+            if(op == MB_READ) {
+                sum += src[i];
+            } else if(op == MB_WRITE) {
+                src[i] = (ushort)i;
+            } else {
+                dst[i] = src[i];
+            }
+        }
+        break;
+    }
+    case 4: {
+        volatile ulong *src = (ulong *)buf, *dst = (ulong *)(buf + len);
+
+        for(i=0; i<n; i++) {
+            if(op == MB_READ) {
+                sum += src[i];
+            } else if(op == MB_WRITE) {
+                src[i] = i;
+            } else {
+                dst[i] = src[i];
+            }
+        }
+        break;
+    }
+    case 8: {
+        volatile unsigned long long *src, *dst;
+
+        src = (unsigned long long *)buf;
+        dst = (unsigned long long *)(buf + len);
+        for(i=0; i<n; i++) {
+            if(op == MB_READ) {
+                sum += (ulong)src[i];
+            } else if(op == MB_WRITE) {
+                src[i] = i;
+            } else {
+                dst[i] = src[i];
+            }
+        }
+        break;
+    }
+    }
+    mbSink = sum;
+    return(len);
+}
+
+/* mbBandwidth():
+ * Repeat passes for at least 'msec' and return the rate in MB/sec.
+ */
+static ulong
+mbBandwidth(int op, int width, uchar *buf, ulong len, ulong msec)
+{
+    ulong   elapsed;
+    unsigned long long bytes;
+    struct  elapsed_tmr tmr;
+
+    flushDcache((char *)buf,len);
+    bytes = 0;
+    startElapsedTimer(&tmr,0x7fffffff);
+    do {
+        bytes += mbPass(op,width,buf,len);
+        elapsed = msecSinceStart(&tmr);
+    } while(elapsed < msec);
+    return((ulong)((bytes * 1000) / ((unsigned long long)elapsed << 20)));
+}
+
+/* mbLatency():
+ * Link one pointer per MEMBENCH_LINE bytes of the first 'size' bytes
+ * of the block into a single cycle and chase it for at least 'msec'.
+ * The order comes from an LCG modulo the (power of 2) line count,
+ * which visits every line once per cycle.
+ * Return the time per load in tenths of a nanosecond.
+ */
+static ulong
+mbLatency(uchar *buf, ulong size, ulong msec)
+{
+    ulong   i, n, line, next, loads, elapsed;
+    ulong   *p;
+    struct  elapsed_tmr tmr;
+
+    n = size / MEMBENCH_LINE;
+    line = 0;
+    for(i=0; i<n; i++) {
+        next = (line * 1664525 + 1013904223) & (n - 1);
+        *(ulong *)(buf + line * MEMBENCH_LINE) =
+            (ulong)(buf + next * MEMBENCH_LINE);
+        line = next;
+    }
+    flushDcache((char *)buf,size);
+
+    p = (ulong *)buf;
+    loads = 0;
+    startElapsedTimer(&tmr,0x7fffffff);
+    do {
+        for(i=0; i<256; i++) {
+            p = (ulong *)*p;
+            p = (ulong *)*p;
+            p = (ulong *)*p;
+            p = (ulong *)*p;
+        }
+        loads += 1024;
+        elapsed = msecSinceStart(&tmr);
+    } while(elapsed < msec);
+    mbSink = (ulong)p;
+    return((ulong)(((unsigned long long)elapsed * 10000000) / loads));
+}
+
+int
+MemBench(int argc,char *argv[])
+{
+#if INCLUDE_HWTMR
+    static char *opname[] = { "read", "write", "copy" };
+    static char opchar[] = { 'R', 'W', 'C' };
+    char    varname[16], label[8];
+    int     opt, op, width, i, nblk, dobw, dolat;
+    ulong   len, msec, size, val[2];
+    uchar   *blk[2];
+
+    dobw = dolat = 1;
+    msec = MEMBENCH_MSEC;
+    nblk = 1;
+    while((opt=getopt(argc,argv,"blt:u:")) != -1) {
+        switch(opt) {
+        case 'b':
+            dolat = 0;
+            break;
+        case 'l':
+            dobw = 0;
+            break;
+        case 't':
+            msec = strtoul(optarg,0,0);
+            break;
+        case 'u':
+            blk[1] = (uchar *)(strtoul(optarg,0,0) & ~(MEMBENCH_LINE-1));
+            nblk = 2;
+            break;
+        default:
+            return(CMD_PARAM_ERROR);
+        }
+    }
+
+    if(argc != optind+2) {
+        return(CMD_PARAM_ERROR);
+    }
+
+    blk[0] = (uchar *)(strtoul(argv[optind],0,0) & ~(MEMBENCH_LINE-1));
+    len = strtoul(argv[optind+1],0,0);
+    if((len < MEMBENCH_MINLAT) || (msec == 0)) {
+        return(CMD_PARAM_ERROR);
+    }
+    for(size=MEMBENCH_MINLAT; (size << 1) && ((size << 1) <= len); size <<= 1);
+    len = size;
+
+    printf("Block 0x%lx, %ld bytes",(ulong)blk[0],len);
+    if(nblk == 2) {
+        printf(" (uncached 0x%lx)",(ulong)blk[1]);
+    }
+    putchar('\n');
+
+    if(dobw) {
+        printf("\nBandwidth (MB/sec):  %8s%s\n","cached",
+               nblk == 2 ? "  uncached" : "");
+        for(op=MB_READ; op<=MB_COPY; op++) {
+            for(width=1; width<=8; width <<= 1) {
+                for(i=0; i<nblk; i++) {
+                    val[i] = mbBandwidth(op,width,blk[i],len,msec);
+                    sprintf(varname,"MBW_%c%d%s",opchar[op],width*8,
+                            i ? "U" : "");
+                    shell_sprintf(varname,"%ld",val[i]);
+                }
+                printf("  %-5s %2d-bit       %8ld",opname[op],width*8,val[0]);
+                if(nblk == 2) {
+                    printf("  %8ld",val[1]);
+                }
+                putchar('\n');
+            }
+        }
+    }
+
+    if(dolat) {
+        printf("\nLatency (nsec/load): %8s%s\n","cached",
+               nblk == 2 ? "  uncached" : "");
+        for(size=MEMBENCH_MINLAT; size && (size<=len); size <<= 1) {
+            if(size >= 0x100000) {
+                sprintf(label,"%ldM",size >> 20);
+            } else {
+                sprintf(label,"%ldK",size >> 10);
+            }
+            for(i=0; i<nblk; i++) {
+                val[i] = mbLatency(blk[i],size,msec);
+                sprintf(varname,"MBL_%s%s",label,i ? "U" : "");
+                shell_sprintf(varname,"%ld.%ld",val[i]/10,val[i]%10);
+            }
+            printf("  %-18s %6ld.%ld",label,val[0]/10,val[0]%10);
+            if(nblk == 2) {
+                printf("  %6ld.%ld",val[1]/10,val[1]%10);
+            }
+            putchar('\n');
+        }
+    }
+    return(CMD_SUCCESS);
+#else
+    printf("membench needs a hardware timer (INCLUDE_HWTMR)\n");
+    return(CMD_FAILURE);
+#endif
+}
+#endif
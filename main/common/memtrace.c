@@ -36,15 +36,28 @@
  * Both the mon_memtrace() API function and the dump facility in the CLI
  * will deal with buffer wrapping.
  *
+ * Formatting every event at trace time is too slow for high-rate tracing
+ * (for example, function entry/exit with -finstrument-functions), so the
+ * buffer can also be configured in binary mode ("mtrace -b cfg").  In
+ * that mode each call just fills a fixed-size record with a timestamp,
+ * the format string pointer and up to MTRACE_ARGS word-sized arguments;
+ * the formatting is done by "mtrace dump".  This means that the format
+ * strings (and any strings passed with %s) must still be in memory
+ * at the time of the dump, and arguments larger than a long (long long,
+ * double) aren't supported; a call whose format can't be recorded
+ * leaves a record that says so (see mtArgs()).
+ *
  * Original author:     Ed Sutter (ed.sutter@alcatel-lucent.com)
  *
  */
 
 #include "config.h"
 #include <stdarg.h>
+#include <ctype.h>
 #include "stddefs.h"
 #include "genlib.h"
 #include "cli.h"
+#include "timer.h"
 
 #if INCLUDE_MEMTRACE
 
@@ -53,6 +66,28 @@
 
 #define MODE_PRINT      (1<<0)      /* mtrace text is output to console */
 #define MODE_NOWRAP     (1<<1)      /* when mtrace buffer fills, stop */
+#define MODE_BINARY     (1<<2)      /* fixed-size records, see mtRec */
+
+#ifndef MTRACE_ARGS
+#define MTRACE_ARGS     5
+#endif
+#if (MTRACE_ARGS < 1) || (MTRACE_ARGS > 8)
+#error "MTRACE_ARGS must be 1-8"
+#endif
+
+/* struct mtRec:
+ *  One binary mode trace record.  The records are in a power-of-2 sized
+ *  ring; the record for sequence number N is at recs[(N-1) & (nrecs-1)].
+ *  The sno field is written last, so a record whose sno doesn't match
+ *  its position in the ring hasn't been completely written.
+ *  With the default MTRACE_ARGS, a record is 32 bytes.
+ */
+struct mtRec {
+    ulong   sno;
+    ulong   tstamp;             /* target_timer(), if INCLUDE_HWTMR */
+    char    *fmt;
+    ulong   args[MTRACE_ARGS];
+};
 
 /* struct mtInfo:
  *  This structure is at the base of the memory space allocated for
@@ -76,6 +111,8 @@ struct mtInfo {
     int wrap;       /* Wrap counter. */
     int mode;       /* See MODE_XXX bits above. */
     int reentered;  /* Reentry counter. */
+    struct mtRec *recs; /* Binary mode: base of record ring. */
+    int nrecs;      /* Binary mode: records in ring (power of 2). */
 };
 
 static struct mtInfo *Mip;
@@ -90,12 +127,144 @@ static struct mtInfo *Mip;
  * application code and other monitor code.
  */
 
+/* mtFormat():
+ *  Format a binary mode record into buf.
+ */
+static int
+mtFormat(char *buf, int size, struct mtRec *rp)
+{
+    ulong   a[8];
+
+    memset((char *)a,0,sizeof(a));
+    memcpy((char *)a,(char *)rp->args,sizeof(rp->args));
+    return(snprintf(buf,size,rp->fmt,a[0],a[1],a[2],a[3],a[4],a[5],a[6],
+                    a[7]));
+}
+
+/* mtArgs():
+ *  Return the number of arguments that the monitor's vsnprintf() takes
+ *  for 'fmt', parsing each conversion the way it does: an optional '-',
+ *  a width, an optional 'l' and the conversion character; only c, s, M,
+ *  I, d, u, p, x and X take an argument (anything else is printed as
+ *  is).  Return -1 if the format can't be recorded: a '*' or precision
+ *  (vsnprintf() would print them rather than take an argument, so the
+ *  arguments after it would be out of step), "%ll" (the argument
+ *  doesn't fit in a record word) or more than MTRACE_ARGS arguments.
+ */
+static int
+mtArgs(char *fmt)
+{
+    int     nargs;
+    char    *cp;
+
+    nargs = 0;
+    for(cp = fmt; *cp; cp++) {
+        if(*cp != '%') {
+            continue;
+        }
+        cp++;
+        if(*cp == '-') {
+            cp++;
+        }
+        while(isdigit(*cp)) {
+            cp++;
+        }
+        if(*cp == 'l') {
+            cp++;
+            if(*cp == 'l') {
+                return(-1);
+            }
+        }
+        switch(*cp) {
+        case 'c':
+        case 's':
+        case 'M':
+        case 'I':
+        case 'd':
+        case 'u':
+        case 'p':
+        case 'x':
+        case 'X':
+            if(++nargs > MTRACE_ARGS) {
+                return(-1);
+            }
+            break;
+        case '*':
+        case '.':
+            return(-1);
+        case 0:
+            return(nargs);
+        }
+    }
+    return(nargs);
+}
+
+/* mtRecord():
+ *  Binary mode of Mtrace().  A record is claimed by bumping the sequence
+ *  number with interrupts disabled (just for that instruction or two),
+ *  then filled with interrupts enabled.  So unlike text mode, a call
+ *  made from an interrupt while another call is in progress is not lost;
+ *  it just takes the next record.  Only the record itself (and the
+ *  sequence number) are flushed from the d-cache.
+ */
+static int
+mtRecord(char *fmt, va_list argp)
+{
+    int     i, nargs;
+    ulong   sno, ints;
+    struct  mtRec *rp;
+
+    ints = intsoff();
+    sno = Mip->sno;
+    if((Mip->mode & MODE_NOWRAP) && (sno > (ulong)Mip->nrecs)) {
+        Mip->off = 1;
+        intsrestore(ints);
+        return(0);
+    }
+    Mip->sno = sno + 1;
+    intsrestore(ints);
+
+    rp = &Mip->recs[(sno - 1) & (Mip->nrecs - 1)];
+    rp->sno = 0;
+#if INCLUDE_HWTMR
+    rp->tstamp = target_timer();
+#else
+    rp->tstamp = 0;
+#endif
+
+    /* Only pull as many args as the format string takes.  If it can't
+     * be recorded, the record says so (rather than holding arguments
+     * that the dump would format wrongly)...
+     */
+    if((nargs = mtArgs(fmt)) < 0) {
+        rp->fmt = "mtrace: can't record \"%s\"";
+        rp->args[0] = (ulong)fmt;
+    } else {
+        rp->fmt = fmt;
+        for(i=0; i<nargs; i++) {
+            rp->args[i] = va_arg(argp,ulong);
+        }
+    }
+    rp->sno = sno;
+
+    if(Mip->mode & MODE_PRINT) {
+        char    line[MAXLINSIZE];
+
+        mtFormat(line,sizeof(line),rp);
+        printf("%s\n",line);
+    }
+
+    flushDcache((char *)rp,sizeof(struct mtRec));
+    flushDcache((char *)&Mip->sno,sizeof(Mip->sno));
+    return(sizeof(struct mtRec));
+}
+
 int
 Mtrace(char *fmt,...)
 {
     static  int inMtraceNow;
     int len;
-    char *eolp;
+    char *start, *eolp, *cp;
     va_list argp;
 
     /* Mtrace not configured or disabled, so just return.
@@ -104,6 +273,13 @@ Mtrace(char *fmt,...)
         return(0);
     }
 
+    if(Mip->mode & MODE_BINARY) {
+        va_start(argp,fmt);
+        len = mtRecord(fmt,argp);
+        va_end(argp);
+        return(len);
+    }
+
     /* This may be called from interrupt and/or non-interrupt space of
      * an application, so we must deal with possible reentrancy here.
      */
@@ -114,6 +290,7 @@ Mtrace(char *fmt,...)
 
     inMtraceNow = 1;
 
+    start = Mip->ptr;
     Mip->ptr += snprintf(Mip->ptr,MAXLINSIZE,"\n<%04d> ",Mip->sno++);
 
     va_start(argp,fmt);
@@ -127,15 +304,13 @@ Mtrace(char *fmt,...)
      * of the sequence number; hence, additional CR/LFs in the text would
      * just confuse the output.
      */
-    eolp = Mip->ptr;
-    while(*eolp) {
-        if((*eolp == '\r') || (*eolp == '\n')) {
-            strcpy(eolp,eolp+1);
-            len--;
-        } else {
-            eolp++;
+    for(eolp = cp = Mip->ptr; *cp; cp++) {
+        if((*cp != '\r') && (*cp != '\n')) {
+            *eolp++ = *cp;
         }
     }
+    *eolp = 0;
+    len = eolp - Mip->ptr;
 
     /* If print flag is set, then dump to the console...
      */
@@ -149,6 +324,15 @@ Mtrace(char *fmt,...)
         Mip->ptr += len;
     }
 
+    /* Flush the d-cache of the Mip structure and the part of the mtrace
+     * buffer written by this call...
+     * This is important because if this is being accessed from an
+     * application that has d-cache enabled, then the hardware is reset,
+     * there is a chance that the data written was in cache and would be
+     * lost.
+     */
+    flushDcache((char *)start,Mip->ptr - start + 1);
+
     if(Mip->ptr >= Mip->end) {
         Mip->ptr = Mip->base;
         if(Mip->mode & MODE_NOWRAP) {
@@ -157,16 +341,7 @@ Mtrace(char *fmt,...)
             Mip->wrap++;
         }
     }
-
-    /* Flush the d-cache of the mtrace buffer and Mip structure after each
-     * transfer...
-     * This is important because if this is being accessed from an
-     * application that has d-cache enabled, then the hardware is reset,
-     * there is a chance that the data written was in cache and would be
-     * lost.
-     */
     flushDcache((char *)Mip,sizeof(struct mtInfo));
-    flushDcache((char *)Mip->base,Mip->end - Mip->base);
 
     inMtraceNow = 0;
     return(len);
@@ -179,7 +354,7 @@ MtraceReset(void)
     Mip->sno = 1;
     Mip->wrap = 0;
     Mip->off = 0;
-    Mip->mode = 0;
+    Mip->mode &= MODE_BINARY;
     Mip->reentered = 0;
     memset(Mip->base,0,Mip->size-sizeof(struct mtInfo));
 }
@@ -195,9 +370,74 @@ MtraceInit(char *base, int size)
     Mip->base = base + sizeof(struct mtInfo);
     Mip->size = size;
     Mip->end = (Mip->base + size - MAXLINSIZE);
+
+    /* Binary mode uses the same space as a ring of records, rounded
+     * down to a power of 2 so that the ring index is just a mask...
+     */
+    Mip->recs = (struct mtRec *)(((ulong)Mip->base + 7) & ~7);
+    size -= ((char *)Mip->recs - base);
+    for(Mip->nrecs = 1; Mip->nrecs * 2 * (int)sizeof(struct mtRec) <= size;
+            Mip->nrecs *= 2);
+    Mip->mode = 0;
     MtraceReset();
 }
 
+/* mtBinDump():
+ *  Format and print the records in the binary mode ring, oldest first,
+ *  with the time (if INCLUDE_HWTMR) relative to the first one printed.
+ */
+static void
+mtBinDump(int more)
+{
+    int     line;
+    ulong   sno, last, first;
+    char    buf[MAXLINSIZE], *cp;
+    struct  mtRec *rp;
+#if INCLUDE_HWTMR
+    ulong   prevtick;
+    unsigned long long usec, ticks;
+#endif
+
+    last = Mip->sno;
+    first = (last > (ulong)Mip->nrecs) ? last - Mip->nrecs : 1;
+    if(first > 1) {
+        printf("Buffer wrapped...\n");
+    }
+
+    line = 0;
+#if INCLUDE_HWTMR
+    ticks = 0;
+    prevtick = Mip->recs[(first - 1) & (Mip->nrecs - 1)].tstamp;
+#endif
+    for(sno = first; sno < last; sno++) {
+        rp = &Mip->recs[(sno - 1) & (Mip->nrecs - 1)];
+        if(rp->sno != sno) {
+            continue;
+        }
+        mtFormat(buf,sizeof(buf),rp);
+        for(cp = buf; *cp; cp++) {
+            if((*cp == '\r') || (*cp == '\n')) {
+                *cp = ' ';
+            }
+        }
+#if INCLUDE_HWTMR
+        ticks += (rp->tstamp - prevtick);
+        prevtick = rp->tstamp;
+        usec = (ticks * 1000) / TIMER_TICKS_PER_MSEC;
+        printf("\n<%04ld> %6ld.%03ld %s",sno,(ulong)(usec/1000),
+               (ulong)(usec%1000),buf);
+#else
+        printf("\n<%04ld> %s",sno,buf);
+#endif
+        if(more && (++line == 24)) {
+            line = 0;
+            if(!More()) {
+                return;
+            }
+        }
+    }
+}
+
 char *
 mDump(char *bp, int more)
 {
@@ -247,9 +487,10 @@ MipConfigured(void)
 
 char *MtraceHelp[] = {
     "Configure/Dump memory trace.",
-    "-[nm] {cmd} [cmd specific args]",
+    "-[bnm] {cmd} [cmd specific args]",
 #if INCLUDE_VERBOSEHELP
     "Options:",
+    " -b  binary mode (with cfg).",
     " -m  enable 'more' flag for dump.",
     " -n  disable wrapping.",
     "Cmd:",
@@ -269,12 +510,16 @@ int
 MtraceCmd(int argc,char *argv[])
 {
     char    *bp;
-    int     more, opt, nowrap;
+    int     more, opt, nowrap, binary;
 
     more = 0;
     nowrap = 0;
-    while((opt=getopt(argc,argv,"nm")) != -1) {
+    binary = 0;
+    while((opt=getopt(argc,argv,"bnm")) != -1) {
         switch(opt) {
+        case 'b':
+            binary = 1;
+            break;
         case 'n':
             nowrap = 1;
             break;
@@ -294,15 +539,28 @@ MtraceCmd(int argc,char *argv[])
         if(argc == optind + 3) {
             MtraceInit((char *)strtoul(argv[optind+1],0,0),
                        strtoul(argv[optind+2],0,0));
+            if(!Mip) {
+                return(CMD_FAILURE);
+            }
             if(nowrap) {
                 Mip->mode |= MODE_NOWRAP;
             }
+            if(binary) {
+                Mip->mode |= MODE_BINARY;
+            }
         } else if(argc == optind + 1) {
             if(MipConfigured()) {
-                printf("Base: 0x%lx, End: 0x%lx\n",
-                       (ulong)Mip->base,(ulong)Mip->end);
-                printf("Ptr:  0x%lx, Sno: %d\n",(ulong)Mip->ptr,Mip->sno);
-                printf("Wrap: %d\n",Mip->wrap);
+                if(Mip->mode & MODE_BINARY) {
+                    printf("Recs: 0x%lx, Nrecs: %d (%d bytes each)\n",
+                           (ulong)Mip->recs,Mip->nrecs,sizeof(struct mtRec));
+                    printf("Sno:  %d\n",Mip->sno);
+                    printf("Wrap: %d\n",(Mip->sno - 1) / Mip->nrecs);
+                } else {
+                    printf("Base: 0x%lx, End: 0x%lx\n",
+                           (ulong)Mip->base,(ulong)Mip->end);
+                    printf("Ptr:  0x%lx, Sno: %d\n",(ulong)Mip->ptr,Mip->sno);
+                    printf("Wrap: %d\n",Mip->wrap);
+                }
             }
         } else {
             return(CMD_PARAM_ERROR);
@@ -340,7 +598,9 @@ MtraceCmd(int argc,char *argv[])
             if(Mip->reentered) {
                 printf("Reentry count: %d\n",Mip->reentered);
             }
-            if(Mip->wrap) {
+            if(Mip->mode & MODE_BINARY) {
+                mtBinDump(more);
+            } else if(Mip->wrap) {
                 printf("Buffer wrapped...\n");
                 bp =  Mip->ptr;
                 while(bp < Mip->end) {
@@ -477,6 +477,62 @@ monWatchDog(void)
 #endif
 }
 
+/* strhash() & hashprobe():
+ * The open-addressed (linear probing) hash tables that index things by
+ * name (shell variables, commands, script tags, symbols and structure
+ * definitions) share these.  strhash() is the djb2 hash (xor variant)
+ * of the first 'len' characters of 'str' (all of it if len is -1).
+ * hashprobe() walks the table of 'size' slots from the slot of 'hash'
+ * and calls slot(idx,arg) for each slot, which says what is there
+ * (HASH_EMPTY, HASH_MATCH, HASH_OTHER or HASH_DELETED, see genlib.h).
+ * It returns the index of the matching slot, or -1 if the key isn't
+ * in the table; if 'freeslot' is non-null it is loaded with the first
+ * empty or deleted slot seen (where the key could be added), or -1.
+ */
+ulong
+strhash(char *str, int len)
+{
+    ulong   hash;
+
+    hash = 5381;
+    while(len-- && *str) {
+        hash = (hash * 33) ^ (uchar)*str++;
+    }
+    return(hash);
+}
+
+int
+hashprobe(ulong hash, int size, int (*slot)(int, void *), void *arg,
+          int *freeslot)
+{
+    int     i, idx;
+
+    if(freeslot) {
+        *freeslot = -1;
+    }
+    idx = hash % size;
+    for(i=0; i<size; i++) {
+        switch(slot(idx,arg)) {
+        case HASH_MATCH:
+            return(idx);
+        case HASH_EMPTY:
+            if(freeslot && (*freeslot == -1)) {
+                *freeslot = idx;
+            }
+            return(-1);
+        case HASH_DELETED:
+            if(freeslot && (*freeslot == -1)) {
+                *freeslot = idx;
+            }
+            break;
+        }
+        if(++idx == size) {
+            idx = 0;
+        }
+    }
+    return(-1);
+}
+
 #if INCLUDE_SHELLVARS
 
 /* putargv() & getargv():
@@ -138,6 +138,12 @@ moncom(int cmd, void *arg1, void *arg2, void *arg3)
 #if !INCLUDE_ETHERVERBOSE
     case GETMONFUNC_PRINTPKT:
 #endif
+#if !INCLUDE_SYSLOG
+    case GETMONFUNC_SYSLOG:
+#endif
+#if !INCLUDE_BOOTTIME
+    case GETMONFUNC_BOOTMARK:
+#endif
 #if !INCLUDE_FLASH
     case GETMONFUNC_FLASHWRITE:
     case GETMONFUNC_FLASHERASE:
@@ -275,6 +281,16 @@ moncom(int cmd, void *arg1, void *arg2, void *arg3)
         *(unsigned long *)arg1 = (unsigned long)AppPrintPkt;
         break;
 #endif
+#if INCLUDE_SYSLOG
+    case GETMONFUNC_SYSLOG:
+        *(unsigned long *)arg1 = (unsigned long)syslogEnqueue;
+        break;
+#endif
+#if INCLUDE_BOOTTIME
+    case GETMONFUNC_BOOTMARK:
+        *(unsigned long *)arg1 = (unsigned long)bootmark;
+        break;
+#endif
 #if INCLUDE_FLASH
     case GETMONFUNC_FLASHOVRRD:
         *(unsigned long *)arg1 = (unsigned long)FlashOpOverride;
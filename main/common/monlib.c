@@ -83,6 +83,8 @@ static int (*_setenv)(char *,char *);
 static int (*_watchdog)(void);
 static int (*_timeofday)(int,void *);
 static int (*_montimer)(int cmd, void *arg);
+static int (*_syslog)(int,char *);
+static int (*_bootmark)(char *);
 
 static char     *(*_getenv)(char *);
 static char     *(*_version)(void);
@@ -278,6 +280,8 @@ monConnect(int (*mon)(int,void *,void *,void *),
         rc += _moncom(GETMONFUNC_TIMEOFDAY,&_timeofday,0,0);
         rc += _moncom(GETMONFUNC_TIMER,&_montimer,0,0);
         rc += _moncom(GETMONFUNC_FLASHOVRRD,&_flashoverride,0,0);
+        rc += _moncom(GETMONFUNC_SYSLOG,&_syslog,0,0);
+        rc += _moncom(GETMONFUNC_BOOTMARK,&_bootmark,0,0);
     }
     return(rc);
 }
@@ -1131,3 +1135,35 @@ mon_timeofday(int cmd, void *arg)
     GENERIC_MONUNLOCK();
     return(ret);
 }
+
+/* mon_syslog():
+ * Queue a message on the monitor's buffered syslog channel.  This does
+ * not block; the message is sent later by the monitor's ethernet
+ * polling.  Return 0 if queued, else -1 (queue full, message dropped).
+ */
+int
+mon_syslog(int priority, char *msg)
+{
+    int ret;
+
+    GENERIC_MONLOCK();
+    ret = _syslog(priority,msg);
+    GENERIC_MONUNLOCK();
+    return(ret);
+}
+
+/* mon_bootmark():
+ * Add a named checkpoint to the monitor's boot timeline (see the
+ * boottime command), so that the application's own startup phases
+ * show up after the monitor's.  Return 0 if recorded, else -1.
+ */
+int
+mon_bootmark(char *name)
+{
+    int ret;
+
+    GENERIC_MONLOCK();
+    ret = _bootmark(name);
+    GENERIC_MONUNLOCK();
+    return(ret);
+}
@@ -98,6 +98,8 @@ extern int mon_flashwrite(char *dest,char *src, int bytecnt);
 extern int mon_flashinfo(int snum,int *size, char **base);
 extern int mon_watchdog(void);
 extern int mon_timeofday(int cmd, void *arg);
+extern int mon_syslog(int priority, char *msg);
+extern int mon_bootmark(char *name);
 
 extern char *mon_getsym(char *symname, char *buf, int bufsize);
 extern char *mon_getenv(char *varname);
@@ -227,6 +229,8 @@ extern int mon_sprintf();
 #define GETMONFUNC_TIMEOFDAY            71
 #define GETMONFUNC_TIMER                72
 #define GETMONFUNC_FLASHOVRRD           73
+#define GETMONFUNC_SYSLOG               74
+#define GETMONFUNC_BOOTMARK             75
 
 #define CACHEFTYPE_DFLUSH               200
 #define CACHEFTYPE_IINVALIDATE          201
@@ -88,17 +88,64 @@
  * in the 'type' member, and the 'tid' member is used...
  * The user initializes with the "prof tinit {count}" command.  The count
  * is the maximum number of unique task ids expected.  The monitor builds
- * another table and as each tid comes in through mon_profiler, if this is
- * the first time mon_profiler() is being called with the specific incoming
- * tid value, then it is added to the list of pdata structures and the pass
- * count is set to 1; otherwise if it has already been logged, only the
- * pass count is incremented.
+ * another table (a hash table twice that size) and as each tid comes in
+ * through mon_profiler, if this is the first time mon_profiler() is being
+ * called with the specific incoming tid value, then it is added to the
+ * table and the pass count is set to 1; otherwise if it has already been
+ * logged, only the pass count is incremented.
  *
  *    Example setup:
  *      prof init           # Initialize internals.
  *      prof tidcfg 16      # Configure tid logging for 16 unique tids.
  *      prof on             # Enable profiling.
  *
+ * CALL GRAPH LOGGING:
+ * With the MONPROF_CGLOG flag set, the 'fp' member of the incoming
+ * structure is assumed to be the frame pointer of the interrupted code.
+ * The profiler walks the frames (the same way as strace) to capture the
+ * call stack, up to PROF_MAXDEPTH deep, and counts each unique stack in
+ * a hash table.  If the function table is configured, each address is
+ * reduced to the start of its function first, so that stacks that only
+ * differ by call site within a function are counted together.
+ * The stacks can be written to a TFS file in the "folded" format used
+ * by flame graph tools (one "outer;...;leaf count" line per stack) with
+ * "prof fold {file}".
+ * Since this runs in the application's tick handler, the walk and the
+ * table insert are bounded (PROF_MAXDEPTH frames, PROF_MAXPROBE probes);
+ * stacks that don't fit are just counted as overflow.
+ *
+ *    Example setup:
+ *      prof init           # Initialize internals.
+ *      prof funccfg        # Optional, reduce addresses to functions.
+ *      prof cgcfg 256      # Configure call graph logging for 256 stacks.
+ *      prof on             # Enable profiling.
+ *      ...
+ *      prof fold prof.fold # Write the stacks to TFS.
+ *
+ * MONITOR-DRIVEN SAMPLING:
+ * All of the above relies on the application calling mon_profiler()
+ * from its own tick.  On targets with a hardware timer (INCLUDE_HWTMR)
+ * the port can instead provide a sampling timer: config.h defines
+ * PROF_SAMPLE_TIMER as the name of a function, int func(int hz), that
+ * starts (hz > 0) or stops (hz == 0) a periodic interrupt whose handler
+ * calls prof_sample() with the interrupted pc and frame pointer.
+ * prof_sample() logs into whichever of the function, pc and call graph
+ * tables are configured, and keeps track of the sample rate and of the
+ * time spent in the profiler, so "prof rate" can report samples per
+ * second and the overhead (the interrupt entry/exit itself is not
+ * included).
+ * Without a sampling timer (or to check the cost of a configuration
+ * before using it), "prof simulate {count}" runs the same path with
+ * synthetic samples spread over the configured text area.
+ *
+ *    Example setup:
+ *      prof init           # Initialize internals.
+ *      prof funccfg        # Configure function logging using symtbl.
+ *      prof sample 1000    # Sample at 1KHz (enables profiling).
+ *      ...
+ *      prof sample 0       # Stop sampling.
+ *      prof rate           # Samples/sec and overhead.
+ *      prof show
  *
  * Original author:     Ed Sutter (ed.sutter@alcatel-lucent.com)
  *
@@ -112,9 +159,16 @@
 #include "cli.h"
 #include "tfs.h"
 #include "tfsprivate.h"
+#include "timer.h"
 
 #define HALF(m) (m >> 1)
 
+#ifndef PROF_MAXDEPTH
+#define PROF_MAXDEPTH   16
+#endif
+
+#define PROF_MAXPROBE   8       /* Limit on hash table probes per hit */
+
 /* pdata:
  * One of these represents each symbol (or tid) in the profiling session.
  * For MONPROF_FUNCLOG, the data member is the starting address of the symbol
@@ -125,11 +179,24 @@ struct pdata {
     int     pcount;         /* Pass count. */
 };
 
+/* pstack:
+ * One of these represents each unique call stack logged by MONPROF_CGLOG.
+ * The count is set last when the entry is added, so a zero count means
+ * the slot is empty.
+ */
+struct pstack {
+    ulong   hash;
+    int     count;                  /* Pass count. */
+    int     depth;                  /* Number of entries in pc[]. */
+    ulong   pc[PROF_MAXDEPTH];      /* Leaf first. */
+};
+
 static int prof_Enabled;        /* If set, profiler runs; else return. */
 static int prof_BadSymCnt;      /* Number of hits not within a symbol. */
 static int prof_CallCnt;        /* Number of times profiler was called. */
 static int prof_FuncTot;        /* Number of functions being profiled. */
-static int prof_TidTot;         /* Number of TIDs being profiled. */
+static int prof_TidTot;         /* Size of TID hash table. */
+static int prof_TidMax;         /* Number of TIDs being profiled. */
 static int prof_TidTally;       /* Number of unique TIDs logged so far. */
 static int prof_TidOverflow;    /* More TIDs than the table was built for. */
 static int prof_PcTot;          /* Number of instructions being profiled. */
@@ -138,93 +205,182 @@ static int prof_PcWidth;        /* Width (2 or 4) of PC table elements. */
 static int prof_PcOORCnt;       /* Out-of-range hit count for PC profiler */
 static ulong prof_PcTxtEnd;     /* End of .text area being profiled */
 static ulong prof_PcTxtBase;    /* Base of .text area being profiled */
+static int prof_CgTot;          /* Size of call stack hash table. */
+static int prof_CgTally;        /* Number of unique stacks logged so far. */
+static int prof_CgOverflow;     /* Stacks that didn't fit in the table. */
+static int prof_CgTruncated;    /* Stacks deeper than PROF_MAXDEPTH. */
 
 static struct pdata *prof_FuncTbl;
 static struct pdata *prof_TidTbl;
 static uchar  *prof_PcTbl;
+static struct pstack *prof_CgTbl;
+
+#if INCLUDE_HWTMR
+static int prof_SampleHz;       /* Sampling timer rate (0 = stopped). */
+static int prof_SampleType;     /* MONPROF_XXX for each sample. */
+static ulong prof_SampleCnt;    /* Number of samples. */
+static ulong prof_SampleLast;   /* target_timer() at the last sample. */
+static unsigned long long prof_SampleSpan;  /* Ticks between first/last. */
+static unsigned long long prof_SampleCost;  /* Ticks spent in profiler. */
+
+/* The stack frame layout walked by prof_CgLog(): by default the ARM
+ * (APCS) one that strace walks, with the return address at fp-1 and
+ * the caller's fp at fp-3.  A port with a different layout defines
+ * both in config.h.
+ */
+#ifndef PROF_FRAME_PC
+#define PROF_FRAME_PC(fp)       (*((fp) - 1))
+#define PROF_FRAME_NEXT(fp)     (*((fp) - 3))
+#endif
+
+#ifdef PROF_SAMPLE_TIMER
+extern int PROF_SAMPLE_TIMER(int hz);
+#endif
+#endif
 static char prof_SymFile[TFSNAMESIZE+1];
 
-void
-profiler(struct monprof *mpp)
+/* prof_FuncFind():
+ * Binary search of the function table for the function that contains
+ * the address; return null if none does.
+ */
+static struct pdata *
+prof_FuncFind(ulong pc)
 {
     struct pdata *current, *base;
     int nmem;
 
+    nmem = prof_FuncTot;
+    base = prof_FuncTbl;
+    while(nmem) {
+        current = &base[HALF(nmem)];
+        if(pc < current->data) {
+            nmem = HALF(nmem);
+        } else if(pc > current->data) {
+            if(pc < (current+1)->data) {
+                return(current);
+            } else {
+                base = current + 1;
+                nmem = (HALF(nmem)) - (nmem ? 0 : 1);
+            }
+        } else {
+            return(current);
+        }
+    }
+    return((struct pdata *)0);
+}
+
+/* prof_TidHash():
+ * Starting index for the tid in the TID hash table.
+ */
+static int
+prof_TidHash(ulong tid)
+{
+    return((int)((tid * 2654435761UL) >> 8) & (prof_TidTot - 1));
+}
+
+/* prof_CgLog():
+ * Capture the call stack by walking the frame pointer chain from the
+ * incoming fp (see strace), then count it in the stack hash table.
+ * Each frame must be above the previous one on the stack, so a bad
+ * frame pointer can't send the walk around in circles.
+ */
+static void
+prof_CgLog(struct monprof *mpp)
+{
+    ulong   pc[PROF_MAXDEPTH], *fp, *next, hash;
+    int     i, idx, depth, probe;
+    struct  pdata *pdp;
+    struct  pstack *psp;
+
+    pc[0] = mpp->pc;
+    depth = 1;
+    fp = (ulong *)mpp->fp;
+    while(fp && !((ulong)fp & 3)) {
+        if(depth == PROF_MAXDEPTH) {
+            prof_CgTruncated++;
+            break;
+        }
+        if((pc[depth] = PROF_FRAME_PC(fp)) == 0) {
+            break;
+        }
+        depth++;
+        next = (ulong *)PROF_FRAME_NEXT(fp);
+        if(next <= fp) {
+            break;
+        }
+        fp = next;
+    }
+
+    hash = 5381;
+    for(i=0; i<depth; i++) {
+        if(prof_FuncTbl && ((pdp = prof_FuncFind(pc[i])) != 0)) {
+            pc[i] = pdp->data;
+        }
+        hash = (hash * 33) ^ pc[i];
+    }
+
+    idx = hash & (prof_CgTot - 1);
+    for(probe=0; probe<PROF_MAXPROBE; probe++) {
+        psp = &prof_CgTbl[idx];
+        if(psp->count == 0) {
+            psp->hash = hash;
+            psp->depth = depth;
+            memcpy((char *)psp->pc,(char *)pc,depth * sizeof(ulong));
+            psp->count = 1;
+            prof_CgTally++;
+            return;
+        }
+        if((psp->hash == hash) && (psp->depth == depth) &&
+                (memcmp((char *)psp->pc,(char *)pc,depth*sizeof(ulong)) == 0)) {
+            psp->count++;
+            return;
+        }
+        idx = (idx + 1) & (prof_CgTot - 1);
+    }
+    prof_CgOverflow++;
+}
+
+void
+profiler(struct monprof *mpp)
+{
+    struct pdata *current;
+    int idx, probe;
+
     if(prof_Enabled == 0) {
         return;
     }
 
     if(mpp->type & MONPROF_FUNCLOG) {
-        nmem = prof_FuncTot;
-        base = prof_FuncTbl;
-        while(nmem) {
-            current = &base[HALF(nmem)];
-            if(mpp->pc < current->data) {
-                nmem = HALF(nmem);
-            } else if(mpp->pc > current->data) {
-                if(mpp->pc < (current+1)->data) {
-                    current->pcount++;
-                    goto tidlog;
-                } else {
-                    base = current + 1;
-                    nmem = (HALF(nmem)) - (nmem ? 0 : 1);
-                }
-            } else {
-                current->pcount++;
-                goto tidlog;
-            }
+        if((current = prof_FuncFind(mpp->pc)) != 0) {
+            current->pcount++;
+        } else {
+            prof_BadSymCnt++;
         }
-        prof_BadSymCnt++;
     }
-tidlog:
-    if(mpp->type & MONPROF_TIDLOG) {
-        /* First see if the tid is already in the table.  If it is,
-         * increment the pcount.  If it isn't add it to the table.
-         */
-        nmem = prof_TidTally;
-        base = prof_TidTbl;
-        while(nmem) {
-            current = &base[HALF(nmem)];
-            if(mpp->tid < current->data) {
-                nmem = HALF(nmem);
-            } else if(mpp->tid > current->data) {
-                base = current + 1;
-                nmem = (HALF(nmem)) - (nmem ? 0 : 1);
-            } else {
-                current->pcount++;
-                goto pclog;
-            }
-        }
-        /* Since we got here, the tid must not be in the table, so
-         * do an insertion into the table.  Items are in the table in
-         * ascending order.
+
+    if((mpp->type & MONPROF_TIDLOG) && prof_TidTbl) {
+        /* Look for the tid in the hash table.  If it is there,
+         * increment the pcount; else add it in the first empty slot.
          */
-        if(prof_TidTally == 0) {
-            prof_TidTbl->pcount = 1;
-            prof_TidTbl->data = mpp->tid;
-            prof_TidTally++;
-        } else if(prof_TidTally >= prof_TidTot) {
-            prof_TidOverflow++;
-        } else {
-            current = prof_TidTbl + prof_TidTally - 1;
-            while(current >= prof_TidTbl) {
-                if(mpp->tid > current->data) {
-                    current++;
-                    current->pcount = 1;
-                    current->data = mpp->tid;
+        idx = prof_TidHash(mpp->tid);
+        for(probe=0; probe<PROF_MAXPROBE; probe++) {
+            current = &prof_TidTbl[idx];
+            if(current->pcount == 0) {
+                if(prof_TidTally >= prof_TidMax) {
                     break;
-                } else {
-                    *(current+1) = *current;
-                    if(current == prof_TidTbl) {
-                        current->pcount = 1;
-                        current->data = mpp->tid;
-                        break;
-                    }
                 }
-                current--;
+                current->data = mpp->tid;
+                current->pcount = 1;
+                prof_TidTally++;
+                goto pclog;
+            }
+            if(current->data == mpp->tid) {
+                current->pcount++;
+                goto pclog;
             }
-            prof_TidTally++;
+            idx = (idx + 1) & (prof_TidTot - 1);
         }
+        prof_TidOverflow++;
     }
 pclog:
     if(mpp->type & MONPROF_PCLOG) {
@@ -244,10 +400,178 @@ pclog:
             }
         }
     }
+    if((mpp->type & MONPROF_CGLOG) && prof_CgTbl) {
+        prof_CgLog(mpp);
+    }
     prof_CallCnt++;
     return;
 }
 
+#if INCLUDE_HWTMR
+/* prof_sample():
+ * Entry point for the port's sampling timer interrupt.  Other than
+ * profiler() itself, this just keeps the timestamps needed for the rate
+ * and overhead numbers.  Samples are at least a timer interrupt apart,
+ * so the 32-bit timer can't wrap between two of them.
+ */
+void
+prof_sample(ulong pc, ulong fp)
+{
+    ulong   now;
+    struct  monprof mp;
+
+    now = target_timer();
+    if(prof_SampleCnt) {
+        prof_SampleSpan += (now - prof_SampleLast);
+    }
+    prof_SampleLast = now;
+
+    mp.type = prof_SampleType;
+    mp.pc = pc;
+    mp.tid = 0;
+    mp.fp = fp;
+    profiler(&mp);
+
+    prof_SampleCnt++;
+    prof_SampleCost += (target_timer() - now);
+}
+
+/* prof_SampleSetup():
+ * Clear the sampling stats and pick the sample type based on the
+ * tables that are configured.  Return -1 if there are none.
+ */
+static int
+prof_SampleSetup(void)
+{
+    prof_SampleType = 0;
+    if(prof_FuncTbl) {
+        prof_SampleType |= MONPROF_FUNCLOG;
+    }
+    if(prof_PcTbl) {
+        prof_SampleType |= MONPROF_PCLOG;
+    }
+    if(prof_CgTbl) {
+        prof_SampleType |= MONPROF_CGLOG;
+    }
+    if(prof_SampleType == 0) {
+        printf("Configure funccfg, pccfg or cgcfg first\n");
+        return(-1);
+    }
+    prof_SampleCnt = 0;
+    prof_SampleSpan = prof_SampleCost = 0;
+    return(0);
+}
+
+/* prof_SampleStart():
+ * Start (hz > 0) or stop (hz == 0) the port's sampling timer.
+ */
+static int
+prof_SampleStart(int hz)
+{
+#ifdef PROF_SAMPLE_TIMER
+    if(hz == 0) {
+        PROF_SAMPLE_TIMER(0);
+        prof_SampleHz = 0;
+        return(0);
+    }
+    if(prof_SampleHz) {
+        printf("Already sampling, stop with \"prof sample 0\"\n");
+        return(-1);
+    }
+    if(prof_SampleSetup() < 0) {
+        return(-1);
+    }
+    prof_Enabled = 1;
+    if(PROF_SAMPLE_TIMER(hz) < 0) {
+        printf("Can't sample at %dHz\n",hz);
+        return(-1);
+    }
+    prof_SampleHz = hz;
+    return(0);
+#else
+    printf("No sampling timer on this target, see prof simulate\n");
+    return(-1);
+#endif
+}
+
+/* prof_SampleRate():
+ * Report the measured sample rate and profiler overhead, and store them
+ * in shell variables PROF_SPS (samples/sec), PROF_COST (usec/sample)
+ * and PROF_OVERHEAD (percent of cpu, to two decimal places).
+ */
+static void
+prof_SampleRate(void)
+{
+    ulong   sps, cost, ovhd;
+
+    if((prof_SampleCnt < 2) || (prof_SampleSpan == 0)) {
+        printf("Not enough samples\n");
+        return;
+    }
+    sps = (ulong)(((unsigned long long)(prof_SampleCnt - 1) * 1000 *
+                   TIMER_TICKS_PER_MSEC) / prof_SampleSpan);
+    cost = (ulong)((prof_SampleCost * 1000) /
+                   ((unsigned long long)prof_SampleCnt * TIMER_TICKS_PER_MSEC));
+    ovhd = (ulong)((prof_SampleCost * 10000) / prof_SampleSpan);
+
+    printf("Samples: %ld over %ld msec (%ld/sec",prof_SampleCnt,
+           (ulong)(prof_SampleSpan / TIMER_TICKS_PER_MSEC),sps);
+    if(prof_SampleHz) {
+        printf(", configured %d",prof_SampleHz);
+    }
+    printf(")\nCost:    %ld usec/sample, %ld.%02ld%% overhead\n",
+           cost,ovhd/100,ovhd%100);
+
+    shell_sprintf("PROF_SPS","%ld",sps);
+    shell_sprintf("PROF_COST","%ld",cost);
+    shell_sprintf("PROF_OVERHEAD","%ld.%02ld",ovhd/100,ovhd%100);
+}
+
+/* prof_Simulate():
+ * Feed 'count' synthetic samples through prof_sample() back to back;
+ * the pcs step through the function table (or the pc profiler's text
+ * area).  This exercises the sampling path without a sampling timer,
+ * and gives the cost per sample for the current configuration, which
+ * is reported as the overhead it would have at 'hz'.
+ */
+static int
+prof_Simulate(int count, int hz)
+{
+    int     i;
+    ulong   pc, cost, ovhd;
+
+    if(prof_SampleHz) {
+        printf("Stop sampling first\n");
+        return(-1);
+    }
+    if(prof_SampleSetup() < 0) {
+        return(-1);
+    }
+    prof_Enabled = 1;
+    for(i=0; i<count; i++) {
+        if(prof_FuncTbl && (prof_FuncTot > 1)) {
+            pc = prof_FuncTbl[i % (prof_FuncTot - 1)].data;
+        } else if(prof_PcTbl) {
+            pc = prof_PcTxtBase +
+                 ((i * 7919) % prof_PcTot) * prof_PcWidth;
+        } else {
+            pc = (ulong)i << 2;
+        }
+        prof_sample(pc,0);
+    }
+    if(count == 0) {
+        return(0);
+    }
+    cost = (ulong)((prof_SampleCost * 1000000) /
+                   ((unsigned long long)count * TIMER_TICKS_PER_MSEC));
+    ovhd = (cost * hz) / 100000;
+    printf("%d samples, %ld.%03ld usec/sample, ",
+           count,cost/1000,cost%1000);
+    printf("%ld.%02ld%% overhead at %dHz\n",ovhd/100,ovhd%100,hz);
+    return(0);
+}
+#endif
+
 int
 prof_GetSymFile(void)
 {
@@ -264,13 +588,161 @@ prof_GetSymFile(void)
     return(tfd);
 }
 
+/* prof_TblEnd():
+ * Return the first (aligned) address after the tables configured so
+ * far, or the start of application ram if none are.
+ */
+static ulong
+prof_TblEnd(void)
+{
+    ulong end, tmp;
+
+    end = 0;
+    if(prof_FuncTbl) {
+        tmp = (ulong)&prof_FuncTbl[prof_FuncTot];
+        if(tmp > end) {
+            end = tmp;
+        }
+    }
+    if(prof_TidTbl) {
+        tmp = (ulong)&prof_TidTbl[prof_TidTot];
+        if(tmp > end) {
+            end = tmp;
+        }
+    }
+    if(prof_PcTbl) {
+        tmp = (ulong)prof_PcTbl + (prof_PcTot * prof_PcWidth);
+        if(tmp > end) {
+            end = tmp;
+        }
+    }
+    if(prof_CgTbl) {
+        tmp = (ulong)&prof_CgTbl[prof_CgTot];
+        if(tmp > end) {
+            end = tmp;
+        }
+    }
+    if(end == 0) {
+        return(getAppRamStart());
+    }
+    return((end + 3) & ~3);
+}
+
+/* prof_Pow2():
+ * Smallest power of 2 that is at least 'min'.
+ */
+static int
+prof_Pow2(int min)
+{
+    int size;
+
+    for(size=8; size<min; size <<= 1);
+    return(size);
+}
+
+/* prof_StackLine():
+ * Format one logged stack as "outer;...;leaf count\n" (the folded
+ * format) into 'line' and return its length.
+ */
+static int
+prof_StackLine(int tfd, struct pstack *psp, char *line)
+{
+    int     i, len;
+    ulong   notused;
+    char    symname[96];
+
+    len = 0;
+    for(i=psp->depth-1; i>=0; i--) {
+        if((tfd < 0) ||
+                (AddrToSym(tfd,psp->pc[i],symname,&notused) == 0)) {
+            sprintf(symname,"0x%lx",psp->pc[i]);
+        }
+        len += sprintf(line+len,"%s%c",symname,i ? ';' : ' ');
+    }
+    len += sprintf(line+len,"%d\n",psp->count);
+    return(len);
+}
+
+/* prof_Fold():
+ * Write all logged stacks to the TFS file in folded format.  The
+ * buffer is sized in a first pass, then filled in a second; if
+ * 'address' is non-zero it is used as the buffer.
+ */
+static int
+prof_Fold(char *fname, ulong address)
+{
+    int     i, tfd, err, len, size;
+    char    *buf, line[PROF_MAXDEPTH*96+16];
+
+    if(!prof_CgTbl) {
+        printf("Call graph profiling not configured\n");
+        return(-1);
+    }
+    tfd = prof_GetSymFile();
+    size = 0;
+    for(i=0; i<prof_CgTot; i++) {
+        if(prof_CgTbl[i].count) {
+            size += prof_StackLine(tfd,&prof_CgTbl[i],line);
+        }
+    }
+    if(address) {
+        buf = (char *)address;
+    } else {
+#if INCLUDE_MALLOC
+        if((buf = malloc(size+1)) == 0) {
+            printf("Can't allocate %d bytes\n",size+1);
+            err = -1;
+            goto done;
+        }
+#else
+        printf("Need -a for buffer address\n");
+        err = -1;
+        goto done;
+#endif
+    }
+
+    /* The profiler may still be running, so the second pass
+     * can't run past the size computed by the first.
+     */
+    len = 0;
+    for(i=0; i<prof_CgTot; i++) {
+        if(prof_CgTbl[i].count) {
+            err = prof_StackLine(tfd,&prof_CgTbl[i],line);
+            if(len + err > size) {
+                break;
+            }
+            memcpy(buf+len,line,err);
+            len += err;
+        }
+    }
+
+    tfsunlink(fname);
+    err = tfsadd(fname,"prof_fold",0,(unsigned char *)buf,len);
+    if(err != TFS_OKAY) {
+        printf("%s: %s\n",fname,(char *)tfsctrl(TFS_ERRMSG,err,0));
+        err = -1;
+    } else {
+        err = 0;
+    }
+#if INCLUDE_MALLOC
+    if(!address) {
+        free(buf);
+    }
+#endif
+done:
+    if(tfd >= 0) {
+        tfsclose(tfd,0);
+    }
+    return(err);
+}
+
 void
 prof_ShowStats(int minhit, int more)
 {
-    int     i, tfd, linecount;
-    ulong   notused;
+    int     i, n, tfd, linecount;
+    ulong   notused, last;
     char    symname[64];
-    struct  pdata   *pptr;
+    struct  pdata   *pptr, *tptr;
 
     printf("FuncCount Cfg: tbl: 0x%08lx, size: 0x%x\n",
            (ulong)prof_FuncTbl, prof_FuncTot);
@@ -278,6 +750,8 @@ prof_ShowStats(int minhit, int more)
            (ulong)prof_TidTbl, prof_TidTot);
     printf("PcCount   Cfg: tbl: 0x%08lx, size: 0x%x\n",
            (ulong)prof_PcTbl, prof_PcTot*prof_PcWidth);
+    printf("CallGraph Cfg: tbl: 0x%08lx, size: 0x%x\n",
+           (ulong)prof_CgTbl, prof_CgTot);
 
     if(prof_CallCnt == 0) {
         printf("No data collected%s",
@@ -308,9 +782,26 @@ prof_ShowStats(int minhit, int more)
         }
     }
     if((prof_TidTbl) && (prof_TidTot > 0)) {
+        /* The hash table isn't ordered, so pick each tid in
+         * ascending order...
+         */
         printf("\nTID_PROF stats:\n");
-        pptr = prof_TidTbl;
-        for(i=0; i<prof_TidTot; pptr++,i++) {
+        last = 0;
+        for(n=0; n<prof_TidTally; n++) {
+            pptr = (struct pdata *)0;
+            for(i=0; i<prof_TidTot; i++) {
+                tptr = &prof_TidTbl[i];
+                if((tptr->pcount == 0) || (n && (tptr->data <= last))) {
+                    continue;
+                }
+                if(!pptr || (tptr->data < pptr->data)) {
+                    pptr = tptr;
+                }
+            }
+            if(!pptr) {
+                break;
+            }
+            last = pptr->data;
             if(pptr->pcount < minhit) {
                 continue;
             }
@@ -357,6 +848,25 @@ prof_ShowStats(int minhit, int more)
             }
         }
     }
+    if(prof_CgTbl) {
+        char line[PROF_MAXDEPTH*96+16];
+
+        printf("\nCG_PROF stats:\n");
+        for(i=0; i<prof_CgTot; i++) {
+            if((prof_CgTbl[i].count == 0) ||
+                    (prof_CgTbl[i].count < minhit)) {
+                continue;
+            }
+            prof_StackLine(tfd,&prof_CgTbl[i],line);
+            printf(" %s",line);
+            if((more) && (++linecount >= more)) {
+                linecount = 0;
+                if(More() == 0) {
+                    goto showdone;
+                }
+            }
+        }
+    }
 showdone:
     putchar('\n');
     if(prof_BadSymCnt) {
@@ -368,6 +878,16 @@ showdone:
     if(prof_PcOORCnt) {
         printf("%d pc out-of-range hits\n",prof_PcOORCnt);
     }
+    if(prof_CgTbl) {
+        printf("%d unique stacks\n",prof_CgTally);
+    }
+    if(prof_CgOverflow) {
+        printf("%d stack overflow attempts\n",prof_CgOverflow);
+    }
+    if(prof_CgTruncated) {
+        printf("%d stacks truncated at %d frames\n",prof_CgTruncated,
+               PROF_MAXDEPTH);
+    }
     printf("%d total profiler calls\n",prof_CallCnt);
 
     if(tfd >= 0) {
@@ -435,7 +955,7 @@ prof_FuncConfig(void)
 
 char *ProfHelp[] = {
     "Profiler configuration and result display",
-    "-[h:m:s:] [operation] [op-specific args]",
+    "-[a:h:m:r:s:] [operation] [op-specific args]",
 #if INCLUDE_VERBOSEHELP
     "Operations:",
     " on                  enable profiler",
@@ -443,15 +963,26 @@ char *ProfHelp[] = {
     " show                dump stats",
     " init                clear internal tables and runtime stats",
     " call {type pc tid}  call profiler from CLI",
-    "                     ('type' can be any combination of 't', 'f' & 'p')",
+    "                     ('type' can be any combination of 't', 'f', 'p'",
+    "                     & 'g'; 'g' logs the single frame at pc)",
     " restart             clear runtime stats only",
     " tidcfg {tidtot}     init tid profiler based on number of task ids",
     " funccfg             init function profiler from symtbl file",
     " pccfg {wid add siz} init pc profiler with instruction width (2 or 4)",
     "                     plus size and addr of text area",
+    " cgcfg {stacktot}    init call graph profiler for stacktot unique stacks",
+    " fold {file}         write call graph stacks to file in folded format",
+#if INCLUDE_HWTMR
+    " sample {hz}         start sampling timer at hz (0 to stop)",
+    " rate                show/store sample rate and profiler overhead",
+    " simulate {count}    run count synthetic samples, show cost per sample",
+#endif
     "",
     "Options:",
-    " -a{#}        address to use for table",
+    " -a{#}        address to use for table (or fold buffer)",
+#if INCLUDE_HWTMR
+    " -r{hz}       rate assumed by simulate (default 1000)",
+#endif
     " -h{#}        minimum hit count for show",
     " -m{#}        line count for output throttling in show",
     " -s{symfile}  use this file for symbols instead of default",
@@ -464,13 +995,14 @@ Prof(int argc,char *argv[])
 {
     char    *arg1, *arg2, *arg3, *arg4;
     ulong   address;
-    int     i, opt, minhit, ret, more;
+    int     i, opt, minhit, ret, more, hz;
 
     ret = CMD_SUCCESS;
     minhit = 1;
     more = 0;
     address = 0;
-    while((opt=getopt(argc,argv,"a:h:m:s:")) != -1) {
+    hz = 1000;
+    while((opt=getopt(argc,argv,"a:h:m:r:s:")) != -1) {
         switch(opt) {
         case 'a':
             address = strtoul(optarg,0,0);
@@ -481,6 +1013,9 @@ Prof(int argc,char *argv[])
         case 'm':
             more = atoi(optarg);
             break;
+        case 'r':
+            hz = atoi(optarg);
+            break;
         case 's':
             strncpy(prof_SymFile,optarg,TFSNAMESIZE);
             prof_SymFile[TFSNAMESIZE] = 0;
@@ -502,17 +1037,34 @@ Prof(int argc,char *argv[])
             prof_Enabled = 0;
         } else if(!strcmp(arg1,"show")) {
             prof_ShowStats(minhit, more);
+#if INCLUDE_HWTMR
+        } else if(!strcmp(arg1,"rate")) {
+            prof_SampleRate();
+#endif
         } else if(!strcmp(arg1,"init")) {
+#if INCLUDE_HWTMR
+            if(prof_SampleHz) {
+                prof_SampleStart(0);
+            }
+#endif
             prof_BadSymCnt = 0;
             prof_CallCnt = 0;
             prof_TidTally = 0;
+            prof_TidOverflow = 0;
+            prof_PcOORCnt = 0;
             prof_Enabled = 0;
             prof_FuncTot = 0;
             prof_TidTot = 0;
+            prof_TidMax = 0;
             prof_PcTot = 0;
+            prof_CgTot = 0;
+            prof_CgTally = 0;
+            prof_CgOverflow = 0;
+            prof_CgTruncated = 0;
             prof_FuncTbl = (struct pdata *)0;
             prof_TidTbl = (struct pdata *)0;
             prof_PcTbl = (uchar *)0;
+            prof_CgTbl = (struct pstack *)0;
             prof_PcWidth = 0;
             prof_PcDelta = 0;
             prof_SymFile[0] = 0;
@@ -525,15 +1077,23 @@ Prof(int argc,char *argv[])
                     prof_FuncTbl[i].pcount = 0;
                 }
             }
+            prof_TidOverflow = 0;
+            prof_PcOORCnt = 0;
             if(prof_TidTbl) {
                 for(i=0; i<prof_TidTot; i++) {
+                    prof_TidTbl[i].data = 0;
                     prof_TidTbl[i].pcount = 0;
                 }
-                prof_TidTbl[i].data = 0;
             }
             if(prof_PcTbl) {
                 memset((char *)prof_PcTbl,0,prof_PcTot*prof_PcWidth);
             }
+            prof_CgTally = 0;
+            prof_CgOverflow = 0;
+            prof_CgTruncated = 0;
+            if(prof_CgTbl) {
+                memset((char *)prof_CgTbl,0,prof_CgTot*sizeof(struct pstack));
+            }
         } else if(!strcmp(arg1,"funccfg")) {
             if(prof_FuncTbl) {
                 printf("Already configured, run init to re-configure\n");
@@ -543,10 +1103,8 @@ Prof(int argc,char *argv[])
                 return(CMD_FAILURE);
             } else if(address) {
                 prof_FuncTbl = (struct pdata *)address;
-            } else if(prof_TidTbl) {
-                prof_FuncTbl = &prof_TidTbl[prof_TidTot];
             } else {
-                prof_FuncTbl = (struct pdata *)getAppRamStart();
+                prof_FuncTbl = (struct pdata *)prof_TblEnd();
             }
 
             prof_FuncConfig();
@@ -560,18 +1118,43 @@ Prof(int argc,char *argv[])
                 return(CMD_FAILURE);
             } else if(address) {
                 prof_TidTbl = (struct pdata *)address;
-            } else if(prof_FuncTbl) {
-                prof_TidTbl = &prof_FuncTbl[prof_FuncTot];
-            } else if(prof_PcTbl) {
-                prof_TidTbl = (struct pdata *)&prof_PcTbl[prof_PcTot];
             } else {
-                prof_TidTbl = (struct pdata *)getAppRamStart();
+                prof_TidTbl = (struct pdata *)prof_TblEnd();
             }
-            prof_TidTot = strtoul(arg2,0,0);
+            /* The hash table is kept at most half full, so that
+             * lookups rarely need more than one or two probes...
+             */
+            prof_TidMax = strtoul(arg2,0,0);
+            prof_TidTot = prof_Pow2(prof_TidMax * 2);
             for(i=0; i<prof_TidTot; i++) {
                 prof_TidTbl[i].data = 0;
                 prof_TidTbl[i].pcount = 0;
             }
+        } else if(!strcmp(arg1,"cgcfg")) {
+            if(prof_CgTbl) {
+                printf("Already configured, run init to re-configure\n");
+                return(CMD_FAILURE);
+            } else if(address) {
+                prof_CgTbl = (struct pstack *)address;
+            } else {
+                prof_CgTbl = (struct pstack *)prof_TblEnd();
+            }
+            prof_CgTot = prof_Pow2(strtoul(arg2,0,0));
+            memset((char *)prof_CgTbl,0,prof_CgTot*sizeof(struct pstack));
+        } else if(!strcmp(arg1,"fold")) {
+            if(prof_Fold(arg2,address) < 0) {
+                ret = CMD_FAILURE;
+            }
+#if INCLUDE_HWTMR
+        } else if(!strcmp(arg1,"sample")) {
+            if(prof_SampleStart(atoi(arg2)) < 0) {
+                ret = CMD_FAILURE;
+            }
+        } else if(!strcmp(arg1,"simulate")) {
+            if(prof_Simulate(atoi(arg2),hz) < 0) {
+                ret = CMD_FAILURE;
+            }
+#endif
         } else {
             ret = CMD_PARAM_ERROR;
         }
@@ -590,9 +1173,13 @@ Prof(int argc,char *argv[])
             if(strchr(arg2,'t')) {
                 mp.type |= MONPROF_TIDLOG;
             }
+            if(strchr(arg2,'g')) {
+                mp.type |= MONPROF_CGLOG;
+            }
 
             mp.pc = strtoul(arg3,0,0);
             mp.tid = strtoul(arg4,0,0);
+            mp.fp = 0;
 
             profiler(&mp);
         } else if(!strcmp(arg1,"pccfg")) {
@@ -606,10 +1193,8 @@ Prof(int argc,char *argv[])
                 return(CMD_FAILURE);
             } else if(address) {
                 prof_PcTbl = (uchar *)address;
-            } else if(prof_TidTbl) {
-                prof_PcTbl = (uchar *)&prof_TidTbl[prof_TidTot];
             } else {
-                prof_PcTbl = (uchar *)getAppRamStart();
+                prof_PcTbl = (uchar *)prof_TblEnd();
             }
             prof_PcWidth = strtol(arg2,0,0);    /* instruction width */
             prof_PcTxtBase = strtol(arg3,0,0);  /* address of .text */
@@ -29,11 +29,23 @@
 #define MONPROF_FUNCLOG     (1 << 0)
 #define MONPROF_TIDLOG      (1 << 1)
 #define MONPROF_PCLOG       (1 << 2)
+#define MONPROF_CGLOG       (1 << 3)
 
+/* The fp member is only used (and only needs to be set) with
+ * MONPROF_CGLOG; it is the frame pointer (r11 on ARM) of the
+ * interrupted context, from which the call stack is walked.
+ */
 struct monprof {
     unsigned long   type;
     unsigned long   pc;
     unsigned long   tid;
+    unsigned long   fp;
 };
 
+/* prof_sample():
+ * Called by the port's sampling timer interrupt handler (see
+ * PROF_SAMPLE_TIMER in monprof.c) with the interrupted pc and fp.
+ */
+extern void prof_sample(unsigned long pc, unsigned long fp);
+
 #endif
@@ -0,0 +1,57 @@
+/**************************************************************************
+ *
+ * Copyright (c) 2013 Alcatel-Lucent
+ *
+ * Alcatel Lucent licenses this file to You under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file except in
+ * compliance with the License.  A copy of the License is contained the
+ * file LICENSE at the top level of this repository.
+ * You may also obtain a copy of the License at:
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ **************************************************************************
+ *
+ * mpool.h
+ *
+ * Fixed-size object pools layered on top of malloc().  Refer to the
+ * discussion above mpoolAlloc() in malloc.c for details.
+ *
+ */
+#ifndef _MPOOL_H_
+#define _MPOOL_H_
+
+struct mpool {
+    char    *name;          /* Name shown by the heap command. */
+    int     objsize;        /* Size of each object (pointer aligned). */
+    int     objcnt;         /* Number of objects per chunk. */
+    int     inuse;          /* Objects currently allocated. */
+    int     hwm;            /* High-water mark of inuse. */
+    int     chunks;         /* Number of chunks malloc'd for this pool. */
+    int     bump;           /* Next never-used object in curchunk. */
+    char    *freelist;      /* Objects freed since the last reset. */
+    char    *chunklist;     /* First chunk (chunks are linked). */
+    char    *curchunk;      /* Chunk currently being carved up. */
+    struct  mpool *next;    /* Link in list of pools shown by 'heap'. */
+};
+
+/* MPOOL_INIT():
+ * Static initializer for a pool, so that a pool can be declared and
+ * used without an explicit call to mpoolCreate().
+ */
+#define MPOOL_INIT(name,size,count) \
+    { name, (((size) + sizeof(char *) - 1) & ~(sizeof(char *) - 1)), \
+      count, 0, 0, 0, 0, 0, 0, 0, 0 }
+
+extern int mpoolCreate(struct mpool *mp, char *name, int objsize, int objcnt);
+extern char *mpoolAlloc(struct mpool *mp);
+extern void mpoolFree(struct mpool *mp, void *obj);
+extern void mpoolReset(struct mpool *mp);
+
+#endif
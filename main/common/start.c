@@ -40,6 +40,7 @@
 #include "cli.h"
 #include "tfsprivate.h"
 #include "fbi.h"
+#include "timer.h"
 
 #ifdef PRE_COMMANDLOOP_HOOK
 extern void PRE_COMMANDLOOP_HOOK();
@@ -165,6 +166,7 @@ init2(void)
 #if INCLUDE_FLASH
     if(StateOfMonitor == INITIALIZE) {
         rc = FlashInit();    /* Init flashop data structures and (possibly) */
+        bootmark("flash");
     }
     /* the relocatable functions.  This MUST be */
 #endif                      /* done prior to turning on cache!!! */
@@ -178,6 +180,7 @@ init2(void)
 #if INCLUDE_TFS
     if(rc != -1) {      /* Start up TFS as long as flash */
         tfsstartup();    /* initialization didn't fail. */
+        bootmark("tfs");
     }
 #endif
 }
@@ -249,6 +252,7 @@ _init3(ulong startmode)
      */
     if(startmode & WARMSTART_RUNMONRC) {
         tfsrunrcfile();
+        bootmark("monrc");
     }
 #endif
 
@@ -274,6 +278,7 @@ _init3(ulong startmode)
 #endif
     if(startmode & WARMSTART_IOINIT) {
         EthernetStartup(0,1);
+        bootmark("ethernet");
     }
 #endif
 
@@ -294,6 +299,7 @@ _init3(ulong startmode)
 
 #if INCLUDE_TFS
     if(startmode & WARMSTART_TFSAUTOBOOT) {
+        bootmark("autoboot");
         tfsrunboot();
     }
 #endif
@@ -367,6 +373,7 @@ AppWarmStart(ulong mask)
         }
         devInit(ConsoleBaudRate);
     }
+    bootmarkreset();
     init2();
     _init3(mask);
 }
@@ -426,7 +433,14 @@ start(int state)
      */
     init0();
     init1();
+
+    /* The boot timeline starts here, because init1() is where the
+     * hardware timer is set up...
+     */
+    bootmarkreset();
+    bootmark("init1");
     init2();
+    bootmark("init2");
 
     /* Depending on the type of startup, alert the console and do
      * further initialization as needed...
@@ -479,6 +493,7 @@ start(int state)
 #endif
 
     /* Enter the endless loop of command processing: */
+    bootmark("cmdloop");
     CommandLoop();
 
     printf("ERROR: CommandLoop() returned\n");
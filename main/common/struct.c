@@ -34,57 +34,31 @@
 #include "stddefs.h"
 #include "cli.h"
 #include "ether.h"
+#include "structdef.h"
 #include <stdarg.h>
 
 #if INCLUDE_STRUCT
 
-#define OPENBRACE   '{'
-#define CLOSEBRACE  '}'
-#define PTRSIZE     4
-
-int structsize(char *name);
-
-struct mbrtype {
-    char *type;
-    int size;
-};
-
-struct mbrtype types[] = {
-    { "long",       4 },
-    { "short",      2 },
-    { "char",       1 },
-    { 0, -1 }
-};
-
-static int struct_sfd;
+static struct sdimage *struct_image;
 static ulong struct_base;
 static char *struct_fname;
 static char struct_verbose;
 static char struct_scriptisstructfile;
 
-/* err_general(), err_nostruct(), err_nomember():
+/* err_nostruct(), err_nomember():
  * Error processing functions...
  */
 static void
-err_general(int errnum,int linenum, long tfsloc)
-{
-    printf("%s: err%d at ln %d\n",struct_fname,errnum,linenum);
-    tfsseek(struct_sfd,tfsloc,TFS_BEGIN);
-}
-
-static void
-err_nostruct(char *structname, long tfsloc)
+err_nostruct(char *structname)
 {
     printf("%s: can't find struct '%s'\n",struct_fname,structname);
-    tfsseek(struct_sfd,tfsloc,TFS_BEGIN);
 }
 
 static void
-err_nomember(char *structname, char *mbrname, long tfsloc)
+err_nomember(char *structname, char *mbrname)
 {
     printf("%s: member '%s' not in struct '%s'\n",
            struct_fname,mbrname,structname);
-    tfsseek(struct_sfd,tfsloc,TFS_BEGIN);
 }
 
 /* struct_printf():
@@ -133,387 +107,77 @@ struct_prleft(int mask, char *str, char *fmt, ...)
     return(tot);
 }
 
-/* skipline():
- * If the line is filled with only whitespace, or if the first non-whitespace
- * character is a poundsign, return 1; else return 0.
- */
-static int
-skipline(char *line)
-{
-    if(struct_scriptisstructfile) {
-        if(strncmp(line,"###>>",5) == 0) {
-            strcpy(line,line+5);
-            return(0);
-        } else {
-            return(1);
-        }
-    } else {
-        while(isspace(*line)) {
-            line++;
-        }
-
-        switch(*line) {
-        case 0:
-        case '#':
-            return(1);
-        }
-        return(0);
-    }
-}
-
-/* typesize():
- * Given the incoming type name, return the size of that symbol.
- * Take into account the possibility of it being a pointer (leading '*')
- * or an array (trailing [xx]).
- */
-static int
-typesize(char *typename, char *name)
-{
-    char *np;
-    struct mbrtype *mp;
-    int nlen, ptr, arraysize;
-
-    ptr = 0;
-    arraysize = 1;
-
-    struct_printf(4,"typesize(%s,%s)\n",typename,name);
-
-    if(name[0] == '*') {
-        ptr = 1;
-    }
-
-    nlen = strlen(name);
-    np = name+nlen-1;
-    if(*np == ']') {
-        while(*np && (*np != '[')) {
-            np--;
-        }
-        if(*np == 0) {
-            return(-1);
-        }
-        arraysize = atoi(np+1);
-    }
-
-    mp = types;
-    while(mp->type) {
-        if(strncmp(mp->type,typename,strlen(mp->type)) == 0) {
-            break;
-        }
-        mp++;
-    }
-
-    if(ptr) {
-        return(PTRSIZE * arraysize);
-    }
-
-    return(mp->size * arraysize);
-}
-
-/* structline():
- * Assume that the incoming line is text within a structure definition
- * from the structure file.  Parse it, expecting either two or three
- * tokens (2 if the member is a basic type, 3 if the member is another
- * structure).  Return the count and pointers to each token.
- */
-static int
-structline(char *line, char **type, char **name)
-{
-    int tot;
-    char *cp, *token1, *token2, *token3;
-
-    cp = line;
-    while(isspace(*cp)) {
-        cp++;
-    }
-    token1 = cp;
-    while(!isspace(*cp)) {
-        cp++;
-    }
-    *cp++ = 0;
-
-    if(!strcmp(token1,"struct")) {
-        while(isspace(*cp)) {
-            cp++;
-        }
-        token2 = cp;
-        while(!isspace(*cp)) {
-            cp++;
-        }
-        *cp++ = 0;
-        while(isspace(*cp)) {
-            cp++;
-        }
-        token3 = cp;
-        while((!isspace(*cp)) && (*cp != ';')) {
-            cp++;
-        }
-        if(*cp != ';') {
-            return(-1);
-        }
-        *cp++ = 0;
-        *type = token2;
-        *name = token3;
-        tot = 3;
-    } else {
-        while(isspace(*cp)) {
-            cp++;
-        }
-        token2 = cp;
-        while((!isspace(*cp)) && (*cp != ';')) {
-            cp++;
-        }
-        if(*cp != ';') {
-            return(-1);
-        }
-        *cp++ = 0;
-        *type = token1;
-        *name = token2;
-        tot = 2;
-    }
-    struct_printf(4,"structline: type='%s', name='%s'\n",*type,*name);
-    return(tot);
-
-}
-
 /* structsize():
- * Assuming the incoming string is a pointer to some structure definition
- * in the structure file, parse the file and figure out how big the
- * structure is.  Return the size of successful; else return -1 to indicate
- * some kind of parsing error.
+ * Return the size of the named structure from the structure file,
+ * or -1 if it isn't there or can't be sized.
  */
 int
 structsize(char *structname)
 {
-    long loc;
-    int offset, slen, lno, size;
-    char line[80], *cp, *cp1, *type, *name;
+    struct sdstruct *ssp;
 
     struct_printf(4,"structsize(%s)\n",structname);
 
-    loc = tfstell(struct_sfd);
-
-    if(tfsseek(struct_sfd,0,TFS_BEGIN) < 0) {
-        tfsseek(struct_sfd,loc,TFS_BEGIN);
-        return(-1);
-    }
-
-    offset = 0;
-    slen = strlen(structname);
-    lno = 0;
-    while(tfsgetline(struct_sfd,line,sizeof(line)) > 0) {
-        lno++;
-        if(skipline(line)) {
-            continue;
-        }
-        if(!strncmp(line,"struct ",7)) {
-            cp = line+7;
-            while(isspace(*cp)) {
-                cp++;
-            }
-            if((!strncmp(structname,cp,slen)) && (isspace(cp[slen]))) {
-                cp1 = cp+slen;
-                while(isspace(*cp1)) {
-                    cp1++;
-                }
-                if(*cp1 != OPENBRACE) {
-                    err_general(1,lno,loc);
-                    return(-1);
-                }
-
-                while(tfsgetline(struct_sfd,line,sizeof(line)) > 0) {
-                    lno++;
-                    if(skipline(line)) {
-                        continue;
-                    }
-                    if(line[0] == CLOSEBRACE) {
-                        tfsseek(struct_sfd,loc,TFS_BEGIN);
-                        return(offset);
-                    }
-                    switch(structline(line,&type,&name)) {
-                    case 2:
-                        if((size = typesize(type,name)) < 0) {
-                            err_general(2,lno,loc);
-                            return(-1);
-                        }
-                        break;
-                    case 3:
-                        if((size = structsize(type)) < 0) {
-                            err_general(3,lno,loc);
-                            return(-1);
-                        }
-                        break;
-                    default:
-                        err_general(4,lno,loc);
-                        return(-1);
-                    }
-                    offset += size;
-                }
-                err_general(5,lno,loc);
-                return(-1);
-            }
-        }
-    }
-    err_nostruct(structname,loc);
-    return(-1);
-}
-
-int
-membertype(char *structname, char *mbrname, char *mbrtype)
-{
-    long    loc;
-    int     rc, slen, lno;
-    char    line[80], *cp, *cp1, *type, *name;
-
-    struct_printf(4,"membertype(%s,%s)\n",structname,mbrname);
-
-    loc = tfstell(struct_sfd);
-
-    if(tfsseek(struct_sfd,0,TFS_BEGIN) < 0) {
-        tfsseek(struct_sfd,loc,TFS_BEGIN);
+    if((ssp = sdeffind(struct_image,structname)) == 0) {
+        err_nostruct(structname);
         return(-1);
     }
-
-    slen = strlen(structname);
-    lno = 0;
-    while(tfsgetline(struct_sfd,line,sizeof(line)) > 0) {
-        lno++;
-        if(skipline(line)) {
-            continue;
-        }
-        if(!strncmp(line,"struct ",7)) {
-            cp = line+7;
-            while(isspace(*cp)) {
-                cp++;
-            }
-            if((!strncmp(structname,cp,slen)) && (isspace(cp[slen]))) {
-                cp1 = cp+slen;
-                while(isspace(*cp1)) {
-                    cp1++;
-                }
-                if(*cp1 != OPENBRACE) {
-                    err_general(6,lno,loc);
-                    return(-1);
-                }
-
-                while(tfsgetline(struct_sfd,line,sizeof(line)) > 0) {
-                    lno++;
-                    if(skipline(line)) {
-                        continue;
-                    }
-                    if(line[0] == CLOSEBRACE) {
-                        err_nomember(structname,mbrname,loc);
-                        return(-1);
-                    }
-                    if((rc = structline(line,&type,&name)) < 0) {
-                        err_general(7,lno,loc);
-                        return(-1);
-                    }
-                    if(!strcmp(name,mbrname)) {
-                        tfsseek(struct_sfd,loc,TFS_BEGIN);
-                        if(mbrtype) {
-                            strcpy(mbrtype,type);
-                        }
-                        return(rc);
-                    }
-                }
-                err_general(8,lno,loc);
-                return(-1);
-            }
-        }
-    }
-    err_nostruct(structname,loc);
-    return(-1);
+    return(sdefsize(struct_image,ssp));
 }
 
 /* memberoffset():
- * Return the offset into the structure at which point the member resides.
- * If mbrsize is non-zero, then assume it is a pointer to an integer
- * into which this function will also load the size of the member.
+ * Return the offset of the member described by the dotted string
+ * "struct.mbr[.mbr...]" from the base of the structure; loading the
+ * size of the last member into *mbrsize.  Each member but the last
+ * must be a struct, whose type is the structure searched for the
+ * next member.  Return -1 if the path can't be resolved.
  */
-int
-memberoffset(char *structname, char *mbrname, int *mbrsize)
+static int
+memberoffset(char *path, int *mbrsize)
 {
-    long loc;
-    int offset, slen, size, lno;
-    char line[80], *cp, *cp1, *type, *name;
-
-    struct_printf(4,"memberoffset(%s,%s)\n",structname,mbrname);
-
-    loc = tfstell(struct_sfd);
-
-    if(tfsseek(struct_sfd,0,TFS_BEGIN) < 0) {
-        tfsseek(struct_sfd,loc,TFS_BEGIN);
+    int     offset;
+    char    *mbr, *dot;
+    struct  sdstruct *ssp;
+    struct  sdmember *mp;
+
+    dot = strchr(path,'.');
+    *dot = 0;
+    if((ssp = sdeffind(struct_image,path)) == 0) {
+        err_nostruct(path);
         return(-1);
     }
+    *dot = '.';
 
     offset = 0;
-    slen = strlen(structname);
-    lno = 0;
-    while(tfsgetline(struct_sfd,line,sizeof(line)) > 0) {
-        lno++;
-        if(skipline(line)) {
-            continue;
+    while(dot) {
+        mbr = dot+1;
+        if((dot = strchr(mbr,'.'))) {
+            *dot = 0;
         }
-        if(!strncmp(line,"struct ",7)) {
-            cp = line+7;
-            while(isspace(*cp)) {
-                cp++;
-            }
-            if((!strncmp(structname,cp,slen)) && (isspace(cp[slen]))) {
-                cp1 = cp+slen;
-                while(isspace(*cp1)) {
-                    cp1++;
-                }
-                if(*cp1 != OPENBRACE) {
-                    err_general(9,lno,loc);
-                    return(-1);
-                }
-
-                while(tfsgetline(struct_sfd,line,sizeof(line)) > 0) {
-                    lno++;
-                    if(skipline(line)) {
-                        continue;
-                    }
-                    if(line[0] == '#') {
-                        continue;
-                    }
-                    if(line[0] == CLOSEBRACE) {
-                        err_nomember(structname,mbrname,loc);
-                        return(-1);
-                    }
-                    switch(structline(line,&type,&name)) {
-                    case 2:
-                        if((size = typesize(type,name)) < 0) {
-                            err_general(10,lno,loc);
-                            return(-1);
-                        }
-                        break;
-                    case 3:
-                        if((size = structsize(type)) < 0) {
-                            err_general(11,lno,loc);
-                            return(-1);
-                        }
-                        break;
-                    default:
-                        err_general(12,lno,loc);
-                        return(-1);
-                    }
-                    if(!strcmp(name,mbrname)) {
-                        tfsseek(struct_sfd,loc,TFS_BEGIN);
-                        if(mbrsize) {
-                            *mbrsize = size;
-                        }
-                        return(offset);
-                    }
-                    offset += size;
-                }
-                err_general(13,lno,loc);
+
+        struct_printf(4,"memberoffset(%s,%s)\n",ssp->name,mbr);
+
+        if(sdefsize(struct_image,ssp) < 0) {
+            return(-1);
+        }
+        if((mp = sdefmember(ssp,mbr)) == 0) {
+            err_nomember(ssp->name,mbr);
+            return(-1);
+        }
+        offset += mp->offset;
+        *mbrsize = mp->size;
+
+        if(dot) {
+            *dot = '.';
+            if((mp->kind != SDM_STRUCT) || (mp->sidx < 0)) {
+                printf("%s: member '%s' of struct '%s' is not a struct\n",
+                       struct_fname,mbr,ssp->name);
                 return(-1);
             }
+            ssp = &struct_image->structs[mp->sidx];
         }
     }
-    err_nostruct(structname,loc);
-    return(-1);
+    return(offset);
 }
 
 char *StructHelp[] = {
@@ -540,9 +204,9 @@ int
 StructCmd(int argc,char *argv[])
 {
     unsigned long lval, dest;
-    char    copy[CMDLINESIZE], type[32];
-    char    *eq, *dot, *str, *mbr, *env, *equation;
-    int     opt, i, offset, mbrtype, rc, size, processlval;
+    char    copy[CMDLINESIZE];
+    char    *eq, *env, *equation;
+    int     opt, i, offset, size, processlval;
 
     struct_fname = 0;
     struct_verbose = 0;
@@ -584,13 +248,6 @@ StructCmd(int argc,char *argv[])
         }
     }
 
-    struct_sfd = tfsopen(struct_fname,TFS_RDONLY,0);
-
-    if(struct_sfd < 0) {
-        printf("Can't find file '%s'\n",struct_fname);
-        return(CMD_FAILURE);
-    }
-
     /* If the specified structure description file is the currently
      * running script, then set a flag so that this code will look
      * for the "###>>" prefix as a required line prefix in the
@@ -602,6 +259,13 @@ StructCmd(int argc,char *argv[])
         struct_scriptisstructfile = 0;
     }
 
+    struct_image = sdefload(struct_fname,struct_scriptisstructfile);
+
+    if(struct_image == 0) {
+        printf("Can't find file '%s'\n",struct_fname);
+        return(CMD_FAILURE);
+    }
+
     /* Assume each command line argument is some "struct=val" statement,
      * and process each one...
      */
@@ -621,42 +285,11 @@ StructCmd(int argc,char *argv[])
 
         /* Start parsing and processing the structure request...
          */
-        offset = mbrtype = 0;
-        dot = strchr(copy,'.');
-        if(!dot) {
+        offset = 0;
+        if(strchr(copy,'.') == 0) {
             size = structsize(copy);
-        } else {
-            while(dot) {
-                *dot++ = 0;
-                mbr = dot;
-                str = dot-2;
-                while((*str != 0) && (str != copy) && (*str != '.')) {
-                    str--;
-                }
-                if(str != copy) {
-                    str++;
-                }
-                while((dot != 0) && (*dot != '.')) {
-                    dot++;
-                }
-                *dot = 0;
-
-                if(mbrtype == 3) {
-                    str = type;
-                }
-
-                if((rc = memberoffset(str,mbr,&size)) < 0) {
-                    goto done;
-                }
-
-                if((mbrtype = membertype(str,mbr,type)) < 0) {
-                    goto done;
-                }
-
-                offset += rc;
-                *dot = '.';
-                dot = strchr(mbr,'.');
-            }
+        } else if((offset = memberoffset(copy,&size)) < 0) {
+            goto done;
         }
 
         shell_sprintf("STRUCTOFFSET","0x%lx",offset);
@@ -832,11 +465,9 @@ StructCmd(int argc,char *argv[])
         }
     }
 done:
-    tfsclose(struct_sfd,0);
     return(CMD_SUCCESS);
 
 paramerr:
-    tfsclose(struct_sfd,0);
     return(CMD_PARAM_ERROR);
 }
 #endif
@@ -0,0 +1,519 @@
+/**************************************************************************
+ *
+ * Copyright (c) 2013 Alcatel-Lucent
+ *
+ * Alcatel Lucent licenses this file to You under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file except in
+ * compliance with the License.  A copy of the License is contained the
+ * file LICENSE at the top level of this repository.
+ * You may also obtain a copy of the License at:
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ **************************************************************************
+ *
+ * structdef.c:
+ *
+ *  Structure definition file support for the struct and cast commands.
+ *  The file is a list of C-like structure definitions:
+ *
+ *      struct name {
+ *          type        member;
+ *          type        *member;
+ *          type        member[n];
+ *          struct name member;
+ *          pad[n];
+ *      }
+ *
+ *  where type is char, short or long, optionally followed by .x (hex)
+ *  or .c (character) for cast.  Anything after a ';' or '#' on a line
+ *  is ignored.  If the file is the running script, only lines that
+ *  start with "###>>" are part of the definitions.
+ *
+ *  Rather than rescanning the file for every member lookup (and every
+ *  nested structure), the file is parsed once into an image holding
+ *  the structures (hashed by name) and their members.  Sizes and
+ *  offsets are computed the first time a structure is used and are
+ *  kept in the image.  The image is kept until a different file is
+ *  used, or the file's header CRC changes.
+ *
+ * Original author:     Ed Sutter (ed.sutter@alcatel-lucent.com)
+ *
+ */
+#include "config.h"
+#include "stddefs.h"
+#include "genlib.h"
+#if INCLUDE_STRUCT || INCLUDE_CAST
+#include <ctype.h>
+#include "tfs.h"
+#include "tfsprivate.h"
+#include "structdef.h"
+
+#ifndef SDEF_LINESIZE
+#define SDEF_LINESIZE   128
+#endif
+
+/* Without malloc, the image is built in a static buffer, so the
+ * definition file must fit in SDEF_IMAGESIZE once parsed.
+ */
+#if !INCLUDE_MALLOC
+#ifndef SDEF_IMAGESIZE
+#define SDEF_IMAGESIZE  4096
+#endif
+static long SdefArena[SDEF_IMAGESIZE/sizeof(long)];
+#endif
+
+static struct sdimage *SdefImage;
+
+struct sdefkey {
+    struct  sdimage *sdp;
+    char    *name;
+};
+
+/* sdefslot():
+ * The hashprobe() callback for the structure name hash.
+ */
+static int
+sdefslot(int idx, void *arg)
+{
+    struct  sdefkey *key = (struct sdefkey *)arg;
+    int     hit;
+
+    if((hit = key->sdp->hashtbl[idx]) == 0) {
+        return(HASH_EMPTY);
+    }
+    if(strcmp(key->sdp->structs[hit-1].name,key->name) == 0) {
+        return(HASH_MATCH);
+    }
+    return(HASH_OTHER);
+}
+
+/* sdefline():
+ * Copy the next line of the file into 'line' (truncated to SDEF_LINESIZE)
+ * and split it into at most 'max' whitespace separated tokens, ignoring
+ * everything after a ';' or '#'.  Return a pointer to the start of the
+ * next line; the number of tokens is returned in *ntok.
+ */
+static char *
+sdefline(char *cp, char *end, int scriptmode, char *line, char **tok,
+         int max, int *ntok)
+{
+    char    *lp;
+    int     len;
+
+    for(len = 0; (cp < end) && (*cp != '\n') && *cp; cp++) {
+        if((len < SDEF_LINESIZE-1) && (*cp != '\r')) {
+            line[len++] = *cp;
+        }
+    }
+    line[len] = 0;
+    if(cp < end) {
+        cp = (*cp == '\n') ? cp+1 : end;
+    }
+
+    *ntok = 0;
+    lp = line;
+    if(scriptmode) {
+        if(strncmp(lp,"###>>",5) != 0) {
+            return(cp);
+        }
+        lp += 5;
+    }
+    while(*ntok < max) {
+        while(isspace(*lp)) {
+            lp++;
+        }
+        if((*lp == 0) || (*lp == ';') || (*lp == '#')) {
+            break;
+        }
+        tok[(*ntok)++] = lp;
+        while(*lp && !isspace(*lp) && (*lp != ';') && (*lp != '#')) {
+            lp++;
+        }
+        if(*lp == 0) {
+            break;
+        }
+        if(!isspace(*lp)) {
+            *lp = 0;
+            break;
+        }
+        *lp++ = 0;
+    }
+    return(cp);
+}
+
+/* sdefstr():
+ * Copy the string into the image's string space (if building), and
+ * return the space it needs.
+ */
+static int
+sdefstr(char **strings, char **dest, char *str)
+{
+    int len;
+
+    len = strlen(str) + 1;
+    if(*strings) {
+        memcpy(*strings,str,len);
+        *dest = *strings;
+        *strings += len;
+    }
+    return(len);
+}
+
+/* sdefscan():
+ * Parse the file.  If sdp is null, just count the structures, members
+ * and string space needed; otherwise fill in the image.
+ */
+static void
+sdefscan(char *cp, char *end, int scriptmode, struct sdimage *sdp,
+         char *strings, int *nstructs, int *nmbrs, int *strsize)
+{
+    char    line[SDEF_LINESIZE], *tok[3], *brace;
+    int     ntok, lno, inside;
+    struct  sdstruct *ssp;
+    struct  sdmember *mp;
+
+    ssp = (struct sdstruct *)0;
+    mp = sdp ? (struct sdmember *)(sdp->structs + sdp->nstructs) : 0;
+    *nstructs = *nmbrs = *strsize = 0;
+    inside = lno = 0;
+    while(cp < end) {
+        cp = sdefline(cp,end,scriptmode,line,tok,3,&ntok);
+        lno++;
+        if(ntok == 0) {
+            continue;
+        }
+
+        /* A structure starts with "struct name {" (the brace may be
+         * attached to the name).  If one starts before the previous
+         * one is closed, the previous one is flagged as unterminated.
+         */
+        brace = (char *)0;
+        if((ntok >= 2) && !strcmp(tok[0],"struct")) {
+            if((brace = strchr(tok[1],'{')) == 0) {
+                if((ntok == 3) && (tok[2][0] == '{')) {
+                    brace = tok[2];
+                }
+            }
+        }
+        if(brace) {
+            if(ssp && inside) {
+                ssp->flags |= SDS_NOEND;
+            }
+            *brace = 0;
+            if(sdp) {
+                ssp = &sdp->structs[*nstructs];
+                ssp->size = SDS_UNSIZED;
+                ssp->lno = lno;
+                ssp->flags = 0;
+                ssp->nmbrs = 0;
+                ssp->mbrs = mp;
+            }
+            *strsize += sdefstr(&strings,ssp ? &ssp->name : 0,tok[1]);
+            (*nstructs)++;
+            inside = 1;
+            continue;
+        }
+        if(!inside) {
+            continue;
+        }
+        if(tok[0][0] == '}') {
+            inside = 0;
+            continue;
+        }
+
+        (*nmbrs)++;
+        if(!sdp) {
+            while(ntok > 0) {
+                *strsize += strlen(tok[--ntok]) + 1;
+            }
+            *strsize += 1;
+            continue;
+        }
+
+        ssp->nmbrs++;
+        mp->lno = lno;
+        mp->ptr = 0;
+        mp->count = 1;
+        mp->offset = mp->size = 0;
+        mp->sidx = -1;
+        if(!strcmp(tok[0],"struct")) {
+            if(ntok == 3) {
+                mp->kind = SDM_STRUCT;
+                sdefstr(&strings,&mp->type,tok[1]);
+                sdefstr(&strings,&mp->name,tok[2]);
+            } else {
+                mp->kind = SDM_BAD;
+                sdefstr(&strings,&mp->type,tok[0]);
+                sdefstr(&strings,&mp->name,ntok == 2 ? tok[1] : "");
+            }
+        } else if(!strncmp(tok[0],"pad[",4)) {
+            mp->kind = SDM_PAD;
+            mp->count = atoi(tok[0]+4);
+            sdefstr(&strings,&mp->type,tok[0]);
+            sdefstr(&strings,&mp->name,"");
+        } else {
+            mp->kind = (ntok == 2) ? SDM_BASIC : SDM_BAD;
+            sdefstr(&strings,&mp->type,tok[0]);
+            sdefstr(&strings,&mp->name,ntok >= 2 ? tok[1] : "");
+        }
+        if(mp->name[0] == '*') {
+            mp->ptr = 1;
+        }
+        if((brace = strchr(mp->name,'[')) != 0) {
+            mp->count = atoi(brace+1);
+        }
+        mp++;
+    }
+    if(ssp && inside) {
+        ssp->flags |= SDS_NOEND;
+    }
+}
+
+/* sdefload():
+ * Return the image of the structure definition file 'fname', building
+ * it if necessary.  If scriptmode is set, the file is the running script
+ * and only its "###>>" lines are used.
+ */
+struct sdimage *
+sdefload(char *fname, int scriptmode)
+{
+    TFILE   *tfp;
+    char    *base, *end, *strings;
+    int     i, idx, tmp, nstructs, nmbrs, strsize, size;
+    struct  sdimage *sdp;
+    struct  sdmember *mp;
+    struct  sdefkey key;
+#if INCLUDE_TFSCPRS
+    char    *image;
+#endif
+
+    if((tfp = tfsstat(fname)) == (TFILE *)0) {
+        return((struct sdimage *)0);
+    }
+
+    if(SdefImage && (SdefImage->hdrcrc == tfp->hdrcrc) &&
+            (SdefImage->scriptmode == scriptmode) &&
+            (strcmp(SdefImage->fname,tfp->name) == 0)) {
+        return(SdefImage);
+    }
+#if INCLUDE_MALLOC
+    if(SdefImage) {
+        free((char *)SdefImage);
+    }
+#endif
+    SdefImage = (struct sdimage *)0;
+
+    /* First pass: count the structures, members and string space...
+     */
+    base = TFS_BASE(tfp);
+    end = base + TFS_SIZE(tfp);
+#if INCLUDE_TFSCPRS
+    image = (char *)0;
+    if(TFS_ISCPRS(tfp)) {
+        if(((tmp = tfsopen(fname,TFS_RDONLY,0)) < 0) ||
+                (tfscprsimage(tmp,&image) != TFS_OKAY)) {
+            if(tmp >= 0) {
+                tfsclose(tmp,0);
+            }
+            printf("%s: can't decompress\n",fname);
+            return((struct sdimage *)0);
+        }
+        base = image;
+        end = base + tfsSlots[tmp].hdr.filsize;
+        tfsclose(tmp,0);
+    }
+#endif
+    sdefscan(base,end,scriptmode,0,0,&nstructs,&nmbrs,&strsize);
+    for(tmp = 8; tmp < nstructs*2; tmp <<= 1);
+
+    size = sizeof(struct sdimage) + nstructs * sizeof(struct sdstruct) +
+           nmbrs * sizeof(struct sdmember) + tmp * sizeof(short) + strsize;
+#if INCLUDE_MALLOC
+    sdp = (struct sdimage *)malloc(size);
+#else
+    sdp = (size <= (int)sizeof(SdefArena)) ? (struct sdimage *)SdefArena : 0;
+#endif
+    if(!sdp) {
+        printf("%s: too big to load (%d bytes)\n",fname,size);
+#if INCLUDE_TFSCPRS
+        if(image) {
+            free(image);
+        }
+#endif
+        return((struct sdimage *)0);
+    }
+    strcpy(sdp->fname,tfp->name);
+    sdp->hdrcrc = tfp->hdrcrc;
+    sdp->scriptmode = scriptmode;
+    sdp->structs = (struct sdstruct *)(sdp+1);
+    sdp->hashsize = tmp;
+    sdp->hashtbl = (short *)((struct sdmember *)(sdp->structs+nstructs)+nmbrs);
+    strings = (char *)(sdp->hashtbl + tmp);
+    memset((char *)sdp->hashtbl,0,tmp * sizeof(short));
+
+    /* Second pass: fill in the image...
+     */
+    sdp->nstructs = nstructs;
+    sdefscan(base,end,scriptmode,sdp,strings,&nstructs,&nmbrs,&strsize);
+#if INCLUDE_TFSCPRS
+    if(image) {
+        free(image);
+    }
+#endif
+
+    /* Hash the structure names (the first definition of a name wins,
+     * as with the file scan), then point each struct member at its
+     * type's definition.
+     */
+    key.sdp = sdp;
+    for(i=0; i<nstructs; i++) {
+        key.name = sdp->structs[i].name;
+        if((hashprobe(strhash(key.name,-1),tmp,sdefslot,&key,&idx) == -1) &&
+                (idx != -1)) {
+            sdp->hashtbl[idx] = i + 1;
+        }
+    }
+    mp = (struct sdmember *)(sdp->structs + nstructs);
+    for(i=0; i<nmbrs; i++, mp++) {
+        struct sdstruct *ssp;
+
+        if(mp->kind == SDM_STRUCT) {
+            if((ssp = sdeffind(sdp,mp->type)) != 0) {
+                mp->sidx = ssp - sdp->structs;
+            }
+        }
+    }
+
+    SdefImage = sdp;
+    return(sdp);
+}
+
+/* sdeffind():
+ * Return the definition of the named structure, or null.
+ */
+struct sdstruct *
+sdeffind(struct sdimage *sdp, char *name)
+{
+    int     idx;
+    struct  sdefkey key;
+
+    key.sdp = sdp;
+    key.name = name;
+    idx = hashprobe(strhash(name,-1),sdp->hashsize,sdefslot,&key,0);
+    if(idx == -1) {
+        return((struct sdstruct *)0);
+    }
+    return(&sdp->structs[sdp->hashtbl[idx]-1]);
+}
+
+/* sdefmember():
+ * Return the named member of the structure, or null.  The name must
+ * match the member as written (including any '*' or [n]).
+ */
+struct sdmember *
+sdefmember(struct sdstruct *ssp, char *name)
+{
+    int     i;
+
+    for(i=0; i<ssp->nmbrs; i++) {
+        if(!strcmp(ssp->mbrs[i].name,name)) {
+            return(&ssp->mbrs[i]);
+        }
+    }
+    return((struct sdmember *)0);
+}
+
+/* sdefbasic():
+ * Return the size of a basic type, or -1.  The type only has to
+ * start with the basic type name, so "long.x" is a long.
+ */
+static int
+sdefbasic(char *type)
+{
+    if(!strncmp(type,"long",4)) {
+        return(4);
+    }
+    if(!strncmp(type,"short",5)) {
+        return(2);
+    }
+    if(!strncmp(type,"char",4)) {
+        return(1);
+    }
+    return(-1);
+}
+
+/* sdefsize():
+ * Return the size of the structure, computing it (and the size and
+ * offset of each of its members) the first time through.  On error,
+ * print a message and return -1; the structure is left unsized so
+ * the error is reported again the next time it is used.
+ */
+int
+sdefsize(struct sdimage *sdp, struct sdstruct *ssp)
+{
+    int     i, offset, size;
+    struct  sdmember *mp;
+
+    if(ssp->size >= 0) {
+        return(ssp->size);
+    }
+    if(ssp->size == SDS_SIZING) {
+        printf("%s: struct '%s' contains itself (ln %d)\n",
+               sdp->fname,ssp->name,ssp->lno);
+        return(-1);
+    }
+    if(ssp->flags & SDS_NOEND) {
+        printf("%s: struct '%s' has no closing brace (ln %d)\n",
+               sdp->fname,ssp->name,ssp->lno);
+        return(-1);
+    }
+
+    ssp->size = SDS_SIZING;
+    offset = 0;
+    mp = ssp->mbrs;
+    for(i=0; i<ssp->nmbrs; i++, mp++) {
+        switch(mp->kind) {
+        case SDM_BASIC:
+            size = mp->ptr ? SDEF_PTRSIZE : sdefbasic(mp->type);
+            break;
+        case SDM_STRUCT:
+            if(mp->ptr) {
+                size = SDEF_PTRSIZE;
+            } else if(mp->sidx < 0) {
+                printf("%s: can't find struct '%s' (ln %d)\n",
+                       sdp->fname,mp->type,mp->lno);
+                size = -2;
+            } else if((size = sdefsize(sdp,&sdp->structs[mp->sidx])) < 0) {
+                size = -2;
+            }
+            break;
+        case SDM_PAD:
+            size = 1;
+            break;
+        default:
+            size = -1;
+            break;
+        }
+        if(size < 0) {
+            if(size == -1) {
+                printf("%s: bad member '%s %s' (ln %d)\n",
+                       sdp->fname,mp->type,mp->name,mp->lno);
+            }
+            ssp->size = SDS_UNSIZED;
+            return(-1);
+        }
+        mp->size = size * mp->count;
+        mp->offset = offset;
+        offset += mp->size;
+    }
+    ssp->size = offset;
+    return(offset);
+}
+#endif
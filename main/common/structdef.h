@@ -0,0 +1,86 @@
+/**************************************************************************
+ *
+ * Copyright (c) 2013 Alcatel-Lucent
+ *
+ * Alcatel Lucent licenses this file to You under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file except in
+ * compliance with the License.  A copy of the License is contained the
+ * file LICENSE at the top level of this repository.
+ * You may also obtain a copy of the License at:
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ **************************************************************************
+ *
+ * structdef.h:
+ *
+ * Parsed image of a structure definition file, shared by the struct
+ * and cast commands.  See structdef.c for the file format.
+ *
+ * Original author:     Ed Sutter (ed.sutter@alcatel-lucent.com)
+ *
+ */
+#ifndef _STRUCTDEF_H_
+#define _STRUCTDEF_H_
+
+#define SDEF_PTRSIZE    4
+
+/* Member kinds:
+ */
+#define SDM_BASIC       1       /* char, short, long (with .x/.c suffix) */
+#define SDM_STRUCT      2       /* struct type name */
+#define SDM_PAD         3       /* pad[n] */
+#define SDM_BAD         4       /* line couldn't be parsed */
+
+/* Structure flags:
+ */
+#define SDS_NOEND       (1<<0)  /* no closing brace */
+
+/* Structure size states (before/while sdefsize() computes it):
+ */
+#define SDS_UNSIZED     -1
+#define SDS_SIZING      -2
+
+struct sdmember {
+    char    *type;          /* Type as written (or struct name) */
+    char    *name;          /* Name as written (with '*' and [n]) */
+    char    kind;           /* SDM_XXX */
+    char    ptr;            /* Non-zero if name starts with '*' */
+    short   lno;            /* Line number in the file */
+    int     count;          /* Array size (or pad size) */
+    int     offset;         /* Offset within the structure */
+    int     size;           /* Total size of the member */
+    int     sidx;           /* SDM_STRUCT: index into structs[] (or -1) */
+};
+
+struct sdstruct {
+    char    *name;
+    int     size;           /* Size, or SDS_XXX state */
+    short   lno;
+    short   flags;
+    int     nmbrs;
+    struct  sdmember *mbrs;
+};
+
+struct sdimage {
+    char    fname[TFSNAMESIZE+1];
+    ulong   hdrcrc;
+    int     scriptmode;
+    int     nstructs;
+    struct  sdstruct *structs;
+    int     hashsize;
+    short   *hashtbl;       /* Index+1 into structs[]; 0 = empty */
+};
+
+extern struct sdimage *sdefload(char *fname, int scriptmode);
+extern struct sdstruct *sdeffind(struct sdimage *sdp, char *name);
+extern struct sdmember *sdefmember(struct sdstruct *ssp, char *name);
+extern int sdefsize(struct sdimage *sdp, struct sdstruct *ssp);
+
+#endif
@@ -38,6 +38,336 @@
 #define SYMFILE "symtbl"
 #endif
 
+/* Symbol image:
+ * The first lookup in a symbol file parses the whole file into a RAM
+ * image; an array of entries in file order (used by getsym(), through
+ * a hash of the names) and an index of those entries sorted by address
+ * (used by AddrToSym(), with a binary search).  The image is kept until
+ * a lookup is made in a different file, or the file's header CRC
+ * changes (which it will if the file is rewritten, since the header
+ * includes the file's CRC and modification time).
+ * If there isn't enough memory for the image, the lookups fall back to
+ * scanning the file as they always did.
+ *
+ * In addition to the text format (see getsym()), the symbol file can
+ * be in a compact binary format that is quicker to load:
+ *
+ *  ulong   magic;          SYMBIN_MAGIC
+ *  ulong   nsyms;
+ *  struct {
+ *      ulong   addr;
+ *      ulong   nameoff;    offset of the name in the string table
+ *  } sym[nsyms];           sorted by address
+ *  char    strings[];      NULL terminated names
+ *
+ * All fields are in the target's byte order; the file is built on the
+ * host from the same 'nm' output used for the text format.  For getsym()
+ * the value of a symbol in a binary file is its address, in hex.
+ */
+#define SYMBIN_MAGIC    0x53594d42      /* "SYMB" */
+#define SYMNAMEMAX      83              /* Same limit as the text scan */
+
+struct symentry {
+    char    *name;
+    char    *value;         /* Null for binary files */
+    ulong   addr;
+};
+
+struct symimage {
+    char    fname[TFSNAMESIZE+1];
+    ulong   hdrcrc;
+    int     nsyms;
+    struct  symentry *syms;     /* In file order */
+    int     *byaddr;            /* Indices into syms[], sorted by addr */
+    int     hashsize;
+    int     *hashtbl;           /* Index+1 into syms[]; 0 = empty */
+};
+
+struct symkey {
+    struct  symimage *sip;
+    char    *name;
+};
+
+static struct symimage *SymImage;
+
+/* symslot():
+ * The hashprobe() callback for the name hash of a symbol image.
+ */
+static int
+symslot(int idx, void *arg)
+{
+    struct  symkey *key = (struct symkey *)arg;
+    int     i;
+
+    if((i = key->sip->hashtbl[idx]) == 0) {
+        return(HASH_EMPTY);
+    }
+    if(strcmp(key->sip->syms[i-1].name,key->name) == 0) {
+        return(HASH_MATCH);
+    }
+    return(HASH_OTHER);
+}
+
+/* symparse():
+ * Parse the next line of a text symbol file.  If the line has a name
+ * and value, the lengths of each are returned in *nlen and *vlen, with
+ * *namep and *valp pointing to them (not NULL terminated); otherwise
+ * *nlen is zero.  Return a pointer to the start of the next line.
+ */
+static char *
+symparse(char *cp, char *end, char **namep, int *nlen, char **valp, int *vlen)
+{
+    char    *eol;
+
+    for(eol = cp; (eol < end) && (*eol != '\n') && (*eol != '\r') &&
+            *eol; eol++);
+
+    *nlen = 0;
+    *namep = cp;
+    while((cp < eol) && (*cp != ' ') && (*cp != '\t')) {
+        cp++;
+    }
+    if(cp < eol) {
+        *nlen = cp - *namep;
+        if(*nlen > SYMNAMEMAX) {
+            *nlen = SYMNAMEMAX;
+        }
+        while((cp < eol) && ((*cp == ' ') || (*cp == '\t'))) {
+            cp++;
+        }
+        *valp = cp;
+        *vlen = eol - cp;
+    }
+
+    while((eol < end) && ((*eol == '\n') || (*eol == '\r'))) {
+        eol++;
+    }
+    if((eol < end) && (*eol == 0)) {
+        eol = end;
+    }
+    return(eol);
+}
+
+/* symload():
+ * Return the image of the symbol file whose header is 'tfp' and whose
+ * data is at 'base'; building it if necessary.
+ */
+static struct symimage *
+symload(TFILE *tfp, char *base)
+{
+    char    *cp, *end, *name, *val, *strings;
+    int     i, j, tmp, nsyms, nlen, vlen, strsize, idx;
+    ulong   magic, binsyms, sym[2];
+    struct  symimage *sip;
+    struct  symentry *sep;
+    struct  symkey key;
+
+    if(SymImage && (SymImage->hdrcrc == tfp->hdrcrc) &&
+            (strcmp(SymImage->fname,tfp->name) == 0)) {
+        return(SymImage);
+    }
+    if(SymImage) {
+        free((char *)SymImage);
+        SymImage = (struct symimage *)0;
+    }
+
+    /* First pass: count the symbols and the string space needed...
+     */
+    end = base + tfp->filsize;
+    nsyms = strsize = 0;
+    binsyms = 0;
+    if(tfp->filsize > (int)(2 * sizeof(ulong))) {
+        memcpy((char *)&magic,base,sizeof(ulong));
+        memcpy((char *)&binsyms,base+sizeof(ulong),sizeof(ulong));
+        /* The header and the binsyms entries, (2 + 2*binsyms) ulongs,
+         * must fit in the file (written so it can't overflow)...
+         */
+        if((magic != SYMBIN_MAGIC) ||
+                (binsyms > ((tfp->filsize / sizeof(ulong)) - 2) / 2)) {
+            binsyms = 0;
+        }
+    }
+    if(binsyms) {
+        nsyms = binsyms;
+        strsize = (end - base) - (2 + 2*nsyms) * sizeof(ulong) + 1;
+    } else {
+        for(cp = base; cp < end; ) {
+            cp = symparse(cp,end,&name,&nlen,&val,&vlen);
+            if(nlen) {
+                nsyms++;
+                strsize += nlen + vlen + 2;
+            }
+        }
+    }
+    for(tmp = 8; tmp < nsyms*2; tmp <<= 1);
+
+    sip = (struct symimage *)malloc(sizeof(struct symimage) +
+                                    nsyms * sizeof(struct symentry) +
+                                    (nsyms + tmp) * sizeof(int) + strsize);
+    if(!sip) {
+        return((struct symimage *)0);
+    }
+    strcpy(sip->fname,tfp->name);
+    sip->hdrcrc = tfp->hdrcrc;
+    sip->nsyms = nsyms;
+    sip->syms = (struct symentry *)(sip+1);
+    sip->byaddr = (int *)(sip->syms + nsyms);
+    sip->hashsize = tmp;
+    sip->hashtbl = sip->byaddr + nsyms;
+    strings = (char *)(sip->hashtbl + tmp);
+    memset((char *)sip->hashtbl,0,tmp * sizeof(int));
+
+    /* Second pass: fill in the entries...
+     */
+    sep = sip->syms;
+    if(binsyms) {
+        cp = base + (2 + 2*nsyms) * sizeof(ulong);
+        memcpy(strings,cp,end-cp);
+        strings[end-cp] = 0;
+        for(i=0; i<nsyms; i++, sep++) {
+            memcpy((char *)sym,base + (2 + 2*i) * sizeof(ulong),sizeof(sym));
+            sep->addr = sym[0];
+            sep->name = (sym[1] < (ulong)(end-cp)) ? strings + sym[1] : "";
+            sep->value = (char *)0;
+        }
+    } else {
+        for(cp = base; cp < end; ) {
+            cp = symparse(cp,end,&name,&nlen,&val,&vlen);
+            if(nlen == 0) {
+                continue;
+            }
+            memcpy(strings,name,nlen);
+            strings[nlen] = 0;
+            sep->name = strings;
+            strings += nlen + 1;
+            memcpy(strings,val,vlen);
+            strings[vlen] = 0;
+            sep->value = strings;
+            strings += vlen + 1;
+            sep->addr = strtoul(sep->value,0,0);
+            sep++;
+        }
+    }
+
+    /* Build the name hash (the first of any duplicate names wins, as
+     * with the file scan) and the address index.  The address sort is
+     * an insertion sort because symbol files are normally already
+     * sorted (nm -n), in which case it's a single pass; it is also
+     * stable, so equal addresses stay in file order.
+     */
+    key.sip = sip;
+    for(i=0; i<nsyms; i++) {
+        key.name = sip->syms[i].name;
+        if((hashprobe(strhash(key.name,-1),tmp,symslot,&key,&idx) == -1) &&
+                (idx != -1)) {
+            sip->hashtbl[idx] = i + 1;
+        }
+
+        for(j=i; (j > 0) &&
+                (sip->syms[sip->byaddr[j-1]].addr > sip->syms[i].addr); j--) {
+            sip->byaddr[j] = sip->byaddr[j-1];
+        }
+        sip->byaddr[j] = i;
+    }
+
+    SymImage = sip;
+    return(sip);
+}
+
+/* symfload():
+ * symload() for the open symbol file 'tfd'.  A compressed file is only
+ * decompressed (to a temporary copy) if the image has to be built.
+ */
+static struct symimage *
+symfload(int tfd)
+{
+    struct  tfsdat *tdat;
+#if INCLUDE_TFSCPRS
+    char    *image;
+    struct  symimage *sip;
+#endif
+
+    tdat = &tfsSlots[tfd];
+#if INCLUDE_TFSCPRS
+    if(tdat->blktbl) {
+        if(SymImage && (SymImage->hdrcrc == tdat->hdr.hdrcrc) &&
+                (strcmp(SymImage->fname,tdat->hdr.name) == 0)) {
+            return(SymImage);
+        }
+        if(tfscprsimage(tfd,&image) != TFS_OKAY) {
+            return((struct symimage *)0);
+        }
+        sip = symload(&tdat->hdr,image);
+        free(image);
+        return(sip);
+    }
+#endif
+    return(symload(&tdat->hdr,(char *)tdat->base));
+}
+
+/* symbyaddr():
+ * AddrToSym() using the symbol image.  Same rules as the file scan:
+ * an exact match, else the closest symbol below the address, but not
+ * if the address is below the first or above the last symbol.
+ */
+static int
+symbyaddr(struct symimage *sip,ulong addr,char *name,ulong *offset)
+{
+    int     lo, hi, mid;
+    struct  symentry *sep;
+
+    lo = 0;
+    hi = sip->nsyms;
+    while(lo < hi) {
+        mid = (lo + hi) / 2;
+        if(sip->syms[sip->byaddr[mid]].addr < addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if((lo == sip->nsyms) ||
+            ((lo == 0) && (sip->syms[sip->byaddr[0]].addr != addr))) {
+        sprintf(name,"0x%lx",addr);
+        return(0);
+    }
+    sep = &sip->syms[sip->byaddr[lo]];
+    if(sep->addr != addr) {
+        sep = &sip->syms[sip->byaddr[lo-1]];
+    }
+    strcpy(name,sep->name);
+    if(offset) {
+        *offset = addr - sep->addr;
+    }
+    return(1);
+}
+
+/* symbyname():
+ * getsym() using the symbol image.
+ */
+static char *
+symbyname(struct symimage *sip,char *symname,char *line,int sizeofline)
+{
+    int     idx;
+    struct  symentry *sep;
+    struct  symkey key;
+
+    key.sip = sip;
+    key.name = symname;
+    idx = hashprobe(strhash(symname,-1),sip->hashsize,symslot,&key,0);
+    if(idx == -1) {
+        return((char *)0);
+    }
+    sep = &sip->syms[sip->hashtbl[idx]-1];
+    if(sep->value == 0) {
+        snprintf(line,sizeofline,"0x%lx",sep->addr);
+    } else {
+        strncpy(line,sep->value,sizeofline-1);
+        line[sizeofline-1] = 0;
+    }
+    return(line);
+}
+
 /* SymFileFd():
  * Attempt to open the symbol table file.  First look to the SYMFILE env var;
  * else default to SYMFILE definition.  If the file exists, open it and return
@@ -92,8 +422,9 @@ AddrToSym(int tfdin,ulong addr,char *name,ulong *offset)
     int     lno, tfd;
     char    *space;
     ulong   thisaddr, lastaddr;
-    char    thisline[84];
+    char    thisline[SYMNAMEMAX+1];
     char    lastline[sizeof(thisline)];
+    struct  symimage *sip;
 
     lno = 1;
     if(offset) {
@@ -108,6 +439,16 @@ AddrToSym(int tfdin,ulong addr,char *name,ulong *offset)
     } else {
         tfd = tfdin;
     }
+
+    sip = symfload(tfd);
+    if(sip) {
+        lno = symbyaddr(sip,addr,name,offset);
+        if(tfdin == -1) {
+            tfsclose(tfd,0);
+        }
+        return(lno);
+    }
+
     tfsseek(tfd,0,TFS_BEGIN);
     while(tfsgetline(tfd,thisline,sizeof(thisline)-1)) {
         space = strpbrk(thisline,"\t ");
@@ -181,11 +522,18 @@ getsym(char *symname,char *line,int sizeofline)
 {
     int     tfd;
     char    *space;
+    struct  symimage *sip;
 
     if((tfd = SymFileFd(1)) < 0) {
         return((char *)0);
     }
 
+    sip = symfload(tfd);
+    if(sip) {
+        tfsclose(tfd,0);
+        return(symbyname(sip,symname,line,sizeofline));
+    }
+
     while(tfsgetline(tfd,line,sizeofline)) {
         char *eol;
         eol = strpbrk(line,"\r\n");
@@ -32,9 +32,36 @@
 #include "ether.h"
 #include "stddefs.h"
 #include "cli.h"
+#include "timer.h"
 
 #define SYSLOG_PORT 514
 
+/* Buffered syslog channel configuration:
+ * SYSLOG_QSIZE:
+ *  Number of messages that can be held in the ring waiting for delivery.
+ * SYSLOG_MSGSIZE:
+ *  Maximum size of one queued message (longer messages are truncated).
+ * SYSLOG_PKTSIZE:
+ *  Maximum syslog payload packed into one datagram in batch mode.
+ * SYSLOG_MAXPPS:
+ *  Maximum number of datagrams sent per second by syslogPoll().
+ */
+#ifndef SYSLOG_QSIZE
+#define SYSLOG_QSIZE    16
+#endif
+
+#ifndef SYSLOG_MSGSIZE
+#define SYSLOG_MSGSIZE  128
+#endif
+
+#ifndef SYSLOG_PKTSIZE
+#define SYSLOG_PKTSIZE  1024
+#endif
+
+#ifndef SYSLOG_MAXPPS
+#define SYSLOG_MAXPPS   50
+#endif
+
 struct nameval {
     char *name;
     int val;
@@ -183,35 +210,18 @@ getFacilityValue(char *fac)
     return(-1);
 }
 
-int
-sendSyslog(uchar *syslogsrvr,char *msg, short port, int null)
+/* buildSyslogPkt():
+ * Retrieve the transmit buffer from the driver and fill in the
+ * ethernet, IP and UDP headers for a syslog datagram of 'msglen'
+ * bytes.  Return a pointer to the start of the syslog payload.
+ */
+static uchar *
+buildSyslogPkt(uchar *binip, uchar *binenet, short port, int msglen)
 {
-    int msglen;
-    uchar *syslogmsg;
     ushort ip_len, sport;
     struct ether_header *enetp;
     struct ip *ipp;
     struct Udphdr *udpp;
-    uchar   binip[8], binenet[8], *enetaddr;
-
-    /* msglen is the length of the message, plus optionally the
-     * terminating null character (-n option of syslog command)..
-     */
-    msglen = strlen(msg) + null;
-
-    /* Convert IP address to binary:
-     */
-    if(IpToBin((char *)syslogsrvr,(unsigned char *)binip) < 0) {
-        return(0);
-    }
-
-    /* Get the ethernet address for the IP:
-     */
-    enetaddr = ArpEther(binip,binenet,0);
-    if(!enetaddr) {
-        printf("ARP failed for %s\n",syslogsrvr);
-        return(0);
-    }
 
     /* Retrieve an ethernet buffer from the driver and populate the
      * ethernet level of packet:
@@ -244,28 +254,245 @@ sendSyslog(uchar *syslogsrvr,char *msg, short port, int null)
     udpp->uh_dport = ecs(port);
     udpp->uh_ulen = ecs((ushort)(ip_len - sizeof(struct ip)));
 
-    /* Finally, the SYSLOG data ...
-     */
-    syslogmsg = (uchar *)(udpp+1);
-    strcpy((char *)syslogmsg,(char *)msg);
+    return((uchar *)(udpp+1));
+}
 
+/* sendSyslogPkt():
+ * Complete the checksums of the packet started by buildSyslogPkt()
+ * and send it.
+ */
+static void
+sendSyslogPkt(int msglen)
+{
+    struct ip *ipp;
+
+    ipp = (struct ip *)(getXmitBuffer() + ETHERSIZE);
     ipChksum(ipp);          /* Compute csum of ip hdr */
     udpChksum(ipp);         /* Compute UDP checksum */
 
     sendBuffer(ETHERSIZE + IPSIZE + UDPSIZE + msglen);
+}
+
+int
+sendSyslog(uchar *syslogsrvr,char *msg, short port, int null)
+{
+    int msglen;
+    uchar *syslogmsg;
+    uchar   binip[8], binenet[8], *enetaddr;
+
+    /* msglen is the length of the message, plus optionally the
+     * terminating null character (-n option of syslog command)..
+     */
+    msglen = strlen(msg) + null;
+
+    /* Convert IP address to binary:
+     */
+    if(IpToBin((char *)syslogsrvr,(unsigned char *)binip) < 0) {
+        return(0);
+    }
+
+    /* Get the ethernet address for the IP:
+     */
+    enetaddr = ArpEther(binip,binenet,0);
+    if(!enetaddr) {
+        printf("ARP failed for %s\n",syslogsrvr);
+        return(0);
+    }
+
+    /* Finally, the SYSLOG data ...
+     */
+    syslogmsg = buildSyslogPkt(binip,binenet,port,msglen);
+    strcpy((char *)syslogmsg,(char *)msg);
+    sendSyslogPkt(msglen);
+    return(0);
+}
+
+/* Buffered syslog channel:
+ * Messages passed to syslogEnqueue() (by the application through
+ * mon_syslog(), or by "syslog -q") are copied into a ring and returned
+ * immediately; nothing is sent and no ARP is done at that point.
+ * The ring is drained by syslogPoll(), which is called from
+ * pollethernet().  Each call sends at most one datagram and the total
+ * is limited to SYSLOG_MAXPPS datagrams per second, so a burst of
+ * logging doesn't flood the network or starve other polled services.
+ *
+ * In batch mode (syslog -S -b) as many queued messages as will fit in
+ * SYSLOG_PKTSIZE are packed into one datagram, each one framed with
+ * the octet-counting method of RFC 6587 ("LEN SP MSG"); otherwise each
+ * message goes out in its own datagram.
+ *
+ * If the ring is full, the new message is dropped and counted.  The
+ * destination server (and its MAC address) is resolved once by
+ * "syslog -S" so that draining never has to block on ARP.
+ */
+struct syslogqmsg {
+    short   len;
+    char    msg[SYSLOG_MSGSIZE];
+};
+
+static struct syslogqmsg SyslogQ[SYSLOG_QSIZE];
+static int  SyslogQin, SyslogQout, SyslogQcnt;
+static int  SyslogBatch, SyslogSrvrSet, SyslogPktsInWindow;
+static short SyslogQPort;
+static uchar SyslogQIp[4], SyslogQEnet[6];
+static ulong SyslogQueued, SyslogSent, SyslogDropped, SyslogPkts;
+static struct elapsed_tmr SyslogRateTmr;
+
+int
+syslogEnqueue(int pri, char *msg)
+{
+    int len;
+    struct syslogqmsg *qmp;
+
+    if(SyslogQcnt == SYSLOG_QSIZE) {
+        SyslogDropped++;
+        return(-1);
+    }
+    qmp = &SyslogQ[SyslogQin];
+
+    if(pri) {
+        len = snprintf(qmp->msg,SYSLOG_MSGSIZE,"<%d>",pri);
+    } else {
+        len = 0;
+    }
+    while(*msg && (len < SYSLOG_MSGSIZE)) {
+        qmp->msg[len++] = *msg++;
+    }
+    qmp->len = len;
+
+    if(++SyslogQin == SYSLOG_QSIZE) {
+        SyslogQin = 0;
+    }
+    SyslogQcnt++;
+    SyslogQueued++;
+    return(0);
+}
+
+void
+syslogPoll(void)
+{
+    int msglen, len;
+    char *cp;
+    struct syslogqmsg *qmp;
+
+    if((SyslogQcnt == 0) || (!SyslogSrvrSet)) {
+        return;
+    }
+
+    /* Rate limit:
+     */
+    if(msecElapsed(&SyslogRateTmr)) {
+        startElapsedTimer(&SyslogRateTmr,1000);
+        SyslogPktsInWindow = 0;
+    }
+    if(SyslogPktsInWindow >= SYSLOG_MAXPPS) {
+        return;
+    }
+
+    /* Determine how much of the queue goes into this datagram...
+     */
+    msglen = 0;
+    if(SyslogBatch) {
+        int i, qidx;
+        char lenbuf[8];
+
+        qidx = SyslogQout;
+        for(i=0; i<SyslogQcnt; i++) {
+            qmp = &SyslogQ[qidx];
+            len = snprintf(lenbuf,sizeof(lenbuf),"%d ",qmp->len) + qmp->len;
+            if((msglen + len > SYSLOG_PKTSIZE) && (msglen != 0)) {
+                break;
+            }
+            msglen += len;
+            if(++qidx == SYSLOG_QSIZE) {
+                qidx = 0;
+            }
+        }
+    } else {
+        msglen = SyslogQ[SyslogQout].len;
+    }
+
+    cp = (char *)buildSyslogPkt(SyslogQIp,SyslogQEnet,SyslogQPort,msglen);
+
+    len = 0;
+    while(len < msglen) {
+        qmp = &SyslogQ[SyslogQout];
+        if(SyslogBatch) {
+            len += snprintf(cp+len,8,"%d ",qmp->len);
+        }
+        memcpy(cp+len,qmp->msg,qmp->len);
+        len += qmp->len;
+        if(++SyslogQout == SYSLOG_QSIZE) {
+            SyslogQout = 0;
+        }
+        SyslogQcnt--;
+        SyslogSent++;
+    }
+
+    sendSyslogPkt(msglen);
+    SyslogPkts++;
+    SyslogPktsInWindow++;
+}
+
+/* syslogSetServer():
+ * Establish (or with srvr == 0, disable) the destination of the
+ * buffered syslog channel.
+ */
+static int
+syslogSetServer(char *srvr, short port, int batch)
+{
+    SyslogSrvrSet = 0;
+    if(srvr == 0) {
+        return(0);
+    }
+
+    if(IpToBin(srvr,SyslogQIp) < 0) {
+        return(-1);
+    }
+
+    if(!ArpEther(SyslogQIp,SyslogQEnet,0)) {
+        printf("ARP failed for %s\n",srvr);
+        return(-1);
+    }
+    SyslogQPort = port;
+    SyslogBatch = batch;
+    startElapsedTimer(&SyslogRateTmr,1000);
+    SyslogPktsInWindow = 0;
+    SyslogSrvrSet = 1;
     return(0);
 }
 
+static void
+syslogQStats(void)
+{
+    if(SyslogSrvrSet) {
+        printf("Buffered server: %d.%d.%d.%d port %d%s\n",
+               SyslogQIp[0],SyslogQIp[1],SyslogQIp[2],SyslogQIp[3],
+               SyslogQPort, SyslogBatch ? " (batched)" : "");
+    } else {
+        printf("Buffered server: not set\n");
+    }
+    printf("Queued:    %d (of %d)\n",SyslogQcnt,SYSLOG_QSIZE);
+    printf("Enqueued:  %ld\n",SyslogQueued);
+    printf("Sent:      %ld (in %ld datagrams, at most %d/sec)\n",
+           SyslogSent,SyslogPkts,SYSLOG_MAXPPS);
+    printf("Dropped:   %ld\n",SyslogDropped);
+}
+
 char *SyslogHelp[] = {
     "Syslog client",
-    "-[f:lP:np:v] {srvr ip} {msg}",
+    "-[bf:lP:np:qSv] {srvr ip} {msg}",
 #if INCLUDE_VERBOSEHELP
     "Options:",
+    " -b        batch queued msgs per datagram (with -S)",
     " -f {fac}  specify facility",
     " -l        list facility & priority strings",
     " -n        append null-char to message",
     " -P {##}   override default port 514",
     " -p {prio} specify priority",
+    " -q        queue msg to buffered server (no srvr ip)",
+    " -S        set buffered server ('off' to disable)",
+    "           or show its stats if no srvr ip",
     " -v        verbose",
 #endif
     0,
@@ -277,13 +504,18 @@ SyslogCmd(int argc, char *argv[])
 {
     char *facility, *priority, *msg;
     int opt, verbose, fac_val, prio_val, val, port, null;
+    int batch, queue, setsrvr;
 
     port =  SYSLOG_PORT;
     facility = priority = 0;
     null = fac_val = prio_val = verbose = 0;
+    batch = queue = setsrvr = 0;
 
-    while((opt=getopt(argc,argv,"f:lnP:p:v")) != -1) {
+    while((opt=getopt(argc,argv,"bf:lnP:p:qSv")) != -1) {
         switch(opt) {
+        case 'b':
+            batch = 1;
+            break;
         case 'f':
             facility = optarg;
             break;
@@ -299,6 +531,12 @@ SyslogCmd(int argc, char *argv[])
         case 'p':
             priority = optarg;
             break;
+        case 'q':
+            queue = 1;
+            break;
+        case 'S':
+            setsrvr = 1;
+            break;
         case 'v':
             verbose = 1;
             break;
@@ -307,7 +545,23 @@ SyslogCmd(int argc, char *argv[])
         }
     }
 
-    if(argc != optind+2) {
+    if(setsrvr) {
+        if(argc == optind) {
+            syslogQStats();
+            return(CMD_SUCCESS);
+        }
+        if(argc != optind+1) {
+            return(CMD_PARAM_ERROR);
+        }
+        if(!strcmp(argv[optind],"off")) {
+            syslogSetServer(0,0,0);
+        } else if(syslogSetServer(argv[optind],port,batch) < 0) {
+            return(CMD_FAILURE);
+        }
+        return(CMD_SUCCESS);
+    }
+
+    if(argc != optind+(queue ? 1 : 2)) {
         return(CMD_PARAM_ERROR);
     }
 
@@ -320,6 +574,16 @@ SyslogCmd(int argc, char *argv[])
 
     val = (prio_val | fac_val);
 
+    if(queue) {
+        if(syslogEnqueue(val,argv[optind]) < 0) {
+            if(verbose) {
+                printf("Syslog queue full, msg dropped\n");
+            }
+            return(CMD_FAILURE);
+        }
+        return(CMD_SUCCESS);
+    }
+
     if((priority != 0) || (facility != 0)) {
         msg = malloc(strlen(argv[optind+1])+16);
         if(!msg) {
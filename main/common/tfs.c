@@ -149,6 +149,7 @@ struct  tfsdat tfsSlots[TFS_MAXOPEN];
 long    tfsTrace;
 int     TfsCleanEnable;
 long    tfsFmodCount;
+struct  defragstat DefragStat;
 char    tfsInitialized;
 
 static void     pre_tfsautoboot_hook(void);
@@ -207,6 +208,9 @@ struct tfsflg tfsflgtbl[] = {
     { TFS_EXEC,         'e',    "executable",           TFS_EXEC },
     { TFS_SYMLINK,      'l',    "symbolic link",        TFS_SYMLINK },
     { TFS_EBIN,         'E',    TFS_EBIN_NAME,          TFS_EBIN },
+#if INCLUDE_TFSCPRS
+    { TFS_CPRS,         'c',    "compressed",           TFS_CPRS },
+#endif
     { TFS_IPMOD,        'i',    "inplace_modifiable",   TFS_IPMOD },
     { TFS_UNREAD,       'u',    "ulvl_unreadable",      TFS_UNREAD },
     /*  { TFS_ULVL0,        '0',    "ulvl_0",               TFS_ULVLMSK }, */
@@ -248,6 +252,7 @@ static struct tfserr tfserrtbl[] = {
     { TFSERR_NORUNMONRC,    "can't run from monrc" },
     { TFSERR_DSIMAX,        "out of DSI space" },
     { TFSERR_TOOSMALL,      "partition size too small" },
+    { TFSERR_BADCPRS,       "bad compressed file" },
     { 0,0 }
 };
 
@@ -358,12 +363,10 @@ tfsflasheraseall(TDEV *tdp)
     if(addrtosector((uchar *)tdp->start,&snum,0,0) < 0) {
         return(TFSERR_MEMFAIL);
     }
-    last = snum + tdp->sectorcount;
+    last = snum + tdp->sectorcount - 1;
 
-    while(snum < last) {
-        if(AppFlashErase(snum++) <= 0) {
-            return(TFSERR_MEMFAIL);
-        }
+    if(AppFlashEraseSet(snum,last) <= 0) {
+        return(TFSERR_MEMFAIL);
     }
 
     /* Erase the spare (if there is one)...
@@ -2127,6 +2130,21 @@ tfsadd(char *name, char *info, char *flags, uchar *src, int size)
         if((bflags & TFS_SYMLINK) && (size != 0)) {
             return(TFSERR_LINKERROR);
         }
+
+#if INCLUDE_TFSCPRS
+        /* A compressed file is only ever read through the API (or by
+         * scripts), so it can't be an executable binary, a link or
+         * in-place-modifiable; and it must have a valid block table...
+         */
+        if(bflags & TFS_CPRS) {
+            if(bflags & (TFS_EBIN | TFS_SYMLINK | TFS_IPMOD)) {
+                return(TFSERR_BADFLAG);
+            }
+            if(!tfscprsidx(src,size,0,0)) {
+                return(TFSERR_BADCPRS);
+            }
+        }
+#endif
     }
 
     /* Make sure that there isn't a stale file and a normal file
@@ -58,6 +58,7 @@
 /*      query passes. */
 #define TFS_SYMLINK 0x00000008  /* 'l': Symbolic link file. */
 #define TFS_EBIN    0x00000010  /* 'E': Executable binary (coff/elf/a.out). */
+#define TFS_CPRS    0x00000040  /* 'c': File is compressed (see below). */
 #define TFS_IPMOD   0x00000080  /* 'i': File is in-place modifiable. */
 #define TFS_UNREAD  0x00000100  /* 'u': File is not even readable if the */
 /*      user-level requirement is not met; */
@@ -151,6 +152,29 @@ struct tfsramdev {
 
 #define TFSHDRSIZ   sizeof(struct tfshdr)
 
+/* Compressed files:
+ *  The data of a file with the TFS_CPRS flag is LZ4 compressed in
+ *  fixed-size independent blocks, so that tfsread(), tfsseek() and
+ *  tfsgetline() can work on the uncompressed data while only
+ *  decompressing the blocks that are touched.  The file is an LZ4
+ *  skippable frame holding the block offset table, followed by an
+ *  ordinary LZ4 frame (so the file as a whole is still valid LZ4
+ *  data).  All values are 32-bit little-endian:
+ *
+ *      TFSCPRS_MAGIC
+ *      Length of the rest of this frame (12 + 4 * (nblks + 1))
+ *      Uncompressed size of the file
+ *      Uncompressed block size (every block but the last is this size)
+ *      nblks
+ *      nblks+1 offsets from the start of the file; the first nblks
+ *      are the blocks (each starting with its LZ4 block size word),
+ *      the last is the frame's end mark.
+ *
+ *  Use "lz4pack -t" (ports/linux_host) to build one.
+ */
+#define TFSCPRS_MAGIC   0x184D2A5C
+#define TFSCPRS_HDRSIZ  20
+
 /* TFS error returns. */
 #define TFS_OKAY                0
 #define TFSERR_NOFILE           -1
@@ -184,6 +208,7 @@ struct tfsramdev {
 #define TFSERR_NORUNMONRC       -31
 #define TFSERR_DSIMAX           -32
 #define TFSERR_TOOSMALL         -33
+#define TFSERR_BADCPRS          -34
 #define TFSERR_MIN              -100
 
 /* TFS seek options. */
@@ -194,6 +219,7 @@ struct tfsramdev {
 /* Macros: */
 #define TFS_DELETED(fp)     (!((fp)->flags & TFS_ACTIVE))
 #define TFS_FILEEXISTS(fp)  ((fp)->flags & TFS_ACTIVE)
+#define TFS_ISCPRS(fp)      ((fp)->flags & TFS_CPRS)
 #define TFS_ISEXEC(fp)      ((fp)->flags & TFS_EXEC)
 #define TFS_ISBOOT(fp)      ((fp)->flags & TFS_BRUN)
 #define TFS_ISLINK(fp)      ((fp)->flags & TFS_SYMLINK)
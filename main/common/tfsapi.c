@@ -39,6 +39,232 @@
 #include "tfsprivate.h"
 #if INCLUDE_TFSAPI
 
+#if INCLUDE_TFSCPRS
+
+/* Compressed files (TFS_CPRS, see tfs.h):
+ *  These are read through a small cache of decompressed blocks, shared
+ *  by all open files.  A block is decompressed the first time it is
+ *  touched, replacing the least recently used one in the cache.  Each
+ *  block is tagged with the file's data address and header crc, so the
+ *  cache stays good across opens of the same file, and can't be
+ *  confused with a file that later replaces it.
+ *  TFSCPRS_CACHE is the number of blocks kept, and TFSCPRS_BLKMAX is
+ *  the largest block size that can be read (each cache buffer is this
+ *  size, malloc'ed when it is first used).
+ */
+#ifndef TFSCPRS_CACHE
+#define TFSCPRS_CACHE   4
+#endif
+
+#ifndef TFSCPRS_BLKMAX
+#define TFSCPRS_BLKMAX  0x4000
+#endif
+
+struct tfscblk {
+    uchar   *base;          /* Data address of the file... */
+    ulong   hdrcrc;         /* ...and its header crc. */
+    long    blkno;
+    ulong   lastuse;        /* Zero if the entry is empty. */
+    char    *data;
+};
+
+static struct tfscblk TfsCblk[TFSCPRS_CACHE];
+static ulong TfsCblkTick;
+
+static ulong
+tfsget32(uchar *p)
+{
+    return((ulong)p[0] | ((ulong)p[1] << 8) | ((ulong)p[2] << 16) |
+           ((ulong)p[3] << 24));
+}
+
+/* tfscprsidx():
+ *  Check the header and block offset table at the start of the 'size'
+ *  bytes of compressed file data at 'base'.  If they are good, return a
+ *  pointer to the offset table, and the uncompressed size and block
+ *  size in *usize and *bsize (if not null); else return 0.
+ */
+uchar *
+tfscprsidx(uchar *base,long size,long *usize,long *bsize)
+{
+    long    i, fsize, blksize, nblks, off, min;
+    uchar   *tbl;
+
+    if(size < TFSCPRS_HDRSIZ + 4) {
+        return((uchar *)0);
+    }
+    fsize = (long)tfsget32(base+8);
+    blksize = (long)tfsget32(base+12);
+    nblks = (long)tfsget32(base+16);
+    if((tfsget32(base) != TFSCPRS_MAGIC) || (fsize < 0) ||
+            (blksize < 1) || (blksize > TFSCPRS_BLKMAX) ||
+            (nblks < 0) || (nblks > (size - TFSCPRS_HDRSIZ) / 8) ||
+            (nblks != fsize / blksize + (fsize % blksize ? 1 : 0)) ||
+            (tfsget32(base+4) != (ulong)(12 + 4 * (nblks + 1)))) {
+        return((uchar *)0);
+    }
+
+    /* Each block (and the end mark that follows them) is at least its
+     * 4-byte size word, and they are in order...
+     */
+    tbl = base + TFSCPRS_HDRSIZ;
+    min = TFSCPRS_HDRSIZ + 4 * (nblks + 1);
+    for(i=0; i<=nblks; i++) {
+        off = (long)tfsget32(tbl + 4*i);
+        if((off < min) || (off > size - 4)) {
+            return((uchar *)0);
+        }
+        min = off + 4;
+    }
+
+    if(usize) {
+        *usize = fsize;
+    }
+    if(bsize) {
+        *bsize = blksize;
+    }
+    return(tbl);
+}
+
+/* tfscprsinfo():
+ *  Return the uncompressed size and block size of a compressed file.
+ */
+int
+tfscprsinfo(TFILE *fp,long *usize,long *bsize)
+{
+    if(!(fp->flags & TFS_CPRS) ||
+            !tfscprsidx((uchar *)TFS_BASE(fp),fp->filsize,usize,bsize)) {
+        return(TFSERR_BADCPRS);
+    }
+    return(TFS_OKAY);
+}
+
+/* tfscblock():
+ *  Point *data at block 'blkno' of the open compressed file, from the
+ *  cache or by decompressing it into the cache.
+ */
+static int
+tfscblock(struct tfsdat *tdat,long blkno,char **data)
+{
+    int     i, victim;
+    long    n, len, off;
+    struct  tfscblk *cbp;
+
+    victim = 0;
+    for(i=0,cbp=TfsCblk; i<TFSCPRS_CACHE; i++,cbp++) {
+        if(cbp->lastuse && (cbp->blkno == blkno) &&
+                (cbp->base == tdat->base) &&
+                (cbp->hdrcrc == tdat->hdr.hdrcrc)) {
+            cbp->lastuse = ++TfsCblkTick;
+            *data = cbp->data;
+            return(TFS_OKAY);
+        }
+        if(cbp->lastuse < TfsCblk[victim].lastuse) {
+            victim = i;
+        }
+    }
+
+    cbp = &TfsCblk[victim];
+    cbp->lastuse = 0;
+    if(!cbp->data) {
+        cbp->data = malloc(TFSCPRS_BLKMAX);
+        if(!cbp->data) {
+            return(TFSERR_MEMFAIL);
+        }
+    }
+
+    len = tdat->hdr.filsize - blkno * tdat->blksize;
+    if(len > tdat->blksize) {
+        len = tdat->blksize;
+    }
+    off = (long)tfsget32(tdat->blktbl + 4*blkno);
+    n = unLz4Block((char *)tdat->base + off,
+                   (int)(tfsget32(tdat->blktbl + 4*blkno + 4) - off),
+                   cbp->data,(int)len);
+
+    if(tfsTrace > 1) {
+        printf("tfscblock(%s,%ld)=%ld\n",tdat->hdr.name,blkno,n);
+    }
+
+    if(n != len) {
+        return(TFSERR_CORRUPT);
+    }
+    cbp->base = tdat->base;
+    cbp->hdrcrc = tdat->hdr.hdrcrc;
+    cbp->blkno = blkno;
+    cbp->lastuse = ++TfsCblkTick;
+    *data = cbp->data;
+    return(TFS_OKAY);
+}
+
+/* tfscread():
+ *  Copy 'cnt' bytes (which the caller has checked are within the file)
+ *  from the current offset of the open compressed file to buf, without
+ *  changing the offset.
+ */
+static int
+tfscread(struct tfsdat *tdat,char *buf,int cnt)
+{
+    int     err;
+    long    off, boff, n, tot;
+    char    *data;
+
+    off = tdat->offset;
+    for(tot=0; tot<cnt; tot+=n) {
+        err = tfscblock(tdat,off / tdat->blksize,&data);
+        if(err != TFS_OKAY) {
+            return(err);
+        }
+        boff = off % tdat->blksize;
+        n = tdat->blksize - boff;
+        if(n > cnt - tot) {
+            n = cnt - tot;
+        }
+        memcpy(buf+tot,data+boff,n);
+        off += n;
+    }
+    return(tot);
+}
+
+/* tfscprsimage():
+ *  For code that parses a whole file in memory (the script compiler,
+ *  the symbol and structure file loaders): return, in *image, a
+ *  malloc'ed copy of the uncompressed data of the open compressed file.
+ *  The caller frees it.  The file offset is not changed.
+ */
+int
+tfscprsimage(int fd,char **image)
+{
+    int     err;
+    long    offset;
+    struct tfsdat *tdat;
+
+    if((fd < 0) || (fd >= TFS_MAXOPEN)) {
+        return(TFSERR_BADARG);
+    }
+
+    tdat = &tfsSlots[fd];
+    if((tdat->offset == -1) || (!tdat->blktbl)) {
+        return(TFSERR_BADFD);
+    }
+
+    /* One extra byte, so an empty file still gets a buffer. */
+    if((*image = malloc(tdat->hdr.filsize + 1)) == 0) {
+        return(TFSERR_MEMFAIL);
+    }
+    offset = tdat->offset;
+    tdat->offset = 0;
+    err = tfscread(tdat,*image,tdat->hdr.filsize);
+    tdat->offset = offset;
+    if(err < 0) {
+        free(*image);
+        return(err);
+    }
+    return(TFS_OKAY);
+}
+
+#endif  /* INCLUDE_TFSCPRS */
+
 /* tfstruncate():
  *  To support the ability to truncate a file (make it smaller); this
  *  function allows the user to adjust the high-water point of the currently
@@ -138,6 +364,20 @@ tfsread(int fd, char *buf, int cnt)
         return(TFSERR_EOF);
     }
 
+#if INCLUDE_TFSCPRS
+    /* A compressed file is read from its (cached) decompressed blocks. */
+    if(tdat->blktbl) {
+        if((tdat->offset + cnt) > tdat->hdr.filsize) {
+            cnt = tdat->hdr.filsize - tdat->offset;
+        }
+        cnt = tfscread(tdat,buf,cnt);
+        if(cnt > 0) {
+            tdat->offset += cnt;
+        }
+        return(cnt);
+    }
+#endif
+
     from = (uchar *) tdat->base + tdat->offset;
 
     /* If request size is within the range of the file and current
@@ -213,6 +453,8 @@ tfswrite(int fd, char *buf, int cnt)
  *  Adjust the current pointer into the specified file.
  *  If file is read-only, then the offset cannot exceed the file size;
  *  otherwise, the only check made to the offset is that it is positive.
+ *  For a compressed file, the offset and size are those of the
+ *  uncompressed data (nothing is decompressed until it is read).
  *  MONLIB NOTICE: this function is accessible through monlib.c.
  */
 int
@@ -401,6 +643,14 @@ tfsopen(char *file,long flagmode,char *buf)
         break;
     }
 
+#if INCLUDE_TFSCPRS
+    /* A compressed file can only be replaced, not appended to. */
+    if((errno == TFS_OKAY) && (fmode & TFS_APPEND) &&
+            (fp->flags & TFS_CPRS)) {
+        errno = TFSERR_RDONLY;
+    }
+#endif
+
     if(errno != TFS_OKAY) {
         retval = errno;
         goto done;
@@ -423,6 +673,7 @@ tfsopen(char *file,long flagmode,char *buf)
         slot->hwp = 0;
         slot->offset = 0;
         slot->flagmode = fmode;
+        slot->blktbl = (uchar *)0;
         if(fmode & TFS_CREATE) {
             strncpy(slot->hdr.name,file,TFSNAMESIZE);
             slot->flagmode |= (flagmode & TFS_FLAGMASK);
@@ -442,6 +693,20 @@ tfsopen(char *file,long flagmode,char *buf)
         } else {
             slot->base = (uchar *)(TFS_BASE(fp));
             memcpy((char *)&slot->hdr,(char *)fp,sizeof(struct tfshdr));
+#if INCLUDE_TFSCPRS
+            /* For a compressed file, the size (as seen through the API)
+             * is the uncompressed size...
+             */
+            if(fp->flags & TFS_CPRS) {
+                slot->blktbl = tfscprsidx(slot->base,fp->filsize,
+                                          &slot->hdr.filsize,&slot->blksize);
+                if(!slot->blktbl) {
+                    slot->offset = -1;
+                    retval = TFSERR_BADCPRS;
+                    goto done;
+                }
+            }
+#endif
         }
     } else {
         retval = TFSERR_NOSLOT;
@@ -582,6 +847,9 @@ tfsgetline(int fd,char *buf,int max)
     int     tot, rtot;
     struct  tfsdat *tdat;
     volatile char   *to;
+#if INCLUDE_TFSCPRS
+    long    off, end;
+#endif
 
     max--;
 
@@ -619,6 +887,46 @@ tfsgetline(int fd,char *buf,int max)
         max = tdat->hdr.filsize - tdat->offset + 1;
     }
 
+#if INCLUDE_TFSCPRS
+    /* For a compressed file, pull what could be the line into buf and
+     * scan it from there.  The line is never longer than the raw data
+     * (CRs are dropped), so it can be built in place; the NULL stops
+     * the scan at the end of the file.  The data is pulled in up to
+     * one block at a time, stopping at the block that ends the line,
+     * so a long 'max' doesn't decompress (and push out of the cache)
+     * blocks that the line doesn't reach.
+     */
+    if(tdat->blktbl) {
+        off = tdat->offset;
+        end = (off + max) > tdat->hdr.filsize ? tdat->hdr.filsize : off+max;
+        for(rtot=0; off+rtot < end; rtot+=tot) {
+            tot = tdat->blksize - ((off + rtot) % tdat->blksize);
+            if(tot > end - (off + rtot)) {
+                tot = end - (off + rtot);
+            }
+            tdat->offset = off + rtot;
+            tot = tfscread(tdat,buf+rtot,tot);
+            tdat->offset = off;
+            if(tot < 0) {
+                return(tot);
+            }
+            for(to=buf+rtot; to<buf+rtot+tot; to++) {
+                if((*to == 0x0a) || (*to == 0x1a) ||
+                        ((uchar)*to > 0x7f) || (*to == 0)) {
+                    break;
+                }
+            }
+            if(to < buf+rtot+tot) {
+                rtot += tot;
+                break;
+            }
+        }
+        buf[rtot] = 0;
+        from = (uchar *)buf;
+        to = buf;
+    }
+#endif
+
     /* Read from the file data area until newline (0x0a) is found
      * (or until the 'max buffer space' value is reached).
      * Strip 0x0d (if present) and terminate with NULL  in all cases.
@@ -37,6 +37,7 @@
 #include "flash.h"
 #include "monflags.h"
 #include "warmstart.h"
+#include "timer.h"
 
 #if INCLUDE_TFS
 
@@ -127,6 +128,7 @@ defragSerase(int tag, int snum)
     } else
 #endif
         ret = tfsflasherase(snum);
+    DefragStat.toterases++;
     if(ret <= 0) {
         printf("tfsclean() serase erase failed: %d,%d,%d\n",snum,tag,ret);
     }
@@ -160,6 +162,8 @@ defragFwrite(int tag, uchar *dest,uchar *src,int size)
     } else
 #endif
         ret = tfsflashwrite(dest,src,size);
+    DefragStat.totwrites++;
+    DefragStat.totbytes += size;
     if(ret != TFS_OKAY) {
         printf("tfsclean() fwrite failed: 0x%lx,0x%lx,%d,%d\n",
                (ulong)dest,(ulong)src,size,tag);
@@ -1724,8 +1728,8 @@ defragBuildCrcTable(TDEV *tdp, struct defraghdr *dht, int verbose)
     return(0);
 }
 
-/* _tfsclean():
- * This is the front-end of the defragmentation process, following are the
+/* defragclean():
+ * This is the body of the defragmentation process, following are the
  * basic steps of defragmentation...
  *
  * Build the Defrag State Information (DSI) area:
@@ -1761,8 +1765,8 @@ defragBuildCrcTable(TDEV *tdp, struct defraghdr *dht, int verbose)
  * always fit into one sector (the sector just prior to the spare).
  */
 
-int
-_tfsclean(TDEV *tdp, int restart, int verbose)
+static int
+defragclean(TDEV *tdp, int restart, int verbose)
 {
     int     dhstsize;       /* Size of state table overhead */
     int     firstsnum;      /* Number of first sector in TFS device. */
@@ -2127,6 +2131,37 @@ _tfsclean(TDEV *tdp, int restart, int verbose)
     return(chkstat);
 }
 
+/* _tfsclean():
+ * The front-end of the defragmentation process; run defragclean() and,
+ * if it did any flash work, record how long it took and how much work
+ * it was in DefragStat (so that changes to the defrag code, and the
+ * recovery done by tfsfixup(), can be measured).
+ */
+int
+_tfsclean(TDEV *tdp, int restart, int verbose)
+{
+    int     ret;
+    long    erases, writes, bytes;
+    struct  elapsed_tmr tmr;
+
+    erases = DefragStat.toterases;
+    writes = DefragStat.totwrites;
+    bytes = DefragStat.totbytes;
+    startElapsedTimer(&tmr,0x7fffffff);
+
+    ret = defragclean(tdp,restart,verbose);
+
+    if((DefragStat.toterases != erases) || (DefragStat.totwrites != writes)) {
+        DefragStat.count++;
+        DefragStat.msec = msecSinceStart(&tmr);
+        DefragStat.erases = DefragStat.toterases - erases;
+        DefragStat.writes = DefragStat.totwrites - writes;
+        DefragStat.bytes = DefragStat.totbytes - bytes;
+        DefragStat.totmsec += DefragStat.msec;
+    }
+    return(ret);
+}
+
 /* tfsfixup():
  *  Called at system startup to finish up a TFS defragmentation if one
  *  was in progress.
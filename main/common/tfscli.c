@@ -246,6 +246,18 @@ tfsvlist(char *filter[], int verbose, int more)
                 }
 #endif
                 putchar('\n');
+#if INCLUDE_TFSCPRS
+                if(TFS_FILEEXISTS(fp) && TFS_ISCPRS(fp)) {
+                    long usize, bsize;
+
+                    if(tfscprsinfo(fp,&usize,&bsize) == TFS_OKAY) {
+                        printf(" Data:  %ld bytes uncompressed, %ld byte blocks\n",
+                               usize,bsize);
+                    } else {
+                        printf(" Data:  bad block table\n");
+                    }
+                }
+#endif
                 sizetot += (fp->filsize + TFSHDRSIZ + DEFRAGHDRSIZ);
                 if(TFS_TIME(fp) != TIME_UNDEFINED)
                     printf(" Time:  %s\n",
@@ -354,6 +366,16 @@ tfsqlist(char *filter[], int verbose, int more)
                 }
                 printf(" %-23s  %7ld  0x%08lx  %-5s  %s\n",TFS_NAME(fp),
                        TFS_SIZE(fp),(ulong)(TFS_BASE(fp)),flags,TFS_INFO(fp));
+#if INCLUDE_TFSCPRS
+                if(verbose && TFS_ISCPRS(fp)) {
+                    long usize;
+
+                    if(tfscprsinfo(fp,&usize,0) == TFS_OKAY) {
+                        printf(" %-23s  %7ld  (uncompressed, %ld%%)\n","",
+                               usize,usize ? (TFS_SIZE(fp) * 100) / usize : 0);
+                    }
+                }
+#endif
             }
             idx++;
             if((more) && !(filelisted % more)) {
@@ -415,36 +437,96 @@ tfsrm(char *filter[])
     return(TFS_OKAY);
 }
 
-/* tfscat():
- *  Print each character of the file until NULL terminate. Replace
- *  each instance of CR or LF with CRLF.
+/* tfscatbuf():
+ *  Print 'size' characters from cp, counting lines in *lcnt for the
+ *  more throttle.  Return 0 if the output is to stop (ctrl-z in the
+ *  data or the user quit at the More prompt), else 1.
  */
-static void
-tfscat(TFILE *fp, int more)
+static int
+tfscatbuf(char *cp, long size, int more, int *lcnt)
 {
-    int i, lcnt;
-    char    *cp;
+    long    i;
 
-    lcnt = 0;
-    cp = (char *)(TFS_BASE(fp));
-    for(i=0; i<fp->filsize; i++) {
+    for(i=0; i<size; i++) {
         if(*cp == 0x1a) {   /* EOF or ctrl-z */
-            break;
+            return(0);
         }
         putchar(*cp);
         if((*cp == '\r') || (*cp == '\n')) {
-            lcnt++;
-            if(lcnt == more) {
+            (*lcnt)++;
+            if(*lcnt == more) {
                 if(More() == 0) {
-                    break;
+                    return(0);
                 }
-                lcnt = 0;
+                *lcnt = 0;
             }
         }
         cp++;
     }
+    return(1);
 }
 
+/* tfscat():
+ *  Print each character of the file until NULL terminate. Replace
+ *  each instance of CR or LF with CRLF.
+ */
+static void
+tfscat(TFILE *fp, int more)
+{
+    int     lcnt;
+#if INCLUDE_TFSCPRS
+    int     tfd, n;
+    char    buf[128];
+#endif
+
+    lcnt = 0;
+#if INCLUDE_TFSCPRS
+    /* A compressed file is read through the API, so only a block at a
+     * time is decompressed...
+     */
+    if(TFS_ISCPRS(fp)) {
+        if((tfd = tfsopen(TFS_NAME(fp),TFS_RDONLY,0)) < 0) {
+            showTfsError(tfd,TFS_NAME(fp));
+            return;
+        }
+        while(((n = tfsread(tfd,buf,sizeof(buf))) > 0) &&
+                tfscatbuf(buf,n,more,&lcnt));
+        if((n < 0) && (n != TFSERR_EOF)) {
+            showTfsError(n,TFS_NAME(fp));
+        }
+        tfsclose(tfd,0);
+        return;
+    }
+#endif
+    tfscatbuf((char *)(TFS_BASE(fp)),fp->filsize,more,&lcnt);
+}
+
+#if INCLUDE_TFSCPRS
+/* tfscprscp():
+ *  Copy the uncompressed data of a compressed file to memory.
+ */
+static int
+tfscprscp(char *name, char *to)
+{
+    int     tfd, n;
+
+    if((tfd = tfsopen(name,TFS_RDONLY,0)) < 0) {
+        return(tfd);
+    }
+    n = tfsSlots[tfd].hdr.filsize;
+    if(n > 0) {
+        n = tfsread(tfd,to,n);
+    }
+    tfsclose(tfd,0);
+    if(n < 0) {
+        return(n);
+    }
+    flushDcache(to,n);
+    invalidateIcache(to,n);
+    return(TFS_OKAY);
+}
+#endif
+
 int
 dumpFhdr(TFILE *fhp)
 {
@@ -499,7 +581,7 @@ char *TfsHelp[] = {
     " info {file} {var}, init, ld[v] {name} [sname]",
     " log {on|off} {msg}, ln {src} {lnk}, ls [filter]",
     " qclean [ramstart] [ramlen], ramdev {name} {base} {size}",
-    " rm {filter}, run {name}, size {file} {var}, stat",
+    " rm {filter}, run {name}, sflush, size {file} {var}, stat",
     " trace [lvl], uname {prefix} {var}",
 #if DEFRAG_TEST_ENABLED
     "",
@@ -617,6 +699,8 @@ Tfs(int argc, char *argv[])
         }
     } else if(strcmp(arg1, "log") == 0) {
         retval = tfsLogCmd(argc,argv,optind);
+    } else if((strcmp(arg1, "sflush") == 0) && (argc == (optind+1))) {
+        printf("%d cached script(s) flushed\n",tfsscriptflush(1));
     } else if(strcmp(arg1, "cfg") == 0) {
         /* args:
          * tfsstart tfsend spare_address
@@ -659,6 +743,15 @@ Tfs(int argc, char *argv[])
             }
         }
         printf("Total files currently opened: %d\n",opencnt);
+
+        /* Display the cost of defragmentation: */
+        if(DefragStat.count) {
+            printf("Defrags: %ld (%ld msec total)\n",
+                   DefragStat.count,DefragStat.totmsec);
+            printf("Last defrag: %ld msec, %ld erases, %ld writes (%ld bytes)\n",
+                   DefragStat.msec,DefragStat.erases,DefragStat.writes,
+                   DefragStat.bytes);
+        }
     } else if(strcmp(arg1, "freemem") == 0) {
         char *prefix;
 
@@ -761,6 +854,11 @@ Tfs(int argc, char *argv[])
             if((fp->flags & TFS_UNREAD) &&
                     (TFS_USRLVL(fp) > getUsrLvl())) {
                 status = showTfsError(TFSERR_USERDENIED,from);
+#if INCLUDE_TFSCPRS
+            } else if((to[0] == '0' && to[1] == 'x') && TFS_ISCPRS(fp)) {
+                status = showTfsError(tfscprscp(from,
+                                      (char *)strtol(to,0,16)),from);
+#endif
             } else if(to[0] == '0' && to[1] == 'x') {
                 memcpy((char *)strtol(to,0,16),TFS_BASE(fp),TFS_SIZE(fp));
                 flushDcache((char *)strtol(to,0,16), TFS_SIZE(fp));
@@ -26,6 +26,8 @@
  * TFS_EBIN_COFF, TFS_EBIN_ELF, TFS_EBIN_AOUT or TFS_EBIN_MSBIN
  * respectively, be set in the monitor's config.h file.  Also, defining
  * TFS_EBIN_ELFMSBIN will allow TFS to support both ELF and MSBIN.
+ * With INCLUDE_UNZIP or INCLUDE_UNLZ4, the COFF, ELF and A.OUT loaders
+ * also accept files that are gzip'ed or LZ4 compressed (see tfsloadz()).
  *
  * Original author:     Ed Sutter (ed.sutter@alcatel-lucent.com)
  *
@@ -524,12 +526,533 @@ tfsloadmsbin(TFILE *fp,int verbose,long *entrypoint,char *sname,int verifyonly)
 
 #endif
 
+#if (INCLUDE_UNZIP | INCLUDE_UNLZ4) & !TFS_EBIN_MSBIN
+
+/* Compressed executables:
+ * If an executable binary in TFS starts with the gzip or LZ4 magic
+ * number, it is loaded by the code below instead of by the loaders
+ * above.  Rather than decompressing the whole file to RAM and then
+ * loading the sections from that copy, the image is read as a stream:
+ * the headers are decompressed into local buffers and the data of each
+ * section is decompressed straight to its load address, TFSLD_ZCHUNK
+ * bytes at a time.  The compressed data is read in place from TFS, and
+ * the checksum (done by the decompressor) and the cache flush of each
+ * chunk are done while it is still in the data cache.  The stream only
+ * moves forward, so sections are loaded in the order they are in the
+ * file.
+ *
+ * A gzip image can be one member or several back to back (the image
+ * split into chunks that are compressed independently, so that inflate
+ * could be restarted at, or spread across, member boundaries; refer to
+ * unZipOpen() in zlib/gzio.c).  An LZ4 image trades some compression
+ * for a much faster load; it must have independent blocks (refer to
+ * unLz4Open() in zlib/unlz4.c, and lz4pack in ports/linux_host).
+ */
+#ifndef TFSLD_ZCHUNK
+#define TFSLD_ZCHUNK    4096
+#endif
+
+#define TFSLD_GZIP      1
+#define TFSLD_LZ4       2
+
+struct zld {
+    void    *zs;            /* Stream returned by unZipOpen()/unLz4Open()... */
+    int     (*read)(void *,char *,int);    /* ...and its read function. */
+    char    *verb;          /* "gunz" or "unlz", for the load map. */
+    ulong   offset;         /* Current offset into the decompressed image. */
+    char    *buf;           /* TFSLD_ZCHUNK bytes of scratch space. */
+    char    *head;          /* A copy of the image's first headsize bytes */
+    ulong   headsize;       /* (the headers), if the loader kept one. */
+    int     verbose;
+    int     verifyonly;
+};
+
+/* One of these for each piece of the image to be loaded (zero == 0)
+ * or cleared (zero == 1)...
+ */
+struct zldsec {
+    char    name[12];
+    ulong   offset;         /* Offset of the data in the decompressed image. */
+    char    *addr;          /* Destination. */
+    long    size;
+    char    zero;
+    char    done;
+};
+
+/* tfsldcompressed():
+ * Return TFSLD_GZIP or TFSLD_LZ4 if the file starts with the magic
+ * number of one of those, else 0.
+ */
+static int
+tfsldcompressed(TFILE *fp)
+{
+    uchar   *base;
+
+    base = (uchar *)tfsBase(fp);
+#if INCLUDE_UNZIP
+    if((TFS_SIZE(fp) > 2) && (base[0] == 0x1f) && (base[1] == 0x8b)) {
+        return(TFSLD_GZIP);
+    }
+#endif
+#if INCLUDE_UNLZ4
+    if(isLz4((char *)base,(int)TFS_SIZE(fp))) {
+        return(TFSLD_LZ4);
+    }
+#endif
+    return(0);
+}
+
+/* zldread():
+ * Decompress the next 'len' bytes of the image to 'to'.
+ * Return 0 if successful, else -1.
+ */
+static int
+zldread(struct zld *z,char *to,long len)
+{
+    if(z->read(z->zs,to,len) != len) {
+        return(-1);
+    }
+    z->offset += len;
+    return(0);
+}
+
+/* zldseek():
+ * Step forward to 'offset' in the image (by decompressing to the
+ * scratch buffer); the stream can't go backwards.
+ */
+static int
+zldseek(struct zld *z,ulong offset)
+{
+    long    n;
+
+    if(offset < z->offset) {
+        return(-1);
+    }
+    while(z->offset < offset) {
+        n = offset - z->offset;
+        if(n > TFSLD_ZCHUNK) {
+            n = TFSLD_ZCHUNK;
+        }
+        if(zldread(z,z->buf,n) < 0) {
+            return(-1);
+        }
+    }
+    return(0);
+}
+
+/* zldload():
+ * The compressed-image equivalent of tfsld_memcpy(): decompress one
+ * section to its destination (or compare it with the destination if
+ * verifyonly is set), a chunk at a time.  With verbosity greater than
+ * one (and verifyonly clear) this just reports what would be done.
+ */
+static int
+zldload(struct zld *z,struct zldsec *sp)
+{
+    int     rc;
+    long    n, left;
+    char    *to;
+
+    if(z->verbose) {
+        showSection(sp->name);
+        printf("%s %7ld bytes from +0x%06lx to 0x%08lx",
+               z->verifyonly ? "vrfy" : z->verb,sp->size,sp->offset,
+               (ulong)sp->addr);
+    }
+    if((z->verbose > 1) && !z->verifyonly) {
+        printf("\n");
+        return(0);
+    }
+    if(!z->verifyonly && inUmonBssSpace(sp->addr,sp->addr+sp->size-1)) {
+        return(-1);
+    }
+
+    to = sp->addr;
+    left = sp->size;
+    rc = 0;
+
+    /* The stream can't go back, but a section that starts within the
+     * headers (the first PT_LOAD segment of an ELF file usually has
+     * p_offset 0) can take that part from the loader's copy of them...
+     */
+    if((sp->offset < z->offset) && (z->offset <= z->headsize)) {
+        n = z->offset - sp->offset;
+        if(n > left) {
+            n = left;
+        }
+        if(z->verifyonly) {
+            if(memcmp(to,z->head+sp->offset,n) != 0) {
+                rc = -1;
+            }
+        } else {
+            memcpy(to,z->head+sp->offset,n);
+            flushDcache(to,n);
+            invalidateIcache(to,n);
+        }
+        to += n;
+        left -= n;
+    }
+    if((rc == 0) && (left > 0)) {
+        rc = zldseek(z,sp->offset + (sp->size - left));
+    }
+    while((rc == 0) && (left > 0)) {
+        n = left > TFSLD_ZCHUNK ? TFSLD_ZCHUNK : left;
+        if(z->verifyonly) {
+            rc = zldread(z,z->buf,n);
+            if((rc == 0) && (memcmp(to,z->buf,n) != 0)) {
+                rc = -1;
+            }
+        } else {
+            rc = zldread(z,to,n);
+            flushDcache(to,n);
+            invalidateIcache(to,n);
+        }
+        to += n;
+        left -= n;
+        WATCHDOG_MACRO;
+    }
+
+    if(z->verbose) {
+        if(rc < 0) {
+            printf(" FAILED\n");
+        } else if(z->verifyonly) {
+            printf(" OK\n");
+        } else {
+            printf("\n");
+        }
+    }
+    return(rc);
+}
+
+/* zldsections():
+ * Load the data of each entry in the table, in the order that the
+ * data appears in the image, then clear the zero entries.
+ */
+static int
+zldsections(struct zld *z,struct zldsec *tbl,int tot)
+{
+    int     i, next;
+
+    while(1) {
+        next = -1;
+        for(i=0; i<tot; i++) {
+            if(tbl[i].zero || tbl[i].done) {
+                continue;
+            }
+            if((next < 0) || (tbl[i].offset < tbl[next].offset)) {
+                next = i;
+            }
+        }
+        if(next < 0) {
+            break;
+        }
+        tbl[next].done = 1;
+        if(zldload(z,&tbl[next]) < 0) {
+            return(TFSERR_MEMFAIL);
+        }
+    }
+    for(i=0; i<tot; i++) {
+        if(!tbl[i].zero) {
+            continue;
+        }
+        if(z->verbose) {
+            showSection(tbl[i].name);
+        }
+        if(tfsld_memset((uchar *)tbl[i].addr,0,tbl[i].size,
+                        z->verbose,z->verifyonly) != 0) {
+            return(TFSERR_MEMFAIL);
+        }
+    }
+    return(TFS_OKAY);
+}
+
+/* zldsec():
+ * Add an entry to the section table.
+ */
+static void
+zldsec(struct zldsec *sp,char *name,ulong offset,ulong addr,long size,int zero)
+{
+    memset((char *)sp,0,sizeof(struct zldsec));
+    strncpy(sp->name,name,sizeof(sp->name)-1);
+    sp->offset = offset;
+    sp->addr = (char *)addr;
+    sp->size = size;
+    sp->zero = zero;
+}
+
+#if TFS_EBIN_AOUT
+
+static int
+zldaout(struct zld *z,long *entrypoint,char *sname)
+{
+    struct  exec ehdr;
+    struct  zldsec tbl[3];
+
+    if(zldread(z,(char *)&ehdr,sizeof(ehdr)) < 0) {
+        return(TFSERR_BADHDR);
+    }
+    if((ehdr.a_trsize) || (ehdr.a_drsize)) {
+        return(TFSERR_BADHDR);
+    }
+
+    zldsec(&tbl[0],"text",sizeof(ehdr),ehdr.a_entry,ehdr.a_text,0);
+    zldsec(&tbl[1],"data",sizeof(ehdr)+ehdr.a_text,
+           ehdr.a_entry+ehdr.a_text,ehdr.a_data,0);
+    zldsec(&tbl[2],"bss",0,ehdr.a_entry+ehdr.a_text+ehdr.a_data,
+           ehdr.a_bss,1);
+    if(zldsections(z,tbl,3) != TFS_OKAY) {
+        return(TFSERR_MEMFAIL);
+    }
+
+    if(z->verbose && !z->verifyonly) {
+        showEntrypoint(ehdr.a_entry);
+    }
+    if(entrypoint) {
+        *entrypoint = (long)(ehdr.a_entry);
+    }
+    return(TFS_OKAY);
+}
+
+#elif TFS_EBIN_COFF
+
+static int
+zldcoff(struct zld *z,long *entrypoint,char *sname)
+{
+    int     i, tot, err;
+    FILHDR  fhdr;
+    AOUTHDR ahdr;
+    SCNHDR  *shdr;
+    char    name[sizeof(shdr->s_name)+1];
+    struct  zldsec *tbl;
+
+    if(zldread(z,(char *)&fhdr,sizeof(fhdr)) < 0) {
+        return(TFSERR_BADHDR);
+    }
+    if((fhdr.f_opthdr < sizeof(ahdr)) || ((fhdr.f_flags & F_EXEC) == 0)) {
+        return(TFSERR_BADHDR);
+    }
+    if((zldread(z,(char *)&ahdr,sizeof(ahdr)) < 0) ||
+            (zldseek(z,sizeof(fhdr)+fhdr.f_opthdr) < 0)) {
+        return(TFSERR_BADHDR);
+    }
+
+    shdr = (SCNHDR *)malloc(fhdr.f_nscns * sizeof(SCNHDR));
+    tbl = (struct zldsec *)malloc(fhdr.f_nscns * sizeof(struct zldsec));
+    if(!shdr || !tbl) {
+        err = TFSERR_MEMFAIL;
+        goto done;
+    }
+    if(zldread(z,(char *)shdr,fhdr.f_nscns * sizeof(SCNHDR)) < 0) {
+        err = TFSERR_BADHDR;
+        goto done;
+    }
+
+    for(i=0,tot=0; i<fhdr.f_nscns; i++) {
+        memcpy(name,shdr[i].s_name,sizeof(shdr->s_name));
+        name[sizeof(shdr->s_name)] = 0;
+        if((shdr[i].s_size == 0) || (sname && strcmp(sname,name))) {
+            continue;
+        }
+        if(ISLOADABLE(shdr[i].s_flags)) {
+            zldsec(&tbl[tot++],name,shdr[i].s_scnptr,shdr[i].s_paddr,
+                   shdr[i].s_size,0);
+        } else if(ISBSS(shdr[i].s_flags)) {
+            zldsec(&tbl[tot++],name,0,shdr[i].s_paddr,shdr[i].s_size,1);
+        }
+    }
+    err = zldsections(z,tbl,tot);
+
+    if((err == TFS_OKAY) && entrypoint) {
+        *entrypoint = (long)(ahdr.entry);
+    }
+    if((err == TFS_OKAY) && z->verbose && !z->verifyonly && !sname) {
+        showEntrypoint(ahdr.entry);
+    }
+
+done:
+    if(tbl) {
+        free((char *)tbl);
+    }
+    if(shdr) {
+        free((char *)shdr);
+    }
+    return(err);
+}
+
+#elif TFS_EBIN_ELF | TFS_EBIN_ELFMSBIN
+
+/* zldelf():
+ * The section headers of an ELF file are usually at the end of it, so
+ * a compressed ELF file is loaded by its program headers (which follow
+ * the file header) instead: the file part of each PT_LOAD segment is
+ * decompressed to p_paddr and the rest of the segment is cleared.  For the
+ * same reason, loading a single named section isn't supported.
+ * Everything up to the end of the program headers is kept in z->head,
+ * because a segment can start in it (refer to zldload()).
+ */
+static int
+zldelf(struct zld *z,long *entrypoint,char *sname)
+{
+    int     i, tot, err;
+    char    name[12];
+    ulong   hsize;
+    ELFFHDR ehdr;
+    ELFPHDR *phdr, *pp;
+    struct  zldsec *tbl;
+
+    if(sname) {
+        printf("Can't load a section from a compressed file\n");
+        return(TFSERR_BADARG);
+    }
+    if(zldread(z,(char *)&ehdr,sizeof(ehdr)) < 0) {
+        return(TFSERR_BADHDR);
+    }
+    if((ehdr.e_ident[0] != 0x7f) || (ehdr.e_ident[1] != 'E') ||
+            (ehdr.e_ident[2] != 'L') || (ehdr.e_ident[3] != 'F') ||
+            (ehdr.e_phnum == 0) || (ehdr.e_phoff < sizeof(ehdr))) {
+        return(TFSERR_BADHDR);
+    }
+    hsize = ehdr.e_phoff + ehdr.e_phnum * sizeof(ELFPHDR);
+
+    z->head = malloc(hsize);
+    phdr = (ELFPHDR *)malloc(ehdr.e_phnum * sizeof(ELFPHDR));
+    tbl = (struct zldsec *)malloc(ehdr.e_phnum * 2 * sizeof(struct zldsec));
+    if(!z->head || !phdr || !tbl) {
+        err = TFSERR_MEMFAIL;
+        goto done;
+    }
+    memcpy(z->head,(char *)&ehdr,sizeof(ehdr));
+    if(zldread(z,z->head+sizeof(ehdr),hsize-sizeof(ehdr)) < 0) {
+        err = TFSERR_BADHDR;
+        goto done;
+    }
+    z->headsize = hsize;
+    memcpy((char *)phdr,z->head+ehdr.e_phoff,ehdr.e_phnum * sizeof(ELFPHDR));
+
+    for(i=0,tot=0,pp=phdr; i<ehdr.e_phnum; i++,pp++) {
+        if(pp->p_type != PT_LOAD) {
+            continue;
+        }
+        if(pp->p_filesz) {
+            sprintf(name,"segment%d",i);
+            zldsec(&tbl[tot++],name,pp->p_offset,pp->p_paddr,
+                   pp->p_filesz,0);
+        }
+        if(pp->p_memsz > pp->p_filesz) {
+            sprintf(name,"segment%d+",i);
+            zldsec(&tbl[tot++],name,0,pp->p_paddr+pp->p_filesz,
+                   pp->p_memsz-pp->p_filesz,1);
+        }
+    }
+    err = zldsections(z,tbl,tot);
+
+    if((err == TFS_OKAY) && entrypoint) {
+        *entrypoint = (long)(ehdr.e_entry);
+    }
+    if((err == TFS_OKAY) && z->verbose && !z->verifyonly) {
+        showEntrypoint(ehdr.e_entry);
+    }
+
+done:
+    if(tbl) {
+        free((char *)tbl);
+    }
+    if(phdr) {
+        free((char *)phdr);
+    }
+    if(z->head) {
+        free(z->head);
+        z->head = 0;
+        z->headsize = 0;
+    }
+    return(err);
+}
+
+#endif
+
+/* tfsloadz():
+ * Load a gzip'ed or LZ4 compressed executable ('type' is what
+ * tfsldcompressed() returned; see the notes above it).
+ */
+static int
+tfsloadz(TFILE *fp,int type,int verbose,long *entrypoint,char *sname,
+         int verifyonly)
+{
+    int     err;
+    struct  zld z;
+    void    (*zclose)(void *);
+
+    if(tfsTrace) {
+        printf("tfsloadz(%s)\n",TFS_NAME(fp));
+    }
+
+    z.zs = 0;
+    zclose = 0;
+#if INCLUDE_UNZIP
+    if(type == TFSLD_GZIP) {
+        z.zs = unZipOpen(tfsBase(fp),(int)TFS_SIZE(fp));
+        z.read = unZipRead;
+        z.verb = "gunz";
+        zclose = unZipClose;
+    }
+#endif
+#if INCLUDE_UNLZ4
+    if(type == TFSLD_LZ4) {
+        z.zs = unLz4Open(tfsBase(fp),(int)TFS_SIZE(fp));
+        z.read = unLz4Read;
+        z.verb = "unlz";
+        zclose = unLz4Close;
+    }
+#endif
+    if(!z.zs) {
+        return(TFSERR_BADHDR);
+    }
+    z.buf = malloc(TFSLD_ZCHUNK);
+    if(!z.buf) {
+        zclose(z.zs);
+        return(TFSERR_MEMFAIL);
+    }
+    z.offset = 0;
+    z.head = 0;
+    z.headsize = 0;
+    z.verbose = verbose;
+    z.verifyonly = verifyonly;
+
+#if TFS_EBIN_AOUT
+    err = zldaout(&z,entrypoint,sname);
+#elif TFS_EBIN_COFF
+    err = zldcoff(&z,entrypoint,sname);
+#else
+    err = zldelf(&z,entrypoint,sname);
+#endif
+
+    if(verbose > 1) {
+        printf(" decompressed %ld bytes",z.offset);
+#if INCLUDE_UNZIP
+        if(type == TFSLD_GZIP) {
+            printf(" (%d gzip member%s)",unZipMember(z.zs,0,0),
+                   unZipMember(z.zs,0,0) == 1 ? "" : "s");
+        }
+#endif
+        printf("\n");
+    }
+
+    free(z.buf);
+    zclose(z.zs);
+    return(err);
+}
+
+#endif  /* (INCLUDE_UNZIP | INCLUDE_UNLZ4) & !TFS_EBIN_MSBIN */
+
 int
 tfsloadebin(TFILE *fp,int verbose,long *entrypoint,char *sname,int verifyonly)
 {
 #if TFS_EBIN_ELFMSBIN
     int err;
 #endif
+#if (INCLUDE_UNZIP | INCLUDE_UNLZ4) & !TFS_EBIN_MSBIN
+    int type;
+#endif
 
     /* If verbosity is greater than one and verifyonly is not set, then
      * we are simply dumping a map, so start with an appropriate
@@ -539,6 +1062,13 @@ tfsloadebin(TFILE *fp,int verbose,long *entrypoint,char *sname,int verifyonly)
         printf("Load map:\n");
     }
 
+#if (INCLUDE_UNZIP | INCLUDE_UNLZ4) & !TFS_EBIN_MSBIN
+    type = tfsldcompressed(fp);
+    if(type) {
+        return(tfsloadz(fp,type,verbose,entrypoint,sname,verifyonly));
+    }
+#endif
+
 #if TFS_EBIN_AOUT
     return(tfsloadaout(fp,verbose,entrypoint,sname,verifyonly));
 #elif TFS_EBIN_COFF
@@ -189,7 +189,9 @@ struct tfsdat {
     unsigned char   *base;      /* Base address of file. */
     long    flagmode;           /* Flags & mode file was opened with. */
     struct  tfshdr hdr;         /* File structure. */
-};
+    unsigned char   *blktbl;    /* Compressed file only: block offset */
+    long    blksize;            /* table and uncompressed block size. */
+};                              /* The hdr.filsize is then uncompressed. */
 
 /* struct tfsdfg, tfsflg & tfserr:
     Structures provide an easy means of translation between values and
@@ -229,10 +231,28 @@ struct tfsinfo {
 };
 typedef struct tfsinfo TINFO;
 
+/* struct defragstat:
+    The flash work done by the most recent defragmentation (including
+    one completed by tfsfixup() after a power hit) and the totals since
+    startup.  Updated by tfsclean1.c, displayed by "tfs stat".
+*/
+struct defragstat {
+    long    count;      /* Number of defragmentations. */
+    long    msec;       /* Time taken by the last one. */
+    long    erases;     /* Sectors erased by the last one. */
+    long    writes;     /* Flash writes issued by the last one. */
+    long    bytes;      /* Bytes written by the last one. */
+    long    totmsec;
+    long    toterases;
+    long    totwrites;
+    long    totbytes;
+};
+
 
 /* Extern data: */
 extern  long tfsTrace;
 extern  long tfsFmodCount;
+extern  struct defragstat DefragStat;
 extern  TFILE **tfsAlist;
 extern  TDEV tfsDeviceTbl[];
 #ifdef TFS_ALTDEVTBL_BASE
@@ -266,6 +286,7 @@ extern  int validtfshdr(TFILE *);
 extern  int tfstruncate(int,long);
 extern  int tfsclose(int, char *);
 extern  int tfsscript(TFILE *,int);
+extern  int tfsscriptflush(int);
 extern  int tfsseek(int, int, int);
 extern  int tfsread(int,char *,int);
 extern  int tfsspace(char *);
@@ -295,6 +316,8 @@ extern  int tfsramdevice(char *,long,long);
 extern  int tfscfg(char *,unsigned long, unsigned long, unsigned long);
 extern  int tfscfgrestore(void);
 extern  int tfsflagsatob(char *, long *);
+extern  int tfscprsinfo(TFILE *,long *,long *);
+extern  int tfscprsimage(int,char **);
 
 
 extern  TDEV *gettfsdev_fromprefix(char *,int);
@@ -304,6 +327,8 @@ extern  TFILE *tfsstat(char *name);
 extern  TFILE *_tfsstat(char *name,int uselink);
 extern  TFILE *nextfp(TFILE *,TDEV *);
 
+extern  unsigned char *tfscprsidx(unsigned char *,long,long *,long *);
+
 extern  long tfstell(int);
 extern  long (*tfsGetLtime)(void);
 extern  long tfsctrl(int,long,long);
@@ -66,6 +66,17 @@ extern unsigned long target_timer(void);
 extern void startElapsedTimer(struct elapsed_tmr *tmr,long timeout);
 extern int msecElapsed(struct elapsed_tmr *tmr);
 extern unsigned long msecRemaining(struct elapsed_tmr *tmr);
+extern unsigned long msecSinceStart(struct elapsed_tmr *tmr);
 extern int monTimer(int cmd, void *arg);
 
+/* Boot timeline (boottime.c):
+ */
+#if INCLUDE_BOOTTIME
+extern int bootmark(char *name);
+extern void bootmarkreset(void);
+#else
+#define bootmark(name)
+#define bootmarkreset()
+#endif
+
 #endif
@@ -229,6 +229,24 @@ msecRemaining(struct elapsed_tmr *tmr)
     return(msectot);
 }
 
+/* msecSinceStart():
+ * Return the number of milliseconds that have elapsed since the timer
+ * was started by startElapsedTimer().  This is used for measurements
+ * rather than timeouts, so the timer should be started with a timeout
+ * that is larger than the interval being measured.  As with the rest
+ * of this code, the result is only as accurate as the underlying timer
+ * (refer to the msecElapsed() discussion above).
+ */
+ulong
+msecSinceStart(struct elapsed_tmr *tmr)
+{
+    unsigned long long ticks;
+
+    msecElapsed(tmr);
+    ticks = ((unsigned long long)tmr->elapsed_high << 32) | tmr->elapsed_low;
+    return((ulong)(ticks / tmr->tpm));
+}
+
 /* monDelay():
  * Delay for specified number of milliseconds.
  * Refer to msecElapsed() description for a discussion on the
@@ -0,0 +1,507 @@
+/**************************************************************************
+ *
+ * Copyright (c) 2013 Alcatel-Lucent
+ *
+ * Alcatel Lucent licenses this file to You under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file except in
+ * compliance with the License.  A copy of the License is contained the
+ * file LICENSE at the top level of this repository.
+ * You may also obtain a copy of the License at:
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ **************************************************************************
+ *
+ * norsim.c:
+ *
+ * Simulated NOR flash device, for ports (like linux_host) where the
+ * "flash" is just memory provided by the port (for example a file
+ * mapped by the host at FLASH_BANK0_BASE_ADDR).  The driver enforces
+ * the rules of real NOR so that the flash and TFS code above it can be
+ * exercised off-target:
+ *
+ *  - Erase is by sector only, and sets the whole sector to 0xff.
+ *  - Programming can only clear bits; an attempt to set a bit (0->1)
+ *    fails the same way a real device does, with the data left as the
+ *    AND of the old and new values.
+ *  - Programs and erases take time (per byte and per sector, set with
+ *    the norsim command), so that throughput numbers mean something.
+ *  - A power cut can be armed to hit after a given number of "units"
+ *    (one unit per byte programmed and one per sector erased).  When
+ *    it hits, the operation is left incomplete (the byte half written,
+ *    or the first half of the sector erased) and the port's
+ *    NORSIM_POWERCUT() hook is called; with no hook the monitor is
+ *    restarted.  The cut can also be armed to hit part way through the
+ *    Nth program or erase operation, so that a script can step it
+ *    through every operation of (for example) a TFS defragmentation.
+ *
+ * The sector size and count come from NORSIM_SECTOR_SIZE and
+ * NORSIM_SECTOR_COUNT in config.h.  NORSIM_BANKS banks of that size
+ * (default 1) are laid out one after the other from
+ * FLASH_BANK0_BASE_ADDR as flash banks 0 to NORSIM_BANKS-1, each with
+ * its own asynchronous erase, so that flasheraseset() can overlap them.
+ */
+#include "config.h"
+
+#if INCLUDE_FLASH
+
+#include "stddefs.h"
+#include "genlib.h"
+#include "cpu.h"
+#include "cpuio.h"
+#include "cli.h"
+#include "timer.h"
+#include "warmstart.h"
+#include "flash.h"          /* Part of monitor common code */
+#include "norsim.h"
+
+#ifndef NORSIM_SECTOR_SIZE
+#define NORSIM_SECTOR_SIZE      0x10000
+#endif
+
+#ifndef NORSIM_SECTOR_COUNT
+#define NORSIM_SECTOR_COUNT     64
+#endif
+
+#ifndef NORSIM_BANKS
+#define NORSIM_BANKS            1
+#endif
+
+/* NORSIM_PROG_USEC & NORSIM_ERASE_MSEC:
+ * Default timing model (changed at runtime with "norsim time").
+ */
+#ifndef NORSIM_PROG_USEC
+#define NORSIM_PROG_USEC        0
+#endif
+
+#ifndef NORSIM_ERASE_MSEC
+#define NORSIM_ERASE_MSEC       0
+#endif
+
+#define NORSIM_ID               0x00004e53
+
+#ifdef NORSIM_POWERCUT
+extern void NORSIM_POWERCUT(void);
+#endif
+
+static ulong NorsimProgUsec = NORSIM_PROG_USEC;
+static ulong NorsimEraseMsec = NORSIM_ERASE_MSEC;
+
+static long NorsimCut;          /* Units left before the power cut (0=off) */
+static long NorsimCutOps;       /* Operations left before the cut (0=off) */
+static ulong NorsimErases;
+static ulong NorsimProgOps;
+static ulong NorsimProgBytes;
+static ulong NorsimProgFaults;
+static ulong NorsimWear[NORSIM_BANKS * NORSIM_SECTOR_COUNT];
+
+/* The state of each bank's asynchronous erase (Norsim_erasectl()),
+ * indexed by flash bank number:
+ */
+struct norsimectl {
+    int     busy;
+    ulong   left;           /* Msec left while suspended. */
+    struct  elapsed_tmr tmr;
+};
+
+static struct norsimectl NorsimEctl[FLASHBANKS];
+
+/* norsimwait():
+ * The timing model; spin for the specified number of microseconds.
+ */
+static void
+norsimwait(ulong usec)
+{
+#if INCLUDE_HWTMR
+    ulong   t0, ticks;
+
+    if(usec == 0) {
+        return;
+    }
+    ticks = (usec * (TIMER_TICKS_PER_MSEC / 1000)) +
+            ((usec * (TIMER_TICKS_PER_MSEC % 1000)) / 1000);
+    t0 = target_timer();
+    while((target_timer() - t0) < ticks) {
+        WATCHDOG_MACRO;
+    }
+#endif
+}
+
+/* norsimcut():
+ * Called for each unit of work; return 1 if this is the one that the
+ * power cut hits.
+ */
+static int
+norsimcut(void)
+{
+    if(NorsimCut == 0) {
+        return(0);
+    }
+    return(--NorsimCut == 0);
+}
+
+/* norsimcutop():
+ * Called at the start of each operation of 'units' units; if this is
+ * the operation that an operation-count power cut is to hit, arm the
+ * unit count so that it hits half way through it.
+ */
+static void
+norsimcutop(long units)
+{
+    if((NorsimCutOps == 0) || (--NorsimCutOps != 0)) {
+        return;
+    }
+    NorsimCut = (units / 2) + 1;
+}
+
+/* norsimpowerfail():
+ * The power is gone; nothing after this point reaches the flash.
+ */
+static void
+norsimpowerfail(void)
+{
+    printf("\nnorsim: power cut\n");
+#ifdef NORSIM_POWERCUT
+    NORSIM_POWERCUT();
+#else
+    monrestart(INITIALIZE);
+#endif
+}
+
+/* norsimerase():
+ * Set the sector to 0xff (or, if the power cut hits, just its first
+ * half, as an erase that was interrupted), and count it.
+ */
+static void
+norsimerase(struct flashinfo *fdev,int snum)
+{
+    int     cut, bank;
+    long    size;
+
+    norsimcutop(1);
+    cut = norsimcut();
+    size = fdev->sectors[snum].size;
+    if(cut) {
+        size /= 2;
+    }
+    memset((char *)fdev->sectors[snum].begin,0xff,size);
+    if(cut) {
+        norsimpowerfail();
+    }
+
+    NorsimErases++;
+    bank = fdev - FlashBank;
+    if((bank < NORSIM_BANKS) && (snum < NORSIM_SECTOR_COUNT)) {
+        NorsimWear[bank * NORSIM_SECTOR_COUNT + snum]++;
+    }
+}
+
+/* Norsim_erase():
+ * Erase the sector, taking the configured erase time.
+ * Return 0 if success, else -1.
+ */
+int
+Norsim_erase(struct flashinfo *fdev,int snum)
+{
+    if((snum < 0) || (snum >= fdev->sectorcnt)) {
+        return(-1);
+    }
+
+    norsimwait(NorsimEraseMsec * 1000);
+    norsimerase(fdev,snum);
+    return(0);
+}
+
+/* Norsim_erasectl():
+ * Asynchronous erase (see flerasectl in flash.h).  The erase completes
+ * when NorsimEraseMsec has passed (not counting the time suspended),
+ * so the erase scheduling in flash.c can be timed on the host.  Each
+ * bank has its own erase in progress.
+ */
+int
+Norsim_erasectl(struct flashinfo *fdev,int snum,int op)
+{
+    int     bank;
+    struct  norsimectl *ecp;
+
+    bank = fdev - FlashBank;
+    if((bank < 0) || (bank >= FLASHBANKS)) {
+        return(-1);
+    }
+    ecp = &NorsimEctl[bank];
+
+    switch(op) {
+    case FLASH_ERASE_START:
+        if((snum < 0) || (snum >= fdev->sectorcnt)) {
+            return(-1);
+        }
+        startElapsedTimer(&ecp->tmr,NorsimEraseMsec);
+        ecp->busy = 1;
+        return(0);
+    case FLASH_ERASE_POLL:
+        if(ecp->busy && !msecElapsed(&ecp->tmr)) {
+            return(0);
+        }
+        ecp->busy = 0;
+        norsimerase(fdev,snum);
+        return(1);
+    case FLASH_ERASE_SUSPEND:
+        ecp->left = msecRemaining(&ecp->tmr);
+        return(0);
+    case FLASH_ERASE_RESUME:
+        startElapsedTimer(&ecp->tmr,ecp->left);
+        return(0);
+    }
+    return(-1);
+}
+
+/* Norsim_write():
+ * Program bytecnt bytes; each byte takes NorsimProgUsec.  Like the real
+ * device, programming can only clear bits, so if the data asks for a
+ * 0->1 transition the result is the AND of old and new, and the write
+ * fails.
+ * Return 0 if success, else -1.
+ */
+int
+Norsim_write(struct flashinfo *fdev,uchar *dest,uchar *src,long bytecnt)
+{
+    uchar   old;
+    int     ret;
+
+    ret = 0;
+    NorsimProgOps++;
+    norsimcutop(bytecnt);
+    norsimwait(NorsimProgUsec * bytecnt);
+    while(bytecnt-- > 0) {
+        old = *dest;
+        if(norsimcut()) {
+            /* Only the low nibble made it... */
+            *dest = old & (*src | 0xf0);
+            norsimpowerfail();
+        }
+        *dest = old & *src;
+        if(*dest != *src) {
+            NorsimProgFaults++;
+            ret = -1;
+        }
+        NorsimProgBytes++;
+        dest++;
+        src++;
+    }
+    return(ret);
+}
+
+/* Norsim_ewrite():
+ * Erase all sectors that are part of the address space to be written,
+ * write the data to that address space, then restart the monitor (this
+ * is what is used to install a new monitor image).
+ */
+int
+Norsim_ewrite(struct flashinfo *fdev,uchar *dest,uchar *src,long bytecnt)
+{
+    int     i;
+    struct  sectorinfo *sip;
+
+    for(i=0; i<fdev->sectorcnt; i++) {
+        sip = &(fdev->sectors[i]);
+        if((dest > sip->end) || ((dest+bytecnt-1) < sip->begin)) {
+            continue;
+        }
+        if(!flasherased(sip->begin,sip->end)) {
+            Norsim_erase(fdev,i);
+        }
+    }
+
+    if(Norsim_write(fdev,dest,src,bytecnt) < 0) {
+        return(-1);
+    }
+
+    monrestart(INITIALIZE);
+    return(0);  /* won't get here */
+}
+
+/* Norsim_type():
+ * There's no autoselect to run; just return the simulator's id.
+ */
+int
+Norsim_type(struct flashinfo *fdev)
+{
+    fdev->id = NORSIM_ID;
+    return((int)(fdev->id));
+}
+
+/* Norsim_cutarm():
+ * Arm the power cut to hit after 'units' more bytes programmed or
+ * sectors erased (0 disarms).  This allows the port to arm it from
+ * its command line before the monitor even starts.
+ */
+void
+Norsim_cutarm(long units)
+{
+    NorsimCut = units;
+    NorsimCutOps = 0;
+}
+
+char *NorsimHelp[] = {
+    "NOR flash simulator",
+    "{op} [args]",
+#if INCLUDE_VERBOSEHELP
+    "Ops...",
+    "  stat                 show counts and settings",
+    "  clear                clear counts",
+    "  time [usec msec]     per-byte program and per-sector erase time",
+    "  cut {units}          power cut after that many units (0 = off)",
+    "  cutop {ops}          power cut part way through operation #ops",
+    "  wear                 erase count per (flash) sector",
+    "",
+    "A unit is one byte programmed or one sector erased; an operation",
+    "is one program (of any size) or one sector erase.",
+#endif
+    0,
+};
+
+int
+NorsimCmd(int argc,char *argv[])
+{
+    int     i;
+    ulong   min, max;
+
+    if(argc < 2) {
+        return(CMD_PARAM_ERROR);
+    }
+
+    if(strcmp(argv[1],"stat") == 0) {
+        printf("Erases:          %ld\n",NorsimErases);
+        printf("Programs:        %ld\n",NorsimProgOps);
+        printf("Bytes programmed: %ld\n",NorsimProgBytes);
+        printf("Program faults:  %ld\n",NorsimProgFaults);
+        printf("Timing:          %ld usec/byte, %ld msec/sector\n",
+               NorsimProgUsec,NorsimEraseMsec);
+        if(NorsimCut) {
+            printf("Power cut in:    %ld units\n",NorsimCut);
+        }
+        if(NorsimCutOps) {
+            printf("Power cut in:    %ld operations\n",NorsimCutOps);
+        }
+    } else if(strcmp(argv[1],"clear") == 0) {
+        NorsimErases = NorsimProgOps = NorsimProgBytes = NorsimProgFaults = 0;
+        for(i=0; i<NORSIM_BANKS*NORSIM_SECTOR_COUNT; i++) {
+            NorsimWear[i] = 0;
+        }
+    } else if(strcmp(argv[1],"time") == 0) {
+        if(argc == 4) {
+            NorsimProgUsec = strtoul(argv[2],0,0);
+            NorsimEraseMsec = strtoul(argv[3],0,0);
+        } else if(argc != 2) {
+            return(CMD_PARAM_ERROR);
+        }
+        printf("%ld usec/byte, %ld msec/sector\n",
+               NorsimProgUsec,NorsimEraseMsec);
+    } else if((strcmp(argv[1],"cut") == 0) && (argc == 3)) {
+        Norsim_cutarm(strtol(argv[2],0,0));
+    } else if((strcmp(argv[1],"cutop") == 0) && (argc == 3)) {
+        Norsim_cutarm(0);
+        NorsimCutOps = strtol(argv[2],0,0);
+    } else if(strcmp(argv[1],"wear") == 0) {
+        min = max = NorsimWear[0];
+        for(i=0; i<NORSIM_BANKS*NORSIM_SECTOR_COUNT; i++) {
+            if(NorsimWear[i]) {
+                printf("  %3d: %ld\n",i,NorsimWear[i]);
+            }
+            if(NorsimWear[i] < min) {
+                min = NorsimWear[i];
+            }
+            if(NorsimWear[i] > max) {
+                max = NorsimWear[i];
+            }
+        }
+        printf("Min %ld, max %ld\n",min,max);
+    } else {
+        return(CMD_PARAM_ERROR);
+    }
+    return(CMD_SUCCESS);
+}
+
+/**************************************************************************
+ **************************************************************************
+ *
+ * The remainder of the code in this file should only included if the
+ * target configuration is such that this simulated device is the only
+ * flash device in the system that is to be visible to the monitor.
+ *
+ **************************************************************************
+ **************************************************************************
+ */
+#ifdef SINGLE_FLASH_DEVICE
+
+/* FlashNamId[]:
+ * Used to correlate between the ID and a string representing the name
+ * of the flash device.
+ */
+struct flashdesc FlashNamId[] = {
+    { NORSIM_ID,    "NOR-simulator" },
+    { 0, (char *)0 },
+};
+
+struct sectorinfo sinfo_norsim[NORSIM_BANKS][NORSIM_SECTOR_COUNT];
+
+/* FlashInit():
+ * Initialize data structures for the simulated banks (the port must
+ * have made the memory at FLASH_BANK0_BASE_ADDR available by now).
+ */
+int
+FlashInit()
+{
+    int     b, i, snum;
+    uchar   *begin;
+    struct  flashinfo *fbnk;
+
+    FlashCurrentBank = 0;
+
+    begin = (unsigned char *)FLASH_BANK0_BASE_ADDR;
+    for(b=0, snum=0; b<NORSIM_BANKS; b++) {
+        fbnk = &FlashBank[b];
+        fbnk->base = begin;
+        fbnk->end = begin + (NORSIM_SECTOR_SIZE * NORSIM_SECTOR_COUNT) - 1;
+        fbnk->sectorcnt = NORSIM_SECTOR_COUNT;
+        fbnk->width = 1;
+        fbnk->fltype = Norsim_type;
+        fbnk->flerase = Norsim_erase;
+        fbnk->flwrite = Norsim_write;
+        fbnk->flewrite = Norsim_ewrite;
+        fbnk->flerasectl = Norsim_erasectl;
+        fbnk->fllock = FlashLockNotSupported;
+        fbnk->sectors = sinfo_norsim[b];
+        fbnk->id = flashtype(fbnk);
+
+        for(i=0; i<fbnk->sectorcnt; i++,snum++) {
+            fbnk->sectors[i].snum = snum;
+            fbnk->sectors[i].size = NORSIM_SECTOR_SIZE;
+            fbnk->sectors[i].begin = begin;
+            fbnk->sectors[i].end = begin + NORSIM_SECTOR_SIZE - 1;
+            fbnk->sectors[i].protected = 0;
+            begin += NORSIM_SECTOR_SIZE;
+        }
+    }
+
+#ifdef FLASH_PROTECT_RANGE
+    sectorProtect(FLASH_PROTECT_RANGE,1);
+#endif
+
+#ifdef FLASHRAM_BASE
+    FlashRamInit(snum, FLASHRAM_SECTORCOUNT, &FlashBank[FLASHRAM_BANKNUM],
+                 sinfoRAM, 0);
+#endif
+
+    return(0);
+}
+
+#endif  /* SINGLE_FLASH_DEVICE */
+
+#endif  /* INCLUDE_FLASH */
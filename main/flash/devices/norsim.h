@@ -0,0 +1,6 @@
+extern int Norsim_erase(struct flashinfo *,int);
+extern int Norsim_erasectl(struct flashinfo *,int,int);
+extern int Norsim_write(struct flashinfo *,unsigned char *,unsigned char *,long);
+extern int Norsim_ewrite(struct flashinfo *,unsigned char *,unsigned char *,long);
+extern int Norsim_type(struct flashinfo *);
+extern void Norsim_cutarm(long units);
@@ -127,6 +127,56 @@ EndS29gl512n_16x1_erase(void)
 {
 }
 
+/* S29gl512n_16x1_erasectl():
+ * Asynchronous erase (see flerasectl in flash.h) using the AMD command
+ * set: start the sector erase and return; poll with the same DQ7/DQ5
+ * checks as above; suspend with 0xb0 (then wait for DQ6 to stop
+ * toggling, at most tESL) and resume with 0x30.
+ */
+int
+S29gl512n_16x1_erasectl(struct flashinfo *fdev,int snum,int op)
+{
+    ulong   add;
+
+    add = (ulong)(fdev->sectors[snum].begin);
+
+    switch(op) {
+    case FLASH_ERASE_START:
+        SECTOR_ERASE(add);
+        return(0);
+    case FLASH_ERASE_POLL:
+        if(*(ftype *)(add) == 0xffff) {
+            if(*(ftype *)(add) == 0xffff) {
+                return(1);
+            }
+        }
+        if(D5_Timeout(add)) {
+            if(*(ftype *)(add) != 0xffff) {
+                READ_RESET();
+                return(-1);
+            }
+            return(1);
+        }
+        return(0);
+    case FLASH_ERASE_SUSPEND:
+        *(ftype *)(add) = 0x00b0;
+        WHILE_D6_TOGGLES(add);
+        return(0);
+    case FLASH_ERASE_RESUME:
+        *(ftype *)(add) = 0x0030;
+        return(0);
+    }
+    return(-1);
+}
+
+/* EndS29gl512n_16x1_erasectl():
+ * Function place holder to determine the end of the above function.
+ */
+void
+EndS29gl512n_16x1_erasectl(void)
+{
+}
+
 #ifdef BUFFERED_WRITE
 
 /* S29gl512n_16x1_write():
@@ -624,6 +674,7 @@ ulong    FlashWriteFbuf[600];
 ulong    FlashWriteFbuf[400];
 #endif
 ulong    FlashEwriteFbuf[400];
+ulong    FlashEraseCtlFbuf[200];
 #endif
 
 /* FlashNamId[]:
@@ -661,11 +712,13 @@ flashBankInit(int banknum, int snum, struct sectorinfo *sinfotbl)
     fbnk->flerase = (int(*)())FlashEraseFbuf;
     fbnk->flwrite = (int(*)())FlashWriteFbuf;
     fbnk->flewrite = (int(*)())FlashEwriteFbuf;
+    fbnk->flerasectl = (int(*)())FlashEraseCtlFbuf;
 #else
     fbnk->fltype = S29gl512n_16x1_type;
     fbnk->flerase = S29gl512n_16x1_erase;
     fbnk->flwrite = S29gl512n_16x1_write;
     fbnk->flewrite = S29gl512n_16x1_ewrite;
+    fbnk->flerasectl = S29gl512n_16x1_erasectl;
 #endif
 
     /* This device doesn't support flash lock, so set the pointer
@@ -743,6 +796,12 @@ FlashInit()
         return(-1);
     }
 
+    if(flashopload((ulong *)S29gl512n_16x1_erasectl,
+                   (ulong *)EndS29gl512n_16x1_erasectl,
+                   FlashEraseCtlFbuf,sizeof(FlashEraseCtlFbuf)) < 0) {
+        return(-1);
+    }
+
     if(flashopload((ulong *)S29gl512n_16x1_write,
                    (ulong *)EndS29gl512n_16x1_write,
                    FlashWriteFbuf,sizeof(FlashWriteFbuf)) < 0) {
@@ -1,6 +1,9 @@
 extern int S29gl512n_16x1_erase(struct flashinfo *,int);
 extern void End_s29gl512n_16x1_erase(void);
 
+extern int S29gl512n_16x1_erasectl(struct flashinfo *,int,int);
+extern void EndS29gl512n_16x1_erasectl(void);
+
 extern int S29gl512n_16x1_write(struct flashinfo *,unsigned char *,unsigned char *,long);
 extern void End_s29gl512n_16x1_write(void);
 
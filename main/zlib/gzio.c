@@ -53,6 +53,9 @@ typedef struct gz_stream {
     char     *msg;          /* error message */
     int      transparent;    /* 1 if input file is not a .gz file */
     char     mode;          /* 'w' or 'r' */
+    int      members;       /* gzip members started so far */
+    Bytef    *member_in;    /* start of the current member's header */
+    uLong    member_out;    /* uncompressed offset of the current member */
 } gz_stream;
 
 
@@ -93,6 +96,7 @@ gzInit(unsigned char *compressed_data,int size)
     s->msg = NULL;
     s->transparent = 0;
     s->mode = 'r';
+    s->members = 0;
 
     err = inflateInit2(&(s->stream), -MAX_WBITS);
     /* windowBits is passed < 0 to tell that there is no zlib header.
@@ -151,6 +155,7 @@ gz_stream *s;
     int flags;  /* flags byte */
     uInt len;
     int c;
+    Bytef *start = s->stream.next_in;
 
     /* Check the gzip magic header */
     for(len = 0; len < 2; len++) {
@@ -199,6 +204,11 @@ gz_stream *s;
         }
     }
     s->z_err = s->z_eof ? Z_DATA_ERROR : Z_OK;
+    if(s->z_err == Z_OK) {
+        s->members++;
+        s->member_in = start;
+        s->member_out = s->stream.total_out;
+    }
 }
 
 /* ===========================================================================
@@ -362,6 +372,23 @@ unZip(char *src, int srclen, char *dest, int destlen)
     int len;
     gz_stream   *s;
 
+#if USE_FAST_INFLATE
+    /* gzip data goes to the faster one-shot inflate in zfast.c; anything
+     * else (i.e. not compressed) is still copied by gzRead() below.
+     */
+    if((srclen >= 2) && ((Byte)src[0] == gz_magic[0]) &&
+            ((Byte)src[1] == gz_magic[1])) {
+        len = zfGunzip(src,srclen,dest,destlen);
+        if(len < 0) {
+            printf("zfGunzip() failed\n");
+        } else if(len > 0) {
+            flushDcache(dest,len);
+            invalidateIcache(dest,len);
+        }
+        return(len);
+    }
+#endif
+
     if((s = gzInit((unsigned char *)src,srclen)) == Z_NULL) {
         printf("gzInit(0x%lx,%d) failed!\n",(ulong)src,srclen);
         return(-1);
@@ -381,6 +408,58 @@ unZip(char *src, int srclen, char *dest, int destlen)
     return(len);
 }
 
+/* ===========================================================================
+    unZipOpen(), unZipRead(), unZipMember() & unZipClose():
+    The streaming form of unZip(), for callers (like the TFS loader) that
+    want to inflate an image piece by piece to different destinations
+    rather than all at once to one buffer.  unZipRead() returns the next
+    'len' bytes of uncompressed data (fewer only at the end of the data
+    or on error) and checks the crc of each member as it completes.
+    The input may be several gzip members back to back (for example,
+    an image split into fixed size chunks that were each gzip'ed, then
+    concatenated); each member is independently compressed, so
+    unZipMember() reports where the current one starts, as a point from
+    which inflate could be restarted.
+*/
+void *
+unZipOpen(char *src, int srclen)
+{
+    gz_stream   *s;
+
+    s = gzInit((unsigned char *)src,srclen);
+    if((s != Z_NULL) && ((s->z_err != Z_OK) || s->transparent)) {
+        destroy(s);
+        s = Z_NULL;
+    }
+    return((void *)s);
+}
+
+int
+unZipRead(void *zs, char *dest, int len)
+{
+    return(gzRead((gzFile)zs,dest,len));
+}
+
+int
+unZipMember(void *zs, char **inptr, ulong *outoff)
+{
+    gz_stream *s = (gz_stream *)zs;
+
+    if(inptr) {
+        *inptr = (char *)s->member_in;
+    }
+    if(outoff) {
+        *outoff = s->member_out;
+    }
+    return(s->members);
+}
+
+void
+unZipClose(void *zs)
+{
+    destroy((gz_stream *)zs);
+}
+
 char *UnzipHelp[] = {
     "Decompress memory (or file) to some other block of memory.",
     "-[v:] {src} [dest]",
@@ -462,17 +541,30 @@ Unzip(int argc,char *argv[])
 
 /* Front end to the rest of the unZip() stuff...
     Return the size of the decompressed data or -1 if failure.
-    The same front API end is available if unpack is used instead of unzip.
+    With INCLUDE_UNLZ4, LZ4 data (recognized by its magic number) is
+    passed to unLz4() instead.
 */
 int
 decompress(char *src,int srclen, char *dest)
 {
+#if INCLUDE_UNLZ4
+    if(isLz4(src,srclen)) {
+        return(unLz4(src,srclen,dest,99999999));
+    }
+#endif
     return(unZip(src,srclen,dest,99999999));
 }
 #else
+#include "stddefs.h"
+#include "genlib.h"
+
 int
 decompress(char *src,int srclen, char *dest)
 {
+#if INCLUDE_UNLZ4
+    return(unLz4(src,srclen,dest,99999999));
+#else
     return(-1);
+#endif
 }
 #endif
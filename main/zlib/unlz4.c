@@ -0,0 +1,689 @@
+/* unlz4.c:
+ * LZ4 decompression, for images where load time matters more than
+ * compression ratio.  An LZ4 image is typically a third to a half larger
+ * than the same image gzip'ed, but decompresses several times faster:
+ * there is no huffman stage, just literal runs and matches copied from
+ * earlier output.
+ *
+ * The data is in the LZ4 frame format (as written by the lz4 command
+ * line tool, or by lz4pack in ports/linux_host): one or more frames
+ * (skippable frames are stepped over), each a header, blocks of at most
+ * 64K to 4M of uncompressed data, and an end mark.  The header checksum
+ * is always checked, as are the block checksums, the content checksum
+ * (xxHash32) and the content size when the frame has them.
+ *
+ * There are two interfaces, like those for gzip in gzio.c:
+ *
+ *  unLz4():
+ *      Decompress memory to memory (for decompress()/mon_decompress()).
+ *      Any frame is accepted.
+ *  unLz4Open(), unLz4Read() & unLz4Close():
+ *      The streaming form, used by the TFS loader to decompress an
+ *      image piece by piece to different destinations.  Each block is
+ *      decompressed to a malloc'ed buffer and copied out from there, so
+ *      the blocks must be independent (lz4pack's default, or lz4 -BD
+ *      not set) and memory is needed for one block (so small blocks,
+ *      lz4 -B4 for 64K, are best).
+ *  unLz4Block():
+ *      Decompress a single independent block of a frame; used by TFS
+ *      for random access to compressed files (see TFS_CPRS in tfs.h).
+ *
+ * Set INCLUDE_UNLZ4 in config.h to pull this in.
+ */
+#include "config.h"
+
+#if INCLUDE_UNLZ4
+
+#include "stddefs.h"
+#include "genlib.h"
+
+#define LZ4_MAGIC       0x184D2204
+#define LZ4_SKIPMAGIC   0x184D2A50      /* ...through 0x184D2A5F */
+#define LZ4_SKIPMASK    0xFFFFFFF0
+#define LZ4_MINMATCH    4
+
+/* Frame descriptor flags (FLG byte): */
+#define LZ4F_VERSION    0xc0
+#define LZ4F_BINDEP     0x20            /* Blocks are independent. */
+#define LZ4F_BCHECKSUM  0x10            /* Each block has a checksum. */
+#define LZ4F_CSIZE      0x08            /* Content size is present. */
+#define LZ4F_CCHECKSUM  0x04            /* Content checksum is present. */
+#define LZ4F_DICTID     0x01
+
+#define LZ4_UNCOMPRESSED    0x80000000  /* Block size flag. */
+
+/* xxHash32 (the checksum used by the frame format):
+ * Kept as a running state, so that the content checksum can be done a
+ * block at a time as the data is decompressed.
+ */
+#define XXH_P1  2654435761UL
+#define XXH_P2  2246822519UL
+#define XXH_P3  3266489917UL
+#define XXH_P4  668265263UL
+#define XXH_P5  374761393UL
+
+#define XXH_M32(x)      ((x) & 0xffffffff)
+#define XXH_ROTL(x,r)   XXH_M32(((x) << (r)) | (XXH_M32(x) >> (32 - (r))))
+
+struct xxh {
+    ulong   v[4];
+    ulong   total;
+    uchar   mem[16];
+    int     memsize;
+};
+
+static ulong
+lz4get32(uchar *p)
+{
+    return((ulong)p[0] | ((ulong)p[1] << 8) | ((ulong)p[2] << 16) |
+           ((ulong)p[3] << 24));
+}
+
+static ulong
+xxhround(ulong v,ulong in)
+{
+    v = XXH_M32(v + XXH_M32(in * XXH_P2));
+    v = XXH_ROTL(v,13);
+    return(XXH_M32(v * XXH_P1));
+}
+
+static void
+xxhinit(struct xxh *x)
+{
+    x->v[0] = XXH_M32(XXH_P1 + XXH_P2);
+    x->v[1] = XXH_P2;
+    x->v[2] = 0;
+    x->v[3] = XXH_M32(0 - XXH_P1);
+    x->total = 0;
+    x->memsize = 0;
+}
+
+static void
+xxhupdate(struct xxh *x,uchar *p,long len)
+{
+    int     n;
+
+    x->total += len;
+    if(x->memsize) {
+        n = 16 - x->memsize;
+        if(len < n) {
+            memcpy((char *)x->mem + x->memsize,(char *)p,len);
+            x->memsize += len;
+            return;
+        }
+        memcpy((char *)x->mem + x->memsize,(char *)p,n);
+        p += n;
+        len -= n;
+        x->v[0] = xxhround(x->v[0],lz4get32(x->mem));
+        x->v[1] = xxhround(x->v[1],lz4get32(x->mem+4));
+        x->v[2] = xxhround(x->v[2],lz4get32(x->mem+8));
+        x->v[3] = xxhround(x->v[3],lz4get32(x->mem+12));
+        x->memsize = 0;
+    }
+    while(len >= 16) {
+        x->v[0] = xxhround(x->v[0],lz4get32(p));
+        x->v[1] = xxhround(x->v[1],lz4get32(p+4));
+        x->v[2] = xxhround(x->v[2],lz4get32(p+8));
+        x->v[3] = xxhround(x->v[3],lz4get32(p+12));
+        p += 16;
+        len -= 16;
+    }
+    if(len) {
+        memcpy((char *)x->mem,(char *)p,len);
+        x->memsize = len;
+    }
+}
+
+static ulong
+xxhdigest(struct xxh *x)
+{
+    ulong   h;
+    uchar   *p, *end;
+
+    if(x->total >= 16) {
+        h = XXH_ROTL(x->v[0],1) + XXH_ROTL(x->v[1],7) +
+            XXH_ROTL(x->v[2],12) + XXH_ROTL(x->v[3],18);
+    } else {
+        h = XXH_P5;
+    }
+    h = XXH_M32(h + x->total);
+
+    p = x->mem;
+    end = x->mem + x->memsize;
+    while(p + 4 <= end) {
+        h = XXH_M32(h + XXH_M32(lz4get32(p) * XXH_P3));
+        h = XXH_M32(XXH_ROTL(h,17) * XXH_P4);
+        p += 4;
+    }
+    while(p < end) {
+        h = XXH_M32(h + *p++ * XXH_P5);
+        h = XXH_M32(XXH_ROTL(h,11) * XXH_P1);
+    }
+    h ^= h >> 15;
+    h = XXH_M32(h * XXH_P2);
+    h ^= h >> 13;
+    h = XXH_M32(h * XXH_P3);
+    h ^= h >> 16;
+    return(h);
+}
+
+/* xxh32():
+ * The xxHash32 (seed 0) of len bytes at p; also used by lz4pack.
+ */
+ulong
+xxh32(uchar *p,long len)
+{
+    struct xxh x;
+
+    xxhinit(&x);
+    xxhupdate(&x,p,len);
+    return(xxhdigest(&x));
+}
+
+/* lz4block():
+ * Decompress one block of 'srclen' bytes at src to dst, writing at most
+ * dstlen bytes.  Matches may reach back as far as 'base' (the start of
+ * the block if blocks are independent, else the start of the frame's
+ * output).  Return the number of bytes written, or -1 if the block is
+ * bad.
+ */
+static long
+lz4block(uchar *src,long srclen,uchar *dst,long dstlen,uchar *base)
+{
+    int     token;
+    ulong   len, off, b;
+    uchar   *ip, *iend, *op, *oend, *from;
+
+    ip = src;
+    iend = src + srclen;
+    op = dst;
+    oend = dst + dstlen;
+
+    while(ip < iend) {
+        /* Literals: */
+        token = *ip++;
+        len = token >> 4;
+        if(len == 15) {
+            do {
+                if(ip >= iend) {
+                    return(-1);
+                }
+                b = *ip++;
+                len += b;
+            } while(b == 255);
+        }
+        if((len > (ulong)(iend - ip)) || (len > (ulong)(oend - op))) {
+            return(-1);
+        }
+        memcpy((char *)op,(char *)ip,len);
+        op += len;
+        ip += len;
+
+        /* The last sequence is just literals: */
+        if(ip == iend) {
+            return(op - dst);
+        }
+
+        /* Match: */
+        if(iend - ip < 2) {
+            return(-1);
+        }
+        off = ip[0] | (ip[1] << 8);
+        ip += 2;
+        len = token & 15;
+        if(len == 15) {
+            do {
+                if(ip >= iend) {
+                    return(-1);
+                }
+                b = *ip++;
+                len += b;
+            } while(b == 255);
+        }
+        len += LZ4_MINMATCH;
+        if((off == 0) || (off > (ulong)(op - base)) ||
+                (len > (ulong)(oend - op))) {
+            return(-1);
+        }
+        from = op - off;
+        if(off >= len) {
+            memcpy((char *)op,(char *)from,len);
+            op += len;
+        } else if(off == 1) {
+            memset((char *)op,*from,len);
+            op += len;
+        } else {
+            while(len--) {
+                *op++ = *from++;
+            }
+        }
+    }
+    return(-1);
+}
+
+/* unLz4Block():
+ * Decompress the block at src (its 4-byte block size word, then the
+ * block data), which has at most srclen bytes, to dest, writing at most
+ * destlen bytes.  Any block checksum is not checked, and the block must
+ * not refer to earlier blocks.  Return the size of the decompressed
+ * data, or -1 if the block is bad.
+ */
+int
+unLz4Block(char *src,int srclen,char *dest,int destlen)
+{
+    long    n;
+    ulong   bsize;
+    uchar   *in;
+
+    in = (uchar *)src;
+    if(srclen < 4) {
+        return(-1);
+    }
+    bsize = lz4get32(in);
+    n = bsize & ~LZ4_UNCOMPRESSED;
+    if((bsize == 0) || (n > srclen - 4)) {
+        return(-1);
+    }
+    if(bsize & LZ4_UNCOMPRESSED) {
+        if(n > destlen) {
+            return(-1);
+        }
+        memcpy(dest,(char *)in+4,n);
+        return(n);
+    }
+    return(lz4block(in+4,n,(uchar *)dest,destlen,(uchar *)dest));
+}
+
+/* lz4frame:
+ * What lz4hdr() gets from a frame header.
+ */
+struct lz4frame {
+    int     flags;
+    long    bmax;           /* Maximum uncompressed block size. */
+    ulong   csize;          /* Content size (if LZ4F_CSIZE). */
+};
+
+/* lz4hdr():
+ * Parse the frame header (after the magic number) at p, with len bytes
+ * of input available.  Return the length of the header, or -1 if it is
+ * bad or unsupported.
+ */
+static int
+lz4hdr(uchar *p,long len,struct lz4frame *f)
+{
+    int     hlen, bd;
+
+    if(len < 3) {
+        return(-1);
+    }
+    f->flags = p[0];
+    bd = (p[1] >> 4) & 7;
+    if(((f->flags & LZ4F_VERSION) != 0x40) || (f->flags & 0x02) ||
+            (p[1] & 0x8f) || (bd < 4)) {
+        return(-1);
+    }
+    f->bmax = 1L << (8 + 2 * bd);
+
+    hlen = 3;
+    f->csize = 0;
+    if(f->flags & LZ4F_CSIZE) {
+        hlen += 8;
+    }
+    if(f->flags & LZ4F_DICTID) {
+        hlen += 4;
+    }
+    if(len < hlen) {
+        return(-1);
+    }
+    if(f->flags & LZ4F_CSIZE) {
+        if(lz4get32(p+6) != 0) {            /* Over 4G. */
+            return(-1);
+        }
+        f->csize = lz4get32(p+2);
+    }
+    if(f->flags & LZ4F_DICTID) {            /* No dictionaries here. */
+        return(-1);
+    }
+    if(((xxh32(p,hlen-1) >> 8) & 0xff) != p[hlen-1]) {
+        return(-1);
+    }
+    return(hlen);
+}
+
+/* lz4skip():
+ * Step over any skippable frames at *pp.  Return the magic number of
+ * the frame that follows (or 0 if there are less than 4 bytes left).
+ */
+static ulong
+lz4skip(uchar **pp,uchar *end)
+{
+    ulong   magic, len;
+    uchar   *p;
+
+    p = *pp;
+    while(end - p >= 4) {
+        magic = lz4get32(p);
+        if((magic & LZ4_SKIPMASK) != LZ4_SKIPMAGIC) {
+            *pp = p;
+            return(magic);
+        }
+        if(end - p < 8) {
+            break;
+        }
+        len = lz4get32(p+4);
+        if(len > (ulong)(end - p - 8)) {
+            break;
+        }
+        p += 8 + len;
+    }
+    *pp = p;
+    return(0);
+}
+
+/* isLz4():
+ * Return 1 if the data at src starts with an LZ4 frame (possibly after
+ * skippable frames).
+ */
+int
+isLz4(char *src,int srclen)
+{
+    uchar   *p;
+
+    p = (uchar *)src;
+    return(lz4skip(&p,(uchar *)src+srclen) == LZ4_MAGIC);
+}
+
+/* unLz4():
+ * Decompress the LZ4 data (one or more frames) at src to dest, writing
+ * at most destlen bytes, then flush the caches over it (like unZip()).
+ * Return the size of the decompressed data, or -1 if it fails.
+ */
+int
+unLz4(char *src,int srclen,char *dest,int destlen)
+{
+    int     frames;
+    long    n, hlen;
+    ulong   bsize;
+    uchar   *in, *inend, *out, *outend, *fstart;
+    struct  lz4frame f;
+
+    in = (uchar *)src;
+    inend = in + srclen;
+    out = (uchar *)dest;
+    outend = out + destlen;
+    if(outend < out) {                  /* Unlimited (see decompress()) */
+        outend = (uchar *)~0UL;
+    }
+
+    for(frames=0; ; frames++) {
+        if(lz4skip(&in,inend) != LZ4_MAGIC) {
+            if(frames == 0) {
+                return(-1);
+            }
+            break;
+        }
+        in += 4;
+        if((hlen = lz4hdr(in,inend-in,&f)) < 0) {
+            return(-1);
+        }
+        in += hlen;
+
+        fstart = out;
+        while(1) {
+            if(inend - in < 4) {
+                return(-1);
+            }
+            bsize = lz4get32(in);
+            in += 4;
+            if(bsize == 0) {
+                break;
+            }
+            n = bsize & ~LZ4_UNCOMPRESSED;
+            if((n > f.bmax) || (n > inend - in) ||
+                    ((f.flags & LZ4F_BCHECKSUM) && (inend - in - n < 4))) {
+                return(-1);
+            }
+            if(f.flags & LZ4F_BCHECKSUM) {
+                if(xxh32(in,n) != lz4get32(in+n)) {
+                    return(-1);
+                }
+            }
+            if(bsize & LZ4_UNCOMPRESSED) {
+                if(n > outend - out) {
+                    return(-1);
+                }
+                memcpy((char *)out,(char *)in,n);
+            } else {
+                n = lz4block(in,n,out,
+                             outend - out < f.bmax ? outend - out : f.bmax,
+                             f.flags & LZ4F_BINDEP ? out : fstart);
+                if(n < 0) {
+                    return(-1);
+                }
+            }
+            in += bsize & ~LZ4_UNCOMPRESSED;
+            if(f.flags & LZ4F_BCHECKSUM) {
+                in += 4;
+            }
+            out += n;
+        }
+
+        if(f.flags & LZ4F_CCHECKSUM) {
+            if((inend - in < 4) ||
+                    (xxh32(fstart,out-fstart) != lz4get32(in))) {
+                return(-1);
+            }
+            in += 4;
+        }
+        if((f.flags & LZ4F_CSIZE) && (f.csize != (ulong)(out - fstart))) {
+            return(-1);
+        }
+    }
+
+    n = out - (uchar *)dest;
+    if(n > 0) {
+        flushDcache(dest,n);
+        invalidateIcache(dest,n);
+    }
+    return(n);
+}
+
+/* lz4stream:
+ * The state of a streaming decompression (see unLz4Open()).
+ */
+struct lz4stream {
+    uchar   *in, *inend;
+    struct  lz4frame f;
+    struct  xxh xs;         /* Content checksum of the current frame. */
+    ulong   fsize;          /* Bytes decompressed from the current frame. */
+    uchar   *buf;           /* Block buffer (f.bmax bytes)... */
+    long    bufsize;
+    uchar   *bp;            /* ...and what's left of it to be read. */
+    long    bleft;
+    int     done;
+    int     err;
+};
+
+/* lz4sframe():
+ * Start the frame at s->in.  Return 1 if there is one, 0 if there are
+ * no more, or -1 if it is bad.
+ */
+static int
+lz4sframe(struct lz4stream *s)
+{
+    int     hlen;
+
+    if(lz4skip(&s->in,s->inend) != LZ4_MAGIC) {
+        return(0);
+    }
+    s->in += 4;
+    if((hlen = lz4hdr(s->in,s->inend-s->in,&s->f)) < 0) {
+        return(-1);
+    }
+    s->in += hlen;
+    if(!(s->f.flags & LZ4F_BINDEP)) {
+        printf("LZ4 blocks must be independent\n");
+        return(-1);
+    }
+    if(s->f.bmax > s->bufsize) {
+        if(s->buf) {
+            free((char *)s->buf);
+        }
+        if((s->buf = (uchar *)malloc(s->f.bmax)) == 0) {
+            s->bufsize = 0;
+            return(-1);
+        }
+        s->bufsize = s->f.bmax;
+    }
+    xxhinit(&s->xs);
+    s->fsize = 0;
+    return(1);
+}
+
+/* lz4sblock():
+ * Decompress the next block of the stream to s->buf.  Return 1 if there
+ * is one, 0 at the end of the data, or -1 if it is bad.
+ */
+static int
+lz4sblock(struct lz4stream *s)
+{
+    int     rc;
+    long    n;
+    ulong   bsize;
+    struct  lz4frame *f;
+
+    f = &s->f;
+    while(1) {
+        if(s->inend - s->in < 4) {
+            return(-1);
+        }
+        bsize = lz4get32(s->in);
+        s->in += 4;
+        if(bsize != 0) {
+            break;
+        }
+
+        /* End of the frame; check it, then start the next (if any): */
+        if(f->flags & LZ4F_CCHECKSUM) {
+            if((s->inend - s->in < 4) ||
+                    (xxhdigest(&s->xs) != lz4get32(s->in))) {
+                return(-1);
+            }
+            s->in += 4;
+        }
+        if((f->flags & LZ4F_CSIZE) && (f->csize != s->fsize)) {
+            return(-1);
+        }
+        if((rc = lz4sframe(s)) <= 0) {
+            return(rc);
+        }
+    }
+
+    n = bsize & ~LZ4_UNCOMPRESSED;
+    if((n > f->bmax) || (n > s->inend - s->in) ||
+            ((f->flags & LZ4F_BCHECKSUM) && (s->inend - s->in - n < 4))) {
+        return(-1);
+    }
+    if(f->flags & LZ4F_BCHECKSUM) {
+        if(xxh32(s->in,n) != lz4get32(s->in+n)) {
+            return(-1);
+        }
+    }
+    if(bsize & LZ4_UNCOMPRESSED) {
+        memcpy((char *)s->buf,(char *)s->in,n);
+    } else {
+        n = lz4block(s->in,n,s->buf,f->bmax,s->buf);
+        if(n < 0) {
+            return(-1);
+        }
+    }
+    s->in += bsize & ~LZ4_UNCOMPRESSED;
+    if(f->flags & LZ4F_BCHECKSUM) {
+        s->in += 4;
+    }
+    if(f->flags & LZ4F_CCHECKSUM) {
+        xxhupdate(&s->xs,s->buf,n);
+    }
+    s->fsize += n;
+    s->bp = s->buf;
+    s->bleft = n;
+    return(1);
+}
+
+/* unLz4Open(), unLz4Read() & unLz4Close():
+ * The streaming form of unLz4().  unLz4Open() returns a handle for the
+ * LZ4 data at src (or 0 if it isn't LZ4 data that can be streamed);
+ * unLz4Read() returns the next 'len' bytes of decompressed data (fewer
+ * only at the end of the data) or -1 if the data is bad.
+ */
+void *
+unLz4Open(char *src,int srclen)
+{
+    struct lz4stream *s;
+
+    s = (struct lz4stream *)malloc(sizeof(struct lz4stream));
+    if(!s) {
+        return(0);
+    }
+    memset((char *)s,0,sizeof(struct lz4stream));
+    s->in = (uchar *)src;
+    s->inend = (uchar *)src + srclen;
+    if(lz4sframe(s) != 1) {
+        unLz4Close(s);
+        return(0);
+    }
+    return(s);
+}
+
+int
+unLz4Read(void *handle,char *to,int len)
+{
+    int     tot, rc;
+    long    n;
+    struct  lz4stream *s;
+
+    s = (struct lz4stream *)handle;
+    if(s->err) {
+        return(-1);
+    }
+
+    tot = 0;
+    while((tot < len) && !s->done) {
+        if(s->bleft == 0) {
+            rc = lz4sblock(s);
+            if(rc < 0) {
+                s->err = 1;
+                return(-1);
+            }
+            if(rc == 0) {
+                s->done = 1;
+                break;
+            }
+            continue;
+        }
+        n = len - tot;
+        if(n > s->bleft) {
+            n = s->bleft;
+        }
+        memcpy(to,(char *)s->bp,n);
+        s->bp += n;
+        s->bleft -= n;
+        to += n;
+        tot += n;
+    }
+    return(tot);
+}
+
+void
+unLz4Close(void *handle)
+{
+    struct lz4stream *s;
+
+    s = (struct lz4stream *)handle;
+    if(s->buf) {
+        free((char *)s->buf);
+    }
+    free((char *)s);
+}
+
+#endif  /* INCLUDE_UNLZ4 */
@@ -0,0 +1,861 @@
+/* zfast.c:
+ * A faster inflate for the monitor's one-shot, memory to memory
+ * decompression: decompress()/unZip() (gzip) and jzlibcpy() in jffs2.c
+ * (zlib format).  It is used in place of the zlib 1.1.3 inflate when
+ * USE_FAST_INFLATE is set in config.h; the streaming interface in
+ * gzio.c (unZipOpen() etc...) still uses zlib.
+ *
+ * Most of the speedup comes from what one-shot decompression allows:
+ *
+ *  - The whole output buffer is the window, so matches are copied
+ *    straight from earlier output (no 32K sliding window to maintain
+ *    and copy out of, which is where zlib 1.1.3 spends much of its
+ *    time).
+ *  - Each huffman code is decoded with one lookup into a table indexed
+ *    by the next ZF_LBITS (or ZF_DBITS) bits of input; only the rare
+ *    longer codes are decoded bit by bit.
+ *  - The bit buffer is a full long, refilled a byte at a time only when
+ *    it may not hold the next code and its extra bits.
+ *  - Matches are copied three bytes per step, runs of one byte with
+ *    memset() and long non-overlapping matches with memcpy().
+ *  - The crc32 (gzip) or adler32 (zlib) of each block's output is done
+ *    at the end of the block, while that output is still in cache, and
+ *    the crc32 is done four bytes at a time.
+ *
+ * The decoder checks all of its input: bad codes, distances that
+ * reach back before the start of the output, output that would overrun
+ * the destination and input that is truncated all return -1.
+ */
+#include "config.h"
+
+#if USE_FAST_INFLATE
+
+#include "stddefs.h"
+#include "genlib.h"
+#include "zlib.h"
+
+#ifndef ZF_LBITS
+#define ZF_LBITS    10      /* Literal/length lookup table bits. */
+#endif
+#ifndef ZF_DBITS
+#define ZF_DBITS    8       /* Distance lookup table bits. */
+#endif
+
+#define ZF_MAXBITS  15      /* Longest code allowed by deflate. */
+#define ZF_NLEN     288
+#define ZF_NDIST    30
+#define ZF_BBITS    ((int)sizeof(ulong)*8)
+
+#define ZF_CHECK_CRC32  1
+#define ZF_CHECK_ADLER  2
+
+/* Decoded symbols (table entries):
+ * Each is (value << 16) | (op << 8) | code length.  Symbols below the
+ * code's 'first' are literals (the value is the symbol); the rest are
+ * looked up in its base[] and op[] tables, so a length or distance
+ * symbol decodes straight to its base value and number of extra bits.
+ */
+#define ZF_OPLIT    0x00
+#define ZF_OPBASE   0x10    /* | number of extra bits */
+#define ZF_OPEOB    0x20
+#define ZF_OPBAD    0x40
+
+#define ZF_OP(e)    (((e) >> 8) & 0xff)
+#define ZF_VAL(e)   ((e) >> 16)
+
+/* zfhuff:
+ * A huffman code; count[] and symbol[] are the canonical description
+ * (used for codes longer than the table), fast[] is indexed by the next
+ * 'bits' bits of input and holds the decoded symbol (above), or 0 if
+ * the code is longer than 'bits'.
+ */
+struct zfhuff {
+    int     bits;
+    int     first;
+    int     nbase;
+    const   ushort *base;
+    const   uchar *op;
+    ushort  count[ZF_MAXBITS+1];
+    ushort  symbol[ZF_NLEN];
+    ulong   *fast;
+};
+
+struct zfstate {
+    uchar   *in, *inend;
+    uchar   *out, *outbase, *outend;
+    ulong   bb;             /* Bit buffer (next bit is the lsb). */
+    int     bc;             /* Number of bits in bb. */
+    int     over;           /* Bytes "read" past the end of input. */
+    int     check;          /* ZF_CHECK_XXX */
+    ulong   sum;            /* Running crc32/adler32 of the output. */
+    struct  zfhuff lencode, distcode;
+    ulong   lfast[1 << ZF_LBITS];
+    ulong   dfast[1 << ZF_DBITS];
+};
+
+/* Literal/length symbols 256 (end of block) to 285, and distance
+ * symbols 0 to 29:
+ */
+static const ushort zflbase[30] = {
+    0, 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uchar zflop[30] = {
+    ZF_OPEOB,
+    0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+    0x11, 0x11, 0x11, 0x11, 0x12, 0x12, 0x12, 0x12,
+    0x13, 0x13, 0x13, 0x13, 0x14, 0x14, 0x14, 0x14,
+    0x15, 0x15, 0x15, 0x15, 0x10
+};
+static const ushort zfdbase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577
+};
+static const uchar zfdop[30] = {
+    0x10, 0x10, 0x10, 0x10, 0x11, 0x11, 0x12, 0x12,
+    0x13, 0x13, 0x14, 0x14, 0x15, 0x15, 0x16, 0x16,
+    0x17, 0x17, 0x18, 0x18, 0x19, 0x19, 0x1a, 0x1a,
+    0x1b, 0x1b, 0x1c, 0x1c, 0x1d, 0x1d
+};
+static const uchar zfclorder[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+/* ZFREFILL():
+ * Fill the bit buffer to within a byte of full.  Past the end of the
+ * input, zeros are shifted in and counted in 'over'; zfoverrun() fails
+ * the decode if any of them were actually used.
+ */
+#define ZFREFILL(s) \
+    while((s)->bc <= ZF_BBITS - 8) { \
+        if((s)->in < (s)->inend) \
+            (s)->bb |= (ulong)(*(s)->in++) << (s)->bc; \
+        else \
+            (s)->over++; \
+        (s)->bc += 8; \
+    }
+
+/* ZFBITS() & ZFDROP():
+ * Return the next n bits (the caller must have done ZFREFILL()), and
+ * remove n bits from the buffer.
+ */
+#define ZFBITS(s,n)     ((s)->bb & ((1UL << (n)) - 1))
+#define ZFDROP(s,n)     ((s)->bb >>= (n), (s)->bc -= (n))
+
+static ulong
+zfgetbits(struct zfstate *s,int n)
+{
+    ulong   val;
+
+    ZFREFILL(s);
+    val = ZFBITS(s,n);
+    ZFDROP(s,n);
+    return(val);
+}
+
+/* zfoverrun():
+ * Return 1 if bits that were shifted in past the end of the input
+ * have been consumed.
+ */
+static int
+zfoverrun(struct zfstate *s)
+{
+    return(s->over * 8 > s->bc);
+}
+
+/* zfentry():
+ * The table entry for symbol 'sym' of code 'h' with code length 'len'.
+ */
+static ulong
+zfentry(struct zfhuff *h,int sym,int len)
+{
+    int     i;
+
+    if(sym < h->first) {
+        return(((ulong)sym << 16) | (ZF_OPLIT << 8) | len);
+    }
+    i = sym - h->first;
+    if(i >= h->nbase) {
+        return((ZF_OPBAD << 8) | len);
+    }
+    return(((ulong)h->base[i] << 16) | ((ulong)h->op[i] << 8) | len);
+}
+
+/* zfbuild():
+ * Build the huffman code from the list of code lengths.  Return 0 if
+ * the code is complete, a positive number if it is incomplete, or -1
+ * if it is over-subscribed (the same rules as zlib).
+ */
+static int
+zfbuild(struct zfhuff *h,uchar *length,int n)
+{
+    int     sym, len, left, fill, step;
+    ulong   code, rev, entry;
+    ushort  offs[ZF_MAXBITS+1];
+    ulong   next[ZF_MAXBITS+1];
+
+    for(len=0; len<=ZF_MAXBITS; len++) {
+        h->count[len] = 0;
+    }
+    for(sym=0; sym<n; sym++) {
+        h->count[length[sym]]++;
+    }
+    if(h->count[0] == n) {
+        memset((char *)h->fast,0,(1 << h->bits) * sizeof(ulong));
+        return(0);
+    }
+
+    left = 1;
+    for(len=1; len<=ZF_MAXBITS; len++) {
+        left <<= 1;
+        left -= h->count[len];
+        if(left < 0) {
+            return(-1);
+        }
+    }
+
+    offs[1] = 0;
+    for(len=1; len<ZF_MAXBITS; len++) {
+        offs[len+1] = offs[len] + h->count[len];
+    }
+    for(sym=0; sym<n; sym++) {
+        if(length[sym] != 0) {
+            h->symbol[offs[length[sym]]++] = sym;
+        }
+    }
+
+    /* Canonical code for each length, then fill the lookup table with
+     * each code that fits in it (bit reversed, because deflate sends
+     * the codes msb first into an lsb first stream)...
+     */
+    next[1] = 0;
+    for(len=2, code=0; len<=ZF_MAXBITS; len++) {
+        code = (code + h->count[len-1]) << 1;
+        next[len] = code;
+    }
+
+    memset((char *)h->fast,0,(1 << h->bits) * sizeof(ulong));
+    for(sym=0; sym<n; sym++) {
+        len = length[sym];
+        if(len == 0) {
+            continue;
+        }
+        code = next[len]++;
+        if(len > h->bits) {
+            continue;
+        }
+        for(rev=0, step=0; step<len; step++) {
+            rev = (rev << 1) | ((code >> step) & 1);
+        }
+        entry = zfentry(h,sym,len);
+        step = 1 << len;
+        for(fill=rev; fill < (1 << h->bits); fill += step) {
+            h->fast[fill] = entry;
+        }
+    }
+    return(left);
+}
+
+/* zfslow():
+ * Decode a code that is longer than the lookup table, a bit at a time
+ * from the bit buffer *bbp (which must hold ZF_MAXBITS bits).  Return
+ * the decoded symbol as a table entry (with a code length of 0, the
+ * bits are already removed), or a ZF_OPBAD entry if the code is bad.
+ */
+static ulong
+zfslow(struct zfhuff *h,ulong *bbp,int *bcp)
+{
+    int     len, code, first, index, count;
+    ulong   bb;
+
+    bb = *bbp;
+    code = first = index = 0;
+    for(len=1; len<=ZF_MAXBITS; len++) {
+        code |= (int)(bb & 1);
+        bb >>= 1;
+        count = h->count[len];
+        if(code - count < first) {
+            *bbp = bb;
+            *bcp -= len;
+            return(zfentry(h,h->symbol[index + (code - first)],0));
+        }
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    return(ZF_OPBAD << 8);
+}
+
+/* zfdecode():
+ * Return the next literal of the code (the caller has done ZFREFILL()),
+ * or -1 if it isn't one.
+ */
+static int
+zfdecode(struct zfstate *s,struct zfhuff *h)
+{
+    ulong   entry;
+
+    entry = h->fast[ZFBITS(s,h->bits)];
+    if(entry) {
+        ZFDROP(s,entry & 0xff);
+    } else {
+        entry = zfslow(h,&s->bb,&s->bc);
+    }
+    if(ZF_OP(entry) != ZF_OPLIT) {
+        return(-1);
+    }
+    return((int)ZF_VAL(entry));
+}
+
+/* zfcrc32():
+ * The gzip crc, four bytes per step ("slice by 4").  The byte at a time
+ * crc in zcrc32.c takes as long as the inflate itself; this is about
+ * three times faster.  The tables are built from crc32tab[] on first
+ * use.
+ */
+static ulong zfcrctab[4][256];
+
+static ulong
+zfcrc32(ulong crc,uchar *buf,long len)
+{
+    int     i, j;
+
+    if(zfcrctab[1][1] == 0) {
+        for(i=0; i<256; i++) {
+            zfcrctab[0][i] = crc32tab[i] & 0xffffffff;
+        }
+        for(j=1; j<4; j++) {
+            for(i=0; i<256; i++) {
+                crc = zfcrctab[j-1][i];
+                zfcrctab[j][i] = (crc >> 8) ^ zfcrctab[0][crc & 0xff];
+            }
+        }
+        crc = 0;
+    }
+
+    crc = ~crc & 0xffffffff;
+    while(len >= 4) {
+        crc ^= buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((ulong)buf[3] << 24);
+        crc = zfcrctab[3][crc & 0xff] ^ zfcrctab[2][(crc >> 8) & 0xff] ^
+              zfcrctab[1][(crc >> 16) & 0xff] ^ zfcrctab[0][crc >> 24];
+        buf += 4;
+        len -= 4;
+    }
+    while(len--) {
+        crc = zfcrctab[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+    }
+    return(~crc & 0xffffffff);
+}
+
+/* zfsum():
+ * Add the output from 'from' to the current position to the check
+ * value.
+ */
+static void
+zfsum(struct zfstate *s,uchar *from)
+{
+    if(s->check == ZF_CHECK_CRC32) {
+        s->sum = zfcrc32(s->sum,from,s->out - from);
+    } else if(s->check == ZF_CHECK_ADLER) {
+        s->sum = adler32(s->sum,from,s->out - from);
+    }
+}
+
+/* zfcodes():
+ * Decode the literals and matches of a block using the current tables.
+ * This is where nearly all of the time goes, so the bit buffer and the
+ * pointers are kept in locals (registers) for the duration of the block,
+ * the buffer is only refilled when it may not hold what comes next, and
+ * then without a bounds check while there is enough input left that it
+ * can't run off the end.
+ */
+#define ZFLREFILL() \
+    if(inend - in > (int)sizeof(ulong)) { \
+        while(bc <= ZF_BBITS - 8) { \
+            bb |= (ulong)(*in++) << bc; \
+            bc += 8; \
+        } \
+    } else { \
+        s->in = in, s->bb = bb, s->bc = bc; \
+        ZFREFILL(s); \
+        in = s->in, bb = s->bb, bc = s->bc; \
+    }
+
+static int
+zfcodes(struct zfstate *s)
+{
+    int     op, len, bc;
+    ulong   bb, dist, entry, *lfast, *dfast, lmask, dmask;
+    uchar   *in, *inend, *out, *outbase, *outend, *from;
+
+    in = s->in;
+    inend = s->inend;
+    bb = s->bb;
+    bc = s->bc;
+    out = s->out;
+    outbase = s->outbase;
+    outend = s->outend;
+    lfast = s->lencode.fast;
+    dfast = s->distcode.fast;
+    lmask = (1UL << s->lencode.bits) - 1;
+    dmask = (1UL << s->distcode.bits) - 1;
+
+    while(1) {
+        /* A literal/length code and its extra bits (at most 20): */
+        if(bc < ZF_MAXBITS + 5) {
+            ZFLREFILL();
+        }
+        entry = lfast[bb & lmask];
+        if(entry) {
+            bb >>= entry & 0xff;
+            bc -= (int)(entry & 0xff);
+        } else {
+            entry = zfslow(&s->lencode,&bb,&bc);
+        }
+        op = ZF_OP(entry);
+        if(op == ZF_OPLIT) {
+            if(out >= outend) {
+                break;
+            }
+            *out++ = (uchar)ZF_VAL(entry);
+            continue;
+        }
+        if(op == ZF_OPEOB) {
+            s->in = in;
+            s->bb = bb;
+            s->bc = bc;
+            s->out = out;
+            return(0);
+        }
+        if(op == ZF_OPBAD) {
+            break;
+        }
+        op &= 0x0f;
+        len = (int)ZF_VAL(entry) + (int)(bb & ((1UL << op) - 1));
+        bb >>= op;
+        bc -= op;
+
+        /* A distance code (at most 15 bits), then its extra bits (at
+         * most 13).  A refill only guarantees ZF_BBITS-7 bits, which for
+         * a 32-bit ulong is less than the 28 that the two can take, so
+         * the extra bits may need a refill of their own...
+         */
+        if(bc < ZF_MAXBITS) {
+            ZFLREFILL();
+        }
+        entry = dfast[bb & dmask];
+        if(entry) {
+            bb >>= entry & 0xff;
+            bc -= (int)(entry & 0xff);
+        } else {
+            entry = zfslow(&s->distcode,&bb,&bc);
+        }
+        op = ZF_OP(entry);
+        if(!(op & ZF_OPBASE)) {
+            break;
+        }
+        op &= 0x0f;
+        if(bc < op) {
+            ZFLREFILL();
+        }
+        dist = ZF_VAL(entry) + (bb & ((1UL << op) - 1));
+        bb >>= op;
+        bc -= op;
+        if((dist > (ulong)(out - outbase)) || (len > outend - out)) {
+            break;
+        }
+
+        /* Copy the match from earlier output: */
+        from = out - dist;
+        if(dist == 1) {
+            memset((char *)out,*from,len);
+            out += len;
+        } else if((dist >= (ulong)len) && (len >= 32)) {
+            memcpy((char *)out,(char *)from,len);
+            out += len;
+        } else {
+            while(len > 2) {
+                out[0] = from[0];
+                out[1] = from[1];
+                out[2] = from[2];
+                out += 3;
+                from += 3;
+                len -= 3;
+            }
+            if(len) {
+                *out++ = *from++;
+                if(len > 1) {
+                    *out++ = *from++;
+                }
+            }
+        }
+    }
+    return(-1);
+}
+
+/* zfstored():
+ * Copy a stored (uncompressed) block.
+ */
+static int
+zfstored(struct zfstate *s)
+{
+    int     back;
+    ulong   len, nlen;
+
+    /* Skip to a byte boundary, then get LEN and NLEN: */
+    ZFDROP(s,s->bc & 7);
+    len = zfgetbits(s,16);
+    nlen = zfgetbits(s,16);
+    if(len != (~nlen & 0xffff)) {
+        return(-1);
+    }
+
+    /* Give back the whole bytes still in the bit buffer so that the
+     * data can be copied straight from the input...
+     */
+    back = s->bc / 8;
+    if(s->over >= back) {
+        s->over -= back;
+        back = 0;
+    } else {
+        back -= s->over;
+        s->over = 0;
+    }
+    s->in -= back;
+    s->bb = 0;
+    s->bc = 0;
+    if(s->over) {
+        return(-1);
+    }
+
+    if((len > (ulong)(s->inend - s->in)) || (len > (ulong)(s->outend - s->out))) {
+        return(-1);
+    }
+    memcpy((char *)s->out,(char *)s->in,len);
+    s->out += len;
+    s->in += len;
+    return(0);
+}
+
+static int
+zffixed(struct zfstate *s)
+{
+    int     sym;
+    uchar   length[ZF_NLEN];
+
+    for(sym=0; sym<144; sym++) {
+        length[sym] = 8;
+    }
+    for(; sym<256; sym++) {
+        length[sym] = 9;
+    }
+    for(; sym<280; sym++) {
+        length[sym] = 7;
+    }
+    for(; sym<ZF_NLEN; sym++) {
+        length[sym] = 8;
+    }
+    zfbuild(&s->lencode,length,ZF_NLEN);
+
+    for(sym=0; sym<ZF_NDIST; sym++) {
+        length[sym] = 5;
+    }
+    zfbuild(&s->distcode,length,ZF_NDIST);
+    return(0);
+}
+
+static int
+zfdynamic(struct zfstate *s)
+{
+    int     nlen, ndist, ncode, index, sym, len, err;
+    uchar   length[ZF_NLEN+ZF_NDIST];
+
+    nlen = (int)zfgetbits(s,5) + 257;
+    ndist = (int)zfgetbits(s,5) + 1;
+    ncode = (int)zfgetbits(s,4) + 4;
+    if((nlen > ZF_NLEN - 2) || (ndist > ZF_NDIST)) {
+        return(-1);
+    }
+
+    /* The code length code (built in the literal/length table, where
+     * all 19 symbols are literals)...
+     */
+    for(index=0; index<19; index++) {
+        length[zfclorder[index]] = index < ncode ? (uchar)zfgetbits(s,3) : 0;
+    }
+    if(zfbuild(&s->lencode,length,19) != 0) {
+        return(-1);
+    }
+
+    for(index=0; index<nlen+ndist; ) {
+        ZFREFILL(s);
+        sym = zfdecode(s,&s->lencode);
+        if(sym < 0) {
+            return(-1);
+        }
+        if(sym < 16) {
+            length[index++] = (uchar)sym;
+            continue;
+        }
+        len = 0;
+        if(sym == 16) {
+            if(index == 0) {
+                return(-1);
+            }
+            len = length[index-1];
+            sym = 3 + (int)zfgetbits(s,2);
+        } else if(sym == 17) {
+            sym = 3 + (int)zfgetbits(s,3);
+        } else {
+            sym = 11 + (int)zfgetbits(s,7);
+        }
+        if(index + sym > nlen + ndist) {
+            return(-1);
+        }
+        while(sym--) {
+            length[index++] = (uchar)len;
+        }
+    }
+    if(length[256] == 0) {
+        return(-1);
+    }
+
+    err = zfbuild(&s->lencode,length,nlen);
+    if(err && ((err < 0) ||
+               (nlen != s->lencode.count[0] + s->lencode.count[1]))) {
+        return(-1);
+    }
+    err = zfbuild(&s->distcode,length+nlen,ndist);
+    if(err && ((err < 0) ||
+               (ndist != s->distcode.count[0] + s->distcode.count[1]))) {
+        return(-1);
+    }
+    return(0);
+}
+
+/* zfraw():
+ * Inflate one raw deflate stream from s->in to s->out.
+ */
+static int
+zfraw(struct zfstate *s)
+{
+    int     last, type, err;
+    uchar   *blockstart;
+
+    do {
+        blockstart = s->out;
+        last = (int)zfgetbits(s,1);
+        type = (int)zfgetbits(s,2);
+        switch(type) {
+        case 0:
+            err = zfstored(s);
+            break;
+        case 1:
+            err = zffixed(s);
+            if(err == 0) {
+                err = zfcodes(s);
+            }
+            break;
+        case 2:
+            err = zfdynamic(s);
+            if(err == 0) {
+                err = zfcodes(s);
+            }
+            break;
+        default:
+            err = -1;
+            break;
+        }
+        if((err < 0) || zfoverrun(s)) {
+            return(-1);
+        }
+        zfsum(s,blockstart);
+    } while(!last);
+
+    /* Give back the unused whole bytes of the bit buffer, so that
+     * s->in is just past the end of the deflate data:
+     */
+    s->in -= (s->bc / 8) - s->over;
+    s->bb = 0;
+    s->bc = 0;
+    s->over = 0;
+    return(0);
+}
+
+static struct zfstate *
+zfopen(char *src,int srclen,char *dest,int destlen,int check)
+{
+    struct zfstate *s;
+
+    s = (struct zfstate *)malloc(sizeof(struct zfstate));
+    if(!s) {
+        return(0);
+    }
+    s->in = (uchar *)src;
+    s->inend = (uchar *)src + srclen;
+    s->out = s->outbase = (uchar *)dest;
+    s->outend = (uchar *)dest + destlen;
+    if(s->outend < s->outbase) {        /* Unlimited (see decompress()) */
+        s->outend = (uchar *)~0UL;
+    }
+    s->bb = 0;
+    s->bc = 0;
+    s->over = 0;
+    s->check = check;
+    s->lencode.bits = ZF_LBITS;
+    s->lencode.first = 256;
+    s->lencode.nbase = 30;
+    s->lencode.base = zflbase;
+    s->lencode.op = zflop;
+    s->lencode.fast = s->lfast;
+    s->distcode.bits = ZF_DBITS;
+    s->distcode.first = 0;
+    s->distcode.nbase = 30;
+    s->distcode.base = zfdbase;
+    s->distcode.op = zfdop;
+    s->distcode.fast = s->dfast;
+    return(s);
+}
+
+/* zfget32():
+ * Return the next four (little endian) bytes of input, or -1 with
+ * 'ok' cleared if there aren't four more.
+ */
+static ulong
+zfget32(struct zfstate *s,int bigendian,int *ok)
+{
+    ulong   val;
+    uchar   *p;
+
+    if(s->inend - s->in < 4) {
+        *ok = 0;
+        return(0);
+    }
+    p = s->in;
+    s->in += 4;
+    if(bigendian) {
+        val = ((ulong)p[0] << 24) | ((ulong)p[1] << 16) | (p[2] << 8) | p[3];
+    } else {
+        val = ((ulong)p[3] << 24) | ((ulong)p[2] << 16) | (p[1] << 8) | p[0];
+    }
+    return(val & 0xffffffff);
+}
+
+/* zfgzhdr():
+ * Step over a gzip member header.  Return 1 if there is one, 0 if
+ * there is no more input (or just trailing padding), or -1 if the
+ * header is bad.
+ */
+static int
+zfgzhdr(struct zfstate *s)
+{
+    int     flags;
+    ulong   len;
+    uchar   *p, *end;
+
+    p = s->in;
+    end = s->inend;
+    if((end - p < 18) || (p[0] != 0x1f) || (p[1] != 0x8b)) {
+        return(0);
+    }
+    if((p[2] != Z_DEFLATED) || (p[3] & 0xe0)) {
+        return(-1);
+    }
+    flags = p[3];
+    p += 10;
+    if(flags & 0x04) {                  /* FEXTRA */
+        len = p[0] | (p[1] << 8);
+        p += 2 + len;
+    }
+    if(flags & 0x08) {                  /* FNAME */
+        while((p < end) && *p++);
+    }
+    if(flags & 0x10) {                  /* FCOMMENT */
+        while((p < end) && *p++);
+    }
+    if(flags & 0x02) {                  /* FHCRC */
+        p += 2;
+    }
+    if(p >= end) {
+        return(-1);
+    }
+    s->in = p;
+    return(1);
+}
+
+/* zfGunzip():
+ * Decompress the gzip data at src (one or more members) to dest.
+ * Return the size of the decompressed data, or -1 if it fails.
+ */
+int
+zfGunzip(char *src,int srclen,char *dest,int destlen)
+{
+    int     rc, ok, members;
+    uchar   *start;
+    ulong   crc, isize;
+    struct  zfstate *s;
+
+    if((s = zfopen(src,srclen,dest,destlen,ZF_CHECK_CRC32)) == 0) {
+        return(-1);
+    }
+
+    ok = 1;
+    members = 0;
+    while((rc = zfgzhdr(s)) == 1) {
+        start = s->out;
+        s->sum = 0;
+        if(zfraw(s) < 0) {
+            ok = 0;
+            break;
+        }
+        crc = zfget32(s,0,&ok);
+        isize = zfget32(s,0,&ok);
+        if(!ok || (crc != s->sum) ||
+                (isize != ((ulong)(s->out - start) & 0xffffffff))) {
+            ok = 0;
+            break;
+        }
+        members++;
+    }
+    if((rc < 0) || (members == 0)) {
+        ok = 0;
+    }
+
+    rc = ok ? (int)(s->out - s->outbase) : -1;
+    free((char *)s);
+    return(rc);
+}
+
+/* zfUncompress():
+ * Decompress zlib format (RFC 1950) data at src to dest.
+ * Return the size of the decompressed data, or -1 if it fails.
+ */
+int
+zfUncompress(char *src,int srclen,char *dest,int destlen)
+{
+    int     rc, ok;
+    uchar   *p;
+    struct  zfstate *s;
+
+    p = (uchar *)src;
+    if((srclen < 6) || ((p[0] & 0x0f) != Z_DEFLATED) ||
+            ((((ulong)p[0] << 8) | p[1]) % 31) || (p[1] & 0x20)) {
+        return(-1);
+    }
+    if((s = zfopen(src+2,srclen-2,dest,destlen,ZF_CHECK_ADLER)) == 0) {
+        return(-1);
+    }
+
+    ok = 1;
+    s->sum = adler32(0L,Z_NULL,0);
+    if((zfraw(s) < 0) || (zfget32(s,1,&ok) != s->sum)) {
+        ok = 0;
+    }
+    rc = ok ? (int)(s->out - s->outbase) : -1;
+    free((char *)s);
+    return(rc);
+}
+
+#endif  /* USE_FAST_INFLATE */
@@ -186,6 +186,7 @@
 #define INCLUDE_PORTCMD	        0
 #define INCLUDE_SYSLOG	        1
 #define INCLUDE_HWTMR	        1
+#define INCLUDE_BOOTTIME        1
 #define INCLUDE_VERBOSEHELP     1
 #define INCLUDE_GDB			    1
 #define INCLUDE_USRLVL			0
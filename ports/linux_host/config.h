@@ -0,0 +1,153 @@
+/* Monitor configuration file for the Linux hosted build.
+ *
+ * uMon runs as an ordinary (32-bit) Linux process.  The "flash" is
+ * the NOR simulator (main/flash/devices/norsim.c) over a file that
+ * host.c maps at FLASH_BANK0_BASE_ADDR, the console is stdin/stdout
+ * and the ethernet device sends and receives frames as UDP datagrams.
+ * Refer to README.txt for details.
+ */
+#define CPU_LE
+
+#define CPU_TYPE        HOST
+#define CPU_NAME        "Linux hosted"
+#define PLATFORM_TYPE   LINUX_HOST
+#define PLATFORM_NAME   "uMon Linux host"
+
+/* The process's address space (see host.c); all of these are mapped
+ * with MAP_FIXED, so they must stay clear of the executable, its heap
+ * and the shared libraries.
+ */
+#define APPRAMBASE_OVERRIDE     0x60000000
+#define APPRAMSIZE              0x01000000
+#define BOOTROMBASE_OVERRIDE    FLASH_BANK0_BASE_ADDR
+
+/* The hardware timer is the host's microsecond clock (target_timer()
+ * in cpuio.c).
+ */
+#define TIMER_TICKS_PER_MSEC    1000
+
+/* "prof sample" uses a SIGPROF interval timer (host_proftimer() in
+ * host.c); the call graph walks i386 frames (the port is built with
+ * frame pointers), where the return address is just above the saved
+ * frame pointer.
+ */
+#define PROF_SAMPLE_TIMER       host_proftimer
+#define PROF_FRAME_PC(fp)       (*((fp) + 1))
+#define PROF_FRAME_NEXT(fp)     (*(fp))
+
+#define DEFAULT_ETHERADD "00:30:23:40:00:01"
+#define DEFAULT_IPADD    "192.168.254.110"
+
+#define DONT_CENTER_MONHEADER
+
+#define XBUFCNT     8
+#define RBUFCNT     8
+#define XBUFSIZE    2048
+#define RBUFSIZE    2048
+
+#define LOOPS_PER_SECOND    1000000
+
+/* NORSIM_POWERCUT:
+ * Called by the NOR simulator when an armed power cut hits; host.c
+ * leaves the flash file as it is and exits the process with status
+ * HOST_POWERCUT_EXIT, so that a script can restart it and check how
+ * the monitor recovers.
+ */
+#define NORSIM_POWERCUT         host_powercut
+#define HOST_POWERCUT_EXIT      3
+
+/* Flash bank configuration:
+ * Two simulated NOR banks (sectors 0-63 and 64-127, both in the flash
+ * file), so that overlapped erases across banks can be measured; TFS
+ * is in the first.
+ */
+#define SINGLE_FLASH_DEVICE     1
+#define FLASH_BANK0_BASE_ADDR   0x50000000
+#define FLASH_PROTECT_RANGE     "0-1"
+#define FLASH_BANK0_WIDTH       1
+#define NORSIM_SECTOR_SIZE      0x10000
+#define NORSIM_SECTOR_COUNT     64
+#define NORSIM_BANKS            2
+#define FLASH_LARGEST_SECTOR    NORSIM_SECTOR_SIZE
+
+#define FLASHRAM_BASE           0x58000000
+#define FLASHRAM_END            0x5807ffff
+#define FLASHRAM_SECTORSIZE     0x00010000
+#define FLASHRAM_SPARESIZE      FLASHRAM_SECTORSIZE
+#define FLASHRAM_BANKNUM        NORSIM_BANKS
+#define FLASHRAM_SECTORCOUNT    8
+
+#ifdef FLASHRAM_BASE
+#define FLASHBANKS              (NORSIM_BANKS+1)
+#else
+#define FLASHBANKS              NORSIM_BANKS
+#endif
+
+/* TFS definitions:
+ * The first two sectors hold the (protected) boot area; TFS uses the
+ * rest, with the last sector as the spare.
+ */
+#define TFSSPARESIZE            FLASH_LARGEST_SECTOR
+#define TFS_DEVTOT              1
+#define TFSSTART                (FLASH_BANK0_BASE_ADDR+0x020000)
+#define TFSEND                  (FLASH_BANK0_BASE_ADDR+0x3effff)
+#define TFSSPARE                (TFSEND+1)
+#define TFSSECTORCOUNT          ((TFSSPARE-TFSSTART)/NORSIM_SECTOR_SIZE)
+#define TFS_EBIN_ELF            1
+#define TFS_VERBOSE_STARTUP     1
+
+/* USE_FAST_INFLATE:
+ * One-shot gzip and zlib decompression (decompress(), unZip() and
+ * jzlibcpy()) use the faster inflate in main/zlib/zfast.c instead of
+ * zlib's.  The zbench target in the Makefile compares the two.
+ */
+#define USE_FAST_INFLATE        1
+
+#define ALLOCSIZE       (256*1024)
+#define MONSTACKSIZE    (16*1024)
+
+#define INCLUDE_MEMTRACE        1
+#define INCLUDE_MEMCMDS         1
+#define INCLUDE_EDIT            1
+#define INCLUDE_DISASSEMBLER    0
+#define INCLUDE_UNZIP           1
+#define INCLUDE_UNLZ4           1
+#define INCLUDE_ETHERNET        1
+#define INCLUDE_ICMP            1
+#define INCLUDE_TFTP            1
+#define INCLUDE_DHCPBOOT        1
+#define INCLUDE_TFS             1
+#define INCLUDE_TFSCLI          1
+#define INCLUDE_TFSAPI          1
+#define INCLUDE_TFSSCRIPT       1
+#define INCLUDE_TFSSYMTBL       1
+#define INCLUDE_TFSCPRS         1
+#define INCLUDE_XMODEM          0
+#define INCLUDE_LINEEDIT        1
+#define INCLUDE_EE              0
+#define INCLUDE_FLASH           1
+#define INCLUDE_STRACE          0
+#define INCLUDE_CAST            1
+#define INCLUDE_STRUCT          1
+#define INCLUDE_REDIRECT        1
+#define INCLUDE_QUICKMEMCPY     1
+#define INCLUDE_PROFILER        1
+#define INCLUDE_BBC             0
+#define INCLUDE_STOREMAC        0
+#define INCLUDE_SHELLVARS       1
+#define INCLUDE_MALLOC          1
+#define INCLUDE_PORTCMD         0
+#define INCLUDE_SYSLOG          1
+#define INCLUDE_HWTMR           1
+#define INCLUDE_BOOTTIME        1
+#define INCLUDE_VERBOSEHELP     1
+#define INCLUDE_GDB             0
+#define INCLUDE_USRLVL          0
+#define INCLUDE_JFFS2           0
+#define INCLUDE_JFFS2ZLIB       0
+#define INCLUDE_FBI             0
+#define INCLUDE_TSI             0
+#define INCLUDE_SD              0
+#define INCLUDE_DNS             1
+
+#include "inc_check.h"
@@ -0,0 +1,420 @@
+/* cprstest.c:
+ * Host test of random access to compressed TFS files (TFS_CPRS; refer
+ * to tfs.h).  The monitor's tfsapi.c is built natively against a small
+ * in-memory stand-in for TFS holding two files: the original and the
+ * same data compressed (as "lz4pack -t" does it) in blocks of each of
+ * the given sizes in turn.  The two are then read side by side through
+ * tfsopen(), and every result (data, return value, offset and eof) of
+ * the compressed one must match the original:
+ *
+ *  - a sequential tfsgetline() pass over the whole file, which must also
+ *    decompress each block exactly once,
+ *  - random tfsseek()s, each followed by a tfsread() (mostly short, some
+ *    spanning many blocks) or a tfsgetline() with a random line size,
+ *  - the whole-file copy made by tfscprsimage().
+ *
+ * Then bytes of the compressed image are corrupted at random and the
+ * file is read through again; each read must fail cleanly or return
+ * data, never crash (build with -fsanitize=address to check that bad
+ * block sizes and offsets are caught before they are used).
+ *
+ * Usage: cprstest [-b blksize,...] [-i iterations] [-c corruptions] file ...
+ *
+ *   -b  block sizes to test (default 16,100,4096,16384)
+ *   -i  random seek/read operations per block size (default 20000)
+ *   -c  corrupted images to read per block size (default 100)
+ *
+ * The exit status is 0 only if everything matched.
+ */
+#include "config.h"
+#include "stddefs.h"
+#include "genlib.h"
+#include "tfs.h"
+#include "tfsprivate.h"
+
+/* From the host's C library (its headers can't be used together with
+ * the monitor's):
+ */
+extern int open(const char *,int,...);
+extern long read(int,void *,unsigned long);
+extern int close(int);
+extern long lseek(int,long,int);
+extern void *calloc(unsigned long,unsigned long);
+extern int rand(void);
+extern void srand(unsigned int);
+extern void exit(int);
+
+extern long lz4tfscompress(uchar *,long,uchar *,long,long);
+extern int __real_unLz4Block(char *,int,char *,int);
+
+#define MAXFILE     (4*1024*1024)
+
+#ifndef TFSCPRS_BLKMAX          /* As in tfsapi.c */
+#define TFSCPRS_BLKMAX  0x4000
+#endif
+
+/* The in-memory TFS: the original file and its compressed copy.
+ */
+static TFILE *CtFiles[2];
+static ulong CtHdrcrc;
+static int CtBlocks;
+
+long tfsTrace;
+struct tfsdat tfsSlots[TFS_MAXOPEN];
+
+/* __wrap_unLz4Block():
+ * Every block decompression goes through here (the Makefile links with
+ * --wrap=unLz4Block), so that they can be counted.
+ */
+int
+__wrap_unLz4Block(char *src,int srclen,char *dest,int destlen)
+{
+    CtBlocks++;
+    return(__real_unLz4Block(src,srclen,dest,destlen));
+}
+
+/* The monitor functions that tfsapi.c and unlz4.c refer to: */
+TFILE *
+tfsstat(char *name)
+{
+    int i;
+
+    for(i=0; i<2; i++) {
+        if(CtFiles[i] && !strcmp(CtFiles[i]->name,name)) {
+            return(CtFiles[i]);
+        }
+    }
+    return((TFILE *)0);
+}
+
+long
+tfstell(int fd)
+{
+    return(tfsSlots[fd].offset);
+}
+
+TFILE *_tfsstat(char *name,int uselink) { return((TFILE *)0); }
+ulong crc32(uchar *p,ulong n) { return(0); }
+int getUsrLvl(void) { return(MAXUSRLEVEL); }
+int tfsflashwrite(uchar *a,uchar *b,long c) { return(TFSERR_RDONLY); }
+void tfslog(int a,char *b) { }
+int tfsadd(char *a,char *b,char *c,uchar *d,int e) { return(TFSERR_RDONLY); }
+char *tfsflagsbtoa(long f,char *b) { *b = 0; return(b); }
+char *tfserrmsg(int e) { return("error"); }
+int flushDcache(char *a,int s) { return(0); }
+int invalidateIcache(char *a,int s) { return(0); }
+int s_memcpy(char *to,char *from,int n,int v,int vo)
+{
+    memcpy(to,from,n);
+    return(0);
+}
+
+/* ctfile():
+ * Put 'size' bytes of data in the in-memory TFS as 'name'.  Each file
+ * gets a new header crc, because the block cache is keyed on it.
+ */
+static TFILE *
+ctfile(char *name,char *data,long size,long flags)
+{
+    TFILE   *fp;
+
+    fp = (TFILE *)calloc(1,sizeof(TFILE)+size+8);
+    fp->hdrsize = sizeof(TFILE);
+    fp->filsize = size;
+    fp->flags = flags | TFS_ACTIVE | TFS_NSTALE;
+    fp->hdrcrc = ++CtHdrcrc;
+    strcpy(fp->name,name);
+    memcpy((char *)(fp+1),data,size);
+    memset((char *)(fp+1)+size,0xff,8);
+    return(fp);
+}
+
+/* ctload():
+ * Read a file into memory; return its size or -1.
+ */
+static long
+ctload(char *fname,char **data)
+{
+    int     fd;
+    long    size;
+
+    if((fd = open(fname,0)) < 0) {
+        return(-1);
+    }
+    size = lseek(fd,0,2);
+    if((size < 0) || (size > MAXFILE)) {
+        close(fd);
+        return(-1);
+    }
+    lseek(fd,0,0);
+    *data = (char *)malloc(size+1);
+    if(!*data || (read(fd,*data,size) != size)) {
+        close(fd);
+        return(-1);
+    }
+    close(fd);
+    return(size);
+}
+
+/* ctsame():
+ * Compare the state of the two open files after an operation that
+ * returned r1 (original) and r2 (compressed).
+ */
+static int
+ctsame(int fr,int fc,int r1,int r2)
+{
+    return((r1 == r2) && (tfstell(fr) == tfstell(fc)) &&
+           (tfseof(fr) == tfseof(fc)));
+}
+
+/* ctgetlines():
+ * Read both files through with tfsgetline(); return the number of
+ * mismatches (0 or 1, it stops at the first).
+ */
+static int
+ctgetlines(int fr,int fc,long size,int max,char *b1,char *b2,long *lines)
+{
+    int     r1, r2;
+
+    for(*lines=0; ; (*lines)++) {
+        r1 = tfsgetline(fr,b1,max);
+        r2 = tfsgetline(fc,b2,max);
+        if(!ctsame(fr,fc,r1,r2) || ((r1 > 0) && strcmp(b1,b2))) {
+            printf("  getline %ld: %d/%d at %ld/%ld\n",*lines,r1,r2,
+                   tfstell(fr),tfstell(fc));
+            return(1);
+        }
+        if(r1 == 0) {
+            /* End of file, or stopped at a NULL (binary data); step
+             * over it and go on.
+             */
+            if(tfstell(fr) >= size) {
+                break;
+            }
+            tfsseek(fr,1,TFS_CURRENT);
+            tfsseek(fc,1,TFS_CURRENT);
+        }
+    }
+    return(0);
+}
+
+/* ctrandom():
+ * Random seeks, each followed by a read or a getline, on both files;
+ * return the number of mismatches.
+ */
+static int
+ctrandom(int fr,int fc,long size,long iters,char *b1,char *b2)
+{
+    long    i, off, len;
+    int     r1, r2, max, fails;
+
+    fails = 0;
+    for(i=0; i<iters; i++) {
+        off = rand() % (size + 2);
+        r1 = tfsseek(fr,off,TFS_BEGIN);
+        r2 = tfsseek(fc,off,TFS_BEGIN);
+        if(r1 != r2) {
+            printf("  seek %ld: %d/%d\n",off,r1,r2);
+            fails++;
+            continue;
+        }
+        if(rand() % 3 == 0) {
+            max = 2 + rand() % 300;
+            r1 = tfsgetline(fr,b1,max);
+            r2 = tfsgetline(fc,b2,max);
+            if(!ctsame(fr,fc,r1,r2) || ((r1 > 0) && strcmp(b1,b2))) {
+                printf("  getline %d at %ld: %d/%d\n",max,off,r1,r2);
+                fails++;
+            }
+        } else {
+            len = 1 + rand() % (rand() % 4 ? 200 : 66000);
+            r1 = tfsread(fr,b1,len);
+            r2 = tfsread(fc,b2,len);
+            if(!ctsame(fr,fc,r1,r2) || ((r1 > 0) && memcmp(b1,b2,r1))) {
+                printf("  read %ld at %ld: %d/%d\n",len,off,r1,r2);
+                fails++;
+            }
+        }
+    }
+    return(fails);
+}
+
+/* ctcorrupt():
+ * Read corrupted copies of the compressed image through; only a crash
+ * (or an out of bounds access, with ASan) is a failure.  Return the
+ * number of copies that were rejected by tfsopen() or failed a read.
+ */
+static int
+ctcorrupt(char *zdata,long zsize,long count,char *buf)
+{
+    long    i, j;
+    int     fd, rc, bad;
+    char    *copy;
+
+    bad = 0;
+    copy = (char *)malloc(zsize);
+    for(i=0; i<count; i++) {
+        memcpy(copy,zdata,zsize);
+        for(j=1+rand()%4; j>0; j--) {
+            copy[rand() % zsize] ^= 1 << (rand() % 8);
+        }
+        CtFiles[1] = ctfile("cprs",copy,zsize,TFS_CPRS);
+        fd = tfsopen("cprs",TFS_RDONLY,0);
+        if(fd < 0) {
+            bad++;
+        } else {
+            while((rc = tfsread(fd,buf,1+rand()%5000)) > 0);
+            if(rc != TFSERR_EOF) {
+                bad++;
+            }
+            tfsclose(fd,0);
+        }
+        free((char *)CtFiles[1]);
+        CtFiles[1] = 0;
+    }
+    free(copy);
+    return(bad);
+}
+
+/* cttest():
+ * Test one file at one block size; return the number of failures.
+ */
+static int
+cttest(char *fname,char *data,long size,long bsize,long iters,long corrupt)
+{
+    int     fr, fc, fails, getlineblks;
+    long    zsize, zmax, lines, nblks;
+    char    *zdata, *img, *b1, *b2;
+
+    /* Worst case size of the compressed file (refer to lz4comp.c): */
+    nblks = size / bsize + (size % bsize ? 1 : 0);
+    zmax = TFSCPRS_HDRSIZ + 4 * (nblks + 1) + 27 + 24 * (nblks + 1) +
+           size + size / 255;
+    zdata = (char *)malloc(zmax);
+    zsize = lz4tfscompress((uchar *)data,size,(uchar *)zdata,zmax,bsize);
+    if(zsize <= 0) {
+        printf("%s: can't compress in %ld byte blocks\n",fname,bsize);
+        free(zdata);
+        return(1);
+    }
+
+    CtFiles[0] = ctfile("orig",data,size,0);
+    CtFiles[1] = ctfile("cprs",zdata,zsize,TFS_CPRS);
+    fr = tfsopen("orig",TFS_RDONLY,0);
+    fc = tfsopen("cprs",TFS_RDONLY,0);
+    if((fr < 0) || (fc < 0) || (tfsSlots[fc].hdr.filsize != size)) {
+        printf("%s: tfsopen: %d/%d\n",fname,fr,fc);
+        return(1);
+    }
+
+    fails = 0;
+    b1 = (char *)malloc(70000);
+    b2 = (char *)malloc(70000);
+    CtBlocks = 0;
+    fails += ctgetlines(fr,fc,size,80,b1,b2,&lines);
+    getlineblks = CtBlocks;
+    if(getlineblks != nblks) {
+        printf("  getline pass decompressed %d blocks of %ld\n",
+               getlineblks,nblks);
+        fails++;
+    }
+    fails += ctrandom(fr,fc,size,iters,b1,b2);
+    if(tfscprsimage(fc,&img) != TFS_OKAY) {
+        printf("  tfscprsimage() failed\n");
+        fails++;
+    } else {
+        if(memcmp(img,data,size)) {
+            printf("  tfscprsimage() mismatch\n");
+            fails++;
+        }
+        free(img);
+    }
+    tfsclose(fr,0);
+    tfsclose(fc,0);
+    free((char *)CtFiles[0]);
+    free((char *)CtFiles[1]);
+    CtFiles[0] = CtFiles[1] = 0;
+
+    printf("%s, %5ld byte blocks: %ld -> %ld bytes, %ld lines, %ld ops, "
+           "%d decompressions; %d corrupt images rejected of %ld; %s\n",
+           fname,bsize,size,zsize,lines,iters,CtBlocks,
+           ctcorrupt(zdata,zsize,corrupt,b1),corrupt,
+           fails ? "FAILED" : "ok");
+    free(zdata);
+    free(b1);
+    free(b2);
+    return(fails);
+}
+
+static void
+usage(void)
+{
+    printf("Usage: cprstest [-b blksize,...] [-i iterations] "
+           "[-c corruptions] file ...\n");
+    exit(1);
+}
+
+int
+main(int argc,char *argv[])
+{
+    int     i, opt, fails;
+    long    size, iters, corrupt, bsizes[16], nbsizes;
+    char    *bp, *data;
+
+    iters = 20000;
+    corrupt = 100;
+    bsizes[0] = 16;
+    bsizes[1] = 100;
+    bsizes[2] = 4096;
+    bsizes[3] = 16384;
+    nbsizes = 4;
+    while((opt = getopt(argc,argv,"b:c:i:")) != -1) {
+        switch(opt) {
+        case 'b':
+            bp = optarg;
+            for(nbsizes=0; *bp && (nbsizes < 16); nbsizes++) {
+                bsizes[nbsizes] = strtol(bp,&bp,0);
+                if((bsizes[nbsizes] < 1) ||
+                        (bsizes[nbsizes] > TFSCPRS_BLKMAX)) {
+                    usage();
+                }
+                if(*bp == ',') {
+                    bp++;
+                }
+            }
+            break;
+        case 'c':
+            corrupt = strtol(optarg,0,0);
+            break;
+        case 'i':
+            iters = strtol(optarg,0,0);
+            break;
+        default:
+            usage();
+        }
+    }
+    if(optind == argc) {
+        usage();
+    }
+
+    for(i=0; i<TFS_MAXOPEN; i++) {
+        tfsSlots[i].offset = -1;
+    }
+    srand(1);
+    fails = 0;
+    for(; optind<argc; optind++) {
+        size = ctload(argv[optind],&data);
+        if(size <= 0) {
+            printf("%s: can't read (or empty, or over %d bytes)\n",
+                   argv[optind],MAXFILE);
+            fails++;
+            continue;
+        }
+        for(i=0; i<nbsizes; i++) {
+            fails += cttest(argv[optind],data,size,bsizes[i],iters,corrupt);
+        }
+        free(data);
+    }
+    printf("%s\n",fails ? "FAILED" : "PASSED");
+    return(fails ? 1 : 0);
+}
@@ -0,0 +1,7 @@
+/* cpu.h:
+ * The hosted build has no cpu-specific registers or reset hardware;
+ * a reset just goes back through warmstart() in host.c.
+ */
+#define MONARGV0 "umon"
+
+#define RESETMACRO()    monrestart(INITIALIZE)
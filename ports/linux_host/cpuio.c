@@ -0,0 +1,102 @@
+/* cpuio.c:
+ * Board-level IO for the Linux hosted build; everything is passed
+ * through to host.c.
+ */
+#include "config.h"
+#include "stddefs.h"
+#include "cpuio.h"
+#include "genlib.h"
+#include "cache.h"
+#include "warmstart.h"
+#include "timer.h"
+#include "host.h"
+
+/* devInit():
+ * The console is the process's stdin/stdout.
+ */
+void
+devInit(int baud)
+{
+    host_consoleinit();
+}
+
+/* ConsoleBaudSet():
+ * There is no baud rate to set; accept anything.
+ */
+int
+ConsoleBaudSet(int baud)
+{
+    return(0);
+}
+
+/* target_console_empty():
+ * Output is written straight through, so it's always empty.
+ */
+int
+target_console_empty(void)
+{
+    return(1);
+}
+
+int
+target_putchar(char c)
+{
+    host_putchar(c);
+    return((int)c);
+}
+
+int
+target_gotachar(void)
+{
+    return(host_gotachar());
+}
+
+int
+target_getchar(void)
+{
+    return(host_getchar());
+}
+
+/* intsoff() & intsrestore():
+ * Nothing interrupts the monitor (signals are only used for faults).
+ */
+ulong
+intsoff(void)
+{
+    return(0);
+}
+
+void
+intsrestore(ulong status)
+{
+}
+
+void
+cacheInitForTarget(void)
+{
+}
+
+/* target_reset():
+ * A reset of the hosted "board" ends the process (a script can
+ * restart it; the flash file is kept).
+ */
+void
+target_reset(void)
+{
+    host_exit(0);
+}
+
+void
+initCPUio(void)
+{
+}
+
+/* target_timer():
+ * Used in conjunction with INCLUDE_HWTMR and TIMER_TICKS_PER_MSEC
+ * to set up a hardware based time base; one tick per microsecond.
+ */
+unsigned long
+target_timer(void)
+{
+    return(host_usec());
+}
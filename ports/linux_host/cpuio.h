@@ -0,0 +1,6 @@
+/* cpuio.h:
+ * Board specific definitions for the Linux hosted build.
+ */
+#define DEFAULT_BAUD_RATE   38400
+
+#define MONARGV0 "umon"
@@ -0,0 +1,287 @@
+#!/bin/sh
+#
+# defragtest.sh:
+# Power-loss test of TFS defragmentation on the hosted build.
+#
+# For each workload (a mix of adds, deletes and appends that leaves TFS
+# fragmented), the workload is replayed into a fresh flash file and a
+# reference "tfs clean" is run to count the flash operations (programs
+# plus sector erases) it takes.  Then, for every one of those operations,
+# the defrag is run again from the same starting image with the NOR
+# simulator's power cut armed to hit part way through that operation
+# ("norsim cutop").  Each interrupted image is restarted, which lets
+# tfsfixup() finish (or back out) the defrag, and is checked:
+#
+#  - "tfs check" must pass (all header and data CRCs good),
+#  - the list of files (name and size) must be the same as before,
+#  - a following "tfs clean" must also complete with the same files.
+#
+# Images that fail are kept as fail_<workload>_<op>.flash (as they were
+# at the cut) with the logs, so the failure can be reproduced with
+# "umon.elf -f fail_...".  The time and flash work of the reference
+# defrag and of the slowest recovery are reported ("tfs stat"), so that
+# changes to the defrag code can be measured as well as checked (a
+# restarted defrag's time includes the console polls, about 2 seconds
+# each, that let the user abort it).
+#
+# Usage: ./defragtest.sh [-s step] [-t "usec msec"] [-d dir] [workload ...]
+#
+#   -s  test every step'th operation (default 1, every operation)
+#   -t  norsim program/erase timing to use (default "0 0")
+#   -d  work directory (default ./defragtest)
+#
+# The built-in workloads are "mixed", "appends" and "deletes"; any other
+# workload name is taken as a file of monitor commands to replay.
+# The exit status is 0 only if every cut point recovered.
+
+UMON=${UMON:-./build_LINUX_HOST/umon.elf}
+RAM=0x60000000
+STEP=1
+TIMING="0 0"
+DIR=./defragtest
+
+while getopts "s:t:d:" opt; do
+	case $opt in
+	s)	STEP=$OPTARG ;;
+	t)	TIMING=$OPTARG ;;
+	d)	DIR=$OPTARG ;;
+	*)	printf "Usage: %s [-s step] [-t \"usec msec\"] [-d dir] [workload ...]\n" $0
+		exit 1 ;;
+	esac
+done
+shift $((OPTIND - 1))
+if [ $# -eq 0 ]; then
+	set -- mixed appends deletes
+fi
+
+if [ ! -x $UMON ]; then
+	printf "%s does not exist; build uMon (or set UMON) first\n" $UMON
+	exit 1
+fi
+mkdir -p $DIR || exit 1
+
+# Workloads...
+# Each file's data is taken from a different offset into a block of
+# app RAM filled with an incrementing pattern, so no two files are alike
+# and an append (re-adding a file with the same source and a larger
+# size) keeps the original data as its prefix.
+
+wl_size() {
+	echo $(( ($1 * 7919 + $2) % 30000 + 64 ))
+}
+
+wl_add() {
+	printf "tfs add dt_%d 0x%x %d\n" $1 $(( RAM + $1 * 4096 )) $2
+}
+
+wl_mixed() {
+	i=0
+	while [ $i -lt 40 ]; do
+		wl_add $i $(wl_size $i 0)
+		if [ $((i % 3)) -eq 2 ]; then
+			echo "tfs rm dt_$((i - 1))"
+		fi
+		if [ $((i % 5)) -eq 4 ]; then
+			wl_add $((i - 4)) $(( $(wl_size $((i - 4)) 0) + 5000 ))
+		fi
+		i=$((i + 1))
+	done
+}
+
+wl_appends() {
+	i=0
+	while [ $i -lt 8 ]; do
+		wl_add $i 100
+		i=$((i + 1))
+	done
+	n=1
+	while [ $n -le 10 ]; do
+		i=0
+		while [ $i -lt 8 ]; do
+			wl_add $i $((100 + n * (i + 1) * 700))
+			i=$((i + 1))
+		done
+		n=$((n + 1))
+	done
+}
+
+wl_deletes() {
+	i=0
+	while [ $i -lt 60 ]; do
+		wl_add $i $(wl_size $i 17)
+		i=$((i + 1))
+	done
+	i=0
+	while [ $i -lt 60 ]; do
+		if [ $((i % 4)) -ne 0 ]; then
+			echo "tfs rm dt_$i"
+		fi
+		i=$((i + 1))
+	done
+}
+
+workload() {
+	echo "fm -4 -i -c $RAM 0x100000 0x01020304"
+	case $1 in
+	mixed|appends|deletes)
+		wl_$1 ;;
+	*)
+		cat $1 ;;
+	esac
+}
+
+# umon():
+# Run the monitor on flash file $1 with the commands on stdin; the
+# console output (without carriage returns) goes to $2.  Return the
+# monitor's exit status (3 if the power cut hit).
+# If WAIT is set, the commands are held back until the first prompt:
+# when the startup finds an interrupted defrag it polls the console
+# ("Hit any key to abort...", "ok?") before finishing it, and commands
+# that are already waiting would be taken as the key that aborts it.
+umon() {
+	if [ -z "$WAIT" ]; then
+		{ echo "norsim time $TIMING"; cat; } | $UMON -f $1 >$2.raw 2>&1
+		st=$?
+	else
+		rm -f $2.in
+		mkfifo $2.in || exit 1
+		$UMON -f $1 <$2.in >$2.raw 2>&1 &
+		pid=$!
+		exec 3>$2.in
+		while kill -0 $pid 2>/dev/null && ! grep -qs "uMON>" $2.raw; do
+			sleep 0.1
+		done
+		{ echo "norsim time $TIMING"; cat; } >&3
+		exec 3>&-
+		wait $pid
+		st=$?
+		rm -f $2.in
+	fi
+	tr -d '\r' <$2.raw >$2
+	rm -f $2.raw
+	return $st
+}
+
+# files():
+# The name and size of each workload file listed in log $1.
+files() {
+	awk '/^ dt_/ && $3 ~ /^0x/ { print $1, $2 }' $1
+}
+
+# defragcost():
+# The "Last defrag" line of "tfs stat" in log $1.
+defragcost() {
+	sed -n 's/^Last defrag: //p' $1 | tail -1
+}
+
+# check():
+# Restart the monitor on the image at $1 (so that tfsfixup() runs),
+# then check it, clean it and check it again; the logs are $2.*.
+# Return 0 if everything matches $3 (the expected file list).
+check() {
+	WAIT=1
+	umon $1 $2.fix <<-EOF
+	tfs -d //FLASH/ check
+	tfs ls
+	tfs stat
+	EOF
+	WAIT=
+	grep -q PASSED $2.fix || return 1
+	files $2.fix | cmp -s - $3 || return 1
+	umon $1 $2.clean <<-EOF
+	tfs clean
+	tfs -d //FLASH/ check
+	tfs ls
+	EOF
+	grep -q PASSED $2.clean || return 1
+	files $2.clean | cmp -s - $3 || return 1
+	return 0
+}
+
+failtot=0
+for wl in "$@"; do
+	W=$DIR/$wl
+	rm -f $W.*
+
+	# Build the fragmented starting image...
+	workload $wl >$W.cmds
+	echo "tfs ls" >>$W.cmds
+	umon $W.base.flash $W.build <$W.cmds
+	files $W.build >$W.files
+	if [ ! -s $W.files ]; then
+		printf "%s: workload left no files (see %s.build)\n" $wl $W
+		failtot=$((failtot + 1))
+		continue
+	fi
+
+	# The reference (uninterrupted) defrag...
+	cp $W.base.flash $W.ref.flash
+	umon $W.ref.flash $W.ref <<-EOF
+	norsim clear
+	tfs clean
+	norsim stat
+	tfs stat
+	tfs -d //FLASH/ check
+	tfs ls
+	EOF
+	erases=$(sed -n 's/^Erases: *//p' $W.ref)
+	programs=$(sed -n 's/^Programs: *//p' $W.ref)
+	ops=$((erases + programs))
+	if ! grep -q PASSED $W.ref || ! files $W.ref | cmp -s - $W.files; then
+		printf "%s: reference defrag failed (see %s.ref)\n" $wl $W
+		failtot=$((failtot + 1))
+		continue
+	fi
+	printf "%s: %d files, defrag is %d ops (%s)\n" \
+		$wl $(wc -l <$W.files) $ops "$(defragcost $W.ref)"
+
+	# Cut the power at each operation and check the recovery...
+	fails=0
+	tested=0
+	worst=0
+	worstcost=
+	op=1
+	while [ $op -le $ops ]; do
+		cp $W.base.flash $W.cut.flash
+		umon $W.cut.flash $W.cut <<-EOF
+		norsim cutop $op
+		tfs clean
+		EOF
+		st=$?
+		tested=$((tested + 1))
+		cp $W.cut.flash $W.hit.flash
+		if [ $st -ne 3 ]; then
+			printf "  op %d: no power cut (exit status %d)\n" $op $st
+			ok=1
+		elif check $W.cut.flash $W.chk $W.files; then
+			ok=0
+		else
+			printf "  op %d: recovery failed\n" $op
+			ok=1
+		fi
+		if [ $ok -ne 0 ]; then
+			fails=$((fails + 1))
+			cp $W.hit.flash $DIR/fail_${wl}_$op.flash
+			cat $W.cut $W.chk.fix $W.chk.clean >$DIR/fail_${wl}_$op.log 2>/dev/null
+		else
+			cost=$(defragcost $W.chk.fix)
+			msec=${cost%% msec*}
+			if [ -n "$cost" ] && [ $msec -ge $worst ]; then
+				worst=$msec
+				worstcost="$cost (op $op)"
+			fi
+		fi
+		op=$((op + STEP))
+	done
+	rm -f $W.cut.flash $W.hit.flash
+	printf "%s: %d cut points, %d failed; slowest recovery: %s\n" \
+		$wl $tested $fails "${worstcost:-none}"
+	failtot=$((failtot + fails))
+done
+
+if [ $failtot -ne 0 ]; then
+	printf "FAILED (%d)\n" $failtot
+	exit 1
+fi
+printf "PASSED\n"
+exit 0